@@ -0,0 +1,1433 @@
+// Headless benchmark harness. Runs a fixed set of scenes, each for a fixed
+// number of frames with a fixed random seed, and prints the results as JSON
+// (see bench/compare.py to compare two result files).
+//
+// Windows are created with SDL's offscreen video driver, which presents
+// through VK_EXT_headless_surface, so the harness runs on lavapipe without a
+// display, e.g. with
+// VK_ICD_FILENAMES=/usr/share/vulkan/icd.d/lvp_icd.x86_64.json.
+//
+// usage: vkguide-bench [--frames <count>] [--seed <seed>]
+//                      [--scene <name>] [--output <path>] [--msaa <samples>]
+//                      [--post-process] [--render-scale <scale>]
+//                      [--gpu-budget-ms <ms>] [--validation <mode>]
+//                      [--occlusion-culling] [--windowed]
+//
+// --validation takes off, standard, sync, gpu or perf, see
+// enum vulkan_renderer_validation.
+
+#define _POSIX_C_SOURCE 200809L
+#include "draw_list.h"
+#include "log.h"
+#include "mesh.h"
+#include "mesh_format.h"
+#include "meshlet.h"
+#include "occlusion.h"
+#include "sprite_batch.h"
+#include "texture.h"
+#include "texture_format.h"
+#include "transform.h"
+#include "vulkan_renderer.h"
+#include <SDL3/SDL.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define BENCH_DEFAULT_FRAME_COUNT 300
+// Not measured: lets pipelines, allocations and caches settle
+#define BENCH_WARMUP_FRAME_COUNT 16
+#define BENCH_DEFAULT_SEED 1
+#define BENCH_WINDOW_WIDTH 1280
+#define BENCH_WINDOW_HEIGHT 720
+// Consecutive frames that can't begin before a scene is abandoned
+#define BENCH_MAX_SKIPPED_FRAME_COUNT 1000
+
+#define MANY_DRAWS_DRAW_COUNT 10000
+#define MANY_PIPELINES_PIPELINE_COUNT 64
+#define MANY_PIPELINES_DRAW_COUNT 2048
+// The many_pipelines workload submitted through a draw list
+#define DRAW_LIST_DRAW_COUNT 16384
+#define HEAVY_UPLOADS_BUFFER_SIZE (64 * 1024 * 1024)
+#define HEAVY_UPLOADS_UPLOAD_SIZE (24 * 1024 * 1024)
+#define HEAVY_UPLOADS_DRAW_COUNT 256
+#define RESIZE_CHURN_INTERVAL_FRAME_COUNT 8
+#define RESIZE_CHURN_DRAW_COUNT 256
+#define SPRITES_SPRITE_COUNT 100000
+#define SPRITES_TEXTURE_COUNT 16
+#define SPRITES_LAYER_COUNT 4
+// With its full mip chain: 4x4, 2x2 and 1x1
+#define SPRITES_TEXTURE_SIZE 4
+#define SPRITES_TEXTURE_MIP_COUNT 3
+// Walls of tiles one behind the other, one meshlet per tile. Each wall hides
+// most of the ones behind it, the holes keep the late pass busy.
+#define OCCLUSION_WALL_COUNT 24
+#define OCCLUSION_WALL_COLUMN_COUNT 24
+#define OCCLUSION_WALL_ROW_COUNT 14
+// Quads per tile side
+#define OCCLUSION_TILE_QUAD_COUNT 4
+#define OCCLUSION_TILE_VERTEX_COUNT                                            \
+  ((OCCLUSION_TILE_QUAD_COUNT + 1) * (OCCLUSION_TILE_QUAD_COUNT + 1))
+#define OCCLUSION_TILE_TRIANGLE_COUNT                                          \
+  (OCCLUSION_TILE_QUAD_COUNT * OCCLUSION_TILE_QUAD_COUNT * 2)
+// Out of 100
+#define OCCLUSION_HOLE_PERCENT 10
+// Occlusion culling is paused every other period, for an A/B comparison of
+// the GPU frame time within the same run
+#define OCCLUSION_PAUSE_PERIOD_FRAME_COUNT 32
+
+// xorshift64*, the sequence only depends on the seed
+struct bench_random {
+  uint64_t state;
+};
+
+uint64_t bench_random_next(struct bench_random *random) {
+  random->state ^= random->state >> 12;
+  random->state ^= random->state << 25;
+  random->state ^= random->state >> 27;
+  return random->state * UINT64_C(2685821657736338717);
+}
+
+float bench_random_float(struct bench_random *random, float min, float max) {
+  float unit = (float)(bench_random_next(random) >> 40) / (float)(1u << 24);
+  return min + unit * (max - min);
+}
+
+struct bench_context {
+  struct vulkan_renderer *renderer;
+  SDL_Window *window;
+  struct bench_random random;
+  struct mesh cube;
+
+  // Scene state
+  struct mat4 *models;
+  uint32_t draw_count;
+  VkPipeline pipelines[MANY_PIPELINES_PIPELINE_COUNT];
+  uint32_t pipeline_count;
+  VkBuffer upload_buffer;
+  VkDeviceMemory upload_buffer_memory;
+  uint8_t *upload_data;
+  struct texture_pool *texture_pool;
+  struct sprite_batch *sprite_batch;
+  uint32_t sprite_textures[SPRITES_TEXTURE_COUNT];
+  uint32_t sprite_texture_count;
+  struct sprite *sprites;
+  struct draw_list *draw_list;
+  struct mesh occluder_mesh;
+
+  // Set by scenes that build batches, CPU time spent building them this
+  // frame and the draws they were flushed with
+  bool batch_build_timed;
+  uint64_t batch_build_ns;
+  uint32_t batch_draw_count;
+  bool draw_list_used;
+  struct draw_list_stats draw_list_stats;
+};
+
+struct bench_scene {
+  const char *name;
+  bool (*init)(struct bench_context *context);
+  // Called between vulkan_renderer_begin_frame and
+  // vulkan_renderer_begin_render_pass
+  void (*update)(struct bench_context *context, uint32_t frame_index);
+  void (*draw)(struct bench_context *context, uint32_t frame_index);
+  void (*deinit)(struct bench_context *context);
+};
+
+struct bench_statistics {
+  double mean;
+  double p50;
+  double p95;
+  double p99;
+  double max;
+};
+
+struct bench_scene_result {
+  const char *name;
+  bool completed;
+  double init_ms;
+  uint32_t frame_count;
+  struct bench_statistics cpu_frame_time_ms;
+  uint32_t gpu_sample_count;
+  struct bench_statistics gpu_frame_time_ms;
+  // Scene resolution relative to the swapchain's, varies with dynamic
+  // resolution
+  struct bench_statistics render_scale;
+  uint32_t batch_build_sample_count;
+  struct bench_statistics batch_build_ms;
+  uint32_t batch_draw_count;
+  bool draw_list_used;
+  struct draw_list_stats draw_list_stats;
+  uint64_t init_device_memory_allocation_count;
+  uint64_t frame_device_memory_allocation_count;
+  // Of the occlusion culled frames that culled meshlets
+  uint32_t occlusion_frame_count;
+  double meshlets_culled_percent;
+  double meshlets_occluded_percent;
+  uint32_t occlusion_overhead_sample_count;
+  struct bench_statistics occlusion_overhead_ms;
+  // GPU frame times split by whether the frame was occlusion culled
+  uint32_t occlusion_culled_gpu_sample_count;
+  struct bench_statistics occlusion_culled_gpu_frame_time_ms;
+  uint32_t occlusion_unculled_gpu_sample_count;
+  struct bench_statistics occlusion_unculled_gpu_frame_time_ms;
+};
+
+double nanoseconds_to_milliseconds(uint64_t nanoseconds) {
+  return (double)nanoseconds / 1e6;
+}
+
+// A .vkm file built in memory, sections need no padding
+struct bench_cube_file {
+  struct mesh_file_header header;
+  struct mesh_vertex vertices[24];
+  uint16_t indices[36];
+};
+
+// Unit cube centered on the origin, one quad per face so that each face gets
+// its own normal
+bool bench_create_cube_mesh(struct vulkan_renderer *renderer,
+                            struct mesh *out_mesh) {
+  // Octahedral encoding of the face normals: +X, -X, +Y, -Y, +Z, -Z
+  static const int16_t face_normals[6][2] = {
+      {32767, 0}, {-32767, 0}, {0, 32767}, {0, -32767}, {0, 0}, {32767, 32767}};
+  // Corners of each face, counter-clockwise when looking at the face
+  static const uint8_t face_corners[6][4][3] = {
+      {{1, 0, 1}, {1, 0, 0}, {1, 1, 0}, {1, 1, 1}},
+      {{0, 0, 0}, {0, 0, 1}, {0, 1, 1}, {0, 1, 0}},
+      {{0, 1, 1}, {1, 1, 1}, {1, 1, 0}, {0, 1, 0}},
+      {{0, 0, 0}, {1, 0, 0}, {1, 0, 1}, {0, 0, 1}},
+      {{0, 0, 1}, {1, 0, 1}, {1, 1, 1}, {0, 1, 1}},
+      {{1, 0, 0}, {0, 0, 0}, {0, 1, 0}, {1, 1, 0}}};
+  // Half floats
+  static const uint16_t corner_uvs[4][2] = {
+      {0x0000, 0x3c00}, {0x3c00, 0x3c00}, {0x3c00, 0x0000}, {0x0000, 0x0000}};
+
+  struct bench_cube_file file = {
+      .header = {.magic = MESH_FILE_MAGIC,
+                 .version = MESH_FILE_VERSION,
+                 .vertex_count = 24,
+                 .index_count = 36,
+                 .index_size = sizeof(uint16_t),
+                 .position_offset = {-0.5f, -0.5f, -0.5f},
+                 .position_scale = {1.0f, 1.0f, 1.0f}}};
+  file.header.vertex_data_offset = offsetof(struct bench_cube_file, vertices);
+  file.header.index_data_offset = offsetof(struct bench_cube_file, indices);
+
+  for (int face = 0; face < 6; face++) {
+    for (int corner = 0; corner < 4; corner++) {
+      struct mesh_vertex *vertex = &file.vertices[face * 4 + corner];
+      for (int axis = 0; axis < 3; axis++) {
+        vertex->position[axis] = face_corners[face][corner][axis] ? 65535 : 0;
+      }
+      vertex->normal[0] = face_normals[face][0];
+      vertex->normal[1] = face_normals[face][1];
+      vertex->uv[0] = corner_uvs[corner][0];
+      vertex->uv[1] = corner_uvs[corner][1];
+    }
+
+    static const uint16_t quad_indices[6] = {0, 1, 2, 0, 2, 3};
+    for (int index = 0; index < 6; index++) {
+      file.indices[face * 6 + index] = face * 4 + quad_indices[index];
+    }
+  }
+
+  return vulkan_renderer_create_mesh(renderer, &file, sizeof(file), out_mesh);
+}
+
+// Scatters `draw_count` cubes in front of the camera
+bool bench_create_models(struct bench_context *context, uint32_t draw_count) {
+  context->models = malloc(sizeof(struct mat4) * draw_count);
+  if (!context->models) {
+    return false;
+  }
+
+  for (uint32_t draw_index = 0; draw_index < draw_count; draw_index++) {
+    struct vec3 position = {bench_random_float(&context->random, -20.0f, 20.0f),
+                            bench_random_float(&context->random, -12.0f, 12.0f),
+                            bench_random_float(&context->random, -20.0f, 0.0f)};
+    context->models[draw_index] = mat4_translation(position);
+  }
+  context->draw_count = draw_count;
+  return true;
+}
+
+void bench_destroy_models(struct bench_context *context) {
+  free(context->models);
+  context->models = NULL;
+  context->draw_count = 0;
+}
+
+struct mat4 bench_view_projection(const struct bench_context *context) {
+  VkExtent2D extent = context->renderer->swapchain_extent;
+  struct mat4 view = mat4_look_at((struct vec3){0.0f, 0.0f, 30.0f},
+                                  (struct vec3){0.0f, 0.0f, 0.0f},
+                                  (struct vec3){0.0f, 1.0f, 0.0f});
+  struct mat4 projection = mat4_perspective(
+      1.0f, (float)extent.width / (float)extent.height, 0.1f, 100.0f);
+  return mat4_multiply(&projection, &view);
+}
+
+void bench_draw_models(struct bench_context *context, uint32_t frame_index) {
+  (void)frame_index;
+  struct mat4 view_projection = bench_view_projection(context);
+  for (uint32_t draw_index = 0; draw_index < context->draw_count;
+       draw_index++) {
+    struct mesh_draw_data draw_data = {
+        .model_view_projection =
+            mat4_multiply(&view_projection, &context->models[draw_index]),
+        .model = context->models[draw_index],
+        .color = {1.0f, 1.0f, 1.0f, 1.0f}};
+    vulkan_renderer_draw_mesh(context->renderer, &context->cube, &draw_data);
+  }
+}
+
+bool many_draws_init(struct bench_context *context) {
+  return bench_create_models(context, MANY_DRAWS_DRAW_COUNT);
+}
+
+bool bench_create_pipelines(struct bench_context *context,
+                            uint32_t draw_count) {
+  if (!bench_create_models(context, draw_count)) {
+    goto err;
+  }
+
+  // Every combination is a distinct pipeline, all of them are created up
+  // front so that the scene measures switching rather than creation
+  static const VkCullModeFlags cull_modes[] = {
+      VK_CULL_MODE_NONE, VK_CULL_MODE_BACK_BIT, VK_CULL_MODE_FRONT_BIT,
+      VK_CULL_MODE_NONE};
+  static const VkFrontFace front_faces[] = {VK_FRONT_FACE_COUNTER_CLOCKWISE,
+                                            VK_FRONT_FACE_CLOCKWISE};
+  for (; context->pipeline_count < MANY_PIPELINES_PIPELINE_COUNT;
+       context->pipeline_count++) {
+    uint32_t variant = context->pipeline_count;
+    struct mesh_pipeline_state state = {
+        .cull_mode = cull_modes[variant % 4],
+        .front_face = front_faces[(variant / 4) % 2],
+        .blend_enable = (variant / 8) % 2,
+        // Never empty, that would make the draws trivially cheap
+        .color_write_mask = ((VkColorComponentFlags)(variant / 16) + 1) |
+                            VK_COLOR_COMPONENT_A_BIT};
+    if (!vulkan_renderer_create_mesh_pipeline(
+            context->renderer, &state,
+            &context->pipelines[context->pipeline_count])) {
+      LOG("Couldn't create benchmark pipeline %u", variant);
+      goto destroy_pipelines;
+    }
+  }
+
+  return true;
+destroy_pipelines:
+  for (uint32_t pipeline_index = 0; pipeline_index < context->pipeline_count;
+       pipeline_index++) {
+    vkDestroyPipeline(context->renderer->device,
+                      context->pipelines[pipeline_index], NULL);
+  }
+  context->pipeline_count = 0;
+  bench_destroy_models(context);
+err:
+  return false;
+}
+
+bool many_pipelines_init(struct bench_context *context) {
+  return bench_create_pipelines(context, MANY_PIPELINES_DRAW_COUNT);
+}
+
+void many_pipelines_draw(struct bench_context *context, uint32_t frame_index) {
+  struct vulkan_renderer *renderer = context->renderer;
+  VkCommandBuffer command_buffer =
+      renderer->frames[renderer->current_frame].command_buffer;
+  struct mat4 view_projection = bench_view_projection(context);
+
+  // Binds the buffers once, then switches pipeline on every draw
+  vulkan_renderer_bind_mesh(renderer, &context->cube);
+  for (uint32_t draw_index = 0; draw_index < context->draw_count;
+       draw_index++) {
+    uint32_t pipeline_index =
+        (draw_index + frame_index) % context->pipeline_count;
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                      context->pipelines[pipeline_index]);
+    struct mesh_draw_data draw_data = {
+        .model_view_projection =
+            mat4_multiply(&view_projection, &context->models[draw_index]),
+        .model = context->models[draw_index],
+        .color = {1.0f, 1.0f, 1.0f, 1.0f}};
+    if (!vulkan_renderer_set_mesh_draw_data(renderer, &context->cube,
+                                            &draw_data)) {
+      break;
+    }
+    vkCmdDrawIndexed(command_buffer, context->cube.index_count, 1, 0, 0, 0);
+  }
+}
+
+void many_pipelines_deinit(struct bench_context *context) {
+  for (uint32_t pipeline_index = 0; pipeline_index < context->pipeline_count;
+       pipeline_index++) {
+    vkDestroyPipeline(context->renderer->device,
+                      context->pipelines[pipeline_index], NULL);
+  }
+  context->pipeline_count = 0;
+  bench_destroy_models(context);
+}
+
+bool draw_list_scene_init(struct bench_context *context) {
+  context->draw_list = malloc(sizeof(struct draw_list));
+  if (!context->draw_list) {
+    goto err;
+  }
+  if (!draw_list_init(context->draw_list, DRAW_LIST_DRAW_COUNT)) {
+    goto free_draw_list;
+  }
+  if (!bench_create_pipelines(context, DRAW_LIST_DRAW_COUNT)) {
+    goto deinit_draw_list;
+  }
+  return true;
+deinit_draw_list:
+  draw_list_deinit(context->draw_list);
+free_draw_list:
+  free(context->draw_list);
+  context->draw_list = NULL;
+err:
+  return false;
+}
+
+// Same draws and pipeline order as many_pipelines, the blended pipelines
+// (variants 8-15 of every 16) go to a second, back-to-front pass
+void draw_list_scene_draw(struct bench_context *context,
+                          uint32_t frame_index) {
+  struct vulkan_renderer *renderer = context->renderer;
+  struct mat4 view_projection = bench_view_projection(context);
+  uint64_t build_start_ns = SDL_GetTicksNS();
+  draw_list_reset(context->draw_list);
+  for (uint32_t draw_index = 0; draw_index < context->draw_count;
+       draw_index++) {
+    uint32_t pipeline_index =
+        (draw_index + frame_index) % context->pipeline_count;
+    bool blended = (pipeline_index / 8) % 2 == 1;
+    const struct mat4 *model = &context->models[draw_index];
+    draw_list_add(
+        context->draw_list,
+        &(const struct draw_list_draw){
+            .pass = blended ? 1 : 0,
+            .pipeline = context->pipelines[pipeline_index],
+            .mesh = &context->cube,
+            // The camera looks down -z from z = 30
+            .depth = 30.0f - model->m[14],
+            .back_to_front = blended,
+            .draw_data = {.model_view_projection =
+                              mat4_multiply(&view_projection, model),
+                          .model = *model,
+                          .color = {1.0f, 1.0f, 1.0f, 1.0f}}});
+  }
+  draw_list_record(context->draw_list, renderer);
+  context->batch_build_ns = SDL_GetTicksNS() - build_start_ns;
+  context->batch_build_timed = true;
+  context->batch_draw_count = context->draw_list->stats.draw_count;
+  context->draw_list_used = true;
+  context->draw_list_stats = context->draw_list->stats;
+}
+
+void draw_list_scene_deinit(struct bench_context *context) {
+  many_pipelines_deinit(context);
+  draw_list_deinit(context->draw_list);
+  free(context->draw_list);
+  context->draw_list = NULL;
+}
+
+bool heavy_uploads_init(struct bench_context *context) {
+  if (!bench_create_models(context, HEAVY_UPLOADS_DRAW_COUNT)) {
+    goto err;
+  }
+
+  context->upload_data = malloc(HEAVY_UPLOADS_UPLOAD_SIZE);
+  if (!context->upload_data) {
+    goto destroy_models;
+  }
+  for (size_t byte_index = 0; byte_index < HEAVY_UPLOADS_UPLOAD_SIZE;
+       byte_index += sizeof(uint64_t)) {
+    uint64_t value = bench_random_next(&context->random);
+    memcpy(context->upload_data + byte_index, &value, sizeof(value));
+  }
+
+  if (!vulkan_renderer_create_buffer(
+          context->renderer, HEAVY_UPLOADS_BUFFER_SIZE,
+          VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+          VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &context->upload_buffer,
+          &context->upload_buffer_memory)) {
+    goto free_upload_data;
+  }
+
+  return true;
+free_upload_data:
+  free(context->upload_data);
+  context->upload_data = NULL;
+destroy_models:
+  bench_destroy_models(context);
+err:
+  return false;
+}
+
+// Goes through the renderer's blocking staging path, the upload is larger than
+// the staging buffer so it is split into several transfers
+void heavy_uploads_update(struct bench_context *context,
+                          uint32_t frame_index) {
+  VkDeviceSize offset =
+      (VkDeviceSize)frame_index * HEAVY_UPLOADS_UPLOAD_SIZE %
+      (HEAVY_UPLOADS_BUFFER_SIZE - HEAVY_UPLOADS_UPLOAD_SIZE + 1);
+  if (!vulkan_renderer_upload_to_buffer(context->renderer,
+                                        context->upload_buffer, offset,
+                                        context->upload_data,
+                                        HEAVY_UPLOADS_UPLOAD_SIZE)) {
+    LOG("Couldn't upload benchmark data");
+  }
+}
+
+void heavy_uploads_deinit(struct bench_context *context) {
+  vkDestroyBuffer(context->renderer->device, context->upload_buffer, NULL);
+  vulkan_renderer_free_memory(context->renderer,
+                              context->upload_buffer_memory);
+  free(context->upload_data);
+  context->upload_data = NULL;
+  bench_destroy_models(context);
+}
+
+bool resize_churn_init(struct bench_context *context) {
+  return bench_create_models(context, RESIZE_CHURN_DRAW_COUNT);
+}
+
+// The swapchain is recreated by the next vulkan_renderer_begin_frame, which
+// is part of the measured frame time
+void resize_churn_update(struct bench_context *context, uint32_t frame_index) {
+  if (frame_index % RESIZE_CHURN_INTERVAL_FRAME_COUNT != 0) {
+    return;
+  }
+
+  int width = 320 + (int)(bench_random_next(&context->random) % 961);
+  int height = 240 + (int)(bench_random_next(&context->random) % 481);
+  SDL_SetWindowSize(context->window, width, height);
+  SDL_SyncWindow(context->window);
+  vulkan_renderer_notify_resize(context->renderer);
+}
+
+void resize_churn_deinit(struct bench_context *context) {
+  SDL_SetWindowSize(context->window, BENCH_WINDOW_WIDTH, BENCH_WINDOW_HEIGHT);
+  SDL_SyncWindow(context->window);
+  vulkan_renderer_notify_resize(context->renderer);
+  bench_destroy_models(context);
+}
+
+// A .vkt file holding a single color in RGBA8, with its full mip chain
+struct bench_texture_file {
+  struct texture_file_header header;
+  uint8_t levels[SPRITES_TEXTURE_MIP_COUNT]
+                [SPRITES_TEXTURE_SIZE * SPRITES_TEXTURE_SIZE * 4];
+};
+
+// The file only lives until the pool has mapped it
+bool bench_load_texture(struct texture_pool *texture_pool, uint32_t color,
+                        uint32_t *out_texture) {
+  struct bench_texture_file file = {
+      .header = {.magic = TEXTURE_FILE_MAGIC,
+                 .version = TEXTURE_FILE_VERSION,
+                 .width = SPRITES_TEXTURE_SIZE,
+                 .height = SPRITES_TEXTURE_SIZE,
+                 .mip_count = SPRITES_TEXTURE_MIP_COUNT}};
+  struct texture_file_encoding *encoding =
+      &file.header.encodings[TEXTURE_ENCODING_RGBA8_SRGB];
+  encoding->stored_mip_count = SPRITES_TEXTURE_MIP_COUNT;
+  for (uint32_t mip = 0; mip < SPRITES_TEXTURE_MIP_COUNT; mip++) {
+    uint32_t size = SPRITES_TEXTURE_SIZE >> mip;
+    encoding->levels[mip] = (struct texture_file_level){
+        .data_offset = offsetof(struct bench_texture_file, levels[mip]),
+        .data_size = size * size * 4};
+    for (uint32_t texel = 0; texel < size * size; texel++) {
+      memcpy(&file.levels[mip][texel * 4], &color, sizeof(color));
+    }
+  }
+  _Static_assert(offsetof(struct bench_texture_file, levels) %
+                         TEXTURE_FILE_SECTION_ALIGNMENT ==
+                     0,
+                 "texture levels must be aligned");
+
+  char path[] = "/tmp/vkguide-bench-XXXXXX";
+  int file_descriptor = mkstemp(path);
+  if (file_descriptor < 0) {
+    LOG("Couldn't create benchmark texture file");
+    return false;
+  }
+  bool written =
+      write(file_descriptor, &file, sizeof(file)) == (ssize_t)sizeof(file);
+  close(file_descriptor);
+  bool loaded =
+      written && texture_pool_load(texture_pool, path, out_texture);
+  unlink(path);
+  return loaded;
+}
+
+void sprites_deinit(struct bench_context *context) {
+  if (context->sprite_batch) {
+    sprite_batch_deinit(context->sprite_batch);
+  }
+  if (context->texture_pool) {
+    for (uint32_t texture_index = 0;
+         texture_index < context->sprite_texture_count; texture_index++) {
+      texture_pool_unload(context->texture_pool,
+                          context->sprite_textures[texture_index]);
+    }
+    texture_pool_deinit(context->texture_pool);
+  }
+  context->sprite_texture_count = 0;
+  free(context->sprite_batch);
+  free(context->texture_pool);
+  free(context->sprites);
+  context->sprite_batch = NULL;
+  context->texture_pool = NULL;
+  context->sprites = NULL;
+}
+
+// A quarter of the sprites are untextured and a quarter additive, spread
+// over a few layers so that sorting has work to do
+bool sprites_init(struct bench_context *context) {
+  context->sprites = malloc(sizeof(struct sprite) * SPRITES_SPRITE_COUNT);
+  if (!context->sprites) {
+    goto free_scene;
+  }
+
+  struct texture_pool *texture_pool = malloc(sizeof(struct texture_pool));
+  if (!texture_pool || !texture_pool_init(texture_pool, context->renderer)) {
+    free(texture_pool);
+    goto free_scene;
+  }
+  context->texture_pool = texture_pool;
+
+  for (; context->sprite_texture_count < SPRITES_TEXTURE_COUNT;
+       context->sprite_texture_count++) {
+    uint32_t color =
+        (uint32_t)bench_random_next(&context->random) | 0xff000000u;
+    if (!bench_load_texture(
+            context->texture_pool, color,
+            &context->sprite_textures[context->sprite_texture_count])) {
+      goto free_scene;
+    }
+  }
+
+  struct sprite_batch *sprite_batch = malloc(sizeof(struct sprite_batch));
+  if (!sprite_batch || !sprite_batch_init(sprite_batch, context->renderer,
+                                          context->texture_pool)) {
+    free(sprite_batch);
+    goto free_scene;
+  }
+  context->sprite_batch = sprite_batch;
+
+  for (uint32_t sprite_index = 0; sprite_index < SPRITES_SPRITE_COUNT;
+       sprite_index++) {
+    uint64_t variant = bench_random_next(&context->random);
+    float size = bench_random_float(&context->random, 4.0f, 32.0f);
+    context->sprites[sprite_index] = (struct sprite){
+        .position = {bench_random_float(&context->random, 0.0f,
+                                        BENCH_WINDOW_WIDTH - size),
+                     bench_random_float(&context->random, 0.0f,
+                                        BENCH_WINDOW_HEIGHT - size)},
+        .size = {size, size},
+        .uv_min = {0.0f, 0.0f},
+        .uv_max = {1.0f, 1.0f},
+        .color = 0x80808080u,
+        .texture = variant % 4 == 0
+                       ? SPRITE_NO_TEXTURE
+                       : context->sprite_textures[(variant >> 8) %
+                                                  SPRITES_TEXTURE_COUNT],
+        .blend_mode = (variant >> 16) % 4 == 0 ? SPRITE_BLEND_MODE_ADDITIVE
+                                               : SPRITE_BLEND_MODE_ALPHA,
+        .layer = (uint16_t)((variant >> 24) % SPRITES_LAYER_COUNT)};
+  }
+
+  return true;
+free_scene:
+  sprites_deinit(context);
+  return false;
+}
+
+// The sprites drift a little every frame so that their vertices have to be
+// rewritten, like a UI that animates
+void sprites_update(struct bench_context *context, uint32_t frame_index) {
+  uint64_t build_start_ns = SDL_GetTicksNS();
+  sprite_batch_begin_frame(context->sprite_batch);
+  float offset = (float)(frame_index % 16);
+  for (uint32_t sprite_index = 0; sprite_index < SPRITES_SPRITE_COUNT;
+       sprite_index++) {
+    struct sprite sprite = context->sprites[sprite_index];
+    sprite.position[0] += offset;
+    sprite_batch_add(context->sprite_batch, &sprite);
+  }
+  context->batch_build_ns = SDL_GetTicksNS() - build_start_ns;
+  context->batch_build_timed = true;
+  texture_pool_update(context->texture_pool);
+}
+
+void sprites_draw(struct bench_context *context, uint32_t frame_index) {
+  (void)frame_index;
+  uint64_t build_start_ns = SDL_GetTicksNS();
+  sprite_batch_flush(context->sprite_batch);
+  context->batch_build_ns += SDL_GetTicksNS() - build_start_ns;
+  context->batch_draw_count = context->sprite_batch->draw_count;
+}
+
+size_t bench_align_section(size_t offset) {
+  return (offset + MESH_FILE_SECTION_ALIGNMENT - 1) &
+         ~(size_t)(MESH_FILE_SECTION_ALIGNMENT - 1);
+}
+
+// Facing the camera of bench_view_projection, the first wall at z = 0 and
+// the others 1 unit apart behind it. Tiles are left out at random to make
+// holes, every tile is a meshlet.
+bool bench_create_occluder_mesh(struct bench_context *context,
+                                struct mesh *out_mesh) {
+  static const float wall_size[2] = {40.0f, 24.0f};
+  const uint32_t tile_count = OCCLUSION_WALL_COUNT *
+                              OCCLUSION_WALL_COLUMN_COUNT *
+                              OCCLUSION_WALL_ROW_COUNT;
+  bool result = false;
+  bool *holes = malloc(sizeof(bool) * tile_count);
+  if (!holes) {
+    goto err;
+  }
+  uint32_t meshlet_count = 0;
+  for (uint32_t tile_index = 0; tile_index < tile_count; tile_index++) {
+    holes[tile_index] =
+        bench_random_next(&context->random) % 100 < OCCLUSION_HOLE_PERCENT;
+    meshlet_count += !holes[tile_index];
+  }
+
+  uint32_t vertex_count = meshlet_count * OCCLUSION_TILE_VERTEX_COUNT;
+  uint32_t triangle_count = meshlet_count * OCCLUSION_TILE_TRIANGLE_COUNT;
+  size_t vertex_data_offset =
+      bench_align_section(sizeof(struct mesh_file_header));
+  size_t index_data_offset = bench_align_section(
+      vertex_data_offset + sizeof(struct mesh_vertex) * vertex_count);
+  size_t meshlet_data_offset = bench_align_section(
+      index_data_offset + sizeof(uint32_t) * 3 * triangle_count);
+  size_t meshlet_vertex_data_offset = bench_align_section(
+      meshlet_data_offset + sizeof(struct mesh_meshlet) * meshlet_count);
+  size_t meshlet_triangle_data_offset = bench_align_section(
+      meshlet_vertex_data_offset + sizeof(uint32_t) * vertex_count);
+  size_t file_size =
+      meshlet_triangle_data_offset + sizeof(uint32_t) * triangle_count;
+  uint8_t *file = calloc(1, file_size);
+  if (!file) {
+    goto free_holes;
+  }
+
+  struct mesh_file_header *header = (struct mesh_file_header *)file;
+  *header = (struct mesh_file_header){
+      .magic = MESH_FILE_MAGIC,
+      .version = MESH_FILE_VERSION,
+      .vertex_count = vertex_count,
+      .index_count = triangle_count * 3,
+      .index_size = sizeof(uint32_t),
+      .meshlet_count = meshlet_count,
+      .vertex_data_offset = vertex_data_offset,
+      .index_data_offset = index_data_offset,
+      .position_offset = {-wall_size[0] / 2.0f, -wall_size[1] / 2.0f,
+                          -(float)(OCCLUSION_WALL_COUNT - 1)},
+      .position_scale = {wall_size[0], wall_size[1],
+                         (float)(OCCLUSION_WALL_COUNT - 1)},
+      .meshlet_data_offset = meshlet_data_offset,
+      .meshlet_vertex_data_offset = meshlet_vertex_data_offset,
+      .meshlet_triangle_data_offset = meshlet_triangle_data_offset,
+      .meshlet_vertex_count = vertex_count};
+  struct mesh_vertex *vertices =
+      (struct mesh_vertex *)(file + vertex_data_offset);
+  uint32_t *indices = (uint32_t *)(file + index_data_offset);
+  struct mesh_meshlet *meshlets =
+      (struct mesh_meshlet *)(file + meshlet_data_offset);
+  uint32_t *meshlet_vertices = (uint32_t *)(file + meshlet_vertex_data_offset);
+  uint32_t *meshlet_triangles =
+      (uint32_t *)(file + meshlet_triangle_data_offset);
+
+  const uint32_t grid_size[2] = {
+      OCCLUSION_WALL_COLUMN_COUNT * OCCLUSION_TILE_QUAD_COUNT,
+      OCCLUSION_WALL_ROW_COUNT * OCCLUSION_TILE_QUAD_COUNT};
+  const float tile_size[2] = {wall_size[0] / OCCLUSION_WALL_COLUMN_COUNT,
+                              wall_size[1] / OCCLUSION_WALL_ROW_COUNT};
+  uint32_t meshlet_index = 0;
+  for (uint32_t tile_index = 0; tile_index < tile_count; tile_index++) {
+    if (holes[tile_index]) {
+      continue;
+    }
+    uint32_t column = tile_index % OCCLUSION_WALL_COLUMN_COUNT;
+    uint32_t row = (tile_index / OCCLUSION_WALL_COLUMN_COUNT) %
+                   OCCLUSION_WALL_ROW_COUNT;
+    uint32_t wall =
+        tile_index / (OCCLUSION_WALL_COLUMN_COUNT * OCCLUSION_WALL_ROW_COUNT);
+    uint32_t first_vertex = meshlet_index * OCCLUSION_TILE_VERTEX_COUNT;
+    uint32_t first_triangle = meshlet_index * OCCLUSION_TILE_TRIANGLE_COUNT;
+
+    // Walls are numbered front to back, 65535 is z = 0
+    uint16_t z =
+        (uint16_t)(65535u - wall * 65535u / (OCCLUSION_WALL_COUNT - 1));
+    for (uint32_t y = 0; y <= OCCLUSION_TILE_QUAD_COUNT; y++) {
+      for (uint32_t x = 0; x <= OCCLUSION_TILE_QUAD_COUNT; x++) {
+        uint32_t grid_x = column * OCCLUSION_TILE_QUAD_COUNT + x;
+        uint32_t grid_y = row * OCCLUSION_TILE_QUAD_COUNT + y;
+        uint32_t local_vertex = y * (OCCLUSION_TILE_QUAD_COUNT + 1) + x;
+        // +Z normal, see bench_create_cube_mesh
+        vertices[first_vertex + local_vertex] = (struct mesh_vertex){
+            .position = {(uint16_t)(grid_x * 65535u / grid_size[0]),
+                         (uint16_t)(grid_y * 65535u / grid_size[1]), z, 0}};
+        meshlet_vertices[first_vertex + local_vertex] =
+            first_vertex + local_vertex;
+      }
+    }
+
+    uint32_t triangle = first_triangle;
+    for (uint32_t y = 0; y < OCCLUSION_TILE_QUAD_COUNT; y++) {
+      for (uint32_t x = 0; x < OCCLUSION_TILE_QUAD_COUNT; x++) {
+        // Counter-clockwise when looking at the wall from the camera
+        uint32_t bottom_left = y * (OCCLUSION_TILE_QUAD_COUNT + 1) + x;
+        uint32_t top_left = bottom_left + OCCLUSION_TILE_QUAD_COUNT + 1;
+        uint32_t quad[2][3] = {{bottom_left, bottom_left + 1, top_left + 1},
+                               {bottom_left, top_left + 1, top_left}};
+        for (int quad_triangle = 0; quad_triangle < 2; quad_triangle++) {
+          for (int corner = 0; corner < 3; corner++) {
+            indices[triangle * 3 + corner] =
+                first_vertex + quad[quad_triangle][corner];
+          }
+          meshlet_triangles[triangle++] = MESHLET_PACK_TRIANGLE(
+              quad[quad_triangle][0], quad[quad_triangle][1],
+              quad[quad_triangle][2]);
+        }
+      }
+    }
+
+    // No normal cone, as written by the mesh converter for meshlets whose
+    // triangles face too many ways
+    float half_width = tile_size[0] / 2.0f;
+    float half_height = tile_size[1] / 2.0f;
+    meshlets[meshlet_index++] = (struct mesh_meshlet){
+        .center = {header->position_offset[0] + tile_size[0] * column +
+                       half_width,
+                   header->position_offset[1] + tile_size[1] * row +
+                       half_height,
+                   -(float)wall},
+        // Slightly larger to account for the quantization of the positions
+        .radius = sqrtf(half_width * half_width + half_height * half_height) *
+                  1.01f,
+        .cone_cutoff = 1.0f,
+        .vertex_offset = first_vertex,
+        .triangle_offset = first_triangle,
+        .vertex_count = OCCLUSION_TILE_VERTEX_COUNT,
+        .triangle_count = OCCLUSION_TILE_TRIANGLE_COUNT};
+  }
+
+  result = vulkan_renderer_create_mesh(context->renderer, file, file_size,
+                                       out_mesh);
+  free(file);
+free_holes:
+  free(holes);
+err:
+  return result;
+}
+
+bool occlusion_init(struct bench_context *context) {
+  if (!bench_create_occluder_mesh(context, &context->occluder_mesh)) {
+    LOG("Couldn't create occluder mesh");
+    return false;
+  }
+  return true;
+}
+
+// The walls are drawn untransformed, the camera is already in model space
+void occlusion_update(struct bench_context *context, uint32_t frame_index) {
+  struct vulkan_renderer *renderer = context->renderer;
+  renderer->occlusion_culling_paused =
+      (frame_index / OCCLUSION_PAUSE_PERIOD_FRAME_COUNT) % 2 == 1;
+  struct mat4 view_projection = bench_view_projection(context);
+  vulkan_renderer_cull_meshlets(renderer, &context->occluder_mesh,
+                                &view_projection,
+                                (struct vec3){0.0f, 0.0f, 30.0f});
+}
+
+void occlusion_draw(struct bench_context *context, uint32_t frame_index) {
+  (void)frame_index;
+  struct vulkan_renderer *renderer = context->renderer;
+  struct mesh *mesh = &context->occluder_mesh;
+  struct mat4 view_projection = bench_view_projection(context);
+  struct vec3 camera_position = {0.0f, 0.0f, 30.0f};
+  if (mesh->meshlet_count == 0) {
+    vulkan_renderer_draw_mesh(
+        renderer, mesh,
+        &(const struct mesh_draw_data){
+            .model_view_projection = view_projection,
+            .model = mat4_identity(),
+            .color = {1.0f, 1.0f, 1.0f, 1.0f}});
+    return;
+  }
+
+  vulkan_renderer_draw_meshlets(renderer, mesh, &view_projection,
+                                camera_position);
+  // No-ops unless the frame is occlusion culled
+  vulkan_renderer_build_depth_pyramid(renderer);
+  vulkan_renderer_cull_meshlets_late(renderer, mesh, &view_projection,
+                                     camera_position);
+  vulkan_renderer_resume_render_pass(renderer);
+  vulkan_renderer_draw_meshlets_late(renderer, mesh, &view_projection);
+}
+
+void occlusion_deinit(struct bench_context *context) {
+  context->renderer->occlusion_culling_paused = false;
+  vulkan_renderer_destroy_mesh(context->renderer, &context->occluder_mesh);
+}
+
+static const struct bench_scene bench_scenes[] = {
+    {.name = "many_draws",
+     .init = many_draws_init,
+     .draw = bench_draw_models,
+     .deinit = bench_destroy_models},
+    {.name = "many_pipelines",
+     .init = many_pipelines_init,
+     .draw = many_pipelines_draw,
+     .deinit = many_pipelines_deinit},
+    {.name = "draw_list",
+     .init = draw_list_scene_init,
+     .draw = draw_list_scene_draw,
+     .deinit = draw_list_scene_deinit},
+    {.name = "heavy_uploads",
+     .init = heavy_uploads_init,
+     .update = heavy_uploads_update,
+     .draw = bench_draw_models,
+     .deinit = heavy_uploads_deinit},
+    {.name = "resize_churn",
+     .init = resize_churn_init,
+     .update = resize_churn_update,
+     .draw = bench_draw_models,
+     .deinit = resize_churn_deinit},
+    {.name = "sprites",
+     .init = sprites_init,
+     .update = sprites_update,
+     .draw = sprites_draw,
+     .deinit = sprites_deinit},
+    {.name = "occlusion",
+     .init = occlusion_init,
+     .update = occlusion_update,
+     .draw = occlusion_draw,
+     .deinit = occlusion_deinit},
+};
+#define BENCH_SCENE_COUNT (sizeof(bench_scenes) / sizeof(bench_scenes[0]))
+
+int compare_doubles(const void *a, const void *b) {
+  double lhs = *(const double *)a;
+  double rhs = *(const double *)b;
+  return (lhs > rhs) - (lhs < rhs);
+}
+
+// Nearest-rank percentiles, sorts `samples`
+struct bench_statistics compute_statistics(double *samples,
+                                           uint32_t sample_count) {
+  struct bench_statistics statistics = {0};
+  if (sample_count == 0) {
+    return statistics;
+  }
+
+  qsort(samples, sample_count, sizeof(double), compare_doubles);
+  double sum = 0.0;
+  for (uint32_t sample_index = 0; sample_index < sample_count;
+       sample_index++) {
+    sum += samples[sample_index];
+  }
+  statistics.mean = sum / sample_count;
+
+  double percentiles[3] = {0.50, 0.95, 0.99};
+  double *outputs[3] = {&statistics.p50, &statistics.p95, &statistics.p99};
+  for (int percentile_index = 0; percentile_index < 3; percentile_index++) {
+    uint32_t rank =
+        (uint32_t)ceil(percentiles[percentile_index] * sample_count);
+    *outputs[percentile_index] = samples[rank > 0 ? rank - 1 : 0];
+  }
+  statistics.max = samples[sample_count - 1];
+  return statistics;
+}
+
+bool bench_pump_events(struct bench_context *context) {
+  SDL_Event event;
+  while (SDL_PollEvent(&event)) {
+    if (event.type == SDL_EVENT_QUIT) {
+      return false;
+    }
+    if (event.type == SDL_EVENT_WINDOW_PIXEL_SIZE_CHANGED) {
+      vulkan_renderer_notify_resize(context->renderer);
+    }
+  }
+  return true;
+}
+
+// Frames that can't begin (e.g. while the swapchain is recreated) are retried
+// and their time is accounted to the frame that eventually begins
+bool bench_begin_frame(struct bench_context *context) {
+  for (uint32_t attempt = 0; attempt < BENCH_MAX_SKIPPED_FRAME_COUNT;
+       attempt++) {
+    if (!bench_pump_events(context)) {
+      return false;
+    }
+    if (vulkan_renderer_begin_frame(context->renderer)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool bench_run_scene(struct bench_context *context,
+                     const struct bench_scene *scene, uint32_t frame_count,
+                     struct bench_scene_result *out_result) {
+  struct vulkan_renderer *renderer = context->renderer;
+  *out_result = (struct bench_scene_result){.name = scene->name};
+
+  double *cpu_samples = malloc(sizeof(double) * frame_count);
+  double *gpu_samples = malloc(sizeof(double) * frame_count);
+  double *render_scale_samples = malloc(sizeof(double) * frame_count);
+  double *batch_build_samples = malloc(sizeof(double) * frame_count);
+  double *occlusion_overhead_samples = malloc(sizeof(double) * frame_count);
+  double *occlusion_culled_gpu_samples = malloc(sizeof(double) * frame_count);
+  double *occlusion_unculled_gpu_samples =
+      malloc(sizeof(double) * frame_count);
+  if (!cpu_samples || !gpu_samples || !render_scale_samples ||
+      !batch_build_samples || !occlusion_overhead_samples ||
+      !occlusion_culled_gpu_samples || !occlusion_unculled_gpu_samples) {
+    goto free_samples;
+  }
+  uint64_t meshlet_count = 0;
+  uint64_t culled_meshlet_count = 0;
+  uint64_t occluded_meshlet_count = 0;
+
+  uint64_t allocation_count_before_init =
+      renderer->device_memory_allocation_count;
+  uint64_t init_start_ns = SDL_GetTicksNS();
+  if (!scene->init(context)) {
+    LOG("Couldn't init scene %s", scene->name);
+    goto free_samples;
+  }
+  out_result->init_ms =
+      nanoseconds_to_milliseconds(SDL_GetTicksNS() - init_start_ns);
+  out_result->init_device_memory_allocation_count =
+      renderer->device_memory_allocation_count - allocation_count_before_init;
+
+  uint64_t allocation_count_before_frames = 0;
+  uint32_t total_frame_count = BENCH_WARMUP_FRAME_COUNT + frame_count;
+  uint32_t frame_index = 0;
+  for (; frame_index < total_frame_count; frame_index++) {
+    bool is_measured = frame_index >= BENCH_WARMUP_FRAME_COUNT;
+    if (frame_index == BENCH_WARMUP_FRAME_COUNT) {
+      allocation_count_before_frames = renderer->device_memory_allocation_count;
+    }
+
+    uint64_t frame_start_ns = SDL_GetTicksNS();
+    if (!bench_begin_frame(context)) {
+      LOG("Scene %s stopped after %u frames", scene->name, frame_index);
+      break;
+    }
+
+    // Timestamps of an earlier frame, available once its fence signaled
+    if (is_measured && renderer->gpu_frame_time_available) {
+      gpu_samples[out_result->gpu_sample_count++] =
+          nanoseconds_to_milliseconds(renderer->gpu_frame_time_ns);
+      if (renderer->occlusion_culling_enabled &&
+          renderer->occlusion_stats_available) {
+        occlusion_culled_gpu_samples
+            [out_result->occlusion_culled_gpu_sample_count++] =
+                nanoseconds_to_milliseconds(renderer->gpu_frame_time_ns);
+      } else if (renderer->occlusion_culling_enabled) {
+        occlusion_unculled_gpu_samples
+            [out_result->occlusion_unculled_gpu_sample_count++] =
+                nanoseconds_to_milliseconds(renderer->gpu_frame_time_ns);
+      }
+    }
+    // Of the same earlier frame
+    const struct vulkan_renderer_occlusion_stats *occlusion_stats =
+        &renderer->occlusion_stats;
+    if (is_measured && renderer->occlusion_stats_available &&
+        occlusion_stats->meshlet_count > 0) {
+      out_result->occlusion_frame_count++;
+      meshlet_count += occlusion_stats->meshlet_count;
+      culled_meshlet_count += occlusion_stats->frustum_culled_meshlet_count +
+                              occlusion_stats->occluded_meshlet_count;
+      occluded_meshlet_count += occlusion_stats->occluded_meshlet_count;
+      if (occlusion_stats->gpu_time_available) {
+        occlusion_overhead_samples
+            [out_result->occlusion_overhead_sample_count++] =
+                nanoseconds_to_milliseconds(occlusion_stats->gpu_time_ns);
+      }
+    }
+
+    context->batch_build_timed = false;
+    context->batch_build_ns = 0;
+    context->draw_list_used = false;
+    if (scene->update) {
+      scene->update(context, frame_index);
+    }
+    vulkan_renderer_begin_render_pass(renderer);
+    scene->draw(context, frame_index);
+    vulkan_renderer_end_render_pass(renderer);
+    if (!vulkan_renderer_end_frame(renderer)) {
+      LOG("Couldn't render frame");
+    }
+
+    if (is_measured) {
+      cpu_samples[frame_index - BENCH_WARMUP_FRAME_COUNT] =
+          nanoseconds_to_milliseconds(SDL_GetTicksNS() - frame_start_ns);
+      render_scale_samples[frame_index - BENCH_WARMUP_FRAME_COUNT] =
+          (double)renderer->render_extent.width /
+          (double)renderer->swapchain_extent.width;
+      if (context->batch_build_timed) {
+        batch_build_samples[out_result->batch_build_sample_count++] =
+            nanoseconds_to_milliseconds(context->batch_build_ns);
+        out_result->batch_draw_count = context->batch_draw_count;
+      }
+      if (context->draw_list_used) {
+        out_result->draw_list_used = true;
+        out_result->draw_list_stats = context->draw_list_stats;
+      }
+    }
+  }
+  vkDeviceWaitIdle(renderer->device);
+
+  out_result->completed = frame_index == total_frame_count;
+  out_result->frame_count = frame_index > BENCH_WARMUP_FRAME_COUNT
+                                ? frame_index - BENCH_WARMUP_FRAME_COUNT
+                                : 0;
+  out_result->frame_device_memory_allocation_count =
+      out_result->frame_count > 0 ? renderer->device_memory_allocation_count -
+                                        allocation_count_before_frames
+                                  : 0;
+  out_result->cpu_frame_time_ms =
+      compute_statistics(cpu_samples, out_result->frame_count);
+  out_result->gpu_frame_time_ms =
+      compute_statistics(gpu_samples, out_result->gpu_sample_count);
+  out_result->render_scale =
+      compute_statistics(render_scale_samples, out_result->frame_count);
+  out_result->batch_build_ms = compute_statistics(
+      batch_build_samples, out_result->batch_build_sample_count);
+  if (meshlet_count > 0) {
+    out_result->meshlets_culled_percent =
+        100.0 * (double)culled_meshlet_count / (double)meshlet_count;
+    out_result->meshlets_occluded_percent =
+        100.0 * (double)occluded_meshlet_count / (double)meshlet_count;
+  }
+  out_result->occlusion_overhead_ms = compute_statistics(
+      occlusion_overhead_samples, out_result->occlusion_overhead_sample_count);
+  out_result->occlusion_culled_gpu_frame_time_ms =
+      compute_statistics(occlusion_culled_gpu_samples,
+                         out_result->occlusion_culled_gpu_sample_count);
+  out_result->occlusion_unculled_gpu_frame_time_ms =
+      compute_statistics(occlusion_unculled_gpu_samples,
+                         out_result->occlusion_unculled_gpu_sample_count);
+  scene->deinit(context);
+
+  free(occlusion_unculled_gpu_samples);
+  free(occlusion_culled_gpu_samples);
+  free(occlusion_overhead_samples);
+  free(batch_build_samples);
+  free(render_scale_samples);
+  free(gpu_samples);
+  free(cpu_samples);
+  return out_result->completed;
+free_samples:
+  free(occlusion_unculled_gpu_samples);
+  free(occlusion_culled_gpu_samples);
+  free(occlusion_overhead_samples);
+  free(batch_build_samples);
+  free(render_scale_samples);
+  free(gpu_samples);
+  free(cpu_samples);
+  return false;
+}
+
+void write_json_string(FILE *output, const char *string) {
+  fputc('"', output);
+  for (const char *character = string; *character; character++) {
+    if (*character == '"' || *character == '\\') {
+      fputc('\\', output);
+      fputc(*character, output);
+    } else if ((unsigned char)*character < 0x20) {
+      fprintf(output, "\\u%04x", (unsigned char)*character);
+    } else {
+      fputc(*character, output);
+    }
+  }
+  fputc('"', output);
+}
+
+void write_json_statistics(FILE *output, const char *name,
+                           const struct bench_statistics *statistics) {
+  fprintf(output,
+          "      \"%s\": {\"mean\": %.4f, \"p50\": %.4f, \"p95\": %.4f, "
+          "\"p99\": %.4f, \"max\": %.4f},\n",
+          name, statistics->mean, statistics->p50, statistics->p95,
+          statistics->p99, statistics->max);
+}
+
+void write_json_results(FILE *output, struct vulkan_renderer *renderer,
+                        uint64_t seed, uint32_t frame_count,
+                        double renderer_init_ms, double first_frame_ms,
+                        const struct bench_scene_result *results,
+                        uint32_t result_count) {
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(renderer->physical_device, &properties);
+
+  fprintf(output, "{\n  \"version\": 1,\n  \"device\": ");
+  write_json_string(output, properties.deviceName);
+  fprintf(output,
+          ",\n  \"driver_version\": %u,\n  \"api_version\": \"%u.%u.%u\",\n"
+          "  \"validation_layers\": %s,\n  \"validation\": \"%s\",\n"
+          "  \"performance_messages\": %d,\n  \"draw_data_path\": \"%s\",\n"
+          "  \"msaa_sample_count\": %u,\n  \"occlusion_culling\": %s,\n"
+          "  \"post_process\": %s,\n  \"render_extent\": [%u, %u],\n"
+          "  \"dynamic_resolution_budget_ms\": %.4f,\n  \"seed\": %llu,\n"
+          "  \"frame_count\": %u,\n  \"warmup_frame_count\": %u,\n"
+          "  \"startup\": {\"renderer_init_ms\": %.4f, "
+          "\"first_frame_ms\": %.4f},\n"
+          "  \"frame_arena_high_water_mark_bytes\": %zu,\n"
+          "  \"scenes\": [\n",
+          properties.driverVersion, VK_API_VERSION_MAJOR(properties.apiVersion),
+          VK_API_VERSION_MINOR(properties.apiVersion),
+          VK_API_VERSION_PATCH(properties.apiVersion),
+          renderer->enable_validation_layers ? "true" : "false",
+          vulkan_renderer_validation_name(renderer->validation),
+          SDL_GetAtomicInt(&renderer->performance_message_count),
+          renderer->draw_data_in_push_constants ? "push_constants"
+                                                : "uniform_ring",
+          (uint32_t)renderer->msaa_sample_count,
+          renderer->occlusion_culling_enabled ? "true" : "false",
+          renderer->post_process_enabled
+              ? (renderer->swapchain_storage_supported ? "\"compute\""
+                                                       : "\"fullscreen\"")
+              : "null",
+          renderer->render_target_extent.width,
+          renderer->render_target_extent.height,
+          (double)renderer->dynamic_resolution_budget_ms,
+          (unsigned long long)seed,
+          frame_count, BENCH_WARMUP_FRAME_COUNT, renderer_init_ms,
+          first_frame_ms, renderer->frame_arena.high_water_mark);
+
+  for (uint32_t result_index = 0; result_index < result_count;
+       result_index++) {
+    const struct bench_scene_result *result = &results[result_index];
+    fprintf(output, "    {\n      \"name\": ");
+    write_json_string(output, result->name);
+    fprintf(output,
+            ",\n      \"completed\": %s,\n      \"init_ms\": %.4f,\n"
+            "      \"frames\": %u,\n",
+            result->completed ? "true" : "false", result->init_ms,
+            result->frame_count);
+    write_json_statistics(output, "cpu_frame_time_ms",
+                          &result->cpu_frame_time_ms);
+    if (result->gpu_sample_count > 0) {
+      write_json_statistics(output, "gpu_frame_time_ms",
+                            &result->gpu_frame_time_ms);
+    } else {
+      fprintf(output, "      \"gpu_frame_time_ms\": null,\n");
+    }
+    write_json_statistics(output, "render_scale", &result->render_scale);
+    if (result->batch_build_sample_count > 0) {
+      write_json_statistics(output, "batch_build_ms", &result->batch_build_ms);
+      fprintf(output, "      \"batch_draw_count\": %u,\n",
+              result->batch_draw_count);
+    }
+    if (result->draw_list_used) {
+      const struct draw_list_stats *stats = &result->draw_list_stats;
+      fprintf(output,
+              "      \"draw_list\": {\"pipeline_binds\": %u, "
+              "\"redundant_pipeline_binds\": %u, \"mesh_binds\": %u, "
+              "\"redundant_mesh_binds\": %u, \"dropped_draws\": %u, "
+              "\"unsorted_draws\": %u},\n",
+              stats->pipeline_bind_count, stats->redundant_pipeline_bind_count,
+              stats->mesh_bind_count, stats->redundant_mesh_bind_count,
+              stats->dropped_draw_count, stats->unsorted_draw_count);
+    }
+    if (result->occlusion_frame_count > 0) {
+      // Positive when occlusion culling pays for its own overhead
+      double gpu_time_saved_ms =
+          result->occlusion_culled_gpu_sample_count > 0 &&
+                  result->occlusion_unculled_gpu_sample_count > 0
+              ? result->occlusion_unculled_gpu_frame_time_ms.p50 -
+                    result->occlusion_culled_gpu_frame_time_ms.p50
+              : 0.0;
+      fprintf(output,
+              "      \"occlusion\": {\"frames\": %u, "
+              "\"meshlets_culled_percent\": %.4f, "
+              "\"meshlets_occluded_percent\": %.4f, "
+              "\"overhead_ms\": %.4f, "
+              "\"gpu_frame_time_culled_p50_ms\": %.4f, "
+              "\"gpu_frame_time_unculled_p50_ms\": %.4f, "
+              "\"gpu_time_saved_ms\": %.4f},\n",
+              result->occlusion_frame_count, result->meshlets_culled_percent,
+              result->meshlets_occluded_percent,
+              result->occlusion_overhead_ms.p50,
+              result->occlusion_culled_gpu_frame_time_ms.p50,
+              result->occlusion_unculled_gpu_frame_time_ms.p50,
+              gpu_time_saved_ms);
+    }
+    fprintf(output,
+            "      \"device_memory_allocations\": {\"init\": %llu, "
+            "\"frames\": %llu}\n    }%s\n",
+            (unsigned long long)result->init_device_memory_allocation_count,
+            (unsigned long long)result->frame_device_memory_allocation_count,
+            result_index + 1 < result_count ? "," : "");
+  }
+  fprintf(output, "  ]\n}\n");
+}
+
+void print_usage(void) {
+  fprintf(stderr, "usage: vkguide-bench [--frames <count>] [--seed <seed>] "
+                  "[--scene <name>] [--output <path>] [--msaa <samples>] "
+                  "[--post-process] [--render-scale <scale>] "
+                  "[--gpu-budget-ms <ms>] "
+                  "[--validation off|standard|sync|gpu|perf] "
+                  "[--occlusion-culling] [--windowed]\n");
+}
+
+int main(int argc, char **argv) {
+  uint64_t start_ns = SDL_GetTicksNS();
+  uint32_t frame_count = BENCH_DEFAULT_FRAME_COUNT;
+  uint64_t seed = BENCH_DEFAULT_SEED;
+  const char *scene_name = NULL;
+  const char *output_path = NULL;
+  // Single-sampled by default so that the draw-bound scenes stay draw-bound
+  struct vulkan_renderer_options renderer_options = {.msaa_sample_count = 1};
+  bool windowed = false;
+  for (int arg_index = 1; arg_index < argc; arg_index++) {
+    bool has_value = arg_index + 1 < argc;
+    if (strcmp(argv[arg_index], "--frames") == 0 && has_value) {
+      frame_count = (uint32_t)strtoul(argv[++arg_index], NULL, 10);
+    } else if (strcmp(argv[arg_index], "--seed") == 0 && has_value) {
+      seed = strtoull(argv[++arg_index], NULL, 10);
+    } else if (strcmp(argv[arg_index], "--scene") == 0 && has_value) {
+      scene_name = argv[++arg_index];
+    } else if (strcmp(argv[arg_index], "--output") == 0 && has_value) {
+      output_path = argv[++arg_index];
+    } else if (strcmp(argv[arg_index], "--msaa") == 0 && has_value) {
+      renderer_options.msaa_sample_count =
+          (uint32_t)strtoul(argv[++arg_index], NULL, 10);
+    } else if (strcmp(argv[arg_index], "--post-process") == 0) {
+      renderer_options.post_process = true;
+    } else if (strcmp(argv[arg_index], "--render-scale") == 0 && has_value) {
+      renderer_options.render_scale = strtof(argv[++arg_index], NULL);
+    } else if (strcmp(argv[arg_index], "--gpu-budget-ms") == 0 && has_value) {
+      renderer_options.dynamic_resolution_budget_ms =
+          strtof(argv[++arg_index], NULL);
+    } else if (strcmp(argv[arg_index], "--validation") == 0 && has_value) {
+      if (!vulkan_renderer_validation_from_name(argv[++arg_index],
+                                                &renderer_options.validation)) {
+        print_usage();
+        return 2;
+      }
+    } else if (strcmp(argv[arg_index], "--occlusion-culling") == 0) {
+      renderer_options.occlusion_culling = true;
+    } else if (strcmp(argv[arg_index], "--windowed") == 0) {
+      windowed = true;
+    } else {
+      print_usage();
+      return 2;
+    }
+  }
+
+  if (frame_count == 0) {
+    print_usage();
+    return 2;
+  }
+
+  int exit_code = 1;
+  if (!windowed) {
+    SDL_SetHint(SDL_HINT_VIDEO_DRIVER, "offscreen");
+  }
+
+  if (!SDL_Init(SDL_INIT_VIDEO)) {
+    LOG("Couldn't initialize SDL: %s", SDL_GetError());
+    goto err;
+  }
+
+  SDL_Window *window =
+      SDL_CreateWindow("vkguide-bench", BENCH_WINDOW_WIDTH,
+                       BENCH_WINDOW_HEIGHT, SDL_WINDOW_VULKAN);
+  if (!window) {
+    LOG("Couldn't create window: %s", SDL_GetError());
+    goto quit_sdl;
+  }
+
+  struct vulkan_renderer renderer;
+  if (!vulkan_renderer_init(&renderer, window, &renderer_options)) {
+    LOG("Couldn't init vulkan renderer");
+    goto destroy_window;
+  }
+  double renderer_init_ms =
+      nanoseconds_to_milliseconds(SDL_GetTicksNS() - start_ns);
+
+  // Seeded with a non-zero state, xorshift would stay at 0 forever
+  struct bench_context context = {
+      .renderer = &renderer,
+      .window = window,
+      .random = {seed ^ UINT64_C(0x9e3779b97f4a7c15)}};
+  if (context.random.state == 0) {
+    context.random.state = 1;
+  }
+  if (!bench_create_cube_mesh(&renderer, &context.cube)) {
+    LOG("Couldn't create benchmark mesh");
+    goto deinit_renderer;
+  }
+
+  // Startup ends once the first frame has been presented
+  if (!bench_begin_frame(&context)) {
+    goto destroy_cube;
+  }
+  vulkan_renderer_begin_render_pass(&renderer);
+  vulkan_renderer_end_render_pass(&renderer);
+  vulkan_renderer_end_frame(&renderer);
+  vkDeviceWaitIdle(renderer.device);
+  double first_frame_ms =
+      nanoseconds_to_milliseconds(SDL_GetTicksNS() - start_ns);
+
+  struct bench_scene_result results[BENCH_SCENE_COUNT];
+  uint32_t result_count = 0;
+  bool all_scenes_completed = true;
+  for (uint32_t scene_index = 0; scene_index < BENCH_SCENE_COUNT;
+       scene_index++) {
+    const struct bench_scene *scene = &bench_scenes[scene_index];
+    if (scene_name && strcmp(scene_name, scene->name) != 0) {
+      continue;
+    }
+
+    LOG("Running scene %s", scene->name);
+    all_scenes_completed &= bench_run_scene(&context, scene, frame_count,
+                                            &results[result_count++]);
+  }
+
+  if (result_count == 0) {
+    LOG("Unknown scene %s", scene_name);
+    goto destroy_cube;
+  }
+
+  FILE *output = output_path ? fopen(output_path, "w") : stdout;
+  if (!output) {
+    LOG("Couldn't open %s", output_path);
+    goto destroy_cube;
+  }
+  write_json_results(output, &renderer, seed, frame_count, renderer_init_ms,
+                     first_frame_ms, results, result_count);
+  if (output != stdout) {
+    fclose(output);
+  }
+  exit_code = all_scenes_completed ? 0 : 1;
+
+destroy_cube:
+  vulkan_renderer_destroy_mesh(&renderer, &context.cube);
+deinit_renderer:
+  vulkan_renderer_deinit(&renderer);
+destroy_window:
+  SDL_DestroyWindow(window);
+quit_sdl:
+  SDL_Quit();
+err:
+  return exit_code;
+}
@@ -0,0 +1,128 @@
+#!/usr/bin/env python3
+"""Compares two vkguide-bench result files.
+
+usage: compare.py [--threshold 0.05] [--min-delta-ms 0.05]
+                  baseline.json candidate.json
+
+A metric regresses when the candidate is more than `threshold` (relative)
+and `min-delta-ms` (absolute) slower than the baseline. New device memory
+allocations during the measured frames and scenes that didn't complete are
+regressions as well. Exits with 1 when anything regressed, 2 on usage
+errors.
+"""
+
+import argparse
+import json
+import sys
+
+PERCENTILES = ("p50", "p95", "p99")
+STARTUP_METRICS = ("renderer_init_ms", "first_frame_ms")
+
+
+def load_results(path):
+    with open(path, encoding="utf-8") as file_handle:
+        results = json.load(file_handle)
+    if results.get("version") != 1:
+        raise ValueError(f"{path}: unsupported result version")
+    return results
+
+
+def is_regression(old, new, threshold, min_delta_ms):
+    return new > old * (1.0 + threshold) and new - old > min_delta_ms
+
+
+def format_change(old, new):
+    if old == 0:
+        return "n/a"
+    return f"{(new - old) / old * 100.0:+.1f}%"
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Compares two vkguide-bench result files")
+    parser.add_argument("--threshold", type=float, default=0.05,
+                        help="relative slowdown tolerated (default: 0.05)")
+    parser.add_argument("--min-delta-ms", type=float, default=0.05,
+                        help="absolute slowdown tolerated (default: 0.05)")
+    parser.add_argument("baseline")
+    parser.add_argument("candidate")
+    arguments = parser.parse_args()
+
+    try:
+        baseline = load_results(arguments.baseline)
+        candidate = load_results(arguments.candidate)
+    except (OSError, ValueError) as error:
+        print(error, file=sys.stderr)
+        return 2
+
+    for key in ("device", "driver_version", "validation_layers", "validation",
+                "draw_data_path", "msaa_sample_count", "occlusion_culling",
+                "post_process",
+                "render_extent", "dynamic_resolution_budget_ms", "seed"):
+        if baseline.get(key) != candidate.get(key):
+            print(f"warning: {key} differs: {baseline.get(key)!r} -> "
+                  f"{candidate.get(key)!r}", file=sys.stderr)
+
+    rows = []
+    regressions = []
+
+    def compare(name, old, new):
+        regressed = is_regression(old, new, arguments.threshold,
+                                  arguments.min_delta_ms)
+        rows.append((name, f"{old:.3f}", f"{new:.3f}",
+                     format_change(old, new), "REGRESSION" if regressed else ""))
+        if regressed:
+            regressions.append(name)
+
+    for metric in STARTUP_METRICS:
+        compare(f"startup.{metric}", baseline["startup"][metric],
+                candidate["startup"][metric])
+
+    candidate_scenes = {scene["name"]: scene for scene in candidate["scenes"]}
+    for old_scene in baseline["scenes"]:
+        name = old_scene["name"]
+        new_scene = candidate_scenes.get(name)
+        if new_scene is None:
+            print(f"warning: scene {name} is missing from the candidate",
+                  file=sys.stderr)
+            continue
+        if not new_scene["completed"]:
+            rows.append((f"{name}.completed", "", "false", "", "REGRESSION"))
+            regressions.append(f"{name}.completed")
+            continue
+
+        for timer in ("cpu_frame_time_ms", "gpu_frame_time_ms",
+                      "batch_build_ms"):
+            if old_scene.get(timer) is None or new_scene.get(timer) is None:
+                continue
+            for percentile in PERCENTILES:
+                compare(f"{name}.{timer}.{percentile}",
+                        old_scene[timer][percentile],
+                        new_scene[timer][percentile])
+
+        old_allocations = old_scene["device_memory_allocations"]["frames"]
+        new_allocations = new_scene["device_memory_allocations"]["frames"]
+        allocations_regressed = new_allocations > old_allocations
+        rows.append((f"{name}.device_memory_allocations.frames",
+                     str(old_allocations), str(new_allocations), "",
+                     "REGRESSION" if allocations_regressed else ""))
+        if allocations_regressed:
+            regressions.append(f"{name}.device_memory_allocations.frames")
+
+    header = ("metric", "baseline", "candidate", "change", "")
+    widths = [max(len(row[column]) for row in rows + [header])
+              for column in range(len(header))]
+    for row in [header] + rows:
+        print("  ".join(cell.ljust(width) if column == 0 else
+                        cell.rjust(width)
+                        for column, (cell, width) in
+                        enumerate(zip(row, widths))).rstrip())
+
+    if regressions:
+        print(f"\n{len(regressions)} regression(s)")
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,187 @@
+// CPU microbenchmark of the draw list sort, see src/draw_list.h. Adds draws
+// spread over many pipelines and meshes in random order, a tenth of them
+// blended, then sorts them. Nothing is recorded: the pipelines and meshes are
+// fake handles that are never dereferenced, so no GPU is needed. Prints the
+// add and sort times and the binds the sorted order needs against the
+// submission order as JSON.
+//
+// usage: vkguide-draw-list-bench [--draws <count>] [--iterations <count>]
+//                                [--seed <seed>]
+
+#include "arena.h"
+#include "draw_list.h"
+#include "mesh.h"
+#include <SDL3/SDL.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DRAW_LIST_BENCH_DEFAULT_DRAW_COUNT 100000
+#define DRAW_LIST_BENCH_DEFAULT_ITERATION_COUNT 200
+#define DRAW_LIST_BENCH_DEFAULT_SEED 1
+// Not measured
+#define DRAW_LIST_BENCH_WARMUP_ITERATION_COUNT 8
+#define DRAW_LIST_BENCH_PIPELINE_COUNT 64
+#define DRAW_LIST_BENCH_MESH_COUNT 1024
+#define DRAW_LIST_BENCH_BLENDED_PERCENT 10
+
+// xorshift64*, the sequence only depends on the seed
+uint64_t draw_list_bench_random_next(uint64_t *state) {
+  *state ^= *state >> 12;
+  *state ^= *state << 25;
+  *state ^= *state >> 27;
+  return *state * 0x2545f4914f6cdd1dull;
+}
+
+int draw_list_bench_compare_doubles(const void *a, const void *b) {
+  double lhs = *(const double *)a;
+  double rhs = *(const double *)b;
+  return (lhs > rhs) - (lhs < rhs);
+}
+
+// Sorts `samples`
+void draw_list_bench_write_statistics(const char *name, double *samples,
+                                      uint32_t sample_count) {
+  qsort(samples, sample_count, sizeof(double),
+        draw_list_bench_compare_doubles);
+  double sum = 0.0;
+  for (uint32_t sample_index = 0; sample_index < sample_count;
+       sample_index++) {
+    sum += samples[sample_index];
+  }
+  printf("  \"%s\": {\"mean\": %.4f, \"p50\": %.4f, \"p95\": %.4f, "
+         "\"max\": %.4f},\n",
+         name, sum / sample_count, samples[sample_count / 2],
+         samples[(size_t)sample_count * 95 / 100], samples[sample_count - 1]);
+}
+
+void print_usage(void) {
+  fprintf(stderr, "usage: vkguide-draw-list-bench [--draws <count>] "
+                  "[--iterations <count>] [--seed <seed>]\n");
+}
+
+int main(int argc, char **argv) {
+  uint32_t draw_count = DRAW_LIST_BENCH_DEFAULT_DRAW_COUNT;
+  uint32_t iteration_count = DRAW_LIST_BENCH_DEFAULT_ITERATION_COUNT;
+  uint64_t seed = DRAW_LIST_BENCH_DEFAULT_SEED;
+  for (int arg_index = 1; arg_index < argc; arg_index++) {
+    bool has_value = arg_index + 1 < argc;
+    if (strcmp(argv[arg_index], "--draws") == 0 && has_value) {
+      draw_count = (uint32_t)strtoul(argv[++arg_index], NULL, 10);
+    } else if (strcmp(argv[arg_index], "--iterations") == 0 && has_value) {
+      iteration_count = (uint32_t)strtoul(argv[++arg_index], NULL, 10);
+    } else if (strcmp(argv[arg_index], "--seed") == 0 && has_value) {
+      seed = strtoull(argv[++arg_index], NULL, 10);
+    } else {
+      print_usage();
+      return 2;
+    }
+  }
+  if (draw_count == 0 || draw_count > DRAW_LIST_MAX_CAPACITY ||
+      iteration_count == 0 || seed == 0) {
+    print_usage();
+    return 2;
+  }
+
+  int exit_code = 1;
+  struct draw_list list;
+  if (!draw_list_init(&list, draw_count)) {
+    fprintf(stderr, "Couldn't init the draw list\n");
+    goto err;
+  }
+  // Holds the sort scratch, like the renderer's frame arena
+  struct arena sort_arena;
+  if (!arena_init(&sort_arena, "sort",
+                  sizeof(uint64_t) * draw_count + ARENA_DEFAULT_ALIGNMENT)) {
+    goto deinit_list;
+  }
+
+  struct mesh *meshes = calloc(DRAW_LIST_BENCH_MESH_COUNT, sizeof(struct mesh));
+  struct draw_list_draw *draws =
+      calloc(draw_count, sizeof(struct draw_list_draw));
+  double *add_samples = malloc(sizeof(double) * iteration_count);
+  double *sort_samples = malloc(sizeof(double) * iteration_count);
+  if (!meshes || !draws || !add_samples || !sort_samples) {
+    fprintf(stderr, "Couldn't allocate the benchmark arrays\n");
+    goto free_arrays;
+  }
+
+  uint64_t random_state = seed;
+  for (uint32_t draw_index = 0; draw_index < draw_count; draw_index++) {
+    struct draw_list_draw *draw = &draws[draw_index];
+    uint64_t random = draw_list_bench_random_next(&random_state);
+    // Fake, non-null handles
+    uint64_t pipeline_handle = random % DRAW_LIST_BENCH_PIPELINE_COUNT + 1;
+    memcpy(&draw->pipeline, &pipeline_handle, sizeof(draw->pipeline));
+    draw->mesh = &meshes[(random >> 16) % DRAW_LIST_BENCH_MESH_COUNT];
+    draw->back_to_front =
+        (random >> 32) % 100 < DRAW_LIST_BENCH_BLENDED_PERCENT;
+    draw->pass = draw->back_to_front ? 1 : 0;
+    draw->depth = (float)((random >> 40) % 100000) / 1000.0f;
+  }
+
+  // Binds of the submission order, only skipping repeats
+  uint32_t unsorted_pipeline_bind_count = 0;
+  uint32_t unsorted_mesh_bind_count = 0;
+  for (uint32_t draw_index = 0; draw_index < draw_count; draw_index++) {
+    if (draw_index == 0 ||
+        draws[draw_index].pipeline != draws[draw_index - 1].pipeline) {
+      unsorted_pipeline_bind_count++;
+    }
+    if (draw_index == 0 ||
+        draws[draw_index].mesh != draws[draw_index - 1].mesh) {
+      unsorted_mesh_bind_count++;
+    }
+  }
+
+  for (uint32_t iteration = 0;
+       iteration < DRAW_LIST_BENCH_WARMUP_ITERATION_COUNT + iteration_count;
+       iteration++) {
+    uint64_t add_start_ns = SDL_GetTicksNS();
+    draw_list_reset(&list);
+    arena_reset(&sort_arena);
+    for (uint32_t draw_index = 0; draw_index < draw_count; draw_index++) {
+      draw_list_add(&list, &draws[draw_index]);
+    }
+    uint64_t sort_start_ns = SDL_GetTicksNS();
+    draw_list_sort(&list, &sort_arena);
+    uint64_t sort_end_ns = SDL_GetTicksNS();
+
+    if (iteration >= DRAW_LIST_BENCH_WARMUP_ITERATION_COUNT) {
+      uint32_t sample_index =
+          iteration - DRAW_LIST_BENCH_WARMUP_ITERATION_COUNT;
+      add_samples[sample_index] = (double)(sort_start_ns - add_start_ns) / 1e6;
+      sort_samples[sample_index] = (double)(sort_end_ns - sort_start_ns) / 1e6;
+    }
+  }
+
+  printf("{\n  \"draw_count\": %u,\n  \"iteration_count\": %u,\n"
+         "  \"seed\": %llu,\n  \"pipeline_count\": %u,\n"
+         "  \"mesh_count\": %u,\n",
+         draw_count, iteration_count, (unsigned long long)seed,
+         DRAW_LIST_BENCH_PIPELINE_COUNT, DRAW_LIST_BENCH_MESH_COUNT);
+  draw_list_bench_write_statistics("add_ms", add_samples, iteration_count);
+  draw_list_bench_write_statistics("sort_ms", sort_samples, iteration_count);
+  printf("  \"unsorted\": {\"pipeline_binds\": %u, \"mesh_binds\": %u},\n"
+         "  \"sorted\": {\"pipeline_binds\": %u, \"mesh_binds\": %u, "
+         "\"redundant_pipeline_binds\": %u, \"redundant_mesh_binds\": %u, "
+         "\"dropped_draws\": %u}\n}\n",
+         unsorted_pipeline_bind_count, unsorted_mesh_bind_count,
+         list.stats.pipeline_bind_count, list.stats.mesh_bind_count,
+         list.stats.redundant_pipeline_bind_count,
+         list.stats.redundant_mesh_bind_count, list.stats.dropped_draw_count);
+  exit_code = 0;
+
+free_arrays:
+  free(sort_samples);
+  free(add_samples);
+  free(draws);
+  free(meshes);
+  arena_deinit(&sort_arena);
+deinit_list:
+  draw_list_deinit(&list);
+err:
+  return exit_code;
+}
@@ -0,0 +1,405 @@
+// Replays a capture file (see src/capture.h) through the renderer, in an
+// offscreen window like bench/bench.c, and prints the CPU and GPU time of
+// every frame as JSON next to the times the frames were recorded with. A slow
+// frame captured in production can then be profiled and bisected offline,
+// e.g. on lavapipe with
+// VK_ICD_FILENAMES=/usr/share/vulkan/icd.d/lvp_icd.x86_64.json.
+//
+// usage: vkguide-replay <capture> [--loops <count>] [--first-frame <index>]
+//                       [--frame-count <count>] [--output <path>]
+//                       [--validation <mode>] [--windowed]
+//
+// The renderer is created with the options the capture was recorded with.
+// Each loop replays the frames in order, the first one isn't measured. The
+// time of a frame is the median over the measured loops.
+
+#define _POSIX_C_SOURCE 200809L
+#include "capture.h"
+#include "log.h"
+#include "vulkan_renderer.h"
+#include <SDL3/SDL.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define REPLAY_DEFAULT_LOOP_COUNT 4
+// Not measured: lets pipelines, allocations and caches settle
+#define REPLAY_WARMUP_LOOP_COUNT 1
+// Consecutive frames that can't begin before the replay is abandoned
+#define REPLAY_MAX_SKIPPED_FRAME_COUNT 1000
+#define REPLAY_NO_FRAME UINT32_MAX
+
+struct replay_samples {
+  // frame_count * loop_count, by frame then loop
+  double *cpu_ms;
+  double *gpu_ms;
+  uint32_t *gpu_sample_counts;
+  uint32_t loop_count;
+};
+
+// Replayed frame that last used each frame slot of the renderer, whose GPU
+// time is harvested the next time the slot is used
+struct replay_slot {
+  uint32_t frame_index;
+  bool measured;
+};
+
+double nanoseconds_to_milliseconds(uint64_t nanoseconds) {
+  return (double)nanoseconds / 1e6;
+}
+
+int compare_doubles(const void *a, const void *b) {
+  double lhs = *(const double *)a;
+  double rhs = *(const double *)b;
+  return (lhs > rhs) - (lhs < rhs);
+}
+
+// Sorts `samples`
+double median(double *samples, uint32_t sample_count) {
+  qsort(samples, sample_count, sizeof(double), compare_doubles);
+  return sample_count % 2 == 1
+             ? samples[sample_count / 2]
+             : (samples[sample_count / 2 - 1] + samples[sample_count / 2]) /
+                   2.0;
+}
+
+// Read whole, aligned for the meshes created in place
+void *load_file(const char *path, size_t *out_size) {
+  FILE *file = fopen(path, "rb");
+  if (!file) {
+    LOG("Couldn't open %s", path);
+    goto err;
+  }
+  if (fseek(file, 0, SEEK_END) != 0) {
+    goto close_file;
+  }
+  long size = ftell(file);
+  if (size <= 0 || fseek(file, 0, SEEK_SET) != 0) {
+    goto close_file;
+  }
+  size_t allocation_size =
+      ((size_t)size + CAPTURE_FILE_SECTION_ALIGNMENT - 1) &
+      ~(size_t)(CAPTURE_FILE_SECTION_ALIGNMENT - 1);
+  void *content = aligned_alloc(CAPTURE_FILE_SECTION_ALIGNMENT,
+                                allocation_size);
+  if (!content) {
+    goto close_file;
+  }
+  if (fread(content, 1, (size_t)size, file) != (size_t)size) {
+    LOG("Couldn't read %s", path);
+    free(content);
+    goto close_file;
+  }
+  fclose(file);
+  *out_size = (size_t)size;
+  return content;
+close_file:
+  fclose(file);
+err:
+  return NULL;
+}
+
+void replay_harvest_gpu_time(const struct vulkan_renderer *renderer,
+                             const struct replay_slot *slot,
+                             struct replay_samples *samples) {
+  if (!renderer->gpu_frame_time_available ||
+      slot->frame_index == REPLAY_NO_FRAME || !slot->measured) {
+    return;
+  }
+  uint32_t sample_index = slot->frame_index * samples->loop_count +
+                          samples->gpu_sample_counts[slot->frame_index]++;
+  samples->gpu_ms[sample_index] =
+      nanoseconds_to_milliseconds(renderer->gpu_frame_time_ns);
+}
+
+bool replay_frames(struct capture_replay *replay,
+                   struct vulkan_renderer *renderer, uint32_t first_frame,
+                   uint32_t frame_count, uint32_t loop_count,
+                   struct replay_samples *samples) {
+  struct replay_slot slots[MAX_FRAMES_IN_FLIGHT];
+  for (uint32_t slot_index = 0; slot_index < MAX_FRAMES_IN_FLIGHT;
+       slot_index++) {
+    slots[slot_index] = (struct replay_slot){.frame_index = REPLAY_NO_FRAME};
+  }
+
+  uint32_t total_loop_count = REPLAY_WARMUP_LOOP_COUNT + loop_count;
+  for (uint32_t loop = 0; loop < total_loop_count; loop++) {
+    bool measured = loop >= REPLAY_WARMUP_LOOP_COUNT;
+    for (uint32_t frame_index = 0; frame_index < frame_count; frame_index++) {
+      SDL_Event event;
+      while (SDL_PollEvent(&event)) {
+        if (event.type == SDL_EVENT_WINDOW_PIXEL_SIZE_CHANGED) {
+          vulkan_renderer_notify_resize(renderer);
+        }
+      }
+      struct replay_slot *slot = &slots[renderer->current_frame];
+      uint64_t frame_start_ns = SDL_GetTicksNS();
+      if (!capture_replay_frame(replay, renderer, first_frame + frame_index)) {
+        LOG("Replay stopped at frame %u", first_frame + frame_index);
+        return false;
+      }
+      if (measured) {
+        samples->cpu_ms[frame_index * loop_count + loop -
+                        REPLAY_WARMUP_LOOP_COUNT] =
+            nanoseconds_to_milliseconds(SDL_GetTicksNS() - frame_start_ns);
+      }
+      // Harvested by the frame's vulkan_renderer_begin_frame
+      replay_harvest_gpu_time(renderer, slot, samples);
+      *slot = (struct replay_slot){.frame_index = frame_index,
+                                   .measured = measured};
+    }
+  }
+
+  // Empty frames harvest the GPU time of the last replayed ones
+  for (uint32_t flush_index = 0; flush_index < MAX_FRAMES_IN_FLIGHT;
+       flush_index++) {
+    struct replay_slot *slot = &slots[renderer->current_frame];
+    uint32_t attempt = 0;
+    while (!vulkan_renderer_begin_frame(renderer)) {
+      if (++attempt == REPLAY_MAX_SKIPPED_FRAME_COUNT) {
+        return false;
+      }
+    }
+    replay_harvest_gpu_time(renderer, slot, samples);
+    *slot = (struct replay_slot){.frame_index = REPLAY_NO_FRAME};
+    vulkan_renderer_begin_render_pass(renderer);
+    vulkan_renderer_end_render_pass(renderer);
+    vulkan_renderer_end_frame(renderer);
+  }
+  vkDeviceWaitIdle(renderer->device);
+  return true;
+}
+
+void write_json_string(FILE *output, const char *string) {
+  fputc('"', output);
+  for (const char *character = string; *character; character++) {
+    if (*character == '"' || *character == '\\') {
+      fputc('\\', output);
+      fputc(*character, output);
+    } else if ((unsigned char)*character < 0x20) {
+      fprintf(output, "\\u%04x", (unsigned char)*character);
+    } else {
+      fputc(*character, output);
+    }
+  }
+  fputc('"', output);
+}
+
+void write_json_milliseconds(FILE *output, bool available, double ms) {
+  if (available) {
+    fprintf(output, "%.4f", ms);
+  } else {
+    fprintf(output, "null");
+  }
+}
+
+void write_json_results(FILE *output, struct vulkan_renderer *renderer,
+                        const char *capture_path,
+                        const struct capture_replay *replay,
+                        uint32_t first_frame, uint32_t frame_count,
+                        struct replay_samples *samples) {
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(renderer->physical_device, &properties);
+  const struct capture_file_header *header = &replay->header;
+
+  fprintf(output, "{\n  \"version\": 1,\n  \"capture\": ");
+  write_json_string(output, capture_path);
+  fprintf(output, ",\n  \"device\": ");
+  write_json_string(output, properties.deviceName);
+  fprintf(output,
+          ",\n  \"validation\": \"%s\",\n"
+          "  \"swapchain_extent\": [%u, %u],\n"
+          "  \"msaa_sample_count\": %u,\n  \"post_process\": %s,\n"
+          "  \"render_scale\": %.4f,\n  \"occlusion_culling\": %s,\n"
+          "  \"threshold_ms\": %.4f,\n  \"loops\": %u,\n"
+          "  \"frames\": [\n",
+          vulkan_renderer_validation_name(renderer->validation),
+          renderer->swapchain_extent.width, renderer->swapchain_extent.height,
+          (uint32_t)renderer->msaa_sample_count,
+          renderer->post_process_enabled ? "true" : "false",
+          (double)renderer->render_scale,
+          renderer->occlusion_culling_enabled ? "true" : "false",
+          (double)header->threshold_ms, samples->loop_count);
+
+  for (uint32_t frame_index = 0; frame_index < frame_count; frame_index++) {
+    const struct capture_file_frame *frame =
+        capture_replay_frame_info(replay, first_frame + frame_index);
+    uint32_t gpu_sample_count = samples->gpu_sample_counts[frame_index];
+    double *cpu_ms = &samples->cpu_ms[frame_index * samples->loop_count];
+    double *gpu_ms = &samples->gpu_ms[frame_index * samples->loop_count];
+    fprintf(output,
+            "    {\"index\": %u, \"frame_number\": %llu, "
+            "\"recorded_cpu_ms\": %.4f, \"recorded_gpu_ms\": ",
+            first_frame + frame_index,
+            (unsigned long long)frame->frame_number,
+            nanoseconds_to_milliseconds(frame->cpu_frame_time_ns));
+    write_json_milliseconds(
+        output, frame->gpu_frame_time_available,
+        nanoseconds_to_milliseconds(frame->gpu_frame_time_ns));
+    fprintf(output, ", \"cpu_ms\": %.4f, \"gpu_ms\": ",
+            median(cpu_ms, samples->loop_count));
+    write_json_milliseconds(output, gpu_sample_count > 0,
+                            gpu_sample_count > 0
+                                ? median(gpu_ms, gpu_sample_count)
+                                : 0.0);
+    fprintf(output, "}%s\n", frame_index + 1 < frame_count ? "," : "");
+  }
+  fprintf(output, "  ]\n}\n");
+}
+
+void print_usage(void) {
+  fprintf(stderr, "usage: vkguide-replay <capture> [--loops <count>] "
+                  "[--first-frame <index>] [--frame-count <count>] "
+                  "[--output <path>] "
+                  "[--validation off|standard|sync|gpu|perf] [--windowed]\n");
+}
+
+int main(int argc, char **argv) {
+  const char *capture_path = NULL;
+  const char *output_path = NULL;
+  uint32_t loop_count = REPLAY_DEFAULT_LOOP_COUNT;
+  uint32_t first_frame = 0;
+  uint32_t frame_count = 0;
+  enum vulkan_renderer_validation validation =
+      VULKAN_RENDERER_VALIDATION_DEFAULT;
+  bool windowed = false;
+  for (int arg_index = 1; arg_index < argc; arg_index++) {
+    bool has_value = arg_index + 1 < argc;
+    if (strcmp(argv[arg_index], "--loops") == 0 && has_value) {
+      loop_count = (uint32_t)strtoul(argv[++arg_index], NULL, 10);
+    } else if (strcmp(argv[arg_index], "--first-frame") == 0 && has_value) {
+      first_frame = (uint32_t)strtoul(argv[++arg_index], NULL, 10);
+    } else if (strcmp(argv[arg_index], "--frame-count") == 0 && has_value) {
+      frame_count = (uint32_t)strtoul(argv[++arg_index], NULL, 10);
+    } else if (strcmp(argv[arg_index], "--output") == 0 && has_value) {
+      output_path = argv[++arg_index];
+    } else if (strcmp(argv[arg_index], "--validation") == 0 && has_value) {
+      if (!vulkan_renderer_validation_from_name(argv[++arg_index],
+                                                &validation)) {
+        print_usage();
+        return 2;
+      }
+    } else if (strcmp(argv[arg_index], "--windowed") == 0) {
+      windowed = true;
+    } else if (argv[arg_index][0] != '-' && !capture_path) {
+      capture_path = argv[arg_index];
+    } else {
+      print_usage();
+      return 2;
+    }
+  }
+
+  if (!capture_path || loop_count == 0) {
+    print_usage();
+    return 2;
+  }
+
+  int exit_code = 1;
+  size_t content_size;
+  void *content = load_file(capture_path, &content_size);
+  if (!content) {
+    goto err;
+  }
+
+  struct capture_replay replay;
+  if (!capture_replay_init(&replay, content, content_size)) {
+    LOG("Couldn't read capture %s", capture_path);
+    goto free_content;
+  }
+  // Up to the last frame by default
+  if (first_frame >= replay.header.frame_count) {
+    LOG("Capture %s has %u frames", capture_path, replay.header.frame_count);
+    goto deinit_replay;
+  }
+  if (frame_count == 0 ||
+      frame_count > replay.header.frame_count - first_frame) {
+    frame_count = replay.header.frame_count - first_frame;
+  }
+
+  if (!windowed) {
+    SDL_SetHint(SDL_HINT_VIDEO_DRIVER, "offscreen");
+  }
+  if (!SDL_Init(SDL_INIT_VIDEO)) {
+    LOG("Couldn't initialize SDL: %s", SDL_GetError());
+    goto deinit_replay;
+  }
+
+  SDL_Window *window = SDL_CreateWindow(
+      "vkguide-replay", (int)replay.header.swapchain_width,
+      (int)replay.header.swapchain_height, SDL_WINDOW_VULKAN);
+  if (!window) {
+    LOG("Couldn't create window: %s", SDL_GetError());
+    goto quit_sdl;
+  }
+
+  // Dynamic resolution stays off, each frame gets the scale it was recorded
+  // with
+  struct vulkan_renderer renderer;
+  if (!vulkan_renderer_init(
+          &renderer, window,
+          &(const struct vulkan_renderer_options){
+              .msaa_sample_count = replay.header.msaa_sample_count,
+              .post_process = replay.header.post_process,
+              .render_scale = replay.header.render_scale,
+              .validation = validation,
+              .occlusion_culling = replay.header.occlusion_culling})) {
+    LOG("Couldn't init vulkan renderer");
+    goto destroy_window;
+  }
+  if (renderer.swapchain_extent.width != replay.header.swapchain_width ||
+      renderer.swapchain_extent.height != replay.header.swapchain_height) {
+    LOG("Replaying at %ux%u, the capture was recorded at %ux%u",
+        renderer.swapchain_extent.width, renderer.swapchain_extent.height,
+        replay.header.swapchain_width, replay.header.swapchain_height);
+  }
+
+  if (!capture_replay_create_resources(&replay, &renderer)) {
+    goto destroy_replay_resources;
+  }
+
+  struct replay_samples samples = {
+      .cpu_ms = malloc(sizeof(double) * frame_count * loop_count),
+      .gpu_ms = malloc(sizeof(double) * frame_count * loop_count),
+      .gpu_sample_counts = calloc(frame_count, sizeof(uint32_t)),
+      .loop_count = loop_count};
+  if (!samples.cpu_ms || !samples.gpu_ms || !samples.gpu_sample_counts) {
+    goto free_samples;
+  }
+  if (!replay_frames(&replay, &renderer, first_frame, frame_count, loop_count,
+                     &samples)) {
+    goto free_samples;
+  }
+
+  FILE *output = output_path ? fopen(output_path, "w") : stdout;
+  if (!output) {
+    LOG("Couldn't open %s", output_path);
+    goto free_samples;
+  }
+  write_json_results(output, &renderer, capture_path, &replay, first_frame,
+                     frame_count, &samples);
+  if (output != stdout) {
+    fclose(output);
+  }
+  exit_code = 0;
+
+free_samples:
+  free(samples.gpu_sample_counts);
+  free(samples.gpu_ms);
+  free(samples.cpu_ms);
+destroy_replay_resources:
+  vkDeviceWaitIdle(renderer.device);
+  capture_replay_destroy_resources(&replay, &renderer);
+  vulkan_renderer_deinit(&renderer);
+destroy_window:
+  SDL_DestroyWindow(window);
+quit_sdl:
+  SDL_Quit();
+deinit_replay:
+  capture_replay_deinit(&replay);
+free_content:
+  free(content);
+err:
+  return exit_code;
+}
@@ -1,3 +1,16 @@
 #!/bin/sh
-glslc triangle.vert -o triangle.vert.spv
-glslc triangle.frag -o triangle.frag.spv
+glslc mesh.vert -o mesh.vert.spv
+glslc -DMESH_DRAW_DATA_UNIFORM_BUFFER mesh.vert -o mesh_uniform.vert.spv
+glslc mesh.frag -o mesh.frag.spv
+glslc meshlet_cull.comp -o meshlet_cull.comp.spv
+glslc -DMESHLET_OCCLUSION_CULLING meshlet_cull.comp -o meshlet_cull_occlusion.comp.spv
+glslc depth_pyramid.comp -o depth_pyramid.comp.spv
+glslc -DDEPTH_PYRAMID_MULTISAMPLED depth_pyramid.comp -o depth_pyramid_multisampled.comp.spv
+glslc sprite.vert -o sprite.vert.spv
+glslc sprite.frag -o sprite.frag.spv
+glslc -DSPRITE_UNTEXTURED sprite.frag -o sprite_untextured.frag.spv
+glslc fullscreen.vert -o fullscreen.vert.spv
+glslc post_process.frag -o post_process.frag.spv
+glslc post_process.comp -o post_process.comp.spv
+glslc --target-env=vulkan1.2 meshlet.task -o meshlet.task.spv
+glslc --target-env=vulkan1.2 meshlet.mesh -o meshlet.mesh.spv
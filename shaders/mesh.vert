@@ -0,0 +1,38 @@
+#version 450
+
+// Quantized vertex, see struct mesh_vertex in src/mesh_format.h
+layout(location = 0) in vec4 in_position;
+layout(location = 1) in vec2 in_normal;
+layout(location = 2) in vec2 in_uv;
+
+// See struct mesh_draw_constants in src/vulkan_renderer.h. Compiled a second
+// time with MESH_DRAW_DATA_UNIFORM_BUFFER for devices whose push constants
+// are too small to hold it.
+#ifdef MESH_DRAW_DATA_UNIFORM_BUFFER
+layout(set = 0, binding = 0) uniform draw_constants {
+#else
+layout(push_constant) uniform draw_constants {
+#endif
+    mat4 model_view_projection;
+    mat4 model;
+    vec4 color;
+    vec4 position_offset;
+    vec4 position_scale;
+} dc;
+
+layout(location = 0) out vec4 frag_color;
+
+vec3 octahedral_decode(vec2 encoded) {
+    vec3 normal = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+    float t = max(-normal.z, 0.0);
+    normal.x += normal.x >= 0.0 ? -t : t;
+    normal.y += normal.y >= 0.0 ? -t : t;
+    return normalize(normal);
+}
+
+void main() {
+    vec3 position = dc.position_offset.xyz + in_position.xyz * dc.position_scale.xyz;
+    gl_Position = dc.model_view_projection * vec4(position, 1.0);
+    vec3 normal = mat3(dc.model) * octahedral_decode(in_normal);
+    frag_color = vec4(normal * 0.5 + 0.5, 1.0) * dc.color;
+}
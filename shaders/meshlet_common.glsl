@@ -0,0 +1,55 @@
+// Shared by the meshlet culling compute shader and the meshlet task/mesh
+// shaders.
+
+// See struct mesh_meshlet in src/mesh_format.h
+struct meshlet {
+    vec4 bounding_sphere;
+    vec4 cone;
+    uint vertex_offset;
+    uint triangle_offset;
+    uint vertex_count;
+    uint triangle_count;
+};
+
+layout(std430, set = 0, binding = 0) readonly buffer meshlet_buffer {
+    meshlet meshlets[];
+};
+
+// See struct meshlet_push_constants in src/meshlet.h
+layout(push_constant) uniform push_constants {
+    mat4 model_view_projection;
+    vec4 position_offset;
+    vec4 position_scale;
+    vec3 camera_position;
+    uint meshlet_count;
+    uint flags;
+} pc;
+
+// See MESHLET_CULL_FLAG_* in src/meshlet.h
+#define MESHLET_CULL_FLAG_LATE 1u
+#define MESHLET_CULL_FLAG_DEPTH_PYRAMID 2u
+
+bool is_sphere_in_frustum(vec3 center, float radius) {
+    // Gribb/Hartmann plane extraction, clip space depth is [0, 1]
+    mat4 m = transpose(pc.model_view_projection);
+    vec4 planes[5] = vec4[5](m[3] + m[0], m[3] - m[0], m[3] + m[1], m[3] - m[1],
+                             m[2]);
+    for (int i = 0; i < 5; i++) {
+        if (dot(planes[i].xyz, center) + planes[i].w < -radius * length(planes[i].xyz)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// The far plane is not tested, the orbit camera keeps the whole mesh in range
+bool is_meshlet_visible(meshlet m) {
+    vec3 center = m.bounding_sphere.xyz;
+    float radius = m.bounding_sphere.w;
+    if (!is_sphere_in_frustum(center, radius)) {
+        return false;
+    }
+
+    vec3 view_vector = center - pc.camera_position;
+    return dot(view_vector, m.cone.xyz) < m.cone.w * length(view_vector) + radius;
+}
@@ -0,0 +1,9 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+#include "post_process_common.glsl"
+
+layout(location = 0) out vec4 out_color;
+
+void main() {
+    out_color = post_process(gl_FragCoord.xy);
+}
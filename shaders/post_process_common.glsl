@@ -0,0 +1,87 @@
+// Shared by the compute and fullscreen post process shaders: tonemapping,
+// FXAA and upscaling of the scene color into the swapchain image.
+
+layout(set = 0, binding = 0) uniform sampler2D scene_color;
+
+// See struct post_process_push_constants in src/post_process.h
+layout(push_constant) uniform push_constants {
+    vec2 output_size;
+    vec2 input_texel_size;
+    vec2 input_uv_scale;
+    vec2 input_uv_max;
+    float exposure;
+    uint flags;
+} pc;
+
+// See POST_PROCESS_FLAG_* in src/post_process.h
+const uint FLAG_FXAA = 1u;
+const uint FLAG_ENCODE_SRGB = 2u;
+
+// Narkowicz's fit of the ACES filmic curve
+vec3 tonemap(vec3 color) {
+    color *= pc.exposure;
+    return clamp((color * (2.51 * color + 0.03)) /
+                 (color * (2.43 * color + 0.59) + 0.14), 0.0, 1.0);
+}
+
+// Bilinear, which upscales when the scene is rendered at a lower resolution.
+// With dynamic resolution only part of the scene color image is up to date,
+// clamping keeps the filter from reading past it.
+vec3 sample_tonemapped(vec2 uv) {
+    uv = clamp(uv, 0.5 * pc.input_texel_size, pc.input_uv_max);
+    return tonemap(textureLod(scene_color, uv, 0.0).rgb);
+}
+
+float luma(vec3 color) {
+    return dot(color, vec3(0.299, 0.587, 0.114));
+}
+
+// Single pass FXAA: blurs along the edge direction estimated from the luma
+// of the four diagonal neighbors, in scene texels
+vec3 fxaa(vec2 uv) {
+    vec2 texel = pc.input_texel_size;
+    vec3 center = sample_tonemapped(uv);
+    float luma_nw = luma(sample_tonemapped(uv + vec2(-0.5, -0.5) * texel));
+    float luma_ne = luma(sample_tonemapped(uv + vec2(0.5, -0.5) * texel));
+    float luma_sw = luma(sample_tonemapped(uv + vec2(-0.5, 0.5) * texel));
+    float luma_se = luma(sample_tonemapped(uv + vec2(0.5, 0.5) * texel));
+    float luma_center = luma(center);
+    float luma_min = min(luma_center,
+                         min(min(luma_nw, luma_ne), min(luma_sw, luma_se)));
+    float luma_max = max(luma_center,
+                         max(max(luma_nw, luma_ne), max(luma_sw, luma_se)));
+    if (luma_max - luma_min < max(0.0312, luma_max * 0.125)) {
+        return center;
+    }
+
+    vec2 direction = vec2(-((luma_nw + luma_ne) - (luma_sw + luma_se)),
+                          (luma_nw + luma_sw) - (luma_ne + luma_se));
+    float direction_reduce =
+        max((luma_nw + luma_ne + luma_sw + luma_se) * 0.03125, 1.0 / 128.0);
+    float inverse_direction_min =
+        1.0 / (min(abs(direction.x), abs(direction.y)) + direction_reduce);
+    direction = clamp(direction * inverse_direction_min, -8.0, 8.0) * texel;
+
+    vec3 color_a = 0.5 * (sample_tonemapped(uv - direction / 6.0) +
+                          sample_tonemapped(uv + direction / 6.0));
+    vec3 color_b = color_a * 0.5 +
+                   0.25 * (sample_tonemapped(uv - direction * 0.5) +
+                           sample_tonemapped(uv + direction * 0.5));
+    float luma_b = luma(color_b);
+    return luma_b < luma_min || luma_b > luma_max ? color_a : color_b;
+}
+
+vec3 linear_to_srgb(vec3 color) {
+    return mix(color * 12.92, 1.055 * pow(color, vec3(1.0 / 2.4)) - 0.055,
+               step(0.0031308, color));
+}
+
+vec4 post_process(vec2 pixel_center) {
+    vec2 uv = pixel_center / pc.output_size * pc.input_uv_scale;
+    vec3 color = (pc.flags & FLAG_FXAA) != 0u ? fxaa(uv)
+                                               : sample_tonemapped(uv);
+    if ((pc.flags & FLAG_ENCODE_SRGB) != 0u) {
+        color = linear_to_srgb(color);
+    }
+    return vec4(color, 1.0);
+}
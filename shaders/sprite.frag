@@ -0,0 +1,19 @@
+#version 450
+
+// Compiled a second time with SPRITE_UNTEXTURED for the sprites without a
+// texture, which then don't need a descriptor set
+layout(location = 0) in vec2 frag_uv;
+layout(location = 1) in vec4 frag_color;
+layout(location = 0) out vec4 out_color;
+
+#ifndef SPRITE_UNTEXTURED
+layout(set = 0, binding = 0) uniform sampler2D sprite_texture;
+#endif
+
+void main() {
+#ifdef SPRITE_UNTEXTURED
+    out_color = frag_color;
+#else
+    out_color = texture(sprite_texture, frag_uv) * frag_color;
+#endif
+}
@@ -0,0 +1,20 @@
+#version 450
+
+// See struct sprite_vertex in src/sprite_batch.h
+layout(location = 0) in vec2 in_position;
+layout(location = 1) in vec2 in_uv;
+layout(location = 2) in vec4 in_color;
+
+// Scale from swapchain pixels to normalized device coordinates
+layout(push_constant) uniform sprite_constants {
+    vec2 pixel_to_ndc;
+} sc;
+
+layout(location = 0) out vec2 frag_uv;
+layout(location = 1) out vec4 frag_color;
+
+void main() {
+    gl_Position = vec4(in_position * sc.pixel_to_ndc - 1.0, 0.0, 1.0);
+    frag_uv = in_uv;
+    frag_color = in_color;
+}
@@ -0,0 +1,81 @@
+#include "arena.h"
+#include "log.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+bool arena_init(struct arena *arena, const char *name, size_t capacity) {
+  assert(arena);
+  assert(capacity > 0);
+  arena->base = malloc(capacity);
+  if (!arena->base) {
+    LOG("Couldn't reserve %zu bytes for arena %s", capacity, name);
+    return false;
+  }
+
+  arena->capacity = capacity;
+  arena->offset = 0;
+  arena->high_water_mark = 0;
+  arena->name = name;
+  return true;
+}
+
+void arena_deinit(struct arena *arena) {
+  assert(arena);
+  free(arena->base);
+  arena->base = NULL;
+  arena->capacity = 0;
+  arena->offset = 0;
+}
+
+void *arena_alloc(struct arena *arena, size_t size, size_t alignment) {
+  assert(arena);
+  assert(alignment > 0 && (alignment & (alignment - 1)) == 0);
+
+  uintptr_t current = (uintptr_t)arena->base + arena->offset;
+  uintptr_t aligned = (current + (alignment - 1)) & ~(uintptr_t)(alignment - 1);
+  size_t aligned_offset = arena->offset + (aligned - current);
+  if (aligned_offset > arena->capacity ||
+      size > arena->capacity - aligned_offset) {
+    LOG("Arena %s exhausted: requested %zu bytes, %zu/%zu used", arena->name,
+        size, arena->offset, arena->capacity);
+    return NULL;
+  }
+
+  arena->offset = aligned_offset + size;
+  if (arena->offset > arena->high_water_mark) {
+    arena->high_water_mark = arena->offset;
+  }
+
+  return (void *)aligned;
+}
+
+void *arena_alloc_zeroed(struct arena *arena, size_t size, size_t alignment) {
+  void *memory = arena_alloc(arena, size, alignment);
+  if (memory) {
+    memset(memory, 0, size);
+  }
+  return memory;
+}
+
+size_t arena_mark(const struct arena *arena) {
+  assert(arena);
+  return arena->offset;
+}
+
+void arena_rewind(struct arena *arena, size_t mark) {
+  assert(arena);
+  assert(mark <= arena->offset);
+  arena->offset = mark;
+}
+
+void arena_reset(struct arena *arena) {
+  assert(arena);
+  arena->offset = 0;
+}
+
+void arena_log_usage(const struct arena *arena) {
+  (void)arena;
+  LOG("Arena %s: high-water mark %zu/%zu bytes", arena->name,
+      arena->high_water_mark, arena->capacity);
+}
@@ -0,0 +1,40 @@
+#ifndef VKGUIDE_ARENA_H
+#define VKGUIDE_ARENA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Linear allocator backed by a single block reserved at init time.
+// Allocations are only released all at once by arena_reset (or partially by
+// rewinding to a previously taken mark), so the hot paths never touch the
+// heap.
+struct arena {
+  uint8_t *base;
+  size_t capacity;
+  size_t offset;
+  size_t high_water_mark;
+  const char *name;
+};
+
+#define ARENA_DEFAULT_ALIGNMENT 16
+
+bool arena_init(struct arena *arena, const char *name, size_t capacity);
+void arena_deinit(struct arena *arena);
+
+// Returns NULL when the arena is exhausted.
+void *arena_alloc(struct arena *arena, size_t size, size_t alignment);
+void *arena_alloc_zeroed(struct arena *arena, size_t size, size_t alignment);
+
+#define ARENA_ALLOC_ARRAY(arena, type, count)                                  \
+  ((type *)arena_alloc((arena), sizeof(type) * (count), _Alignof(type)))
+#define ARENA_ALLOC_ARRAY_ZEROED(arena, type, count)                           \
+  ((type *)arena_alloc_zeroed((arena), sizeof(type) * (count), _Alignof(type)))
+
+size_t arena_mark(const struct arena *arena);
+void arena_rewind(struct arena *arena, size_t mark);
+void arena_reset(struct arena *arena);
+
+void arena_log_usage(const struct arena *arena);
+
+#endif // VKGUIDE_ARENA_H
@@ -0,0 +1,765 @@
+#include "capture.h"
+#include "dynamic_resolution.h"
+#include "log.h"
+#include "mesh.h"
+#include "meshlet.h"
+#include "occlusion.h"
+#include "vulkan_renderer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CAPTURE_INITIAL_FRAME_CAPACITY 4096
+// Frames that can't begin while replaying before the replay gives up
+#define CAPTURE_REPLAY_MAX_BEGIN_ATTEMPT_COUNT 1000
+
+struct capture_begin_frame_payload {
+  float dynamic_resolution_scale;
+  uint32_t occlusion_culling_paused;
+};
+
+struct capture_draw_mesh_payload {
+  uint32_t mesh_id;
+  uint32_t reserved;
+  struct mesh_draw_data draw_data;
+};
+
+struct capture_meshlets_payload {
+  uint32_t mesh_id;
+  float camera_position[3];
+  struct mat4 model_view_projection;
+};
+
+struct capture_upload_payload {
+  uint64_t size;
+};
+
+// Indexed by enum capture_command_type, commands of any other size are
+// rejected by the replay
+static const uint32_t capture_command_payload_sizes[] = {
+    [CAPTURE_COMMAND_BEGIN_FRAME] = sizeof(struct capture_begin_frame_payload),
+    [CAPTURE_COMMAND_END_FRAME] = 0,
+    [CAPTURE_COMMAND_BEGIN_RENDER_PASS] = 0,
+    [CAPTURE_COMMAND_BUILD_DEPTH_PYRAMID] = 0,
+    [CAPTURE_COMMAND_RESUME_RENDER_PASS] = 0,
+    [CAPTURE_COMMAND_END_RENDER_PASS] = 0,
+    [CAPTURE_COMMAND_DRAW_MESH] = sizeof(struct capture_draw_mesh_payload),
+    [CAPTURE_COMMAND_CULL_MESHLETS] = sizeof(struct capture_meshlets_payload),
+    [CAPTURE_COMMAND_DRAW_MESHLETS] = sizeof(struct capture_meshlets_payload),
+    [CAPTURE_COMMAND_CULL_MESHLETS_LATE] =
+        sizeof(struct capture_meshlets_payload),
+    [CAPTURE_COMMAND_DRAW_MESHLETS_LATE] =
+        sizeof(struct capture_meshlets_payload),
+    [CAPTURE_COMMAND_UPLOAD] = sizeof(struct capture_upload_payload)};
+#define CAPTURE_COMMAND_TYPE_END                                               \
+  (sizeof(capture_command_payload_sizes) /                                     \
+   sizeof(capture_command_payload_sizes[0]))
+
+size_t capture_align_section(size_t offset) {
+  return (offset + CAPTURE_FILE_SECTION_ALIGNMENT - 1) &
+         ~(size_t)(CAPTURE_FILE_SECTION_ALIGNMENT - 1);
+}
+
+struct capture_frame *capture_current_frame(struct capture *capture) {
+  return &capture->frames[capture->frame_number % capture->frame_capacity];
+}
+
+// Starts assembling frame_number in place of the oldest frame of the window
+void capture_open_frame(struct capture *capture) {
+  struct capture_frame *frame = capture_current_frame(capture);
+  frame->info = (struct capture_file_frame){.frame_number =
+                                                capture->frame_number};
+}
+
+bool capture_init(struct capture *capture, const char *path,
+                  uint32_t frame_count, float threshold_ms) {
+  *capture = (struct capture){.next_mesh_id = 1};
+  if (!path || path[0] == '\0') {
+    return true;
+  }
+
+  if (strlen(path) >= CAPTURE_MAX_PATH_LENGTH) {
+    LOG("Capture path %s is too long", path);
+    return false;
+  }
+  strcpy(capture->path, path);
+
+  // The GPU time of a frame is known MAX_FRAMES_IN_FLIGHT frames later, the
+  // frame must still be in the window by then
+  capture->frame_capacity =
+      frame_count == 0 ? CAPTURE_DEFAULT_FRAME_COUNT
+      : frame_count <= MAX_FRAMES_IN_FLIGHT ? MAX_FRAMES_IN_FLIGHT + 1
+      : frame_count > CAPTURE_MAX_FRAME_COUNT ? CAPTURE_MAX_FRAME_COUNT
+                                              : frame_count;
+  capture->frames =
+      calloc(capture->frame_capacity, sizeof(struct capture_frame));
+  if (!capture->frames) {
+    LOG("Couldn't allocate capture frames");
+    return false;
+  }
+  capture->threshold_ns =
+      threshold_ms > 0.0f ? (uint64_t)(threshold_ms * 1e6f) : 0;
+  capture->header = (struct capture_file_header){
+      .magic = CAPTURE_FILE_MAGIC,
+      .version = CAPTURE_FILE_VERSION,
+      .threshold_ms = threshold_ms > 0.0f ? threshold_ms : 0.0f};
+  capture_open_frame(capture);
+  capture->enabled = true;
+  LOG("Capturing the last %u frames to %s-*.vkcap", capture->frame_capacity,
+      path);
+  return true;
+}
+
+void capture_deinit(struct capture *capture) {
+  if (capture->frames) {
+    for (uint32_t frame_index = 0; frame_index < capture->frame_capacity;
+         frame_index++) {
+      free(capture->frames[frame_index].commands);
+    }
+  }
+  free(capture->frames);
+  for (uint32_t mesh_index = 0; mesh_index < capture->mesh_count;
+       mesh_index++) {
+    free(capture->meshes[mesh_index].content);
+  }
+  free(capture->meshes);
+  *capture = (struct capture){0};
+}
+
+void capture_request_dump(struct capture *capture) {
+  capture->dump_requested = capture->enabled;
+}
+
+// Recording stops for good when memory runs out, a partial window can't be
+// replayed
+void capture_append(struct capture *capture, enum capture_command_type type,
+                    const void *payload, uint32_t payload_size) {
+  struct capture_frame *frame = capture_current_frame(capture);
+  size_t command_size = frame->info.command_size;
+  size_t required_size =
+      command_size + sizeof(struct capture_file_command) + payload_size;
+  if (required_size > UINT32_MAX) {
+    LOG("Capture frame is too large, capture disabled");
+    capture->enabled = false;
+    return;
+  }
+  if (required_size > frame->command_capacity) {
+    size_t capacity = frame->command_capacity > 0
+                          ? frame->command_capacity
+                          : CAPTURE_INITIAL_FRAME_CAPACITY;
+    while (capacity < required_size) {
+      capacity *= 2;
+    }
+    uint8_t *commands = realloc(frame->commands, capacity);
+    if (!commands) {
+      LOG("Couldn't grow capture frame, capture disabled");
+      capture->enabled = false;
+      return;
+    }
+    frame->commands = commands;
+    frame->command_capacity = capacity;
+  }
+
+  struct capture_file_command command = {.type = type, .size = payload_size};
+  memcpy(frame->commands + command_size, &command, sizeof(command));
+  if (payload_size > 0) {
+    memcpy(frame->commands + command_size + sizeof(command), payload,
+           payload_size);
+  }
+  frame->info.command_size = (uint32_t)required_size;
+}
+
+void capture_check_threshold(struct capture *capture, uint64_t frame_time_ns) {
+  if (capture->threshold_ns > 0 && capture->cooldown_frame_count == 0 &&
+      frame_time_ns > capture->threshold_ns) {
+    capture->dump_requested = true;
+    capture->cooldown_frame_count = capture->frame_capacity;
+  }
+}
+
+void capture_add_mesh(struct capture *capture, struct mesh *mesh,
+                      const void *file_content, size_t file_size) {
+  if (!capture->enabled) {
+    return;
+  }
+
+  if (capture->mesh_count == capture->mesh_capacity) {
+    uint32_t capacity =
+        capture->mesh_capacity > 0 ? capture->mesh_capacity * 2 : 16;
+    struct capture_mesh *meshes =
+        realloc(capture->meshes, sizeof(struct capture_mesh) * capacity);
+    if (!meshes) {
+      LOG("Couldn't grow capture meshes, the mesh won't be captured");
+      return;
+    }
+    capture->meshes = meshes;
+    capture->mesh_capacity = capacity;
+  }
+
+  void *content = malloc(file_size);
+  if (!content) {
+    LOG("Couldn't copy mesh content, the mesh won't be captured");
+    return;
+  }
+  memcpy(content, file_content, file_size);
+  // Ids only grow, which keeps the meshes sorted by id
+  mesh->capture_id = capture->next_mesh_id++;
+  capture->meshes[capture->mesh_count++] = (struct capture_mesh){
+      .id = mesh->capture_id, .content = content, .size = file_size};
+}
+
+void capture_remove_mesh(struct capture *capture, const struct mesh *mesh) {
+  if (!capture->enabled || mesh->capture_id == 0) {
+    return;
+  }
+
+  for (uint32_t mesh_index = 0; mesh_index < capture->mesh_count;
+       mesh_index++) {
+    struct capture_mesh *captured_mesh = &capture->meshes[mesh_index];
+    if (captured_mesh->id == mesh->capture_id) {
+      captured_mesh->destroyed = true;
+      captured_mesh->destroyed_frame_number = capture->frame_number;
+      return;
+    }
+  }
+}
+
+// Frees the destroyed meshes no frame of the window can have drawn
+void capture_purge_meshes(struct capture *capture) {
+  uint64_t oldest_frame_number =
+      capture->frame_number > capture->frame_capacity
+          ? capture->frame_number - capture->frame_capacity
+          : 0;
+  uint32_t kept_mesh_count = 0;
+  for (uint32_t mesh_index = 0; mesh_index < capture->mesh_count;
+       mesh_index++) {
+    struct capture_mesh *captured_mesh = &capture->meshes[mesh_index];
+    if (captured_mesh->destroyed &&
+        captured_mesh->destroyed_frame_number < oldest_frame_number) {
+      free(captured_mesh->content);
+      continue;
+    }
+    capture->meshes[kept_mesh_count++] = *captured_mesh;
+  }
+  capture->mesh_count = kept_mesh_count;
+}
+
+void capture_record_begin_frame(struct capture *capture,
+                                const struct vulkan_renderer *renderer) {
+  if (!capture->enabled) {
+    return;
+  }
+
+  // The previous frame was never submitted, its commands are dropped
+  if (capture->frame_begun) {
+    capture_open_frame(capture);
+  }
+
+  // Harvested for the frame that last used the renderer's frame slot
+  if (renderer->gpu_frame_time_available &&
+      capture->frame_number >= MAX_FRAMES_IN_FLIGHT) {
+    uint64_t timed_frame_number = capture->frame_number - MAX_FRAMES_IN_FLIGHT;
+    struct capture_frame *timed_frame =
+        &capture->frames[timed_frame_number % capture->frame_capacity];
+    if (timed_frame->info.frame_number == timed_frame_number) {
+      timed_frame->info.gpu_frame_time_ns = renderer->gpu_frame_time_ns;
+      timed_frame->info.gpu_frame_time_available = true;
+    }
+    capture_check_threshold(capture, renderer->gpu_frame_time_ns);
+  }
+
+  capture->header.swapchain_width = renderer->swapchain_extent.width;
+  capture->header.swapchain_height = renderer->swapchain_extent.height;
+  capture->header.msaa_sample_count = renderer->msaa_sample_count;
+  capture->header.post_process = renderer->post_process_enabled;
+  capture->header.render_scale = renderer->render_scale;
+  capture->header.occlusion_culling = renderer->occlusion_culling_enabled;
+
+  struct capture_begin_frame_payload payload = {
+      .dynamic_resolution_scale = renderer->dynamic_resolution_scale,
+      .occlusion_culling_paused = renderer->occlusion_culling_paused};
+  capture_append(capture, CAPTURE_COMMAND_BEGIN_FRAME, &payload,
+                 sizeof(payload));
+  capture->frame_begun = true;
+}
+
+void capture_record_command(struct capture *capture,
+                            enum capture_command_type type) {
+  if (!capture->enabled || !capture->frame_begun) {
+    return;
+  }
+  capture_append(capture, type, NULL, 0);
+}
+
+void capture_record_draw_mesh(struct capture *capture, const struct mesh *mesh,
+                              const struct mesh_draw_data *draw_data) {
+  if (!capture->enabled || !capture->frame_begun || mesh->capture_id == 0) {
+    return;
+  }
+  struct capture_draw_mesh_payload payload = {.mesh_id = mesh->capture_id,
+                                              .draw_data = *draw_data};
+  capture_append(capture, CAPTURE_COMMAND_DRAW_MESH, &payload,
+                 sizeof(payload));
+}
+
+void capture_record_meshlets(struct capture *capture,
+                             enum capture_command_type type,
+                             const struct mesh *mesh,
+                             const struct mat4 *model_view_projection,
+                             struct vec3 camera_position) {
+  if (!capture->enabled || !capture->frame_begun || mesh->capture_id == 0) {
+    return;
+  }
+  struct capture_meshlets_payload payload = {
+      .mesh_id = mesh->capture_id,
+      .camera_position = {camera_position.x, camera_position.y,
+                          camera_position.z},
+      .model_view_projection = *model_view_projection};
+  capture_append(capture, type, &payload, sizeof(payload));
+}
+
+void capture_record_upload(struct capture *capture, VkDeviceSize size) {
+  if (!capture->enabled) {
+    return;
+  }
+  struct capture_upload_payload payload = {.size = size};
+  capture_append(capture, CAPTURE_COMMAND_UPLOAD, &payload, sizeof(payload));
+}
+
+bool capture_write(FILE *file, const void *data, size_t size,
+                   uint64_t *offset) {
+  *offset += size;
+  return size == 0 || fwrite(data, 1, size, file) == size;
+}
+
+bool capture_write_padding(FILE *file, uint64_t *offset) {
+  static const uint8_t zeros[CAPTURE_FILE_SECTION_ALIGNMENT] = {0};
+  size_t padding_size = capture_align_section(*offset) - *offset;
+  return capture_write(file, zeros, padding_size, offset);
+}
+
+uint64_t capture_max_upload_size(const struct capture_frame *frame) {
+  uint64_t max_upload_size = 0;
+  size_t command_offset = 0;
+  while (command_offset < frame->info.command_size) {
+    struct capture_file_command command;
+    memcpy(&command, frame->commands + command_offset, sizeof(command));
+    if (command.type == CAPTURE_COMMAND_UPLOAD) {
+      struct capture_upload_payload payload;
+      memcpy(&payload, frame->commands + command_offset + sizeof(command),
+             sizeof(payload));
+      if (payload.size > max_upload_size) {
+        max_upload_size = payload.size;
+      }
+    }
+    command_offset += sizeof(command) + command.size;
+  }
+  return max_upload_size;
+}
+
+// Writes the window, the frames up to frame_number - 1
+void capture_dump(struct capture *capture) {
+  uint32_t frame_count = capture->frame_number < capture->frame_capacity
+                             ? (uint32_t)capture->frame_number
+                             : capture->frame_capacity;
+  uint64_t first_frame_number = capture->frame_number - frame_count;
+  struct capture_file_header header = capture->header;
+  header.mesh_count = capture->mesh_count;
+  header.frame_count = frame_count;
+  for (uint32_t frame_index = 0; frame_index < frame_count; frame_index++) {
+    uint64_t max_upload_size = capture_max_upload_size(
+        &capture->frames[(first_frame_number + frame_index) %
+                         capture->frame_capacity]);
+    if (max_upload_size > header.max_upload_size) {
+      header.max_upload_size = max_upload_size;
+    }
+  }
+
+  char path[CAPTURE_MAX_PATH_LENGTH + 16];
+  snprintf(path, sizeof(path), "%s-%04u.vkcap", capture->path,
+           capture->dump_count++);
+  FILE *file = fopen(path, "wb");
+  if (!file) {
+    LOG("Couldn't open capture file %s", path);
+    return;
+  }
+
+  uint64_t offset = 0;
+  bool written = capture_write(file, &header, sizeof(header), &offset) &&
+                 capture_write_padding(file, &offset);
+  for (uint32_t mesh_index = 0; written && mesh_index < capture->mesh_count;
+       mesh_index++) {
+    const struct capture_mesh *captured_mesh = &capture->meshes[mesh_index];
+    struct capture_file_mesh file_mesh = {.id = captured_mesh->id,
+                                          .size = captured_mesh->size};
+    written = capture_write(file, &file_mesh, sizeof(file_mesh), &offset) &&
+              capture_write(file, captured_mesh->content, captured_mesh->size,
+                            &offset) &&
+              capture_write_padding(file, &offset);
+  }
+  for (uint32_t frame_index = 0; written && frame_index < frame_count;
+       frame_index++) {
+    const struct capture_frame *frame =
+        &capture->frames[(first_frame_number + frame_index) %
+                         capture->frame_capacity];
+    written =
+        capture_write(file, &frame->info, sizeof(frame->info), &offset) &&
+        capture_write(file, frame->commands, frame->info.command_size,
+                      &offset) &&
+        capture_write_padding(file, &offset);
+  }
+  if (fclose(file) != 0 || !written) {
+    LOG("Couldn't write capture file %s", path);
+    return;
+  }
+  LOG("Wrote %u frames and %u meshes to %s (%llu bytes)", frame_count,
+      capture->mesh_count, path, (unsigned long long)offset);
+}
+
+void capture_record_end_frame(struct capture *capture,
+                              uint64_t cpu_frame_time_ns) {
+  if (!capture->enabled || !capture->frame_begun) {
+    return;
+  }
+
+  capture_append(capture, CAPTURE_COMMAND_END_FRAME, NULL, 0);
+  capture_current_frame(capture)->info.cpu_frame_time_ns = cpu_frame_time_ns;
+  capture_check_threshold(capture, cpu_frame_time_ns);
+  capture->frame_begun = false;
+  capture->frame_number++;
+  if (capture->cooldown_frame_count > 0) {
+    capture->cooldown_frame_count--;
+  }
+  capture_purge_meshes(capture);
+
+  // Before the oldest frame is reused for the next one
+  if (capture->enabled && capture->dump_requested) {
+    capture_dump(capture);
+    capture->dump_requested = false;
+  }
+  capture_open_frame(capture);
+}
+
+bool capture_replay_validate_frame(const struct capture_replay *replay,
+                                   const uint8_t *commands,
+                                   uint32_t command_size) {
+  bool begun = false;
+  size_t command_offset = 0;
+  while (command_offset < command_size) {
+    struct capture_file_command command;
+    if (command_size - command_offset < sizeof(command)) {
+      return false;
+    }
+    memcpy(&command, commands + command_offset, sizeof(command));
+    command_offset += sizeof(command);
+    if (command.type == 0 || command.type >= CAPTURE_COMMAND_TYPE_END ||
+        command.size != capture_command_payload_sizes[command.type] ||
+        command_size - command_offset < command.size) {
+      return false;
+    }
+
+    // Only uploads can precede the beginning of the frame, nothing follows
+    // its end
+    if (command.type == CAPTURE_COMMAND_UPLOAD) {
+      struct capture_upload_payload payload;
+      memcpy(&payload, commands + command_offset, sizeof(payload));
+      if (payload.size > replay->header.max_upload_size) {
+        return false;
+      }
+    } else if (command.type == CAPTURE_COMMAND_BEGIN_FRAME) {
+      if (begun) {
+        return false;
+      }
+      begun = true;
+    } else if (!begun) {
+      return false;
+    } else if (command.type == CAPTURE_COMMAND_END_FRAME) {
+      return command_offset + command.size == command_size;
+    }
+    command_offset += command.size;
+  }
+  return false;
+}
+
+bool capture_replay_init(struct capture_replay *replay, const void *content,
+                         size_t size) {
+  *replay = (struct capture_replay){.content = content, .size = size};
+  if (size < sizeof(struct capture_file_header)) {
+    LOG("Capture file is too small");
+    goto err;
+  }
+  memcpy(&replay->header, content, sizeof(replay->header));
+  const struct capture_file_header *header = &replay->header;
+  if (header->magic != CAPTURE_FILE_MAGIC ||
+      header->version != CAPTURE_FILE_VERSION) {
+    LOG("Not a version %u capture file", CAPTURE_FILE_VERSION);
+    goto err;
+  }
+  // Bounds the allocations below by the file size
+  if (header->mesh_count > size / sizeof(struct capture_file_mesh) ||
+      header->frame_count > size / sizeof(struct capture_file_frame)) {
+    LOG("Capture file is truncated");
+    goto err;
+  }
+
+  replay->mesh_offsets = malloc(sizeof(size_t) * (header->mesh_count + 1));
+  replay->mesh_ids = malloc(sizeof(uint32_t) * (header->mesh_count + 1));
+  replay->meshes = calloc(header->mesh_count + 1, sizeof(struct mesh));
+  replay->frame_offsets = malloc(sizeof(size_t) * (header->frame_count + 1));
+  if (!replay->mesh_offsets || !replay->mesh_ids || !replay->meshes ||
+      !replay->frame_offsets) {
+    LOG("Couldn't allocate capture replay");
+    goto free_arrays;
+  }
+
+  size_t offset = capture_align_section(sizeof(struct capture_file_header));
+  for (uint32_t mesh_index = 0; mesh_index < header->mesh_count;
+       mesh_index++) {
+    struct capture_file_mesh file_mesh;
+    if (offset > size || size - offset < sizeof(file_mesh)) {
+      LOG("Capture file is truncated");
+      goto free_arrays;
+    }
+    memcpy(&file_mesh, replay->content + offset, sizeof(file_mesh));
+    if (size - offset - sizeof(file_mesh) < file_mesh.size ||
+        (mesh_index > 0 &&
+         file_mesh.id <= replay->mesh_ids[mesh_index - 1])) {
+      LOG("Capture file mesh %u is invalid", mesh_index);
+      goto free_arrays;
+    }
+    replay->mesh_offsets[mesh_index] = offset;
+    replay->mesh_ids[mesh_index] = file_mesh.id;
+    offset = capture_align_section(offset + sizeof(file_mesh) +
+                                   (size_t)file_mesh.size);
+  }
+
+  for (uint32_t frame_index = 0; frame_index < header->frame_count;
+       frame_index++) {
+    struct capture_file_frame frame;
+    if (offset > size || size - offset < sizeof(frame)) {
+      LOG("Capture file is truncated");
+      goto free_arrays;
+    }
+    memcpy(&frame, replay->content + offset, sizeof(frame));
+    if (size - offset - sizeof(frame) < frame.command_size ||
+        !capture_replay_validate_frame(replay,
+                                       replay->content + offset +
+                                           sizeof(frame),
+                                       frame.command_size)) {
+      LOG("Capture file frame %u is invalid", frame_index);
+      goto free_arrays;
+    }
+    replay->frame_offsets[frame_index] = offset;
+    offset = capture_align_section(offset + sizeof(frame) + frame.command_size);
+  }
+
+  return true;
+free_arrays:
+  free(replay->frame_offsets);
+  free(replay->meshes);
+  free(replay->mesh_ids);
+  free(replay->mesh_offsets);
+  *replay = (struct capture_replay){0};
+err:
+  return false;
+}
+
+bool capture_replay_create_resources(struct capture_replay *replay,
+                                     struct vulkan_renderer *renderer) {
+  for (; replay->created_mesh_count < replay->header.mesh_count;
+       replay->created_mesh_count++) {
+    size_t offset = replay->mesh_offsets[replay->created_mesh_count];
+    struct capture_file_mesh file_mesh;
+    memcpy(&file_mesh, replay->content + offset, sizeof(file_mesh));
+    if (!vulkan_renderer_create_mesh(
+            renderer, replay->content + offset + sizeof(file_mesh),
+            file_mesh.size, &replay->meshes[replay->created_mesh_count])) {
+      LOG("Couldn't create captured mesh %u", file_mesh.id);
+      return false;
+    }
+  }
+
+  if (replay->header.max_upload_size == 0) {
+    return true;
+  }
+  // Only the size of the uploads matters, the source is zeroed once
+  replay->upload_data = calloc(1, replay->header.max_upload_size);
+  if (!replay->upload_data) {
+    LOG("Couldn't allocate capture replay upload data");
+    return false;
+  }
+  if (!vulkan_renderer_create_buffer(
+          renderer, replay->header.max_upload_size,
+          VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+          VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &replay->upload_buffer,
+          &replay->upload_buffer_memory)) {
+    LOG("Couldn't create capture replay upload buffer");
+    return false;
+  }
+  return true;
+}
+
+void capture_replay_destroy_resources(struct capture_replay *replay,
+                                      struct vulkan_renderer *renderer) {
+  vkDestroyBuffer(renderer->device, replay->upload_buffer, NULL);
+  vulkan_renderer_free_memory(renderer, replay->upload_buffer_memory);
+  free(replay->upload_data);
+  for (uint32_t mesh_index = 0; mesh_index < replay->created_mesh_count;
+       mesh_index++) {
+    vulkan_renderer_destroy_mesh(renderer, &replay->meshes[mesh_index]);
+  }
+  replay->upload_buffer = VK_NULL_HANDLE;
+  replay->upload_buffer_memory = VK_NULL_HANDLE;
+  replay->upload_data = NULL;
+  replay->created_mesh_count = 0;
+}
+
+void capture_replay_deinit(struct capture_replay *replay) {
+  free(replay->frame_offsets);
+  free(replay->meshes);
+  free(replay->mesh_ids);
+  free(replay->mesh_offsets);
+  *replay = (struct capture_replay){0};
+}
+
+const struct capture_file_frame *
+capture_replay_frame_info(const struct capture_replay *replay,
+                          uint32_t frame_index) {
+  const uint8_t *frame = replay->content + replay->frame_offsets[frame_index];
+  return (const struct capture_file_frame *)frame;
+}
+
+// NULL for meshes that weren't captured
+const struct mesh *capture_replay_find_mesh(const struct capture_replay *replay,
+                                            uint32_t mesh_id) {
+  uint32_t first = 0;
+  uint32_t last = replay->created_mesh_count;
+  while (first < last) {
+    uint32_t middle = first + (last - first) / 2;
+    if (replay->mesh_ids[middle] < mesh_id) {
+      first = middle + 1;
+    } else {
+      last = middle;
+    }
+  }
+  return first < replay->created_mesh_count &&
+                 replay->mesh_ids[first] == mesh_id
+             ? &replay->meshes[first]
+             : NULL;
+}
+
+bool capture_replay_begin_frame(struct vulkan_renderer *renderer,
+                                const struct capture_begin_frame_payload
+                                    *payload) {
+  renderer->occlusion_culling_paused = payload->occlusion_culling_paused;
+  if (renderer->post_process_enabled) {
+    renderer->dynamic_resolution_scale = payload->dynamic_resolution_scale;
+    vulkan_renderer_update_render_extents(renderer);
+  }
+  for (uint32_t attempt = 0; attempt < CAPTURE_REPLAY_MAX_BEGIN_ATTEMPT_COUNT;
+       attempt++) {
+    if (vulkan_renderer_begin_frame(renderer)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool capture_replay_frame(struct capture_replay *replay,
+                          struct vulkan_renderer *renderer,
+                          uint32_t frame_index) {
+  const struct capture_file_frame *frame =
+      capture_replay_frame_info(replay, frame_index);
+  const uint8_t *commands = (const uint8_t *)(frame + 1);
+  size_t command_offset = 0;
+  while (command_offset < frame->command_size) {
+    struct capture_file_command command;
+    memcpy(&command, commands + command_offset, sizeof(command));
+    const uint8_t *payload_bytes = commands + command_offset + sizeof(command);
+    command_offset += sizeof(command) + command.size;
+
+    union {
+      struct capture_begin_frame_payload begin_frame;
+      struct capture_draw_mesh_payload draw_mesh;
+      struct capture_meshlets_payload meshlets;
+      struct capture_upload_payload upload;
+    } payload;
+    memcpy(&payload, payload_bytes, command.size);
+    const struct capture_meshlets_payload *meshlets = &payload.meshlets;
+    const struct mesh *mesh = NULL;
+    struct vec3 camera_position = {0};
+    if (command.type == CAPTURE_COMMAND_DRAW_MESH) {
+      mesh = capture_replay_find_mesh(replay, payload.draw_mesh.mesh_id);
+    } else if (command.size == sizeof(struct capture_meshlets_payload)) {
+      mesh = capture_replay_find_mesh(replay, meshlets->mesh_id);
+      camera_position = (struct vec3){meshlets->camera_position[0],
+                                      meshlets->camera_position[1],
+                                      meshlets->camera_position[2]};
+    }
+
+    switch (command.type) {
+    case CAPTURE_COMMAND_BEGIN_FRAME:
+      if (!capture_replay_begin_frame(renderer, &payload.begin_frame)) {
+        LOG("Couldn't begin replayed frame %u", frame_index);
+        return false;
+      }
+      break;
+    case CAPTURE_COMMAND_END_FRAME:
+      return vulkan_renderer_end_frame(renderer);
+    case CAPTURE_COMMAND_BEGIN_RENDER_PASS:
+      vulkan_renderer_begin_render_pass(renderer);
+      break;
+    case CAPTURE_COMMAND_BUILD_DEPTH_PYRAMID:
+      vulkan_renderer_build_depth_pyramid(renderer);
+      break;
+    case CAPTURE_COMMAND_RESUME_RENDER_PASS:
+      vulkan_renderer_resume_render_pass(renderer);
+      break;
+    case CAPTURE_COMMAND_END_RENDER_PASS:
+      vulkan_renderer_end_render_pass(renderer);
+      break;
+    case CAPTURE_COMMAND_DRAW_MESH:
+      if (mesh) {
+        vulkan_renderer_draw_mesh(renderer, mesh, &payload.draw_mesh.draw_data);
+      }
+      break;
+    case CAPTURE_COMMAND_CULL_MESHLETS:
+      if (mesh) {
+        vulkan_renderer_cull_meshlets(renderer, mesh,
+                                      &meshlets->model_view_projection,
+                                      camera_position);
+      }
+      break;
+    case CAPTURE_COMMAND_DRAW_MESHLETS:
+      if (mesh) {
+        vulkan_renderer_draw_meshlets(renderer, mesh,
+                                      &meshlets->model_view_projection,
+                                      camera_position);
+      }
+      break;
+    case CAPTURE_COMMAND_CULL_MESHLETS_LATE:
+      if (mesh) {
+        vulkan_renderer_cull_meshlets_late(
+            renderer, mesh, &meshlets->model_view_projection,
+            camera_position);
+      }
+      break;
+    case CAPTURE_COMMAND_DRAW_MESHLETS_LATE:
+      if (mesh) {
+        vulkan_renderer_draw_meshlets_late(
+            renderer, mesh, &meshlets->model_view_projection);
+      }
+      break;
+    case CAPTURE_COMMAND_UPLOAD:
+      if (!vulkan_renderer_upload_to_buffer(renderer, replay->upload_buffer, 0,
+                                            replay->upload_data,
+                                            payload.upload.size)) {
+        LOG("Couldn't replay upload of frame %u", frame_index);
+      }
+      break;
+    }
+  }
+
+  // Validated frames always end with CAPTURE_COMMAND_END_FRAME
+  return false;
+}
@@ -0,0 +1,215 @@
+#ifndef VKGUIDE_CAPTURE_H
+#define VKGUIDE_CAPTURE_H
+
+#include "transform.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <vulkan/vulkan.h>
+
+#define CAPTURE_DEFAULT_FRAME_COUNT 60
+#define CAPTURE_MAX_FRAME_COUNT 1024
+#define CAPTURE_MAX_PATH_LENGTH 256
+
+struct mesh;
+struct mesh_draw_data;
+struct vulkan_renderer;
+
+// A .vkcap file is a header, the meshes the frames use, then the frames
+// oldest first. Fields are little-endian, every section starts at a multiple
+// of CAPTURE_FILE_SECTION_ALIGNMENT so that the meshes can be created in
+// place.
+#define CAPTURE_FILE_MAGIC 0x50414356u // "VCAP"
+#define CAPTURE_FILE_VERSION 1u
+#define CAPTURE_FILE_SECTION_ALIGNMENT 16u
+
+struct capture_file_header {
+  uint32_t magic;
+  uint32_t version;
+  // State of the renderer the frames were recorded with
+  uint32_t swapchain_width;
+  uint32_t swapchain_height;
+  uint32_t msaa_sample_count;
+  uint32_t post_process;
+  float render_scale;
+  uint32_t occlusion_culling;
+  uint32_t mesh_count;
+  uint32_t frame_count;
+  // Largest upload of the frames, see CAPTURE_COMMAND_UPLOAD
+  uint64_t max_upload_size;
+  // 0 for dumps made on request
+  float threshold_ms;
+  uint32_t reserved;
+};
+_Static_assert(sizeof(struct capture_file_header) == 56,
+               "capture_file_header layout must not change silently");
+
+// Followed by the content of the .vkm file the mesh was created from
+struct capture_file_mesh {
+  uint32_t id;
+  uint32_t reserved;
+  uint64_t size;
+};
+
+// Followed by the frame's commands
+struct capture_file_frame {
+  uint64_t frame_number;
+  uint64_t cpu_frame_time_ns;
+  uint64_t gpu_frame_time_ns;
+  uint32_t gpu_frame_time_available;
+  uint32_t command_size;
+};
+
+// Each command is a struct capture_file_command followed by `size` bytes of
+// payload, one per call of the renderer API
+enum capture_command_type {
+  // Dynamic resolution scale and occlusion culling pause of the frame
+  CAPTURE_COMMAND_BEGIN_FRAME = 1,
+  CAPTURE_COMMAND_END_FRAME,
+  CAPTURE_COMMAND_BEGIN_RENDER_PASS,
+  CAPTURE_COMMAND_BUILD_DEPTH_PYRAMID,
+  CAPTURE_COMMAND_RESUME_RENDER_PASS,
+  CAPTURE_COMMAND_END_RENDER_PASS,
+  CAPTURE_COMMAND_DRAW_MESH,
+  CAPTURE_COMMAND_CULL_MESHLETS,
+  CAPTURE_COMMAND_DRAW_MESHLETS,
+  CAPTURE_COMMAND_CULL_MESHLETS_LATE,
+  CAPTURE_COMMAND_DRAW_MESHLETS_LATE,
+  // Only the size is kept, the replay uploads as many bytes into a scratch
+  // buffer. Recorded between frames too, e.g. while creating a mesh. The
+  // texture pool's streamed levels are recorded the same way, but neither
+  // the images they are copied into nor the blits generating the missing
+  // levels are replayed.
+  CAPTURE_COMMAND_UPLOAD
+};
+
+struct capture_file_command {
+  uint32_t type;
+  uint32_t size;
+};
+
+// Frame being assembled, or one of the last recorded frames
+struct capture_frame {
+  struct capture_file_frame info;
+  uint8_t *commands;
+  size_t command_capacity;
+};
+
+// Copy of the content of a mesh created while capturing. Destroyed meshes
+// are kept until the last frame that may have drawn them leaves the window.
+struct capture_mesh {
+  uint32_t id;
+  void *content;
+  size_t size;
+  bool destroyed;
+  uint64_t destroyed_frame_number;
+};
+
+// Records the renderer's draw and upload calls into a rolling window of the
+// last frame_capacity frames, dumped to `<path>-<index>.vkcap` on request or
+// once a frame's CPU or GPU time exceeds the threshold. Recording appends a
+// few bytes per call into buffers that stop growing once the window is full.
+// The dump itself blocks the frame it is written in, and is followed by at
+// least a window of frames before the threshold triggers another one.
+//
+// Only the calls going through the renderer are recorded: draws made with
+// vulkan_renderer_bind_mesh and raw Vulkan commands (pipelines created by the
+// application, sprite batches, draw lists) are not replayed.
+struct capture {
+  bool enabled;
+  char path[CAPTURE_MAX_PATH_LENGTH];
+  uint64_t threshold_ns;
+  struct capture_file_header header;
+  uint32_t dump_count;
+  bool dump_requested;
+  // Frames recorded before another threshold dump can be made
+  uint32_t cooldown_frame_count;
+
+  struct capture_frame *frames;
+  uint32_t frame_capacity;
+  // Of the frame being assembled, frames[frame_number % frame_capacity]
+  uint64_t frame_number;
+  bool frame_begun;
+
+  struct capture_mesh *meshes;
+  uint32_t mesh_count;
+  uint32_t mesh_capacity;
+  uint32_t next_mesh_id;
+};
+
+// `path` NULL or empty leaves capture disabled, every other call is then a
+// no-op. A frame count of 0 means CAPTURE_DEFAULT_FRAME_COUNT, a threshold
+// of 0 only dumps on request.
+bool capture_init(struct capture *capture, const char *path,
+                  uint32_t frame_count, float threshold_ms);
+void capture_deinit(struct capture *capture);
+
+// Dumps the window once the frame being recorded has ended
+void capture_request_dump(struct capture *capture);
+
+// Called by the renderer modules
+void capture_add_mesh(struct capture *capture, struct mesh *mesh,
+                      const void *file_content, size_t file_size);
+void capture_remove_mesh(struct capture *capture, const struct mesh *mesh);
+// Once vulkan_renderer_begin_frame succeeded, also attributes the GPU time
+// it harvested
+void capture_record_begin_frame(struct capture *capture,
+                                const struct vulkan_renderer *renderer);
+// Once the frame has been submitted, may dump the window
+void capture_record_end_frame(struct capture *capture,
+                              uint64_t cpu_frame_time_ns);
+// Commands without payload
+void capture_record_command(struct capture *capture,
+                            enum capture_command_type type);
+void capture_record_draw_mesh(struct capture *capture, const struct mesh *mesh,
+                              const struct mesh_draw_data *draw_data);
+// CULL_MESHLETS, DRAW_MESHLETS, CULL_MESHLETS_LATE or DRAW_MESHLETS_LATE
+void capture_record_meshlets(struct capture *capture,
+                             enum capture_command_type type,
+                             const struct mesh *mesh,
+                             const struct mat4 *model_view_projection,
+                             struct vec3 camera_position);
+void capture_record_upload(struct capture *capture, VkDeviceSize size);
+
+// Replays a .vkcap file through the renderer API it was recorded from. The
+// renderer should be created with the options of the header and a swapchain
+// of the recorded size, dynamic resolution disabled: the recorded scale of
+// each frame is applied instead.
+struct capture_replay {
+  const uint8_t *content;
+  size_t size;
+  struct capture_file_header header;
+  // Of each frame's struct capture_file_frame and each mesh's struct
+  // capture_file_mesh in `content`
+  size_t *frame_offsets;
+  size_t *mesh_offsets;
+  // Ascending
+  uint32_t *mesh_ids;
+  struct mesh *meshes;
+  uint32_t created_mesh_count;
+  VkBuffer upload_buffer;
+  VkDeviceMemory upload_buffer_memory;
+  void *upload_data;
+};
+
+// Validates `content`, which must stay alive until capture_replay_deinit
+bool capture_replay_init(struct capture_replay *replay, const void *content,
+                         size_t size);
+// Creates the meshes and the upload scratch buffer
+bool capture_replay_create_resources(struct capture_replay *replay,
+                                     struct vulkan_renderer *renderer);
+// Also after capture_replay_create_resources failed. The device must be idle.
+void capture_replay_destroy_resources(struct capture_replay *replay,
+                                      struct vulkan_renderer *renderer);
+void capture_replay_deinit(struct capture_replay *replay);
+
+const struct capture_file_frame *
+capture_replay_frame_info(const struct capture_replay *replay,
+                          uint32_t frame_index);
+// Runs the commands of a frame, from its uploads to vulkan_renderer_end_frame.
+// Returns false when the frame couldn't begin or be submitted.
+bool capture_replay_frame(struct capture_replay *replay,
+                          struct vulkan_renderer *renderer,
+                          uint32_t frame_index);
+
+#endif // VKGUIDE_CAPTURE_H
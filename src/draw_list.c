@@ -0,0 +1,256 @@
+#include "draw_list.h"
+#include "log.h"
+#include "mesh.h"
+#include "radix_sort.h"
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Front-to-back key, from the most significant bits: pass, pipeline, mesh,
+// depth, draw index
+#define DRAW_LIST_DEPTH_SHIFT DRAW_LIST_INDEX_BITS
+#define DRAW_LIST_MESH_SHIFT (DRAW_LIST_DEPTH_SHIFT + DRAW_LIST_DEPTH_BITS)
+#define DRAW_LIST_PIPELINE_SHIFT (DRAW_LIST_MESH_SHIFT + DRAW_LIST_MESH_BITS)
+#define DRAW_LIST_PASS_SHIFT                                                   \
+  (DRAW_LIST_PIPELINE_SHIFT + DRAW_LIST_PIPELINE_BITS)
+// Back-to-front key: pass, inverted depth, pipeline, mesh, draw index
+#define DRAW_LIST_BACK_TO_FRONT_MESH_SHIFT DRAW_LIST_INDEX_BITS
+#define DRAW_LIST_BACK_TO_FRONT_PIPELINE_SHIFT                                 \
+  (DRAW_LIST_BACK_TO_FRONT_MESH_SHIFT + DRAW_LIST_MESH_BITS)
+#define DRAW_LIST_BACK_TO_FRONT_DEPTH_SHIFT                                    \
+  (DRAW_LIST_BACK_TO_FRONT_PIPELINE_SHIFT + DRAW_LIST_PIPELINE_BITS)
+#define DRAW_LIST_INDEX_MASK ((1u << DRAW_LIST_INDEX_BITS) - 1)
+#define DRAW_LIST_DEPTH_MASK ((1u << DRAW_LIST_DEPTH_BITS) - 1)
+_Static_assert(DRAW_LIST_PASS_SHIFT + DRAW_LIST_PASS_BITS == 64,
+               "the sort key fields must fill 64 bits");
+_Static_assert(DRAW_LIST_INDEX_BITS % 8 == 0,
+               "the payload must end on a byte for radix_sort_u64");
+
+bool draw_list_handle_table_init(struct draw_list_handle_table *table,
+                                 uint32_t max_count) {
+  // Power of two, at most half full
+  *table = (struct draw_list_handle_table){.capacity = max_count * 2,
+                                           .generation = 1,
+                                           .max_count = max_count};
+  table->handles = malloc(sizeof(uint64_t) * table->capacity);
+  table->generations = calloc(table->capacity, sizeof(uint32_t));
+  table->ids = malloc(sizeof(uint16_t) * table->capacity);
+  if (!table->handles || !table->generations || !table->ids) {
+    free(table->ids);
+    free(table->generations);
+    free(table->handles);
+    return false;
+  }
+  return true;
+}
+
+void draw_list_handle_table_deinit(struct draw_list_handle_table *table) {
+  free(table->ids);
+  free(table->generations);
+  free(table->handles);
+}
+
+void draw_list_handle_table_reset(struct draw_list_handle_table *table) {
+  table->count = 0;
+  table->generation++;
+  if (table->generation == 0) {
+    memset(table->generations, 0, sizeof(uint32_t) * table->capacity);
+    table->generation = 1;
+  }
+}
+
+// Returns false when the table already holds max_count handles
+bool draw_list_handle_table_intern(struct draw_list_handle_table *table,
+                                   uint64_t handle, uint32_t *out_id) {
+  // Fibonacci hashing, pointers and handles are aligned
+  uint32_t slot = (uint32_t)((handle * 0x9e3779b97f4a7c15ull) >> 32) &
+                  (table->capacity - 1);
+  while (table->generations[slot] == table->generation) {
+    if (table->handles[slot] == handle) {
+      *out_id = table->ids[slot];
+      return true;
+    }
+    slot = (slot + 1) & (table->capacity - 1);
+  }
+
+  if (table->count == table->max_count) {
+    return false;
+  }
+  table->generations[slot] = table->generation;
+  table->handles[slot] = handle;
+  table->ids[slot] = (uint16_t)table->count;
+  *out_id = table->count++;
+  return true;
+}
+
+bool draw_list_init(struct draw_list *list, uint32_t capacity) {
+  assert(capacity <= DRAW_LIST_MAX_CAPACITY);
+  *list = (struct draw_list){.capacity = capacity};
+  list->draws = malloc(sizeof(struct draw_list_draw) * capacity);
+  list->draw_states = malloc(sizeof(uint32_t) * capacity);
+  list->sort_keys = malloc(sizeof(uint64_t) * capacity);
+  if (!list->draws || !list->draw_states || !list->sort_keys) {
+    LOG("Couldn't allocate the draw list arrays");
+    goto free_arrays;
+  }
+
+  if (!draw_list_handle_table_init(&list->pipeline_ids,
+                                   DRAW_LIST_MAX_PIPELINE_COUNT)) {
+    goto free_arrays;
+  }
+  if (!draw_list_handle_table_init(&list->mesh_ids,
+                                   DRAW_LIST_MAX_MESH_COUNT)) {
+    goto deinit_pipeline_ids;
+  }
+  return true;
+
+deinit_pipeline_ids:
+  draw_list_handle_table_deinit(&list->pipeline_ids);
+free_arrays:
+  free(list->sort_keys);
+  free(list->draw_states);
+  free(list->draws);
+  return false;
+}
+
+void draw_list_deinit(struct draw_list *list) {
+  draw_list_handle_table_deinit(&list->mesh_ids);
+  draw_list_handle_table_deinit(&list->pipeline_ids);
+  free(list->sort_keys);
+  free(list->draw_states);
+  free(list->draws);
+}
+
+void draw_list_reset(struct draw_list *list) {
+  list->draw_count = 0;
+  list->sorted_keys = NULL;
+  list->stats = (struct draw_list_stats){0};
+  draw_list_handle_table_reset(&list->pipeline_ids);
+  draw_list_handle_table_reset(&list->mesh_ids);
+}
+
+// Non-negative floats order like their bit patterns, the top bits keep the
+// exponent and the leading mantissa bits
+uint64_t draw_list_depth_bits(float depth) {
+  if (!(depth > 0.0f)) {
+    return 0;
+  }
+  uint32_t bits;
+  memcpy(&bits, &depth, sizeof(bits));
+  return bits >> (32 - DRAW_LIST_DEPTH_BITS);
+}
+
+bool draw_list_add(struct draw_list *list, const struct draw_list_draw *draw) {
+  assert(draw->pass < DRAW_LIST_MAX_PASS_COUNT);
+  if (list->draw_count == list->capacity) {
+    list->stats.dropped_draw_count++;
+    return false;
+  }
+
+  // Non-dispatchable handles are pointers or 64-bit integers
+  uint64_t pipeline_handle = 0;
+  memcpy(&pipeline_handle, &draw->pipeline, sizeof(draw->pipeline));
+  uint32_t pipeline_id;
+  uint32_t mesh_id;
+  if (!draw_list_handle_table_intern(&list->pipeline_ids, pipeline_handle,
+                                     &pipeline_id) ||
+      !draw_list_handle_table_intern(&list->mesh_ids,
+                                     (uint64_t)(uintptr_t)draw->mesh,
+                                     &mesh_id)) {
+    if (list->stats.dropped_draw_count == 0) {
+      LOG("Too many distinct pipelines or meshes, dropping draws");
+    }
+    list->stats.dropped_draw_count++;
+    return false;
+  }
+
+  uint64_t depth = draw_list_depth_bits(draw->depth);
+  uint64_t key = (uint64_t)draw->pass << DRAW_LIST_PASS_SHIFT;
+  if (draw->back_to_front) {
+    key |= (DRAW_LIST_DEPTH_MASK - depth)
+               << DRAW_LIST_BACK_TO_FRONT_DEPTH_SHIFT |
+           (uint64_t)pipeline_id << DRAW_LIST_BACK_TO_FRONT_PIPELINE_SHIFT |
+           (uint64_t)mesh_id << DRAW_LIST_BACK_TO_FRONT_MESH_SHIFT;
+  } else {
+    key |= (uint64_t)pipeline_id << DRAW_LIST_PIPELINE_SHIFT |
+           (uint64_t)mesh_id << DRAW_LIST_MESH_SHIFT |
+           depth << DRAW_LIST_DEPTH_SHIFT;
+  }
+  list->sort_keys[list->draw_count] = key | list->draw_count;
+  list->draw_states[list->draw_count] = pipeline_id << 16 | mesh_id;
+  list->draws[list->draw_count++] = *draw;
+  return true;
+}
+
+void draw_list_sort(struct draw_list *list, struct arena *scratch_arena) {
+  uint64_t *sort_scratch =
+      ARENA_ALLOC_ARRAY(scratch_arena, uint64_t, list->draw_count);
+  // The keys hold the draw indices, unsorted they are the submission order
+  list->sorted_keys = list->sort_keys;
+  list->stats.unsorted_draw_count = 0;
+  if (sort_scratch) {
+    list->sorted_keys = radix_sort_u64(list->sort_keys, sort_scratch,
+                                       list->draw_count, DRAW_LIST_INDEX_BITS);
+  } else {
+    LOG("No room for the sort scratch, recording %u draws unsorted",
+        list->draw_count);
+    list->stats.unsorted_draw_count = list->draw_count;
+  }
+
+  uint32_t pipeline_bind_count = 0;
+  uint32_t mesh_bind_count = 0;
+  uint32_t bound_state = UINT32_MAX;
+  for (uint32_t key_index = 0; key_index < list->draw_count; key_index++) {
+    uint32_t state =
+        list->draw_states[list->sorted_keys[key_index] & DRAW_LIST_INDEX_MASK];
+    if (state >> 16 != bound_state >> 16) {
+      pipeline_bind_count++;
+    }
+    if ((state & 0xffff) != (bound_state & 0xffff)) {
+      mesh_bind_count++;
+    }
+    bound_state = state;
+  }
+
+  list->stats.draw_count = list->draw_count;
+  list->stats.pipeline_bind_count = pipeline_bind_count;
+  list->stats.mesh_bind_count = mesh_bind_count;
+  list->stats.redundant_pipeline_bind_count =
+      list->draw_count - pipeline_bind_count;
+  list->stats.redundant_mesh_bind_count = list->draw_count - mesh_bind_count;
+}
+
+void draw_list_record(struct draw_list *list,
+                      struct vulkan_renderer *renderer) {
+  draw_list_sort(list, &renderer->frame_arena);
+
+  VkCommandBuffer command_buffer =
+      renderer->frames[renderer->current_frame].command_buffer;
+  VkPipeline bound_pipeline = VK_NULL_HANDLE;
+  const struct mesh *bound_mesh = NULL;
+  for (uint32_t key_index = 0; key_index < list->draw_count; key_index++) {
+    const struct draw_list_draw *draw =
+        &list->draws[list->sorted_keys[key_index] & DRAW_LIST_INDEX_MASK];
+    if (draw->pipeline != bound_pipeline) {
+      vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                        draw->pipeline);
+      renderer->frame_counters.pipeline_bind_count++;
+      bound_pipeline = draw->pipeline;
+    }
+    if (draw->mesh != bound_mesh) {
+      vulkan_renderer_bind_mesh_buffers(renderer, draw->mesh);
+      bound_mesh = draw->mesh;
+    }
+
+    // The mesh pipelines share their layout, the draw data set or push
+    // constants survive the pipeline binds
+    if (!vulkan_renderer_set_mesh_draw_data(renderer, draw->mesh,
+                                            &draw->draw_data)) {
+      list->stats.dropped_draw_count += list->draw_count - key_index;
+      break;
+    }
+    vkCmdDrawIndexed(command_buffer, draw->mesh->index_count, 1, 0, 0, 0);
+    renderer->frame_counters.draw_call_count++;
+  }
+}
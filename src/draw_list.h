@@ -0,0 +1,106 @@
+#ifndef VKGUIDE_DRAW_LIST_H
+#define VKGUIDE_DRAW_LIST_H
+
+#include "vulkan_renderer.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <vulkan/vulkan.h>
+
+// Bits of the sort key given to each field. The draw index is the payload
+// below DRAW_LIST_INDEX_BITS, the distinct pipelines and meshes of a frame
+// are numbered in the order they are first added.
+#define DRAW_LIST_PASS_BITS 4
+#define DRAW_LIST_PIPELINE_BITS 8
+#define DRAW_LIST_MESH_BITS 12
+#define DRAW_LIST_DEPTH_BITS 16
+#define DRAW_LIST_INDEX_BITS 24
+#define DRAW_LIST_MAX_PASS_COUNT (1u << DRAW_LIST_PASS_BITS)
+#define DRAW_LIST_MAX_PIPELINE_COUNT (1u << DRAW_LIST_PIPELINE_BITS)
+#define DRAW_LIST_MAX_MESH_COUNT (1u << DRAW_LIST_MESH_BITS)
+#define DRAW_LIST_MAX_CAPACITY (1u << DRAW_LIST_INDEX_BITS)
+
+struct mesh;
+
+struct draw_list_draw {
+  // Passes are recorded in increasing order, e.g. opaque then blended
+  uint32_t pass;
+  // renderer->pipeline or one created with
+  // vulkan_renderer_create_mesh_pipeline
+  VkPipeline pipeline;
+  const struct mesh *mesh;
+  // Distance to the camera, negative distances are clamped to 0
+  float depth;
+  // Within a pass, draws are grouped by pipeline then mesh and drawn front to
+  // back inside a group. Back-to-front draws are sorted by depth only, as
+  // blending needs; it must be the same for every draw of a pass.
+  bool back_to_front;
+  struct mesh_draw_data draw_data;
+};
+
+// Of the draws added since the last draw_list_reset
+struct draw_list_stats {
+  uint32_t draw_count;
+  uint32_t pipeline_bind_count;
+  uint32_t mesh_bind_count;
+  // Binds skipped because the state was already bound, i.e. the binds a
+  // submission binding the pipeline and mesh of every draw would add
+  uint32_t redundant_pipeline_bind_count;
+  uint32_t redundant_mesh_bind_count;
+  // Past the capacity or the pipeline/mesh count limits, or drawn after the
+  // draw data ring filled up
+  uint32_t dropped_draw_count;
+  // Recorded in submission order, without bind deduplication, because the
+  // sort scratch didn't fit in the arena
+  uint32_t unsorted_draw_count;
+};
+
+// Handle to frame-local id, open addressing. A slot is empty unless its
+// generation is the table's, resetting the table is then O(1).
+struct draw_list_handle_table {
+  uint64_t *handles;
+  uint32_t *generations;
+  uint16_t *ids;
+  uint32_t capacity;
+  uint32_t generation;
+  uint32_t count;
+  uint32_t max_count;
+};
+
+// Collects the draws of a frame and records them sorted by a 64-bit key
+// (pass, pipeline, mesh, depth), binding pipelines and mesh buffers only when
+// they change between consecutive draws.
+struct draw_list {
+  struct draw_list_draw *draws;
+  uint32_t capacity;
+  uint32_t draw_count;
+  // Pipeline id << 16 | mesh id of each draw, lets draw_list_sort count the
+  // binds without reading the draws
+  uint32_t *draw_states;
+  uint64_t *sort_keys;
+  // Set by draw_list_sort, either sort_keys or its scratch
+  const uint64_t *sorted_keys;
+  struct draw_list_handle_table pipeline_ids;
+  struct draw_list_handle_table mesh_ids;
+  struct draw_list_stats stats;
+};
+
+// `capacity` is at most DRAW_LIST_MAX_CAPACITY
+bool draw_list_init(struct draw_list *list, uint32_t capacity);
+void draw_list_deinit(struct draw_list *list);
+
+// Forgets the draws, typically once per frame
+void draw_list_reset(struct draw_list *list);
+// Returns false when the draw is dropped
+bool draw_list_add(struct draw_list *list, const struct draw_list_draw *draw);
+// Sorts the draws and counts the binds recording them needs. Doesn't touch
+// Vulkan, draw_list_record calls it. The sort scratch is allocated from
+// `scratch_arena` and must outlive the use of sorted_keys. The draws keep
+// their submission order when the arena is exhausted.
+void draw_list_sort(struct draw_list *list, struct arena *scratch_arena);
+// Sorts then records the draws, inside the scene render pass, with the sort
+// scratch in the renderer's frame arena. The draws stay in the list until
+// draw_list_reset.
+void draw_list_record(struct draw_list *list,
+                      struct vulkan_renderer *renderer);
+
+#endif // VKGUIDE_DRAW_LIST_H
@@ -0,0 +1,112 @@
+#include "dynamic_resolution.h"
+#include "log.h"
+#include <math.h>
+
+// GPU times are averaged over this many frames between two adjustments
+#define DYNAMIC_RESOLUTION_INTERVAL_FRAME_COUNT 8
+// The controller aims below the budget so that noise doesn't push frames over
+#define DYNAMIC_RESOLUTION_TARGET_FRACTION 0.9f
+// The scale only grows back when the GPU time is under this fraction of the
+// budget, avoids oscillating around the target
+#define DYNAMIC_RESOLUTION_GROW_FRACTION 0.75f
+// Largest relative change of the scale per adjustment
+#define DYNAMIC_RESOLUTION_MAX_STEP 0.1f
+// Scales are snapped to multiples of this
+#define DYNAMIC_RESOLUTION_SCALE_QUANTUM (1.0f / 32.0f)
+#define DYNAMIC_RESOLUTION_SCALE_MIN 0.5f
+
+static VkExtent2D scale_extent(VkExtent2D extent, float scale) {
+  VkExtent2D scaled_extent = {
+      (uint32_t)((float)extent.width * scale + 0.5f),
+      (uint32_t)((float)extent.height * scale + 0.5f)};
+  if (scaled_extent.width == 0) {
+    scaled_extent.width = 1;
+  }
+  if (scaled_extent.height == 0) {
+    scaled_extent.height = 1;
+  }
+  return scaled_extent;
+}
+
+void vulkan_renderer_update_render_extents(struct vulkan_renderer *renderer) {
+  if (!renderer->post_process_enabled) {
+    renderer->render_target_extent = renderer->swapchain_extent;
+    renderer->render_extent = renderer->swapchain_extent;
+    return;
+  }
+
+  renderer->render_target_extent =
+      scale_extent(renderer->swapchain_extent, renderer->render_scale);
+  renderer->render_extent = scale_extent(renderer->swapchain_extent,
+                                         renderer->dynamic_resolution_scale);
+  if (renderer->render_extent.width > renderer->render_target_extent.width) {
+    renderer->render_extent.width = renderer->render_target_extent.width;
+  }
+  if (renderer->render_extent.height > renderer->render_target_extent.height) {
+    renderer->render_extent.height = renderer->render_target_extent.height;
+  }
+}
+
+void vulkan_renderer_update_dynamic_resolution(
+    struct vulkan_renderer *renderer) {
+  if (renderer->dynamic_resolution_budget_ms <= 0.0f ||
+      !renderer->gpu_frame_time_available) {
+    return;
+  }
+
+  // Frames recorded before the last adjustment are still being harvested
+  if (renderer->dynamic_resolution_settle_frame_count > 0) {
+    renderer->dynamic_resolution_settle_frame_count--;
+    return;
+  }
+
+  renderer->dynamic_resolution_gpu_time_sum_ns += renderer->gpu_frame_time_ns;
+  renderer->dynamic_resolution_sample_count++;
+  if (renderer->dynamic_resolution_sample_count <
+      DYNAMIC_RESOLUTION_INTERVAL_FRAME_COUNT) {
+    return;
+  }
+
+  float average_ns = (float)renderer->dynamic_resolution_gpu_time_sum_ns /
+                     (float)renderer->dynamic_resolution_sample_count;
+  renderer->dynamic_resolution_gpu_time_sum_ns = 0;
+  renderer->dynamic_resolution_sample_count = 0;
+
+  float budget_ns = renderer->dynamic_resolution_budget_ms * 1e6f;
+  if (average_ns <= budget_ns &&
+      average_ns >= budget_ns * DYNAMIC_RESOLUTION_GROW_FRACTION) {
+    return;
+  }
+
+  // The GPU time is dominated by per-pixel work, which grows with the square
+  // of the scale
+  float ratio =
+      sqrtf(budget_ns * DYNAMIC_RESOLUTION_TARGET_FRACTION / average_ns);
+  if (ratio < 1.0f - DYNAMIC_RESOLUTION_MAX_STEP) {
+    ratio = 1.0f - DYNAMIC_RESOLUTION_MAX_STEP;
+  } else if (ratio > 1.0f + DYNAMIC_RESOLUTION_MAX_STEP) {
+    ratio = 1.0f + DYNAMIC_RESOLUTION_MAX_STEP;
+  }
+
+  float scale_min = renderer->render_scale < DYNAMIC_RESOLUTION_SCALE_MIN
+                        ? renderer->render_scale
+                        : DYNAMIC_RESOLUTION_SCALE_MIN;
+  float scale = roundf(renderer->dynamic_resolution_scale * ratio /
+                       DYNAMIC_RESOLUTION_SCALE_QUANTUM) *
+                DYNAMIC_RESOLUTION_SCALE_QUANTUM;
+  if (scale < scale_min) {
+    scale = scale_min;
+  } else if (scale > renderer->render_scale) {
+    scale = renderer->render_scale;
+  }
+  if (scale == renderer->dynamic_resolution_scale) {
+    return;
+  }
+
+  LOG("Dynamic resolution scale %.3f -> %.3f (GPU %.2f ms, budget %.2f ms)",
+      renderer->dynamic_resolution_scale, scale, average_ns / 1e6f,
+      renderer->dynamic_resolution_budget_ms);
+  renderer->dynamic_resolution_scale = scale;
+  renderer->dynamic_resolution_settle_frame_count = MAX_FRAMES_IN_FLIGHT;
+  vulkan_renderer_update_render_extents(renderer);
+}
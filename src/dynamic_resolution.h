@@ -0,0 +1,17 @@
+#ifndef VKGUIDE_DYNAMIC_RESOLUTION_H
+#define VKGUIDE_DYNAMIC_RESOLUTION_H
+
+#include "vulkan_renderer.h"
+
+// Sets render_target_extent from render_scale and render_extent from
+// dynamic_resolution_scale, must be called whenever swapchain_extent changes
+void vulkan_renderer_update_render_extents(struct vulkan_renderer *renderer);
+
+// Feeds the GPU frame time harvested by vulkan_renderer_begin_frame to the
+// controller, which adjusts render_extent every few frames to keep the GPU
+// time under dynamic_resolution_budget_ms. Does nothing unless dynamic
+// resolution is enabled.
+void vulkan_renderer_update_dynamic_resolution(
+    struct vulkan_renderer *renderer);
+
+#endif // VKGUIDE_DYNAMIC_RESOLUTION_H
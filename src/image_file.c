@@ -0,0 +1,242 @@
+#include "image_file.h"
+#include "log.h"
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+// Largest payload of a stored deflate block
+#define DEFLATE_STORED_BLOCK_MAX_SIZE 65535u
+// Rows are converted in chunks of this many pixels
+#define IMAGE_FILE_ROW_CHUNK_PIXEL_COUNT 1024u
+
+struct png_chunk_writer {
+  FILE *file_handle;
+  uint32_t crc;
+  bool failed;
+};
+
+struct deflate_stored_writer {
+  struct png_chunk_writer *chunk_writer;
+  uint64_t remaining_size;
+  uint32_t block_remaining_size;
+  uint32_t adler_a;
+  uint32_t adler_b;
+};
+
+static uint32_t crc32_table[256];
+
+void crc32_init_table(void) {
+  for (uint32_t value = 0; value < 256; value++) {
+    uint32_t crc = value;
+    for (int bit = 0; bit < 8; bit++) {
+      crc = crc & 1u ? 0xedb88320u ^ (crc >> 1) : crc >> 1;
+    }
+    crc32_table[value] = crc;
+  }
+}
+
+uint32_t crc32_update(uint32_t crc, const uint8_t *data, size_t size) {
+  for (size_t byte_index = 0; byte_index < size; byte_index++) {
+    crc = crc32_table[(crc ^ data[byte_index]) & 0xffu] ^ (crc >> 8);
+  }
+  return crc;
+}
+
+void png_chunk_writer_write(struct png_chunk_writer *writer,
+                            const uint8_t *data, size_t size) {
+  if (writer->failed) {
+    return;
+  }
+  writer->crc = crc32_update(writer->crc, data, size);
+  writer->failed = fwrite(data, 1, size, writer->file_handle) != size;
+}
+
+void png_chunk_writer_write_u32(struct png_chunk_writer *writer,
+                                uint32_t value) {
+  uint8_t bytes[4] = {value >> 24, value >> 16, value >> 8, value};
+  png_chunk_writer_write(writer, bytes, sizeof(bytes));
+}
+
+// The length isn't part of the CRC
+void png_chunk_writer_begin(struct png_chunk_writer *writer, uint32_t length,
+                            const char type[4]) {
+  uint8_t length_bytes[4] = {length >> 24, length >> 16, length >> 8, length};
+  if (!writer->failed) {
+    writer->failed = fwrite(length_bytes, 1, sizeof(length_bytes),
+                            writer->file_handle) != sizeof(length_bytes);
+  }
+  writer->crc = 0xffffffffu;
+  png_chunk_writer_write(writer, (const uint8_t *)type, 4);
+}
+
+void png_chunk_writer_end(struct png_chunk_writer *writer) {
+  uint32_t crc = writer->crc ^ 0xffffffffu;
+  png_chunk_writer_write_u32(writer, crc);
+}
+
+// Emits a new stored block header whenever the previous block is full
+void deflate_stored_writer_write(struct deflate_stored_writer *writer,
+                                 const uint8_t *data, size_t size) {
+  while (size > 0) {
+    if (writer->block_remaining_size == 0) {
+      uint32_t block_size =
+          writer->remaining_size < DEFLATE_STORED_BLOCK_MAX_SIZE
+              ? (uint32_t)writer->remaining_size
+              : DEFLATE_STORED_BLOCK_MAX_SIZE;
+      bool is_final_block = writer->remaining_size == block_size;
+      uint8_t block_header[5] = {is_final_block, block_size & 0xffu,
+                                 block_size >> 8, ~block_size & 0xffu,
+                                 (~block_size >> 8) & 0xffu};
+      png_chunk_writer_write(writer->chunk_writer, block_header,
+                             sizeof(block_header));
+      writer->block_remaining_size = block_size;
+    }
+
+    size_t write_size =
+        size < writer->block_remaining_size ? size : writer->block_remaining_size;
+    png_chunk_writer_write(writer->chunk_writer, data, write_size);
+    for (size_t byte_index = 0; byte_index < write_size; byte_index++) {
+      writer->adler_a = (writer->adler_a + data[byte_index]) % 65521u;
+      writer->adler_b = (writer->adler_b + writer->adler_a) % 65521u;
+    }
+
+    writer->block_remaining_size -= write_size;
+    writer->remaining_size -= write_size;
+    data += write_size;
+    size -= write_size;
+  }
+}
+
+void convert_pixels_to_rgb(const uint8_t *pixels, uint32_t pixel_count,
+                           enum image_file_channel_order channel_order,
+                           uint8_t *out_rgb) {
+  int red_channel = channel_order == IMAGE_FILE_CHANNEL_ORDER_BGRA ? 2 : 0;
+  int blue_channel = 2 - red_channel;
+  for (uint32_t pixel_index = 0; pixel_index < pixel_count; pixel_index++) {
+    out_rgb[pixel_index * 3 + 0] = pixels[pixel_index * 4 + red_channel];
+    out_rgb[pixel_index * 3 + 1] = pixels[pixel_index * 4 + 1];
+    out_rgb[pixel_index * 3 + 2] = pixels[pixel_index * 4 + blue_channel];
+  }
+}
+
+bool image_file_write_png(const char *path, uint32_t width, uint32_t height,
+                          const uint8_t *pixels,
+                          enum image_file_channel_order channel_order) {
+  assert(path);
+  assert(pixels);
+  if (crc32_table[1] == 0) {
+    crc32_init_table();
+  }
+
+  uint64_t raw_size = (uint64_t)height * (1 + (uint64_t)width * 3);
+  uint64_t block_count = (raw_size + DEFLATE_STORED_BLOCK_MAX_SIZE - 1) /
+                         DEFLATE_STORED_BLOCK_MAX_SIZE;
+  // zlib header, block headers, data and Adler-32
+  uint64_t compressed_size = 2 + block_count * 5 + raw_size + 4;
+  if (width == 0 || height == 0 || compressed_size > INT32_MAX) {
+    LOG("Image %ux%u can't be written as PNG", width, height);
+    goto err;
+  }
+
+  FILE *file_handle = fopen(path, "wb");
+  if (!file_handle) {
+    LOG("Couldn't open %s for writing", path);
+    goto err;
+  }
+
+  struct png_chunk_writer chunk_writer = {.file_handle = file_handle};
+  static const uint8_t png_signature[8] = {0x89, 'P',  'N',  'G',
+                                           '\r', '\n', 0x1a, '\n'};
+  chunk_writer.failed = fwrite(png_signature, 1, sizeof(png_signature),
+                               file_handle) != sizeof(png_signature);
+
+  png_chunk_writer_begin(&chunk_writer, 13, "IHDR");
+  png_chunk_writer_write_u32(&chunk_writer, width);
+  png_chunk_writer_write_u32(&chunk_writer, height);
+  // 8-bit truecolor, deflate, adaptive filtering, no interlacing
+  png_chunk_writer_write(&chunk_writer, (const uint8_t[]){8, 2, 0, 0, 0}, 5);
+  png_chunk_writer_end(&chunk_writer);
+
+  png_chunk_writer_begin(&chunk_writer, (uint32_t)compressed_size, "IDAT");
+  // Deflate with a 32K window, no preset dictionary
+  png_chunk_writer_write(&chunk_writer, (const uint8_t[]){0x78, 0x01}, 2);
+  struct deflate_stored_writer deflate_writer = {.chunk_writer = &chunk_writer,
+                                                 .remaining_size = raw_size,
+                                                 .adler_a = 1};
+  uint8_t rgb[IMAGE_FILE_ROW_CHUNK_PIXEL_COUNT * 3];
+  for (uint32_t y = 0; y < height; y++) {
+    // Filter type None
+    deflate_stored_writer_write(&deflate_writer, (const uint8_t[]){0}, 1);
+    const uint8_t *row = pixels + (size_t)y * width * 4;
+    for (uint32_t x = 0; x < width; x += IMAGE_FILE_ROW_CHUNK_PIXEL_COUNT) {
+      uint32_t pixel_count = width - x < IMAGE_FILE_ROW_CHUNK_PIXEL_COUNT
+                                 ? width - x
+                                 : IMAGE_FILE_ROW_CHUNK_PIXEL_COUNT;
+      convert_pixels_to_rgb(row + (size_t)x * 4, pixel_count, channel_order,
+                            rgb);
+      deflate_stored_writer_write(&deflate_writer, rgb, pixel_count * 3);
+    }
+  }
+  assert(deflate_writer.remaining_size == 0);
+  png_chunk_writer_write_u32(&chunk_writer, deflate_writer.adler_b << 16 |
+                                                deflate_writer.adler_a);
+  png_chunk_writer_end(&chunk_writer);
+
+  png_chunk_writer_begin(&chunk_writer, 0, "IEND");
+  png_chunk_writer_end(&chunk_writer);
+
+  if (fclose(file_handle) != 0 || chunk_writer.failed) {
+    LOG("Couldn't write %s", path);
+    goto err;
+  }
+
+  return true;
+err:
+  return false;
+}
+
+bool image_file_write_ppm(const char *path, uint32_t width, uint32_t height,
+                          const uint8_t *pixels,
+                          enum image_file_channel_order channel_order) {
+  assert(path);
+  assert(pixels);
+  FILE *file_handle = fopen(path, "wb");
+  if (!file_handle) {
+    LOG("Couldn't open %s for writing", path);
+    goto err;
+  }
+
+  bool failed = fprintf(file_handle, "P6\n%u %u\n255\n", width, height) < 0;
+  uint8_t rgb[IMAGE_FILE_ROW_CHUNK_PIXEL_COUNT * 3];
+  size_t pixel_count = (size_t)width * height;
+  for (size_t pixel_index = 0; pixel_index < pixel_count && !failed;
+       pixel_index += IMAGE_FILE_ROW_CHUNK_PIXEL_COUNT) {
+    uint32_t chunk_pixel_count =
+        pixel_count - pixel_index < IMAGE_FILE_ROW_CHUNK_PIXEL_COUNT
+            ? (uint32_t)(pixel_count - pixel_index)
+            : IMAGE_FILE_ROW_CHUNK_PIXEL_COUNT;
+    convert_pixels_to_rgb(pixels + pixel_index * 4, chunk_pixel_count,
+                          channel_order, rgb);
+    failed = fwrite(rgb, 3, chunk_pixel_count, file_handle) !=
+             chunk_pixel_count;
+  }
+
+  if (fclose(file_handle) != 0 || failed) {
+    LOG("Couldn't write %s", path);
+    goto err;
+  }
+
+  return true;
+err:
+  return false;
+}
+
+bool image_file_write(const char *path, uint32_t width, uint32_t height,
+                      const uint8_t *pixels,
+                      enum image_file_channel_order channel_order) {
+  size_t path_length = strlen(path);
+  if (path_length >= 4 && strcmp(path + path_length - 4, ".ppm") == 0) {
+    return image_file_write_ppm(path, width, height, pixels, channel_order);
+  }
+  return image_file_write_png(path, width, height, pixels, channel_order);
+}
@@ -0,0 +1,27 @@
+#ifndef VKGUIDE_IMAGE_FILE_H
+#define VKGUIDE_IMAGE_FILE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Byte order of the 4-byte pixels handed to the writers, alpha is dropped
+enum image_file_channel_order {
+  IMAGE_FILE_CHANNEL_ORDER_RGBA,
+  IMAGE_FILE_CHANNEL_ORDER_BGRA,
+};
+
+// Writes 8-bit RGB images from tightly packed 4-byte pixels, without any
+// color conversion. PNGs are written with uncompressed deflate blocks so
+// that encoding costs no more than the copy.
+bool image_file_write_png(const char *path, uint32_t width, uint32_t height,
+                          const uint8_t *pixels,
+                          enum image_file_channel_order channel_order);
+bool image_file_write_ppm(const char *path, uint32_t width, uint32_t height,
+                          const uint8_t *pixels,
+                          enum image_file_channel_order channel_order);
+// Picks PPM for paths ending in .ppm, PNG otherwise
+bool image_file_write(const char *path, uint32_t width, uint32_t height,
+                      const uint8_t *pixels,
+                      enum image_file_channel_order channel_order);
+
+#endif // VKGUIDE_IMAGE_FILE_H
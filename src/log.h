@@ -0,0 +1,16 @@
+#ifndef VKGUIDE_LOG_H
+#define VKGUIDE_LOG_H
+
+#include <stdio.h>
+
+#ifdef NDEBUG
+#define LOG(...)
+#else
+#define LOG(...)                                                               \
+  do {                                                                         \
+    fprintf(stderr, __VA_ARGS__);                                              \
+    fprintf(stderr, "\n");                                                     \
+  } while (0)
+#endif
+
+#endif // VKGUIDE_LOG_H
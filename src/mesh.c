@@ -0,0 +1,220 @@
+#define _POSIX_C_SOURCE 200809L
+#include "mesh.h"
+#include "log.h"
+#include "mesh_format.h"
+#include "meshlet.h"
+#include <assert.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+bool mesh_file_header_is_valid(const struct mesh_file_header *header,
+                               size_t file_size) {
+  if (header->magic != MESH_FILE_MAGIC) {
+    LOG("Invalid mesh file magic");
+    return false;
+  }
+
+  if (header->version != MESH_FILE_VERSION) {
+    LOG("Unsupported mesh file version %u", header->version);
+    return false;
+  }
+
+  if (header->index_size != sizeof(uint16_t) &&
+      header->index_size != sizeof(uint32_t)) {
+    LOG("Invalid mesh index size %u", header->index_size);
+    return false;
+  }
+
+  // Buffers can't be empty
+  if (header->vertex_count == 0 || header->index_count == 0) {
+    LOG("Mesh file has %u vertices and %u indices, expected some of both",
+        header->vertex_count, header->index_count);
+    return false;
+  }
+
+  uint64_t vertex_data_size =
+      (uint64_t)header->vertex_count * sizeof(struct mesh_vertex);
+  uint64_t index_data_size =
+      (uint64_t)header->index_count * header->index_size;
+  if (header->vertex_data_offset > file_size ||
+      vertex_data_size > file_size - header->vertex_data_offset ||
+      header->index_data_offset > file_size ||
+      index_data_size > file_size - header->index_data_offset) {
+    LOG("Mesh file sections are out of bounds");
+    return false;
+  }
+
+  uint64_t meshlet_data_size =
+      (uint64_t)header->meshlet_count * sizeof(struct mesh_meshlet);
+  uint64_t meshlet_vertex_data_size =
+      (uint64_t)header->meshlet_vertex_count * sizeof(uint32_t);
+  uint64_t meshlet_triangle_data_size =
+      (uint64_t)(header->index_count / 3) * sizeof(uint32_t);
+  if (header->meshlet_count > 0 &&
+      (header->meshlet_data_offset > file_size ||
+       meshlet_data_size > file_size - header->meshlet_data_offset ||
+       header->meshlet_vertex_data_offset > file_size ||
+       meshlet_vertex_data_size >
+           file_size - header->meshlet_vertex_data_offset ||
+       header->meshlet_triangle_data_offset > file_size ||
+       meshlet_triangle_data_size >
+           file_size - header->meshlet_triangle_data_offset ||
+       header->meshlet_data_offset % MESH_FILE_SECTION_ALIGNMENT != 0 ||
+       header->meshlet_vertex_data_offset % MESH_FILE_SECTION_ALIGNMENT != 0 ||
+       header->meshlet_triangle_data_offset % MESH_FILE_SECTION_ALIGNMENT !=
+           0)) {
+    LOG("Mesh file meshlet sections are out of bounds");
+    return false;
+  }
+
+  return true;
+}
+
+bool vulkan_renderer_load_mesh(struct vulkan_renderer *renderer,
+                               const char *path, struct mesh *mesh) {
+  assert(renderer);
+  assert(path);
+  assert(mesh);
+  *mesh = (struct mesh){0};
+
+  int file_descriptor = open(path, O_RDONLY);
+  if (file_descriptor < 0) {
+    LOG("Couldn't open mesh file %s", path);
+    goto err;
+  }
+
+  struct stat file_stat;
+  if (fstat(file_descriptor, &file_stat) < 0 ||
+      (size_t)file_stat.st_size < sizeof(struct mesh_file_header)) {
+    LOG("Mesh file %s is too small", path);
+    goto close_file;
+  }
+  size_t file_size = file_stat.st_size;
+
+  void *file_content =
+      mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, file_descriptor, 0);
+  if (file_content == MAP_FAILED) {
+    LOG("Couldn't map mesh file %s", path);
+    goto close_file;
+  }
+  // Sections are read front to back exactly once
+  posix_madvise(file_content, file_size, POSIX_MADV_SEQUENTIAL);
+
+  if (!vulkan_renderer_create_mesh(renderer, file_content, file_size, mesh)) {
+    goto unmap_file;
+  }
+
+  munmap(file_content, file_size);
+  close(file_descriptor);
+  LOG("Loaded mesh %s: %u vertices, %u indices, %u meshlets", path,
+      mesh->vertex_count, mesh->index_count, mesh->meshlet_count);
+  return true;
+
+unmap_file:
+  munmap(file_content, file_size);
+close_file:
+  close(file_descriptor);
+err:
+  return false;
+}
+
+bool vulkan_renderer_create_mesh(struct vulkan_renderer *renderer,
+                                 const void *file_content, size_t file_size,
+                                 struct mesh *mesh) {
+  assert(renderer);
+  assert(file_content);
+  assert(mesh);
+  *mesh = (struct mesh){0};
+
+  const struct mesh_file_header *header = file_content;
+  if (file_size < sizeof(struct mesh_file_header) ||
+      !mesh_file_header_is_valid(header, file_size)) {
+    goto err;
+  }
+
+  mesh->vertex_count = header->vertex_count;
+  mesh->index_count = header->index_count;
+  mesh->index_type = header->index_size == sizeof(uint16_t)
+                         ? VK_INDEX_TYPE_UINT16
+                         : VK_INDEX_TYPE_UINT32;
+  memcpy(mesh->position_offset, header->position_offset,
+         sizeof(mesh->position_offset));
+  memcpy(mesh->position_scale, header->position_scale,
+         sizeof(mesh->position_scale));
+
+  VkDeviceSize vertex_data_size =
+      (VkDeviceSize)header->vertex_count * sizeof(struct mesh_vertex);
+  VkDeviceSize index_data_size =
+      (VkDeviceSize)header->index_count * header->index_size;
+
+  // Mesh shaders fetch vertices from a storage buffer
+  VkBufferUsageFlags vertex_buffer_usage =
+      VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+  if (renderer->mesh_shader_supported) {
+    vertex_buffer_usage |= VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+  }
+  if (!vulkan_renderer_create_buffer(
+          renderer, vertex_data_size, vertex_buffer_usage,
+          VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &mesh->vertex_buffer,
+          &mesh->vertex_buffer_memory)) {
+    LOG("Couldn't create mesh vertex buffer");
+    goto err;
+  }
+
+  if (!vulkan_renderer_create_buffer(
+          renderer, index_data_size,
+          VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+          VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &mesh->index_buffer,
+          &mesh->index_buffer_memory)) {
+    LOG("Couldn't create mesh index buffer");
+    goto destroy_vertex_buffer;
+  }
+
+  // The mapping is copied straight into the staging buffer, there is no
+  // intermediate CPU-side copy of the mesh data.
+  const uint8_t *file_bytes = file_content;
+  if (!vulkan_renderer_upload_to_buffer(
+          renderer, mesh->vertex_buffer, 0,
+          file_bytes + header->vertex_data_offset, vertex_data_size)) {
+    LOG("Couldn't upload mesh vertices");
+    goto destroy_index_buffer;
+  }
+
+  if (!vulkan_renderer_upload_to_buffer(
+          renderer, mesh->index_buffer, 0,
+          file_bytes + header->index_data_offset, index_data_size)) {
+    LOG("Couldn't upload mesh indices");
+    goto destroy_index_buffer;
+  }
+
+  if (!vulkan_renderer_create_mesh_meshlets(renderer, mesh, header,
+                                            file_bytes)) {
+    LOG("Couldn't create mesh meshlets");
+    goto destroy_index_buffer;
+  }
+
+  capture_add_mesh(&renderer->capture, mesh, file_content, file_size);
+  return true;
+
+destroy_index_buffer:
+  vkDestroyBuffer(renderer->device, mesh->index_buffer, NULL);
+  vulkan_renderer_free_memory(renderer, mesh->index_buffer_memory);
+destroy_vertex_buffer:
+  vkDestroyBuffer(renderer->device, mesh->vertex_buffer, NULL);
+  vulkan_renderer_free_memory(renderer, mesh->vertex_buffer_memory);
+err:
+  return false;
+}
+
+void vulkan_renderer_destroy_mesh(struct vulkan_renderer *renderer,
+                                  struct mesh *mesh) {
+  capture_remove_mesh(&renderer->capture, mesh);
+  vulkan_renderer_destroy_mesh_meshlets(renderer, mesh);
+  vkDestroyBuffer(renderer->device, mesh->index_buffer, NULL);
+  vulkan_renderer_free_memory(renderer, mesh->index_buffer_memory);
+  vkDestroyBuffer(renderer->device, mesh->vertex_buffer, NULL);
+  vulkan_renderer_free_memory(renderer, mesh->vertex_buffer_memory);
+}
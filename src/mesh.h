@@ -0,0 +1,48 @@
+#ifndef VKGUIDE_MESH_H
+#define VKGUIDE_MESH_H
+
+#include "vulkan_renderer.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <vulkan/vulkan.h>
+
+struct mesh {
+  VkBuffer vertex_buffer;
+  VkDeviceMemory vertex_buffer_memory;
+  VkBuffer index_buffer;
+  VkDeviceMemory index_buffer_memory;
+  uint32_t vertex_count;
+  uint32_t index_count;
+  VkIndexType index_type;
+  float position_offset[3];
+  float position_scale[3];
+
+  // 0 when the mesh is drawn without meshlets, see meshlet.h
+  uint32_t meshlet_count;
+  VkBuffer meshlet_buffer;
+  VkDeviceMemory meshlet_buffer_memory;
+  // Mesh shader path only
+  VkBuffer meshlet_vertex_buffer;
+  VkDeviceMemory meshlet_vertex_buffer_memory;
+  VkBuffer meshlet_triangle_buffer;
+  VkDeviceMemory meshlet_triangle_buffer_memory;
+  // Compute path only, written by the culling pass of each frame in flight
+  VkBuffer meshlet_draw_buffers[MAX_FRAMES_IN_FLIGHT];
+  VkDeviceMemory meshlet_draw_buffer_memories[MAX_FRAMES_IN_FLIGHT];
+  VkDescriptorSet meshlet_descriptor_sets[MAX_FRAMES_IN_FLIGHT];
+
+  // Identifies the mesh in capture files, 0 when it isn't captured, see
+  // capture.h
+  uint32_t capture_id;
+};
+
+bool vulkan_renderer_load_mesh(struct vulkan_renderer *renderer,
+                               const char *path, struct mesh *mesh);
+// Creates a mesh from the content of a .vkm file, e.g. one built in memory
+bool vulkan_renderer_create_mesh(struct vulkan_renderer *renderer,
+                                 const void *file_content, size_t file_size,
+                                 struct mesh *mesh);
+void vulkan_renderer_destroy_mesh(struct vulkan_renderer *renderer,
+                                  struct mesh *mesh);
+
+#endif // VKGUIDE_MESH_H
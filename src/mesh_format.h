@@ -0,0 +1,87 @@
+#ifndef VKGUIDE_MESH_FORMAT_H
+#define VKGUIDE_MESH_FORMAT_H
+
+// On-disk layout of the .vkm mesh container written by
+// tools/mesh_converter.c. The file is meant to be mmap'd: every section is
+// stored exactly as the GPU consumes it, so the loader copies ranges of the
+// mapping straight into the staging buffer.
+//
+// [mesh_file_header][vertex data][index data][meshlets][meshlet vertices]
+// [meshlet triangles]
+//
+// Meshlets cover consecutive triangles of the index buffer, so a meshlet can
+// either be drawn as a plain indexed draw (first index = 3 *
+// triangle_offset) or by a mesh shader through its local vertex/triangle
+// lists.
+
+#include <stdint.h>
+
+#define MESH_FILE_MAGIC 0x4d4b5656u // "VVKM"
+#define MESH_FILE_VERSION 2u
+#define MESH_FILE_SECTION_ALIGNMENT 16u
+
+struct mesh_file_header {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t vertex_count;
+  uint32_t index_count;
+  // 2 (uint16_t) or 4 (uint32_t)
+  uint32_t index_size;
+  uint32_t meshlet_count;
+  uint64_t vertex_data_offset;
+  uint64_t index_data_offset;
+  // Dequantized position = position_offset + position * position_scale, with
+  // position being the normalized [0, 1] value of the 16-bit UNORM components
+  float position_offset[3];
+  float position_scale[3];
+  uint64_t meshlet_data_offset;
+  uint64_t meshlet_vertex_data_offset;
+  // One packed triangle per index buffer triangle
+  uint64_t meshlet_triangle_data_offset;
+  uint32_t meshlet_vertex_count;
+  uint32_t reserved;
+};
+_Static_assert(sizeof(struct mesh_file_header) == 96,
+               "mesh_file_header layout must not change silently");
+
+// 16 bytes per vertex
+struct mesh_vertex {
+  // R16G16B16A16_UNORM, w is padding
+  uint16_t position[4];
+  // R16G16_SNORM octahedral encoded unit normal
+  int16_t normal[2];
+  // R16G16_SFLOAT
+  uint16_t uv[2];
+};
+_Static_assert(sizeof(struct mesh_vertex) == 16,
+               "mesh_vertex must stay 16 bytes");
+
+#define MESHLET_MAX_VERTEX_COUNT 64
+#define MESHLET_MAX_TRIANGLE_COUNT 124
+
+// Mirrors struct meshlet in shaders/meshlet_common.glsl (std430)
+struct mesh_meshlet {
+  // Bounding sphere in dequantized model space
+  float center[3];
+  float radius;
+  // Normal cone, the meshlet is backfacing for cameras for which
+  // dot(center - camera, cone_axis) >= cone_cutoff * |center - camera| + radius
+  float cone_axis[3];
+  float cone_cutoff;
+  // Into the meshlet vertices array, which holds indices of the vertex buffer
+  uint32_t vertex_offset;
+  // Into the meshlet triangles array, also the first triangle of the meshlet
+  // in the index buffer
+  uint32_t triangle_offset;
+  uint32_t vertex_count;
+  uint32_t triangle_count;
+};
+_Static_assert(sizeof(struct mesh_meshlet) == 48,
+               "mesh_meshlet must match the std430 layout");
+
+// Meshlet triangles are 3 meshlet-local 8-bit vertex indices packed in a
+// uint32_t, the top byte is unused
+#define MESHLET_PACK_TRIANGLE(a, b, c)                                         \
+  ((uint32_t)(a) | ((uint32_t)(b) << 8) | ((uint32_t)(c) << 16))
+
+#endif // VKGUIDE_MESH_FORMAT_H
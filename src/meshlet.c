@@ -0,0 +1,787 @@
+#include "meshlet.h"
+#include "log.h"
+#include "mesh.h"
+#include <assert.h>
+#include <string.h>
+
+// See shaders/meshlet_cull.comp and shaders/meshlet.task
+#define MESHLET_CULL_WORKGROUP_SIZE 64
+#define MESHLET_TASK_WORKGROUP_SIZE 32
+// The draw count comes first, then the late draw count and the retest count
+// of occlusion culling, padded so the VkDrawIndexedIndirectCommand array
+// starts 16 bytes in
+#define MESHLET_DRAW_COMMANDS_OFFSET 16
+#define MESHLET_LATE_DRAW_COUNT_OFFSET 4
+// Meshes that can have meshlet resources alive at the same time
+#define MAX_MESHLET_MESH_COUNT 64
+
+// See shaders/meshlet_common.glsl, shaders/meshlet_cull.comp and
+// shaders/meshlet.mesh
+enum meshlet_binding {
+  MESHLET_BINDING_MESHLETS,
+  MESHLET_BINDING_DRAW_BUFFER,
+  MESHLET_BINDING_MESHLET_VERTICES,
+  MESHLET_BINDING_MESHLET_TRIANGLES,
+  MESHLET_BINDING_VERTICES,
+  // Meshlets queued for the late culling pass, in the draw buffer
+  MESHLET_BINDING_RETEST_LIST,
+  MESHLET_BINDING_COUNT
+};
+
+VkShaderStageFlags
+meshlet_shader_stages(const struct vulkan_renderer *renderer) {
+  return renderer->mesh_shader_supported
+             ? VK_SHADER_STAGE_TASK_BIT_EXT | VK_SHADER_STAGE_MESH_BIT_EXT
+             : VK_SHADER_STAGE_COMPUTE_BIT;
+}
+
+bool vulkan_renderer_create_meshlet_cull_pipeline(
+    struct vulkan_renderer *renderer) {
+  size_t arena_mark_before_shader = arena_mark(&renderer->init_arena);
+  size_t compute_shader_code_size;
+  char *compute_shader_code = load_shader_from_file(
+      &renderer->init_arena,
+      renderer->occlusion_culling_enabled
+          ? "shaders/meshlet_cull_occlusion.comp.spv"
+          : "shaders/meshlet_cull.comp.spv",
+      &compute_shader_code_size);
+  if (!compute_shader_code) {
+    LOG("Couldn't load meshlet culling shader");
+    return false;
+  }
+  VkShaderModule compute_shader_module = create_shader_module(
+      renderer->device, compute_shader_code, compute_shader_code_size);
+  arena_rewind(&renderer->init_arena, arena_mark_before_shader);
+  if (!compute_shader_module) {
+    return false;
+  }
+
+  VkResult result = vkCreateComputePipelines(
+      renderer->device, VK_NULL_HANDLE, 1,
+      &(const VkComputePipelineCreateInfo){
+          .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+          .stage = {.sType =
+                        VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+                    .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+                    .module = compute_shader_module,
+                    .pName = "main"},
+          .layout = renderer->meshlet_pipeline_layout},
+      NULL, &renderer->meshlet_cull_pipeline);
+  vkDestroyShaderModule(renderer->device, compute_shader_module, NULL);
+  return result == VK_SUCCESS;
+}
+
+// Same fixed-function state as vulkan_renderer_create_graphics_pipeline, the
+// task and mesh stages replace vertex input and input assembly
+bool vulkan_renderer_create_meshlet_mesh_pipeline(
+    struct vulkan_renderer *renderer) {
+  size_t arena_mark_before_shaders = arena_mark(&renderer->init_arena);
+  size_t task_shader_code_size;
+  char *task_shader_code =
+      load_shader_from_file(&renderer->init_arena, "shaders/meshlet.task.spv",
+                            &task_shader_code_size);
+  size_t mesh_shader_code_size;
+  char *mesh_shader_code =
+      load_shader_from_file(&renderer->init_arena, "shaders/meshlet.mesh.spv",
+                            &mesh_shader_code_size);
+  size_t fragment_shader_code_size;
+  char *fragment_shader_code =
+      load_shader_from_file(&renderer->init_arena, "shaders/mesh.frag.spv",
+                            &fragment_shader_code_size);
+  if (!task_shader_code || !mesh_shader_code || !fragment_shader_code) {
+    LOG("Couldn't load meshlet shaders");
+    arena_rewind(&renderer->init_arena, arena_mark_before_shaders);
+    return false;
+  }
+  VkShaderModule task_shader_module = create_shader_module(
+      renderer->device, task_shader_code, task_shader_code_size);
+  VkShaderModule mesh_shader_module = create_shader_module(
+      renderer->device, mesh_shader_code, mesh_shader_code_size);
+  VkShaderModule fragment_shader_module = create_shader_module(
+      renderer->device, fragment_shader_code, fragment_shader_code_size);
+  arena_rewind(&renderer->init_arena, arena_mark_before_shaders);
+
+  VkPipelineShaderStageCreateInfo shader_stages[] = {
+      {.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+       .stage = VK_SHADER_STAGE_TASK_BIT_EXT,
+       .module = task_shader_module,
+       .pName = "main"},
+      {.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+       .stage = VK_SHADER_STAGE_MESH_BIT_EXT,
+       .module = mesh_shader_module,
+       .pName = "main"},
+      {.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+       .stage = VK_SHADER_STAGE_FRAGMENT_BIT,
+       .module = fragment_shader_module,
+       .pName = "main"}};
+
+  VkDynamicState dynamic_states[] = {VK_DYNAMIC_STATE_VIEWPORT,
+                                     VK_DYNAMIC_STATE_SCISSOR};
+
+  VkPipelineDynamicStateCreateInfo dynamic_state = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
+      .dynamicStateCount = (sizeof(dynamic_states) / sizeof(VkDynamicState)),
+      .pDynamicStates = dynamic_states};
+
+  VkPipelineViewportStateCreateInfo viewport_state = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
+      .viewportCount = 1,
+      .scissorCount = 1};
+
+  VkPipelineRasterizationStateCreateInfo rasterizer = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
+      .depthClampEnable = VK_FALSE,
+      .rasterizerDiscardEnable = VK_FALSE,
+      .polygonMode = VK_POLYGON_MODE_FILL,
+      .lineWidth = 1.0f,
+      .cullMode = VK_CULL_MODE_BACK_BIT,
+      .frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE,
+      .depthBiasEnable = VK_FALSE};
+
+  VkPipelineMultisampleStateCreateInfo multisampling = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
+      .sampleShadingEnable = VK_FALSE,
+      .rasterizationSamples = renderer->msaa_sample_count,
+      .minSampleShading = 1.0f,
+  };
+
+  VkPipelineDepthStencilStateCreateInfo depth_stencil = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
+      .depthTestEnable = VK_TRUE,
+      .depthWriteEnable = VK_TRUE,
+      .depthCompareOp = VK_COMPARE_OP_LESS};
+
+  VkPipelineColorBlendAttachmentState color_blend_attachment = {
+      .colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
+                        VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT,
+      .blendEnable = VK_FALSE,
+  };
+
+  VkPipelineColorBlendStateCreateInfo color_blending = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
+      .logicOpEnable = VK_FALSE,
+      .attachmentCount = 1,
+      .pAttachments = &color_blend_attachment};
+
+  VkResult result = vkCreateGraphicsPipelines(
+      renderer->device, VK_NULL_HANDLE, 1,
+      &(const VkGraphicsPipelineCreateInfo){
+          .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+          .stageCount = sizeof(shader_stages) /
+                        sizeof(VkPipelineShaderStageCreateInfo),
+          .pStages = shader_stages,
+          .pViewportState = &viewport_state,
+          .pRasterizationState = &rasterizer,
+          .pMultisampleState = &multisampling,
+          .pDepthStencilState = &depth_stencil,
+          .pColorBlendState = &color_blending,
+          .pDynamicState = &dynamic_state,
+          .layout = renderer->meshlet_pipeline_layout,
+          .renderPass = renderer->render_pass,
+          .subpass = 0},
+      NULL, &renderer->meshlet_mesh_pipeline);
+
+  vkDestroyShaderModule(renderer->device, task_shader_module, NULL);
+  vkDestroyShaderModule(renderer->device, mesh_shader_module, NULL);
+  vkDestroyShaderModule(renderer->device, fragment_shader_module, NULL);
+  if (result != VK_SUCCESS) {
+    return false;
+  }
+
+  renderer->cmd_draw_mesh_tasks =
+      (PFN_vkCmdDrawMeshTasksEXT)vkGetDeviceProcAddr(renderer->device,
+                                                     "vkCmdDrawMeshTasksEXT");
+  return renderer->cmd_draw_mesh_tasks != NULL;
+}
+
+bool vulkan_renderer_create_meshlet_pipelines(
+    struct vulkan_renderer *renderer) {
+  if (!renderer->mesh_shader_supported &&
+      !renderer->multi_draw_indirect_supported) {
+    LOG("Meshlet culling is unavailable, meshes will be drawn whole");
+    return true;
+  }
+
+  VkShaderStageFlags stages = meshlet_shader_stages(renderer);
+  VkDescriptorSetLayoutBinding bindings[MESHLET_BINDING_COUNT];
+  for (uint32_t binding = 0; binding < MESHLET_BINDING_COUNT; binding++) {
+    bindings[binding] = (VkDescriptorSetLayoutBinding){
+        .binding = binding,
+        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        .descriptorCount = 1,
+        .stageFlags = stages};
+  }
+
+  if (vkCreateDescriptorSetLayout(
+          renderer->device,
+          &(const VkDescriptorSetLayoutCreateInfo){
+              .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+              .bindingCount = MESHLET_BINDING_COUNT,
+              .pBindings = bindings},
+          NULL, &renderer->meshlet_descriptor_set_layout) != VK_SUCCESS) {
+    LOG("Couldn't create meshlet descriptor set layout");
+    goto err;
+  }
+
+  uint32_t max_set_count = MAX_MESHLET_MESH_COUNT * MAX_FRAMES_IN_FLIGHT;
+  if (vkCreateDescriptorPool(
+          renderer->device,
+          &(const VkDescriptorPoolCreateInfo){
+              .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+              .flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT,
+              .maxSets = max_set_count,
+              .poolSizeCount = 1,
+              .pPoolSizes =
+                  &(const VkDescriptorPoolSize){
+                      .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                      .descriptorCount =
+                          max_set_count * MESHLET_BINDING_COUNT}},
+          NULL, &renderer->meshlet_descriptor_pool) != VK_SUCCESS) {
+    LOG("Couldn't create meshlet descriptor pool");
+    goto destroy_descriptor_set_layout;
+  }
+
+  VkDescriptorSetLayout set_layouts[] = {
+      renderer->meshlet_descriptor_set_layout,
+      renderer->occlusion_descriptor_set_layout};
+  if (vkCreatePipelineLayout(
+          renderer->device,
+          &(const VkPipelineLayoutCreateInfo){
+              .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+              .setLayoutCount = renderer->occlusion_culling_enabled ? 2 : 1,
+              .pSetLayouts = set_layouts,
+              .pushConstantRangeCount = 1,
+              .pPushConstantRanges =
+                  &(const VkPushConstantRange){
+                      .stageFlags = stages,
+                      .offset = 0,
+                      .size = sizeof(struct meshlet_push_constants)}},
+          NULL, &renderer->meshlet_pipeline_layout) != VK_SUCCESS) {
+    LOG("Couldn't create meshlet pipeline layout");
+    goto destroy_descriptor_pool;
+  }
+
+  if (renderer->mesh_shader_supported) {
+    if (!vulkan_renderer_create_meshlet_mesh_pipeline(renderer)) {
+      LOG("Couldn't create meshlet mesh shader pipeline");
+      goto destroy_pipeline_layout;
+    }
+    LOG("Meshlets are culled and drawn with mesh shaders");
+  } else {
+    if (!vulkan_renderer_create_meshlet_cull_pipeline(renderer)) {
+      LOG("Couldn't create meshlet culling pipeline");
+      goto destroy_pipeline_layout;
+    }
+    LOG("Meshlets are culled by compute and drawn indirectly");
+  }
+
+  return true;
+destroy_pipeline_layout:
+  vkDestroyPipelineLayout(renderer->device, renderer->meshlet_pipeline_layout,
+                          NULL);
+destroy_descriptor_pool:
+  vkDestroyDescriptorPool(renderer->device, renderer->meshlet_descriptor_pool,
+                          NULL);
+destroy_descriptor_set_layout:
+  vkDestroyDescriptorSetLayout(renderer->device,
+                               renderer->meshlet_descriptor_set_layout, NULL);
+err:
+  return false;
+}
+
+void vulkan_renderer_destroy_meshlet_pipelines(
+    struct vulkan_renderer *renderer) {
+  vkDestroyPipeline(renderer->device, renderer->meshlet_mesh_pipeline, NULL);
+  vkDestroyPipeline(renderer->device, renderer->meshlet_cull_pipeline, NULL);
+  vkDestroyPipelineLayout(renderer->device, renderer->meshlet_pipeline_layout,
+                          NULL);
+  vkDestroyDescriptorPool(renderer->device, renderer->meshlet_descriptor_pool,
+                          NULL);
+  vkDestroyDescriptorSetLayout(renderer->device,
+                               renderer->meshlet_descriptor_set_layout, NULL);
+}
+
+// The GPU trusts these offsets, a corrupted file must not turn into
+// out-of-bounds shader reads
+bool meshlets_are_valid(const struct mesh_file_header *header,
+                        const uint8_t *file_bytes) {
+  const struct mesh_meshlet *meshlets =
+      (const struct mesh_meshlet *)(file_bytes + header->meshlet_data_offset);
+  const uint32_t *meshlet_vertices =
+      (const uint32_t *)(file_bytes + header->meshlet_vertex_data_offset);
+  const uint32_t *meshlet_triangles =
+      (const uint32_t *)(file_bytes + header->meshlet_triangle_data_offset);
+  uint32_t triangle_count = header->index_count / 3;
+
+  for (uint32_t meshlet_index = 0; meshlet_index < header->meshlet_count;
+       meshlet_index++) {
+    const struct mesh_meshlet *meshlet = &meshlets[meshlet_index];
+    if (meshlet->vertex_count > MESHLET_MAX_VERTEX_COUNT ||
+        meshlet->triangle_count > MESHLET_MAX_TRIANGLE_COUNT ||
+        meshlet->vertex_offset > header->meshlet_vertex_count ||
+        meshlet->vertex_count >
+            header->meshlet_vertex_count - meshlet->vertex_offset ||
+        meshlet->triangle_offset > triangle_count ||
+        meshlet->triangle_count > triangle_count - meshlet->triangle_offset) {
+      return false;
+    }
+
+    for (uint32_t triangle = 0; triangle < meshlet->triangle_count;
+         triangle++) {
+      uint32_t packed_triangle =
+          meshlet_triangles[meshlet->triangle_offset + triangle];
+      if ((packed_triangle & 0xffu) >= meshlet->vertex_count ||
+          ((packed_triangle >> 8) & 0xffu) >= meshlet->vertex_count ||
+          ((packed_triangle >> 16) & 0xffu) >= meshlet->vertex_count) {
+        return false;
+      }
+    }
+  }
+
+  for (uint32_t vertex = 0; vertex < header->meshlet_vertex_count; vertex++) {
+    if (meshlet_vertices[vertex] >= header->vertex_count) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+void write_meshlet_descriptor(VkWriteDescriptorSet *write,
+                              VkDescriptorBufferInfo *buffer_info,
+                              VkDescriptorSet descriptor_set, uint32_t binding,
+                              VkBuffer buffer, VkDeviceSize offset) {
+  *buffer_info = (VkDescriptorBufferInfo){
+      .buffer = buffer, .offset = offset, .range = VK_WHOLE_SIZE};
+  *write = (VkWriteDescriptorSet){
+      .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+      .dstSet = descriptor_set,
+      .dstBinding = binding,
+      .descriptorCount = 1,
+      .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+      .pBufferInfo = buffer_info};
+}
+
+bool vulkan_renderer_create_mesh_meshlets(struct vulkan_renderer *renderer,
+                                          struct mesh *mesh,
+                                          const struct mesh_file_header *header,
+                                          const uint8_t *file_bytes) {
+  assert(renderer);
+  assert(mesh);
+  assert(header);
+  assert(file_bytes);
+  mesh->meshlet_count = 0;
+  if (header->meshlet_count == 0 ||
+      renderer->meshlet_pipeline_layout == VK_NULL_HANDLE) {
+    return true;
+  }
+
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(renderer->physical_device, &properties);
+  if (!renderer->mesh_shader_supported &&
+      header->meshlet_count > properties.limits.maxDrawIndirectCount) {
+    LOG("Too many meshlets for an indirect draw, the mesh will be drawn whole");
+    return true;
+  }
+
+  if (!meshlets_are_valid(header, file_bytes)) {
+    LOG("Invalid meshlet data");
+    return false;
+  }
+
+  VkDeviceSize retest_list_offset = 0;
+  VkDeviceSize meshlet_data_size =
+      (VkDeviceSize)header->meshlet_count * sizeof(struct mesh_meshlet);
+  if (!vulkan_renderer_create_buffer(
+          renderer, meshlet_data_size,
+          VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+          VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &mesh->meshlet_buffer,
+          &mesh->meshlet_buffer_memory) ||
+      !vulkan_renderer_upload_to_buffer(
+          renderer, mesh->meshlet_buffer, 0,
+          file_bytes + header->meshlet_data_offset, meshlet_data_size)) {
+    LOG("Couldn't upload meshlets");
+    goto err;
+  }
+
+  if (renderer->mesh_shader_supported) {
+    VkDeviceSize meshlet_vertex_data_size =
+        (VkDeviceSize)header->meshlet_vertex_count * sizeof(uint32_t);
+    VkDeviceSize meshlet_triangle_data_size =
+        (VkDeviceSize)(header->index_count / 3) * sizeof(uint32_t);
+    if (!vulkan_renderer_create_buffer(
+            renderer, meshlet_vertex_data_size,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &mesh->meshlet_vertex_buffer,
+            &mesh->meshlet_vertex_buffer_memory) ||
+        !vulkan_renderer_upload_to_buffer(
+            renderer, mesh->meshlet_vertex_buffer, 0,
+            file_bytes + header->meshlet_vertex_data_offset,
+            meshlet_vertex_data_size) ||
+        !vulkan_renderer_create_buffer(
+            renderer, meshlet_triangle_data_size,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &mesh->meshlet_triangle_buffer,
+            &mesh->meshlet_triangle_buffer_memory) ||
+        !vulkan_renderer_upload_to_buffer(
+            renderer, mesh->meshlet_triangle_buffer, 0,
+            file_bytes + header->meshlet_triangle_data_offset,
+            meshlet_triangle_data_size)) {
+      LOG("Couldn't upload meshlet vertices and triangles");
+      goto err;
+    }
+  } else {
+    // Occlusion culling appends the late pass' commands after the early
+    // pass' ones, then the meshlets to retest
+    VkDeviceSize draw_command_size = (VkDeviceSize)header->meshlet_count *
+                                     sizeof(VkDrawIndexedIndirectCommand);
+    VkDeviceSize draw_buffer_size =
+        MESHLET_DRAW_COMMANDS_OFFSET + draw_command_size;
+    if (renderer->occlusion_culling_enabled) {
+      VkDeviceSize alignment =
+          properties.limits.minStorageBufferOffsetAlignment;
+      retest_list_offset = (draw_buffer_size + draw_command_size +
+                            alignment - 1) /
+                           alignment * alignment;
+      draw_buffer_size =
+          retest_list_offset +
+          (VkDeviceSize)header->meshlet_count * sizeof(uint32_t);
+    }
+    for (uint32_t frame_index = 0; frame_index < MAX_FRAMES_IN_FLIGHT;
+         frame_index++) {
+      if (!vulkan_renderer_create_buffer(
+              renderer, draw_buffer_size,
+              VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                  VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+                  VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+              VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+              &mesh->meshlet_draw_buffers[frame_index],
+              &mesh->meshlet_draw_buffer_memories[frame_index])) {
+        LOG("Couldn't create meshlet draw buffer");
+        goto err;
+      }
+    }
+  }
+
+  VkDescriptorSetLayout set_layouts[MAX_FRAMES_IN_FLIGHT];
+  for (uint32_t frame_index = 0; frame_index < MAX_FRAMES_IN_FLIGHT;
+       frame_index++) {
+    set_layouts[frame_index] = renderer->meshlet_descriptor_set_layout;
+  }
+  if (vkAllocateDescriptorSets(
+          renderer->device,
+          &(const VkDescriptorSetAllocateInfo){
+              .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+              .descriptorPool = renderer->meshlet_descriptor_pool,
+              .descriptorSetCount = MAX_FRAMES_IN_FLIGHT,
+              .pSetLayouts = set_layouts},
+          mesh->meshlet_descriptor_sets) != VK_SUCCESS) {
+    LOG("Couldn't allocate meshlet descriptor sets");
+    memset(mesh->meshlet_descriptor_sets, 0,
+           sizeof(mesh->meshlet_descriptor_sets));
+    goto err;
+  }
+
+  // Bindings the active path doesn't use are left unwritten
+  for (uint32_t frame_index = 0; frame_index < MAX_FRAMES_IN_FLIGHT;
+       frame_index++) {
+    VkDescriptorSet descriptor_set = mesh->meshlet_descriptor_sets[frame_index];
+    VkWriteDescriptorSet writes[MESHLET_BINDING_COUNT];
+    VkDescriptorBufferInfo buffer_infos[MESHLET_BINDING_COUNT];
+    uint32_t write_count = 0;
+    write_meshlet_descriptor(&writes[write_count], &buffer_infos[write_count],
+                             descriptor_set, MESHLET_BINDING_MESHLETS,
+                             mesh->meshlet_buffer, 0);
+    write_count++;
+    if (renderer->mesh_shader_supported) {
+      write_meshlet_descriptor(&writes[write_count], &buffer_infos[write_count],
+                               descriptor_set, MESHLET_BINDING_MESHLET_VERTICES,
+                               mesh->meshlet_vertex_buffer, 0);
+      write_count++;
+      write_meshlet_descriptor(
+          &writes[write_count], &buffer_infos[write_count], descriptor_set,
+          MESHLET_BINDING_MESHLET_TRIANGLES, mesh->meshlet_triangle_buffer, 0);
+      write_count++;
+      write_meshlet_descriptor(&writes[write_count], &buffer_infos[write_count],
+                               descriptor_set, MESHLET_BINDING_VERTICES,
+                               mesh->vertex_buffer, 0);
+      write_count++;
+    } else {
+      write_meshlet_descriptor(&writes[write_count], &buffer_infos[write_count],
+                               descriptor_set, MESHLET_BINDING_DRAW_BUFFER,
+                               mesh->meshlet_draw_buffers[frame_index], 0);
+      write_count++;
+      if (renderer->occlusion_culling_enabled) {
+        write_meshlet_descriptor(
+            &writes[write_count], &buffer_infos[write_count], descriptor_set,
+            MESHLET_BINDING_RETEST_LIST,
+            mesh->meshlet_draw_buffers[frame_index], retest_list_offset);
+        write_count++;
+      }
+    }
+    vkUpdateDescriptorSets(renderer->device, write_count, writes, 0, NULL);
+  }
+
+  mesh->meshlet_count = header->meshlet_count;
+  return true;
+err:
+  vulkan_renderer_destroy_mesh_meshlets(renderer, mesh);
+  return false;
+}
+
+// Tolerates partially created resources, the meshlet fields of the mesh must
+// start zeroed
+void vulkan_renderer_destroy_mesh_meshlets(struct vulkan_renderer *renderer,
+                                           struct mesh *mesh) {
+  if (mesh->meshlet_descriptor_sets[0] != VK_NULL_HANDLE) {
+    vkFreeDescriptorSets(renderer->device, renderer->meshlet_descriptor_pool,
+                         MAX_FRAMES_IN_FLIGHT, mesh->meshlet_descriptor_sets);
+  }
+  for (uint32_t frame_index = 0; frame_index < MAX_FRAMES_IN_FLIGHT;
+       frame_index++) {
+    vkDestroyBuffer(renderer->device, mesh->meshlet_draw_buffers[frame_index],
+                    NULL);
+    vulkan_renderer_free_memory(
+        renderer, mesh->meshlet_draw_buffer_memories[frame_index]);
+  }
+  vkDestroyBuffer(renderer->device, mesh->meshlet_triangle_buffer, NULL);
+  vulkan_renderer_free_memory(renderer, mesh->meshlet_triangle_buffer_memory);
+  vkDestroyBuffer(renderer->device, mesh->meshlet_vertex_buffer, NULL);
+  vulkan_renderer_free_memory(renderer, mesh->meshlet_vertex_buffer_memory);
+  vkDestroyBuffer(renderer->device, mesh->meshlet_buffer, NULL);
+  vulkan_renderer_free_memory(renderer, mesh->meshlet_buffer_memory);
+  mesh->meshlet_count = 0;
+}
+
+struct meshlet_push_constants
+make_meshlet_push_constants(const struct mesh *mesh,
+                            const struct mat4 *model_view_projection,
+                            struct vec3 camera_position, uint32_t flags) {
+  return (struct meshlet_push_constants){
+      .model_view_projection = *model_view_projection,
+      .position_offset = {mesh->position_offset[0], mesh->position_offset[1],
+                          mesh->position_offset[2], 0.0f},
+      .position_scale = {mesh->position_scale[0], mesh->position_scale[1],
+                         mesh->position_scale[2], 0.0f},
+      .camera_position = {camera_position.x, camera_position.y,
+                          camera_position.z},
+      .meshlet_count = mesh->meshlet_count,
+      .flags = flags};
+}
+
+// Dispatches one invocation per meshlet, the late pass' invocations past the
+// retest count return early
+void record_meshlet_cull_dispatch(struct vulkan_renderer *renderer,
+                                  const struct mesh *mesh,
+                                  const struct mat4 *model_view_projection,
+                                  struct vec3 camera_position,
+                                  uint32_t flags) {
+  VkCommandBuffer command_buffer =
+      renderer->frames[renderer->current_frame].command_buffer;
+  vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                    renderer->meshlet_cull_pipeline);
+  renderer->frame_counters.pipeline_bind_count++;
+  VkDescriptorSet descriptor_sets[] = {
+      mesh->meshlet_descriptor_sets[renderer->current_frame],
+      renderer->occlusion_descriptor_sets[renderer->current_frame]};
+  vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                          renderer->meshlet_pipeline_layout, 0,
+                          renderer->occlusion_culling_enabled ? 2 : 1,
+                          descriptor_sets, 0, NULL);
+  struct meshlet_push_constants push_constants = make_meshlet_push_constants(
+      mesh, model_view_projection, camera_position, flags);
+  vkCmdPushConstants(command_buffer, renderer->meshlet_pipeline_layout,
+                     VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push_constants),
+                     &push_constants);
+  vkCmdDispatch(command_buffer,
+                (mesh->meshlet_count + MESHLET_CULL_WORKGROUP_SIZE - 1) /
+                    MESHLET_CULL_WORKGROUP_SIZE,
+                1, 1);
+
+  vkCmdPipelineBarrier(
+      command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+      VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 0, 0, NULL, 1,
+      &(const VkBufferMemoryBarrier){
+          .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+          .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+          .dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT,
+          .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+          .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+          .buffer = mesh->meshlet_draw_buffers[renderer->current_frame],
+          .size = VK_WHOLE_SIZE},
+      0, NULL);
+}
+
+void vulkan_renderer_cull_meshlets(struct vulkan_renderer *renderer,
+                                   const struct mesh *mesh,
+                                   const struct mat4 *model_view_projection,
+                                   struct vec3 camera_position) {
+  if (mesh->meshlet_count == 0 || renderer->mesh_shader_supported) {
+    return;
+  }
+  capture_record_meshlets(&renderer->capture, CAPTURE_COMMAND_CULL_MESHLETS,
+                          mesh, model_view_projection, camera_position);
+
+  VkCommandBuffer command_buffer =
+      renderer->frames[renderer->current_frame].command_buffer;
+  VkBuffer draw_buffer = mesh->meshlet_draw_buffers[renderer->current_frame];
+
+  // Without vkCmdDrawIndexedIndirectCount every command slot gets drawn, the
+  // ones past the draw counts must stay empty
+  vkCmdFillBuffer(command_buffer, draw_buffer, 0,
+                  renderer->draw_indirect_count_supported
+                      ? MESHLET_DRAW_COMMANDS_OFFSET
+                      : VK_WHOLE_SIZE,
+                  0);
+  vkCmdPipelineBarrier(
+      command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+      VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, NULL, 1,
+      &(const VkBufferMemoryBarrier){
+          .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+          .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+          .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+          .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+          .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+          .buffer = draw_buffer,
+          .size = VK_WHOLE_SIZE},
+      0, NULL);
+
+  // The first occlusion culled frame after the pyramid's creation has no
+  // earlier depth to test against, its late pass has nothing to retest
+  uint32_t flags = renderer->occlusion_phase ==
+                                   VULKAN_RENDERER_OCCLUSION_PHASE_EARLY &&
+                               renderer->depth_pyramid_valid
+                           ? MESHLET_CULL_FLAG_DEPTH_PYRAMID
+                           : 0;
+  if (renderer->occlusion_phase == VULKAN_RENDERER_OCCLUSION_PHASE_EARLY &&
+      renderer->timestamp_query_pool != VK_NULL_HANDLE &&
+      !renderer->early_cull_timing) {
+    vkCmdWriteTimestamp(
+        command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+        renderer->timestamp_query_pool,
+        renderer->current_frame * VULKAN_RENDERER_TIMESTAMP_COUNT +
+            VULKAN_RENDERER_TIMESTAMP_EARLY_CULL_START);
+    renderer->early_cull_timing = true;
+  }
+  record_meshlet_cull_dispatch(renderer, mesh, model_view_projection,
+                               camera_position, flags);
+}
+
+void vulkan_renderer_cull_meshlets_late(
+    struct vulkan_renderer *renderer, const struct mesh *mesh,
+    const struct mat4 *model_view_projection, struct vec3 camera_position) {
+  if (mesh->meshlet_count == 0 ||
+      renderer->occlusion_phase != VULKAN_RENDERER_OCCLUSION_PHASE_LATE_CULL) {
+    return;
+  }
+  capture_record_meshlets(&renderer->capture,
+                          CAPTURE_COMMAND_CULL_MESHLETS_LATE, mesh,
+                          model_view_projection, camera_position);
+
+  // Reads the retest list of the early pass and appends after its commands
+  vkCmdPipelineBarrier(
+      renderer->frames[renderer->current_frame].command_buffer,
+      VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+      VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, NULL, 1,
+      &(const VkBufferMemoryBarrier){
+          .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+          .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+          .dstAccessMask =
+              VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+          .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+          .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+          .buffer = mesh->meshlet_draw_buffers[renderer->current_frame],
+          .size = VK_WHOLE_SIZE},
+      0, NULL);
+  record_meshlet_cull_dispatch(
+      renderer, mesh, model_view_projection, camera_position,
+      MESHLET_CULL_FLAG_LATE | MESHLET_CULL_FLAG_DEPTH_PYRAMID);
+}
+
+void record_meshlet_indirect_draw(struct vulkan_renderer *renderer,
+                                  const struct mesh *mesh,
+                                  const struct mat4 *model_view_projection,
+                                  VkDeviceSize commands_offset,
+                                  VkDeviceSize count_offset) {
+  struct mesh_draw_data draw_data =
+      mesh_draw_data_from_model_view_projection(model_view_projection);
+  vulkan_renderer_bind_mesh(renderer, mesh);
+  if (!vulkan_renderer_set_mesh_draw_data(renderer, mesh, &draw_data)) {
+    return;
+  }
+  VkCommandBuffer command_buffer =
+      renderer->frames[renderer->current_frame].command_buffer;
+  VkBuffer draw_buffer = mesh->meshlet_draw_buffers[renderer->current_frame];
+  if (renderer->draw_indirect_count_supported) {
+    vkCmdDrawIndexedIndirectCount(command_buffer, draw_buffer, commands_offset,
+                                  draw_buffer, count_offset,
+                                  mesh->meshlet_count,
+                                  sizeof(VkDrawIndexedIndirectCommand));
+  } else {
+    vkCmdDrawIndexedIndirect(command_buffer, draw_buffer, commands_offset,
+                             mesh->meshlet_count,
+                             sizeof(VkDrawIndexedIndirectCommand));
+  }
+  renderer->frame_counters.draw_call_count++;
+}
+
+void vulkan_renderer_draw_meshlets(struct vulkan_renderer *renderer,
+                                   const struct mesh *mesh,
+                                   const struct mat4 *model_view_projection,
+                                   struct vec3 camera_position) {
+  if (mesh->meshlet_count == 0) {
+    struct mesh_draw_data draw_data =
+        mesh_draw_data_from_model_view_projection(model_view_projection);
+    vulkan_renderer_draw_mesh(renderer, mesh, &draw_data);
+    return;
+  }
+  capture_record_meshlets(&renderer->capture, CAPTURE_COMMAND_DRAW_MESHLETS,
+                          mesh, model_view_projection, camera_position);
+
+  if (renderer->mesh_shader_supported) {
+    VkCommandBuffer command_buffer =
+        renderer->frames[renderer->current_frame].command_buffer;
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                      renderer->meshlet_mesh_pipeline);
+    renderer->frame_counters.pipeline_bind_count++;
+    vkCmdBindDescriptorSets(
+        command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+        renderer->meshlet_pipeline_layout, 0, 1,
+        &mesh->meshlet_descriptor_sets[renderer->current_frame], 0, NULL);
+    struct meshlet_push_constants push_constants = make_meshlet_push_constants(
+        mesh, model_view_projection, camera_position, 0);
+    vkCmdPushConstants(command_buffer, renderer->meshlet_pipeline_layout,
+                       meshlet_shader_stages(renderer), 0,
+                       sizeof(push_constants), &push_constants);
+    renderer->cmd_draw_mesh_tasks(
+        command_buffer,
+        (mesh->meshlet_count + MESHLET_TASK_WORKGROUP_SIZE - 1) /
+            MESHLET_TASK_WORKGROUP_SIZE,
+        1, 1);
+    renderer->frame_counters.draw_call_count++;
+    return;
+  }
+
+  record_meshlet_indirect_draw(renderer, mesh, model_view_projection,
+                               MESHLET_DRAW_COMMANDS_OFFSET, 0);
+}
+
+void vulkan_renderer_draw_meshlets_late(
+    struct vulkan_renderer *renderer, const struct mesh *mesh,
+    const struct mat4 *model_view_projection) {
+  if (mesh->meshlet_count == 0 ||
+      renderer->occlusion_phase != VULKAN_RENDERER_OCCLUSION_PHASE_LATE_DRAW) {
+    return;
+  }
+  capture_record_meshlets(&renderer->capture,
+                          CAPTURE_COMMAND_DRAW_MESHLETS_LATE, mesh,
+                          model_view_projection, (struct vec3){0});
+
+  record_meshlet_indirect_draw(
+      renderer, mesh, model_view_projection,
+      MESHLET_DRAW_COMMANDS_OFFSET + (VkDeviceSize)mesh->meshlet_count *
+                                         sizeof(VkDrawIndexedIndirectCommand),
+      MESHLET_LATE_DRAW_COUNT_OFFSET);
+}
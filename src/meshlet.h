@@ -0,0 +1,78 @@
+#ifndef VKGUIDE_MESHLET_H
+#define VKGUIDE_MESHLET_H
+
+#include "mesh_format.h"
+#include "transform.h"
+#include "vulkan_renderer.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// Flags of meshlet_push_constants, set by the culling passes of occlusion
+// culling
+#define MESHLET_CULL_FLAG_LATE 1u
+// Meshlets are tested against the depth pyramid, unset until it is built
+#define MESHLET_CULL_FLAG_DEPTH_PYRAMID 2u
+
+struct mesh;
+
+// Layout of the push constant block of shaders/meshlet_common.glsl
+struct meshlet_push_constants {
+  struct mat4 model_view_projection;
+  float position_offset[4];
+  float position_scale[4];
+  float camera_position[3];
+  uint32_t meshlet_count;
+  uint32_t flags;
+};
+
+// Counters of the cull stats buffers of occlusion culling, see
+// shaders/meshlet_cull.comp
+enum meshlet_cull_stat {
+  MESHLET_CULL_STAT_TESTED,
+  MESHLET_CULL_STAT_FRUSTUM_CULLED,
+  MESHLET_CULL_STAT_RETESTED,
+  MESHLET_CULL_STAT_OCCLUDED,
+  MESHLET_CULL_STAT_COUNT
+};
+
+bool vulkan_renderer_create_meshlet_pipelines(struct vulkan_renderer *renderer);
+void vulkan_renderer_destroy_meshlet_pipelines(
+    struct vulkan_renderer *renderer);
+
+// Uploads the meshlet sections of a mapped .vkm file. Meshes without meshlets
+// or devices supporting neither culling path are left with meshlet_count = 0
+// and are drawn with vulkan_renderer_draw_mesh.
+bool vulkan_renderer_create_mesh_meshlets(struct vulkan_renderer *renderer,
+                                          struct mesh *mesh,
+                                          const struct mesh_file_header *header,
+                                          const uint8_t *file_bytes);
+void vulkan_renderer_destroy_mesh_meshlets(struct vulkan_renderer *renderer,
+                                           struct mesh *mesh);
+
+// Records the culling pass of the compute path, must be called between
+// vulkan_renderer_begin_frame and vulkan_renderer_begin_render_pass. Does
+// nothing when mesh shaders are used, the task shader culls instead.
+void vulkan_renderer_cull_meshlets(struct vulkan_renderer *renderer,
+                                   const struct mesh *mesh,
+                                   const struct mat4 *model_view_projection,
+                                   struct vec3 camera_position);
+// `camera_position` is in model space
+void vulkan_renderer_draw_meshlets(struct vulkan_renderer *renderer,
+                                   const struct mesh *mesh,
+                                   const struct mat4 *model_view_projection,
+                                   struct vec3 camera_position);
+
+// Late phase of occlusion culling, see occlusion.h. Must be given the
+// meshes, in any order, and the transforms the early phase was given.
+// Retests the meshlets the early culling pass found occluded, between
+// vulkan_renderer_build_depth_pyramid and vulkan_renderer_resume_render_pass.
+void vulkan_renderer_cull_meshlets_late(
+    struct vulkan_renderer *renderer, const struct mesh *mesh,
+    const struct mat4 *model_view_projection, struct vec3 camera_position);
+// Draws the meshlets that passed the retest, after
+// vulkan_renderer_resume_render_pass
+void vulkan_renderer_draw_meshlets_late(
+    struct vulkan_renderer *renderer, const struct mesh *mesh,
+    const struct mat4 *model_view_projection);
+
+#endif // VKGUIDE_MESHLET_H
@@ -0,0 +1,644 @@
+#include "occlusion.h"
+#include "arena.h"
+#include "log.h"
+#include "meshlet.h"
+#include <string.h>
+
+// See local_size in shaders/depth_pyramid.comp
+#define DEPTH_PYRAMID_WORKGROUP_SIZE 8
+
+// Layout of the push constant block of shaders/depth_pyramid.comp
+struct depth_pyramid_push_constants {
+  uint32_t source_size[2];
+  uint32_t sample_count;
+};
+
+void vulkan_renderer_select_occlusion_culling(
+    struct vulkan_renderer *renderer) {
+  if (!renderer->occlusion_culling_enabled) {
+    return;
+  }
+
+  VkFormatProperties format_properties;
+  vkGetPhysicalDeviceFormatProperties(
+      renderer->physical_device, renderer->depth_format, &format_properties);
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(renderer->physical_device, &properties);
+  if (!(format_properties.optimalTilingFeatures &
+        VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT) ||
+      !(properties.limits.sampledImageDepthSampleCounts &
+        renderer->msaa_sample_count)) {
+    LOG("The depth attachment can't be sampled, occlusion culling is "
+        "disabled");
+    renderer->occlusion_culling_enabled = false;
+    return;
+  }
+  LOG("Meshlets are occlusion culled against a depth pyramid");
+}
+
+bool vulkan_renderer_create_depth_pyramid_pipeline(
+    struct vulkan_renderer *renderer, const char *shader_path,
+    VkPipeline *out_pipeline) {
+  size_t arena_mark_before_shader = arena_mark(&renderer->init_arena);
+  size_t shader_code_size;
+  char *shader_code = load_shader_from_file(&renderer->init_arena,
+                                            shader_path, &shader_code_size);
+  if (!shader_code) {
+    LOG("Couldn't load depth pyramid shader");
+    return false;
+  }
+  VkShaderModule shader_module =
+      create_shader_module(renderer->device, shader_code, shader_code_size);
+  arena_rewind(&renderer->init_arena, arena_mark_before_shader);
+  if (!shader_module) {
+    return false;
+  }
+
+  VkResult result = vkCreateComputePipelines(
+      renderer->device, VK_NULL_HANDLE, 1,
+      &(const VkComputePipelineCreateInfo){
+          .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+          .stage = {.sType =
+                        VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+                    .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+                    .module = shader_module,
+                    .pName = "main"},
+          .layout = renderer->depth_pyramid_pipeline_layout},
+      NULL, out_pipeline);
+  vkDestroyShaderModule(renderer->device, shader_module, NULL);
+  return result == VK_SUCCESS;
+}
+
+bool vulkan_renderer_create_occlusion(struct vulkan_renderer *renderer) {
+  if (!renderer->occlusion_culling_enabled) {
+    return true;
+  }
+
+  // Only ever read with texelFetch, which ignores filtering
+  if (vkCreateSampler(
+          renderer->device,
+          &(const VkSamplerCreateInfo){
+              .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+              .magFilter = VK_FILTER_NEAREST,
+              .minFilter = VK_FILTER_NEAREST,
+              .mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST,
+              .addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+              .addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+              .addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+              .maxLod = VK_LOD_CLAMP_NONE},
+          NULL, &renderer->depth_pyramid_sampler) != VK_SUCCESS) {
+    LOG("Couldn't create depth pyramid sampler");
+    goto err;
+  }
+
+  VkDescriptorSetLayoutBinding depth_pyramid_bindings[] = {
+      {.binding = 0,
+       .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+       .descriptorCount = 1,
+       .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+       .pImmutableSamplers = &renderer->depth_pyramid_sampler},
+      {.binding = 1,
+       .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+       .descriptorCount = 1,
+       .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT}};
+  if (vkCreateDescriptorSetLayout(
+          renderer->device,
+          &(const VkDescriptorSetLayoutCreateInfo){
+              .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+              .bindingCount = 2,
+              .pBindings = depth_pyramid_bindings},
+          NULL, &renderer->depth_pyramid_descriptor_set_layout) !=
+      VK_SUCCESS) {
+    LOG("Couldn't create depth pyramid descriptor set layout");
+    goto err;
+  }
+
+  VkDescriptorSetLayoutBinding occlusion_bindings[] = {
+      {.binding = 0,
+       .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+       .descriptorCount = 1,
+       .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+       .pImmutableSamplers = &renderer->depth_pyramid_sampler},
+      {.binding = 1,
+       .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+       .descriptorCount = 1,
+       .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT}};
+  if (vkCreateDescriptorSetLayout(
+          renderer->device,
+          &(const VkDescriptorSetLayoutCreateInfo){
+              .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+              .bindingCount = 2,
+              .pBindings = occlusion_bindings},
+          NULL, &renderer->occlusion_descriptor_set_layout) != VK_SUCCESS) {
+    LOG("Couldn't create occlusion descriptor set layout");
+    goto err;
+  }
+
+  VkDescriptorPoolSize pool_sizes[] = {
+      {.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+       .descriptorCount =
+           DEPTH_PYRAMID_MAX_LEVEL_COUNT + MAX_FRAMES_IN_FLIGHT},
+      {.type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+       .descriptorCount = DEPTH_PYRAMID_MAX_LEVEL_COUNT},
+      {.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+       .descriptorCount = MAX_FRAMES_IN_FLIGHT}};
+  if (vkCreateDescriptorPool(
+          renderer->device,
+          &(const VkDescriptorPoolCreateInfo){
+              .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+              .maxSets = DEPTH_PYRAMID_MAX_LEVEL_COUNT + MAX_FRAMES_IN_FLIGHT,
+              .poolSizeCount = sizeof(pool_sizes) / sizeof(pool_sizes[0]),
+              .pPoolSizes = pool_sizes},
+          NULL, &renderer->occlusion_descriptor_pool) != VK_SUCCESS) {
+    LOG("Couldn't create occlusion descriptor pool");
+    goto err;
+  }
+
+  // Allocated for the deepest pyramid once, pyramid recreations only rewrite
+  // them
+  VkDescriptorSetLayout set_layouts[DEPTH_PYRAMID_MAX_LEVEL_COUNT];
+  for (uint32_t level = 0; level < DEPTH_PYRAMID_MAX_LEVEL_COUNT; level++) {
+    set_layouts[level] = renderer->depth_pyramid_descriptor_set_layout;
+  }
+  if (vkAllocateDescriptorSets(
+          renderer->device,
+          &(const VkDescriptorSetAllocateInfo){
+              .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+              .descriptorPool = renderer->occlusion_descriptor_pool,
+              .descriptorSetCount = DEPTH_PYRAMID_MAX_LEVEL_COUNT,
+              .pSetLayouts = set_layouts},
+          renderer->depth_pyramid_descriptor_sets) != VK_SUCCESS) {
+    LOG("Couldn't allocate depth pyramid descriptor sets");
+    goto err;
+  }
+  for (uint32_t frame_index = 0; frame_index < MAX_FRAMES_IN_FLIGHT;
+       frame_index++) {
+    set_layouts[frame_index] = renderer->occlusion_descriptor_set_layout;
+  }
+  if (vkAllocateDescriptorSets(
+          renderer->device,
+          &(const VkDescriptorSetAllocateInfo){
+              .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+              .descriptorPool = renderer->occlusion_descriptor_pool,
+              .descriptorSetCount = MAX_FRAMES_IN_FLIGHT,
+              .pSetLayouts = set_layouts},
+          renderer->occlusion_descriptor_sets) != VK_SUCCESS) {
+    LOG("Couldn't allocate occlusion descriptor sets");
+    goto err;
+  }
+
+  if (vkCreatePipelineLayout(
+          renderer->device,
+          &(const VkPipelineLayoutCreateInfo){
+              .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+              .setLayoutCount = 1,
+              .pSetLayouts = &renderer->depth_pyramid_descriptor_set_layout,
+              .pushConstantRangeCount = 1,
+              .pPushConstantRanges =
+                  &(const VkPushConstantRange){
+                      .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+                      .offset = 0,
+                      .size = sizeof(struct depth_pyramid_push_constants)}},
+          NULL, &renderer->depth_pyramid_pipeline_layout) != VK_SUCCESS) {
+    LOG("Couldn't create depth pyramid pipeline layout");
+    goto err;
+  }
+
+  if (!vulkan_renderer_create_depth_pyramid_pipeline(
+          renderer, "shaders/depth_pyramid.comp.spv",
+          &renderer->depth_pyramid_pipeline) ||
+      (renderer->msaa_sample_count > VK_SAMPLE_COUNT_1_BIT &&
+       !vulkan_renderer_create_depth_pyramid_pipeline(
+           renderer, "shaders/depth_pyramid_multisampled.comp.spv",
+           &renderer->depth_pyramid_multisampled_pipeline))) {
+    LOG("Couldn't create depth pyramid pipelines");
+    goto err;
+  }
+
+  // Read back by the CPU once the frame's fence has signaled, small enough
+  // to always live in host-visible memory
+  VkDeviceSize stats_size = sizeof(uint32_t) * MESHLET_CULL_STAT_COUNT;
+  for (uint32_t frame_index = 0; frame_index < MAX_FRAMES_IN_FLIGHT;
+       frame_index++) {
+    if (!vulkan_renderer_create_buffer(
+            renderer, stats_size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            &renderer->occlusion_stats_buffers[frame_index],
+            &renderer->occlusion_stats_memories[frame_index])) {
+      LOG("Couldn't create occlusion stats buffer");
+      goto err;
+    }
+    void *mapped;
+    if (vkMapMemory(renderer->device,
+                    renderer->occlusion_stats_memories[frame_index], 0,
+                    stats_size, 0, &mapped) != VK_SUCCESS) {
+      LOG("Couldn't map occlusion stats buffer");
+      goto err;
+    }
+    renderer->occlusion_stats_mapped[frame_index] = mapped;
+    memset(mapped, 0, stats_size);
+
+    vkUpdateDescriptorSets(
+        renderer->device, 1,
+        &(const VkWriteDescriptorSet){
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .dstSet = renderer->occlusion_descriptor_sets[frame_index],
+            .dstBinding = 1,
+            .descriptorCount = 1,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .pBufferInfo =
+                &(const VkDescriptorBufferInfo){
+                    .buffer = renderer->occlusion_stats_buffers[frame_index],
+                    .offset = 0,
+                    .range = stats_size}},
+        0, NULL);
+  }
+
+  return true;
+err:
+  vulkan_renderer_destroy_occlusion(renderer);
+  return false;
+}
+
+// Tolerates partially created resources, the occlusion fields of the renderer
+// must start zeroed
+void vulkan_renderer_destroy_occlusion(struct vulkan_renderer *renderer) {
+  if (!renderer->occlusion_culling_enabled) {
+    return;
+  }
+
+  for (uint32_t frame_index = 0; frame_index < MAX_FRAMES_IN_FLIGHT;
+       frame_index++) {
+    vkDestroyBuffer(renderer->device,
+                    renderer->occlusion_stats_buffers[frame_index], NULL);
+    vulkan_renderer_free_memory(
+        renderer, renderer->occlusion_stats_memories[frame_index]);
+    renderer->occlusion_stats_buffers[frame_index] = VK_NULL_HANDLE;
+    renderer->occlusion_stats_memories[frame_index] = VK_NULL_HANDLE;
+    renderer->occlusion_stats_mapped[frame_index] = NULL;
+  }
+  vkDestroyPipeline(renderer->device,
+                    renderer->depth_pyramid_multisampled_pipeline, NULL);
+  vkDestroyPipeline(renderer->device, renderer->depth_pyramid_pipeline, NULL);
+  vkDestroyPipelineLayout(renderer->device,
+                          renderer->depth_pyramid_pipeline_layout, NULL);
+  vkDestroyDescriptorPool(renderer->device,
+                          renderer->occlusion_descriptor_pool, NULL);
+  vkDestroyDescriptorSetLayout(
+      renderer->device, renderer->occlusion_descriptor_set_layout, NULL);
+  vkDestroyDescriptorSetLayout(
+      renderer->device, renderer->depth_pyramid_descriptor_set_layout, NULL);
+  vkDestroySampler(renderer->device, renderer->depth_pyramid_sampler, NULL);
+  renderer->depth_pyramid_multisampled_pipeline = VK_NULL_HANDLE;
+  renderer->depth_pyramid_pipeline = VK_NULL_HANDLE;
+  renderer->depth_pyramid_pipeline_layout = VK_NULL_HANDLE;
+  renderer->occlusion_descriptor_pool = VK_NULL_HANDLE;
+  renderer->occlusion_descriptor_set_layout = VK_NULL_HANDLE;
+  renderer->depth_pyramid_descriptor_set_layout = VK_NULL_HANDLE;
+  renderer->depth_pyramid_sampler = VK_NULL_HANDLE;
+}
+
+uint32_t previous_power_of_two(uint32_t value) {
+  uint32_t power = 1;
+  while (power <= value / 2) {
+    power *= 2;
+  }
+  return power;
+}
+
+VkExtent2D depth_pyramid_level_extent(const struct vulkan_renderer *renderer,
+                                      uint32_t level) {
+  uint32_t width = renderer->depth_pyramid_extent.width >> level;
+  uint32_t height = renderer->depth_pyramid_extent.height >> level;
+  return (VkExtent2D){.width = width > 0 ? width : 1,
+                      .height = height > 0 ? height : 1};
+}
+
+// Power-of-two sized so that every level exactly halves the previous one, a
+// footprint of at most 2^n texels of the first level then spans at most 2x2
+// texels of level n
+bool vulkan_renderer_create_depth_pyramid(struct vulkan_renderer *renderer) {
+  if (!renderer->occlusion_culling_enabled) {
+    return true;
+  }
+
+  renderer->depth_pyramid_extent = (VkExtent2D){
+      .width = previous_power_of_two(renderer->render_target_extent.width),
+      .height = previous_power_of_two(renderer->render_target_extent.height)};
+  uint32_t largest_side = renderer->depth_pyramid_extent.width >
+                                  renderer->depth_pyramid_extent.height
+                              ? renderer->depth_pyramid_extent.width
+                              : renderer->depth_pyramid_extent.height;
+  renderer->depth_pyramid_level_count = 1;
+  while (largest_side >> renderer->depth_pyramid_level_count &&
+         renderer->depth_pyramid_level_count < DEPTH_PYRAMID_MAX_LEVEL_COUNT) {
+    renderer->depth_pyramid_level_count++;
+  }
+  renderer->depth_pyramid_valid = false;
+
+  if (vkCreateImage(
+          renderer->device,
+          &(const VkImageCreateInfo){
+              .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+              .imageType = VK_IMAGE_TYPE_2D,
+              .format = VK_FORMAT_R32_SFLOAT,
+              .extent = {renderer->depth_pyramid_extent.width,
+                         renderer->depth_pyramid_extent.height, 1},
+              .mipLevels = renderer->depth_pyramid_level_count,
+              .arrayLayers = 1,
+              .samples = VK_SAMPLE_COUNT_1_BIT,
+              .tiling = VK_IMAGE_TILING_OPTIMAL,
+              .usage =
+                  VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+              .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+              .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED},
+          NULL, &renderer->depth_pyramid_image) != VK_SUCCESS) {
+    LOG("Couldn't create depth pyramid image");
+    goto err;
+  }
+
+  VkMemoryRequirements memory_requirements;
+  vkGetImageMemoryRequirements(renderer->device, renderer->depth_pyramid_image,
+                               &memory_requirements);
+  uint32_t memory_type_index;
+  if (!find_memory_type(renderer->physical_device,
+                        memory_requirements.memoryTypeBits,
+                        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                        &memory_type_index)) {
+    LOG("Couldn't find a suitable memory type for the depth pyramid");
+    goto err;
+  }
+  if (vkAllocateMemory(renderer->device,
+                       &(const VkMemoryAllocateInfo){
+                           .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+                           .allocationSize = memory_requirements.size,
+                           .memoryTypeIndex = memory_type_index},
+                       NULL, &renderer->depth_pyramid_memory) != VK_SUCCESS) {
+    LOG("Couldn't allocate depth pyramid memory");
+    goto err;
+  }
+  renderer->device_memory_allocation_count++;
+  if (vkBindImageMemory(renderer->device, renderer->depth_pyramid_image,
+                        renderer->depth_pyramid_memory, 0) != VK_SUCCESS) {
+    LOG("Couldn't bind depth pyramid memory");
+    goto err;
+  }
+
+  for (uint32_t level = 0; level <= renderer->depth_pyramid_level_count;
+       level++) {
+    // The view of every level, then one view per level
+    bool all_levels = level == renderer->depth_pyramid_level_count;
+    if (vkCreateImageView(
+            renderer->device,
+            &(const VkImageViewCreateInfo){
+                .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+                .image = renderer->depth_pyramid_image,
+                .viewType = VK_IMAGE_VIEW_TYPE_2D,
+                .format = VK_FORMAT_R32_SFLOAT,
+                .subresourceRange =
+                    {.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                     .baseMipLevel = all_levels ? 0 : level,
+                     .levelCount = all_levels
+                                       ? renderer->depth_pyramid_level_count
+                                       : 1,
+                     .layerCount = 1}},
+            NULL,
+            all_levels ? &renderer->depth_pyramid_view
+                       : &renderer->depth_pyramid_level_views[level]) !=
+        VK_SUCCESS) {
+      LOG("Couldn't create depth pyramid image view");
+      goto err;
+    }
+  }
+
+  // The pyramid stays in VK_IMAGE_LAYOUT_GENERAL, its levels are written
+  // then read by the next level and the culling passes
+  for (uint32_t level = 0; level < renderer->depth_pyramid_level_count;
+       level++) {
+    VkWriteDescriptorSet writes[] = {
+        {.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+         .dstSet = renderer->depth_pyramid_descriptor_sets[level],
+         .dstBinding = 0,
+         .descriptorCount = 1,
+         .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+         .pImageInfo =
+             level == 0
+                 ? &(const VkDescriptorImageInfo){
+                       .imageView = renderer->depth_attachment.view,
+                       .imageLayout =
+                           VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL}
+                 : &(const VkDescriptorImageInfo){
+                       .imageView =
+                           renderer->depth_pyramid_level_views[level - 1],
+                       .imageLayout = VK_IMAGE_LAYOUT_GENERAL}},
+        {.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+         .dstSet = renderer->depth_pyramid_descriptor_sets[level],
+         .dstBinding = 1,
+         .descriptorCount = 1,
+         .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+         .pImageInfo = &(const VkDescriptorImageInfo){
+             .imageView = renderer->depth_pyramid_level_views[level],
+             .imageLayout = VK_IMAGE_LAYOUT_GENERAL}}};
+    vkUpdateDescriptorSets(renderer->device, 2, writes, 0, NULL);
+  }
+  for (uint32_t frame_index = 0; frame_index < MAX_FRAMES_IN_FLIGHT;
+       frame_index++) {
+    vkUpdateDescriptorSets(
+        renderer->device, 1,
+        &(const VkWriteDescriptorSet){
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .dstSet = renderer->occlusion_descriptor_sets[frame_index],
+            .dstBinding = 0,
+            .descriptorCount = 1,
+            .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+            .pImageInfo =
+                &(const VkDescriptorImageInfo){
+                    .imageView = renderer->depth_pyramid_view,
+                    .imageLayout = VK_IMAGE_LAYOUT_GENERAL}},
+        0, NULL);
+  }
+
+  return true;
+err:
+  vulkan_renderer_destroy_depth_pyramid(renderer);
+  return false;
+}
+
+// Tolerates a partially created pyramid
+void vulkan_renderer_destroy_depth_pyramid(struct vulkan_renderer *renderer) {
+  if (!renderer->occlusion_culling_enabled) {
+    return;
+  }
+
+  for (uint32_t level = 0; level < DEPTH_PYRAMID_MAX_LEVEL_COUNT; level++) {
+    vkDestroyImageView(renderer->device,
+                       renderer->depth_pyramid_level_views[level], NULL);
+    renderer->depth_pyramid_level_views[level] = VK_NULL_HANDLE;
+  }
+  vkDestroyImageView(renderer->device, renderer->depth_pyramid_view, NULL);
+  vkDestroyImage(renderer->device, renderer->depth_pyramid_image, NULL);
+  vulkan_renderer_free_memory(renderer, renderer->depth_pyramid_memory);
+  renderer->depth_pyramid_view = VK_NULL_HANDLE;
+  renderer->depth_pyramid_image = VK_NULL_HANDLE;
+  renderer->depth_pyramid_memory = VK_NULL_HANDLE;
+  renderer->depth_pyramid_level_count = 0;
+  renderer->depth_pyramid_valid = false;
+}
+
+void vulkan_renderer_harvest_occlusion_stats(
+    struct vulkan_renderer *renderer) {
+  renderer->occlusion_stats_available = false;
+  if (!renderer->occlusion_culling_enabled) {
+    return;
+  }
+
+  struct vulkan_renderer_frame *frame =
+      &renderer->frames[renderer->current_frame];
+  uint32_t *cull_stats =
+      renderer->occlusion_stats_mapped[renderer->current_frame];
+  if (frame->occlusion_culled) {
+    renderer->occlusion_stats = (struct vulkan_renderer_occlusion_stats){
+        .meshlet_count = cull_stats[MESHLET_CULL_STAT_TESTED],
+        .frustum_culled_meshlet_count =
+            cull_stats[MESHLET_CULL_STAT_FRUSTUM_CULLED],
+        .retested_meshlet_count = cull_stats[MESHLET_CULL_STAT_RETESTED],
+        .occluded_meshlet_count = cull_stats[MESHLET_CULL_STAT_OCCLUDED]};
+
+    uint64_t timestamps[2];
+    if (frame->timestamps_written &&
+        vkGetQueryPoolResults(
+            renderer->device, renderer->timestamp_query_pool,
+            renderer->current_frame * VULKAN_RENDERER_TIMESTAMP_COUNT +
+                VULKAN_RENDERER_TIMESTAMP_OCCLUSION_START,
+            2, sizeof(timestamps), timestamps, sizeof(timestamps[0]),
+            VK_QUERY_RESULT_64_BIT) == VK_SUCCESS) {
+      uint64_t elapsed_ticks =
+          (timestamps[1] - timestamps[0]) & renderer->timestamp_mask;
+      renderer->occlusion_stats.gpu_time_ns =
+          (uint64_t)((double)elapsed_ticks * renderer->timestamp_period_ns);
+      renderer->occlusion_stats.gpu_time_available = true;
+    }
+    if (frame->early_cull_timed &&
+        vkGetQueryPoolResults(
+            renderer->device, renderer->timestamp_query_pool,
+            renderer->current_frame * VULKAN_RENDERER_TIMESTAMP_COUNT +
+                VULKAN_RENDERER_TIMESTAMP_EARLY_CULL_START,
+            2, sizeof(timestamps), timestamps, sizeof(timestamps[0]),
+            VK_QUERY_RESULT_64_BIT) == VK_SUCCESS) {
+      uint64_t elapsed_ticks =
+          (timestamps[1] - timestamps[0]) & renderer->timestamp_mask;
+      renderer->occlusion_stats.early_cull_gpu_time_ns =
+          (uint64_t)((double)elapsed_ticks * renderer->timestamp_period_ns);
+      renderer->occlusion_stats.early_cull_gpu_time_available = true;
+    }
+    renderer->occlusion_stats_available = true;
+    frame->occlusion_culled = false;
+  }
+  // Paused frames still count what the early pass culls
+  memset(cull_stats, 0, sizeof(uint32_t) * MESHLET_CULL_STAT_COUNT);
+}
+
+void vulkan_renderer_build_depth_pyramid(struct vulkan_renderer *renderer) {
+  if (renderer->occlusion_phase != VULKAN_RENDERER_OCCLUSION_PHASE_EARLY) {
+    return;
+  }
+  capture_record_command(&renderer->capture,
+                         CAPTURE_COMMAND_BUILD_DEPTH_PYRAMID);
+
+  VkCommandBuffer command_buffer =
+      renderer->frames[renderer->current_frame].command_buffer;
+  vkCmdEndRenderPass(command_buffer);
+  if (renderer->timestamp_query_pool != VK_NULL_HANDLE) {
+    vkCmdWriteTimestamp(
+        command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+        renderer->timestamp_query_pool,
+        renderer->current_frame * VULKAN_RENDERER_TIMESTAMP_COUNT +
+            VULKAN_RENDERER_TIMESTAMP_OCCLUSION_START);
+  }
+
+  // Every texel of the pyramid is rewritten, the culling passes of this and
+  // the previous frame must be done reading it
+  VkImageAspectFlags depth_aspect = VK_IMAGE_ASPECT_DEPTH_BIT;
+  if (renderer->depth_format != VK_FORMAT_D32_SFLOAT) {
+    depth_aspect |= VK_IMAGE_ASPECT_STENCIL_BIT;
+  }
+  VkImageMemoryBarrier barriers[] = {
+      {.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+       .srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+       .dstAccessMask = VK_ACCESS_SHADER_READ_BIT,
+       .oldLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+       .newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL,
+       .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+       .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+       .image = renderer->depth_attachment.image,
+       .subresourceRange = {.aspectMask = depth_aspect,
+                            .levelCount = 1,
+                            .layerCount = 1}},
+      {.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+       .srcAccessMask = 0,
+       .dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+       .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+       .newLayout = VK_IMAGE_LAYOUT_GENERAL,
+       .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+       .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+       .image = renderer->depth_pyramid_image,
+       .subresourceRange = {.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                            .levelCount = renderer->depth_pyramid_level_count,
+                            .layerCount = 1}}};
+  vkCmdPipelineBarrier(command_buffer,
+                       VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+                           VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT |
+                           VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                       VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, NULL, 0,
+                       NULL, sizeof(barriers) / sizeof(barriers[0]),
+                       barriers);
+
+  for (uint32_t level = 0; level < renderer->depth_pyramid_level_count;
+       level++) {
+    bool multisampled_source =
+        level == 0 && renderer->msaa_sample_count > VK_SAMPLE_COUNT_1_BIT;
+    if (level <= 1) {
+      vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                        multisampled_source
+                            ? renderer->depth_pyramid_multisampled_pipeline
+                            : renderer->depth_pyramid_pipeline);
+      renderer->frame_counters.pipeline_bind_count++;
+    }
+    vkCmdBindDescriptorSets(
+        command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+        renderer->depth_pyramid_pipeline_layout, 0, 1,
+        &renderer->depth_pyramid_descriptor_sets[level], 0, NULL);
+
+    // The first level covers the rendered part of the depth attachment
+    VkExtent2D source_extent =
+        level == 0 ? renderer->render_extent
+                   : depth_pyramid_level_extent(renderer, level - 1);
+    struct depth_pyramid_push_constants push_constants = {
+        .source_size = {source_extent.width, source_extent.height},
+        .sample_count = renderer->msaa_sample_count};
+    vkCmdPushConstants(command_buffer,
+                       renderer->depth_pyramid_pipeline_layout,
+                       VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push_constants),
+                       &push_constants);
+    VkExtent2D level_extent = depth_pyramid_level_extent(renderer, level);
+    vkCmdDispatch(command_buffer,
+                  (level_extent.width + DEPTH_PYRAMID_WORKGROUP_SIZE - 1) /
+                      DEPTH_PYRAMID_WORKGROUP_SIZE,
+                  (level_extent.height + DEPTH_PYRAMID_WORKGROUP_SIZE - 1) /
+                      DEPTH_PYRAMID_WORKGROUP_SIZE,
+                  1);
+
+    // Read by the next level, the last one by the culling passes
+    vkCmdPipelineBarrier(
+        command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1,
+        &(const VkMemoryBarrier){.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+                                 .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+                                 .dstAccessMask = VK_ACCESS_SHADER_READ_BIT},
+        0, NULL, 0, NULL);
+  }
+
+  renderer->depth_pyramid_valid = true;
+  renderer->occlusion_phase = VULKAN_RENDERER_OCCLUSION_PHASE_LATE_CULL;
+}
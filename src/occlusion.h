@@ -0,0 +1,52 @@
+#ifndef VKGUIDE_OCCLUSION_H
+#define VKGUIDE_OCCLUSION_H
+
+#include "vulkan_renderer.h"
+#include <stdbool.h>
+
+// Two-phase occlusion culling of the meshlets culled by the compute pass.
+// A depth pyramid keeps the farthest depth of each texel of every level,
+// built from the depth attachment by a compute max-reduction. A frame is
+// recorded as:
+//
+//   vulkan_renderer_cull_meshlets       frustum, cone, and previous frame's
+//                                       pyramid; rejected meshlets are queued
+//   vulkan_renderer_begin_render_pass
+//   vulkan_renderer_draw_meshlets       the meshlets that passed
+//   vulkan_renderer_build_depth_pyramid from the depth drawn so far
+//   vulkan_renderer_cull_meshlets_late  retests the queue against it
+//   vulkan_renderer_resume_render_pass
+//   vulkan_renderer_draw_meshlets_late  the meshlets that became visible
+//   ... other draws ...
+//   vulkan_renderer_end_render_pass
+//
+// Every meshlet the early phase wrongly rejects, because the camera moved or
+// it was disoccluded, is drawn by the late phase, the pyramid of the current
+// frame only holds depth that is really there. The next frame tests against
+// that pyramid, meshlets disoccluded this frame aren't occluders in it.
+//
+// The late phase functions do nothing unless the frame is occlusion culled,
+// they can be called unconditionally.
+
+// Called once the attachment formats are chosen, turns occlusion culling off
+// when the depth attachment can't be sampled
+void vulkan_renderer_select_occlusion_culling(struct vulkan_renderer *renderer);
+
+// Must be called before the meshlet pipelines are created, whose layout gets
+// occlusion_descriptor_set_layout. Does nothing when occlusion culling is
+// disabled.
+bool vulkan_renderer_create_occlusion(struct vulkan_renderer *renderer);
+void vulkan_renderer_destroy_occlusion(struct vulkan_renderer *renderer);
+// Sized after render_target_extent, must be recreated with the depth
+// attachment
+bool vulkan_renderer_create_depth_pyramid(struct vulkan_renderer *renderer);
+void vulkan_renderer_destroy_depth_pyramid(struct vulkan_renderer *renderer);
+
+// Called by vulkan_renderer_begin_frame once the frame's fence has signaled
+void vulkan_renderer_harvest_occlusion_stats(struct vulkan_renderer *renderer);
+
+// Ends the early render pass and builds the depth pyramid from its depth,
+// the late culling passes can then be recorded
+void vulkan_renderer_build_depth_pyramid(struct vulkan_renderer *renderer);
+
+#endif // VKGUIDE_OCCLUSION_H
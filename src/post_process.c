@@ -0,0 +1,525 @@
+#include "post_process.h"
+#include "arena.h"
+#include "log.h"
+#include "vulkan_renderer.h"
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// See local_size in shaders/post_process.comp
+#define POST_PROCESS_WORKGROUP_SIZE 8
+
+enum post_process_binding {
+  POST_PROCESS_BINDING_SCENE_COLOR,
+  POST_PROCESS_BINDING_OUTPUT,
+  POST_PROCESS_BINDING_COUNT,
+};
+
+bool format_is_srgb(VkFormat format) {
+  return format == VK_FORMAT_B8G8R8A8_SRGB ||
+         format == VK_FORMAT_R8G8B8A8_SRGB ||
+         format == VK_FORMAT_A8B8G8R8_SRGB_PACK32;
+}
+
+VkShaderStageFlags post_process_shader_stage(struct vulkan_renderer *renderer) {
+  return renderer->swapchain_storage_supported ? VK_SHADER_STAGE_COMPUTE_BIT
+                                               : VK_SHADER_STAGE_FRAGMENT_BIT;
+}
+
+VkShaderModule load_post_process_shader(struct vulkan_renderer *renderer,
+                                        const char *path) {
+  size_t arena_mark_before_shader = arena_mark(&renderer->init_arena);
+  size_t shader_code_size;
+  char *shader_code =
+      load_shader_from_file(&renderer->init_arena, path, &shader_code_size);
+  if (!shader_code) {
+    LOG("Couldn't load post process shader %s", path);
+    return VK_NULL_HANDLE;
+  }
+  VkShaderModule shader_module =
+      create_shader_module(renderer->device, shader_code, shader_code_size);
+  arena_rewind(&renderer->init_arena, arena_mark_before_shader);
+  return shader_module;
+}
+
+bool vulkan_renderer_create_post_process_compute_pipeline(
+    struct vulkan_renderer *renderer) {
+  VkShaderModule compute_shader_module =
+      load_post_process_shader(renderer, "shaders/post_process.comp.spv");
+  if (!compute_shader_module) {
+    return false;
+  }
+
+  VkResult result = vkCreateComputePipelines(
+      renderer->device, VK_NULL_HANDLE, 1,
+      &(const VkComputePipelineCreateInfo){
+          .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+          .stage = {.sType =
+                        VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+                    .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+                    .module = compute_shader_module,
+                    .pName = "main"},
+          .layout = renderer->post_process_pipeline_layout},
+      NULL, &renderer->post_process_pipeline);
+  vkDestroyShaderModule(renderer->device, compute_shader_module, NULL);
+  return result == VK_SUCCESS;
+}
+
+// Overwrites the whole swapchain image, its previous content doesn't matter
+bool vulkan_renderer_create_post_process_render_pass(
+    struct vulkan_renderer *renderer) {
+  VkAttachmentDescription color_attachment = {
+      .format = renderer->swapchain_image_format,
+      .samples = VK_SAMPLE_COUNT_1_BIT,
+      .loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+      .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+      .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+      .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+      .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+      .finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR};
+
+  VkAttachmentReference color_attachment_ref = {
+      .attachment = 0,
+      .layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+  };
+
+  VkSubpassDescription subpass = {.pipelineBindPoint =
+                                      VK_PIPELINE_BIND_POINT_GRAPHICS,
+                                  .colorAttachmentCount = 1,
+                                  .pColorAttachments = &color_attachment_ref};
+
+  // Waits for the swapchain image to be acquired, see
+  // vulkan_renderer_create_render_pass
+  VkSubpassDependency dependency = {
+      .srcSubpass = VK_SUBPASS_EXTERNAL,
+      .dstSubpass = 0,
+      .srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+      .srcAccessMask = 0,
+      .dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+      .dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT};
+
+  return vkCreateRenderPass(
+             renderer->device,
+             &(const VkRenderPassCreateInfo){
+                 .sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
+                 .attachmentCount = 1,
+                 .pAttachments = &color_attachment,
+                 .subpassCount = 1,
+                 .pSubpasses = &subpass,
+                 .dependencyCount = 1,
+                 .pDependencies = &dependency},
+             NULL, &renderer->post_process_render_pass) == VK_SUCCESS;
+}
+
+// Fullscreen triangle generated from gl_VertexIndex, no vertex input
+bool vulkan_renderer_create_post_process_graphics_pipeline(
+    struct vulkan_renderer *renderer) {
+  VkShaderModule vertex_shader_module =
+      load_post_process_shader(renderer, "shaders/fullscreen.vert.spv");
+  VkShaderModule fragment_shader_module =
+      load_post_process_shader(renderer, "shaders/post_process.frag.spv");
+  if (!vertex_shader_module || !fragment_shader_module) {
+    goto destroy_shader_modules;
+  }
+
+  VkPipelineShaderStageCreateInfo shader_stages[] = {
+      {.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+       .stage = VK_SHADER_STAGE_VERTEX_BIT,
+       .module = vertex_shader_module,
+       .pName = "main"},
+      {.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+       .stage = VK_SHADER_STAGE_FRAGMENT_BIT,
+       .module = fragment_shader_module,
+       .pName = "main"}};
+
+  VkDynamicState dynamic_states[] = {VK_DYNAMIC_STATE_VIEWPORT,
+                                     VK_DYNAMIC_STATE_SCISSOR};
+
+  VkPipelineDynamicStateCreateInfo dynamic_state = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
+      .dynamicStateCount = (sizeof(dynamic_states) / sizeof(VkDynamicState)),
+      .pDynamicStates = dynamic_states};
+
+  VkPipelineVertexInputStateCreateInfo vertex_input_info = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO};
+
+  VkPipelineInputAssemblyStateCreateInfo input_assembly = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
+      .topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
+      .primitiveRestartEnable = VK_FALSE};
+
+  VkPipelineViewportStateCreateInfo viewport_state = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
+      .viewportCount = 1,
+      .scissorCount = 1};
+
+  VkPipelineRasterizationStateCreateInfo rasterizer = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
+      .depthClampEnable = VK_FALSE,
+      .rasterizerDiscardEnable = VK_FALSE,
+      .polygonMode = VK_POLYGON_MODE_FILL,
+      .lineWidth = 1.0f,
+      .cullMode = VK_CULL_MODE_NONE,
+      .frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE,
+      .depthBiasEnable = VK_FALSE};
+
+  VkPipelineMultisampleStateCreateInfo multisampling = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
+      .sampleShadingEnable = VK_FALSE,
+      .rasterizationSamples = VK_SAMPLE_COUNT_1_BIT,
+      .minSampleShading = 1.0f,
+  };
+
+  VkPipelineColorBlendAttachmentState color_blend_attachment = {
+      .colorWriteMask = MESH_PIPELINE_COLOR_WRITE_MASK_ALL,
+      .blendEnable = VK_FALSE,
+  };
+
+  VkPipelineColorBlendStateCreateInfo color_blending = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
+      .logicOpEnable = VK_FALSE,
+      .attachmentCount = 1,
+      .pAttachments = &color_blend_attachment};
+
+  if (vkCreateGraphicsPipelines(
+          renderer->device, VK_NULL_HANDLE, 1,
+          &(const VkGraphicsPipelineCreateInfo){
+              .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+              .stageCount = 2,
+              .pStages = shader_stages,
+              .pVertexInputState = &vertex_input_info,
+              .pInputAssemblyState = &input_assembly,
+              .pViewportState = &viewport_state,
+              .pRasterizationState = &rasterizer,
+              .pMultisampleState = &multisampling,
+              .pColorBlendState = &color_blending,
+              .pDynamicState = &dynamic_state,
+              .layout = renderer->post_process_pipeline_layout,
+              .renderPass = renderer->post_process_render_pass,
+              .subpass = 0},
+          NULL, &renderer->post_process_pipeline) != VK_SUCCESS) {
+    goto destroy_shader_modules;
+  }
+
+  vkDestroyShaderModule(renderer->device, vertex_shader_module, NULL);
+  vkDestroyShaderModule(renderer->device, fragment_shader_module, NULL);
+  return true;
+destroy_shader_modules:
+  vkDestroyShaderModule(renderer->device, vertex_shader_module, NULL);
+  vkDestroyShaderModule(renderer->device, fragment_shader_module, NULL);
+  return false;
+}
+
+bool vulkan_renderer_create_post_process(struct vulkan_renderer *renderer) {
+  if (!renderer->post_process_enabled) {
+    return true;
+  }
+
+  LOG("Post processing with a %s pass",
+      renderer->swapchain_storage_supported ? "compute" : "fullscreen");
+
+  if (vkCreateSampler(
+          renderer->device,
+          &(const VkSamplerCreateInfo){
+              .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+              .magFilter = VK_FILTER_LINEAR,
+              .minFilter = VK_FILTER_LINEAR,
+              .mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST,
+              .addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+              .addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+              .addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE},
+          NULL, &renderer->post_process_sampler) != VK_SUCCESS) {
+    LOG("Couldn't create post process sampler");
+    goto err;
+  }
+
+  VkShaderStageFlags stage = post_process_shader_stage(renderer);
+  uint32_t binding_count = renderer->swapchain_storage_supported
+                               ? POST_PROCESS_BINDING_COUNT
+                               : POST_PROCESS_BINDING_OUTPUT;
+  VkDescriptorSetLayoutBinding bindings[POST_PROCESS_BINDING_COUNT] = {
+      {.binding = POST_PROCESS_BINDING_SCENE_COLOR,
+       .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+       .descriptorCount = 1,
+       .stageFlags = stage,
+       .pImmutableSamplers = &renderer->post_process_sampler},
+      {.binding = POST_PROCESS_BINDING_OUTPUT,
+       .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+       .descriptorCount = 1,
+       .stageFlags = stage}};
+  if (vkCreateDescriptorSetLayout(
+          renderer->device,
+          &(const VkDescriptorSetLayoutCreateInfo){
+              .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+              .bindingCount = binding_count,
+              .pBindings = bindings},
+          NULL, &renderer->post_process_descriptor_set_layout) != VK_SUCCESS) {
+    LOG("Couldn't create post process descriptor set layout");
+    goto destroy_sampler;
+  }
+
+  VkDescriptorPoolSize pool_sizes[POST_PROCESS_BINDING_COUNT] = {
+      {.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+       .descriptorCount = MAX_SWAPCHAIN_IMAGE_COUNT},
+      {.type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+       .descriptorCount = MAX_SWAPCHAIN_IMAGE_COUNT}};
+  if (vkCreateDescriptorPool(
+          renderer->device,
+          &(const VkDescriptorPoolCreateInfo){
+              .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+              .maxSets = MAX_SWAPCHAIN_IMAGE_COUNT,
+              .poolSizeCount = binding_count,
+              .pPoolSizes = pool_sizes},
+          NULL, &renderer->post_process_descriptor_pool) != VK_SUCCESS) {
+    LOG("Couldn't create post process descriptor pool");
+    goto destroy_descriptor_set_layout;
+  }
+
+  // Allocated for the largest swapchain once, swapchain recreations only
+  // rewrite them
+  VkDescriptorSetLayout set_layouts[MAX_SWAPCHAIN_IMAGE_COUNT];
+  for (uint32_t set_index = 0; set_index < MAX_SWAPCHAIN_IMAGE_COUNT;
+       set_index++) {
+    set_layouts[set_index] = renderer->post_process_descriptor_set_layout;
+  }
+  if (vkAllocateDescriptorSets(
+          renderer->device,
+          &(const VkDescriptorSetAllocateInfo){
+              .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+              .descriptorPool = renderer->post_process_descriptor_pool,
+              .descriptorSetCount = MAX_SWAPCHAIN_IMAGE_COUNT,
+              .pSetLayouts = set_layouts},
+          renderer->post_process_descriptor_sets) != VK_SUCCESS) {
+    LOG("Couldn't allocate post process descriptor sets");
+    goto destroy_descriptor_pool;
+  }
+
+  if (vkCreatePipelineLayout(
+          renderer->device,
+          &(const VkPipelineLayoutCreateInfo){
+              .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+              .setLayoutCount = 1,
+              .pSetLayouts = &renderer->post_process_descriptor_set_layout,
+              .pushConstantRangeCount = 1,
+              .pPushConstantRanges =
+                  &(const VkPushConstantRange){
+                      .stageFlags = stage,
+                      .offset = 0,
+                      .size = sizeof(struct post_process_push_constants)}},
+          NULL, &renderer->post_process_pipeline_layout) != VK_SUCCESS) {
+    LOG("Couldn't create post process pipeline layout");
+    goto destroy_descriptor_pool;
+  }
+
+  if (renderer->swapchain_storage_supported) {
+    if (!vulkan_renderer_create_post_process_compute_pipeline(renderer)) {
+      LOG("Couldn't create post process compute pipeline");
+      goto destroy_pipeline_layout;
+    }
+    return true;
+  }
+
+  if (!vulkan_renderer_create_post_process_render_pass(renderer)) {
+    LOG("Couldn't create post process render pass");
+    goto destroy_pipeline_layout;
+  }
+
+  if (!vulkan_renderer_create_post_process_graphics_pipeline(renderer)) {
+    LOG("Couldn't create post process graphics pipeline");
+    goto destroy_render_pass;
+  }
+
+  return true;
+destroy_render_pass:
+  vkDestroyRenderPass(renderer->device, renderer->post_process_render_pass,
+                      NULL);
+destroy_pipeline_layout:
+  vkDestroyPipelineLayout(renderer->device,
+                          renderer->post_process_pipeline_layout, NULL);
+destroy_descriptor_pool:
+  vkDestroyDescriptorPool(renderer->device,
+                          renderer->post_process_descriptor_pool, NULL);
+destroy_descriptor_set_layout:
+  vkDestroyDescriptorSetLayout(
+      renderer->device, renderer->post_process_descriptor_set_layout, NULL);
+destroy_sampler:
+  vkDestroySampler(renderer->device, renderer->post_process_sampler, NULL);
+err:
+  return false;
+}
+
+void vulkan_renderer_destroy_post_process(struct vulkan_renderer *renderer) {
+  if (!renderer->post_process_enabled) {
+    return;
+  }
+
+  vkDestroyPipeline(renderer->device, renderer->post_process_pipeline, NULL);
+  vkDestroyRenderPass(renderer->device, renderer->post_process_render_pass,
+                      NULL);
+  vkDestroyPipelineLayout(renderer->device,
+                          renderer->post_process_pipeline_layout, NULL);
+  vkDestroyDescriptorPool(renderer->device,
+                          renderer->post_process_descriptor_pool, NULL);
+  vkDestroyDescriptorSetLayout(
+      renderer->device, renderer->post_process_descriptor_set_layout, NULL);
+  vkDestroySampler(renderer->device, renderer->post_process_sampler, NULL);
+}
+
+void vulkan_renderer_update_post_process_descriptors(
+    struct vulkan_renderer *renderer) {
+  if (!renderer->post_process_enabled) {
+    return;
+  }
+
+  for (uint32_t swapchain_image_index = 0;
+       swapchain_image_index < renderer->swapchain_image_count;
+       swapchain_image_index++) {
+    VkDescriptorSet descriptor_set =
+        renderer->post_process_descriptor_sets[swapchain_image_index];
+    VkWriteDescriptorSet writes[POST_PROCESS_BINDING_COUNT] = {
+        {.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+         .dstSet = descriptor_set,
+         .dstBinding = POST_PROCESS_BINDING_SCENE_COLOR,
+         .descriptorCount = 1,
+         .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+         .pImageInfo =
+             &(const VkDescriptorImageInfo){
+                 .imageView = renderer->scene_color_attachment.view,
+                 .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL}},
+        {.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+         .dstSet = descriptor_set,
+         .dstBinding = POST_PROCESS_BINDING_OUTPUT,
+         .descriptorCount = 1,
+         .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+         .pImageInfo = &(const VkDescriptorImageInfo){
+             .imageView =
+                 renderer->swapchain_image_views[swapchain_image_index],
+             .imageLayout = VK_IMAGE_LAYOUT_GENERAL}}};
+    vkUpdateDescriptorSets(renderer->device,
+                           renderer->swapchain_storage_supported
+                               ? POST_PROCESS_BINDING_COUNT
+                               : POST_PROCESS_BINDING_OUTPUT,
+                           writes, 0, NULL);
+  }
+}
+
+void swapchain_image_barrier(VkCommandBuffer command_buffer, VkImage image,
+                             VkPipelineStageFlags src_stage_mask,
+                             VkAccessFlags src_access_mask,
+                             VkPipelineStageFlags dst_stage_mask,
+                             VkAccessFlags dst_access_mask,
+                             VkImageLayout old_layout,
+                             VkImageLayout new_layout) {
+  vkCmdPipelineBarrier(
+      command_buffer, src_stage_mask, dst_stage_mask, 0, 0, NULL, 0, NULL, 1,
+      &(const VkImageMemoryBarrier){
+          .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+          .srcAccessMask = src_access_mask,
+          .dstAccessMask = dst_access_mask,
+          .oldLayout = old_layout,
+          .newLayout = new_layout,
+          .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+          .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+          .image = image,
+          .subresourceRange = {.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                               .levelCount = 1,
+                               .layerCount = 1}});
+}
+
+void vulkan_renderer_record_post_process(struct vulkan_renderer *renderer) {
+  assert(renderer->post_process_enabled);
+  VkCommandBuffer command_buffer =
+      renderer->frames[renderer->current_frame].command_buffer;
+  uint32_t swapchain_image_index = renderer->current_swapchain_image_index;
+  VkExtent2D output_extent = renderer->swapchain_extent;
+
+  // FXAA only makes up for the lack of multisampling
+  VkExtent2D input_extent = renderer->render_target_extent;
+  VkExtent2D rendered_extent = renderer->render_extent;
+  struct post_process_push_constants push_constants = {
+      .output_size = {(float)output_extent.width, (float)output_extent.height},
+      .input_texel_size = {1.0f / (float)input_extent.width,
+                           1.0f / (float)input_extent.height},
+      .input_uv_scale = {(float)rendered_extent.width /
+                             (float)input_extent.width,
+                         (float)rendered_extent.height /
+                             (float)input_extent.height},
+      .input_uv_max = {((float)rendered_extent.width - 0.5f) /
+                           (float)input_extent.width,
+                       ((float)rendered_extent.height - 0.5f) /
+                           (float)input_extent.height},
+      .exposure = 1.0f,
+      .flags = (renderer->msaa_sample_count == VK_SAMPLE_COUNT_1_BIT
+                    ? POST_PROCESS_FLAG_FXAA
+                    : 0) |
+               (format_is_srgb(renderer->swapchain_image_format)
+                    ? 0
+                    : POST_PROCESS_FLAG_ENCODE_SRGB)};
+
+  if (!renderer->swapchain_storage_supported) {
+    vkCmdBeginRenderPass(
+        command_buffer,
+        &(const VkRenderPassBeginInfo){
+            .sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
+            .renderPass = renderer->post_process_render_pass,
+            .framebuffer =
+                renderer->swapchain_framebuffers[swapchain_image_index],
+            .renderArea = {.offset = {0, 0}, .extent = output_extent}},
+        VK_SUBPASS_CONTENTS_INLINE);
+    vkCmdSetViewport(
+        command_buffer, 0, 1,
+        &(const VkViewport){.width = (float)output_extent.width,
+                            .height = (float)output_extent.height,
+                            .maxDepth = 1.0f});
+    vkCmdSetScissor(
+        command_buffer, 0, 1,
+        &(const VkRect2D){.offset = {0, 0}, .extent = output_extent});
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                      renderer->post_process_pipeline);
+    renderer->frame_counters.pipeline_bind_count++;
+    vkCmdBindDescriptorSets(
+        command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+        renderer->post_process_pipeline_layout, 0, 1,
+        &renderer->post_process_descriptor_sets[swapchain_image_index], 0,
+        NULL);
+    vkCmdPushConstants(command_buffer, renderer->post_process_pipeline_layout,
+                       VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(push_constants),
+                       &push_constants);
+    vkCmdDraw(command_buffer, 3, 1, 0, 0);
+    renderer->frame_counters.draw_call_count++;
+    vkCmdEndRenderPass(command_buffer);
+    return;
+  }
+
+  // The submission waits for the image to be acquired at the color attachment
+  // output stage, the barrier chains with that wait
+  VkImage swapchain_image = renderer->swapchain_images[swapchain_image_index];
+  swapchain_image_barrier(
+      command_buffer, swapchain_image,
+      VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0,
+      VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+      VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+
+  vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                    renderer->post_process_pipeline);
+  renderer->frame_counters.pipeline_bind_count++;
+  vkCmdBindDescriptorSets(
+      command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+      renderer->post_process_pipeline_layout, 0, 1,
+      &renderer->post_process_descriptor_sets[swapchain_image_index], 0, NULL);
+  vkCmdPushConstants(command_buffer, renderer->post_process_pipeline_layout,
+                     VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push_constants),
+                     &push_constants);
+  vkCmdDispatch(command_buffer,
+                (output_extent.width + POST_PROCESS_WORKGROUP_SIZE - 1) /
+                    POST_PROCESS_WORKGROUP_SIZE,
+                (output_extent.height + POST_PROCESS_WORKGROUP_SIZE - 1) /
+                    POST_PROCESS_WORKGROUP_SIZE,
+                1);
+
+  // Readbacks may still copy the image before it is presented
+  swapchain_image_barrier(
+      command_buffer, swapchain_image, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+      VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0,
+      VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+}
@@ -0,0 +1,38 @@
+#ifndef VKGUIDE_POST_PROCESS_H
+#define VKGUIDE_POST_PROCESS_H
+
+#include "vulkan_renderer.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#define POST_PROCESS_FLAG_FXAA 1u
+// Set when the swapchain format doesn't encode sRGB itself
+#define POST_PROCESS_FLAG_ENCODE_SRGB 2u
+
+// Layout of the push constant block of shaders/post_process_common.glsl
+struct post_process_push_constants {
+  float output_size[2];
+  float input_texel_size[2];
+  // Maps the output to the rendered part of the scene color image, samples
+  // are clamped to it
+  float input_uv_scale[2];
+  float input_uv_max[2];
+  float exposure;
+  uint32_t flags;
+};
+
+// Must be called once the swapchain exists, before the framebuffers are
+// created. Does nothing when post processing is disabled.
+bool vulkan_renderer_create_post_process(struct vulkan_renderer *renderer);
+void vulkan_renderer_destroy_post_process(struct vulkan_renderer *renderer);
+// Points the descriptor sets at the scene color and swapchain images, must be
+// called whenever they are recreated
+void vulkan_renderer_update_post_process_descriptors(
+    struct vulkan_renderer *renderer);
+
+// Records the tonemapping, anti-aliasing and upscaling of the scene color
+// into the current swapchain image, once the scene render pass has ended.
+// The swapchain image is left in VK_IMAGE_LAYOUT_PRESENT_SRC_KHR.
+void vulkan_renderer_record_post_process(struct vulkan_renderer *renderer);
+
+#endif // VKGUIDE_POST_PROCESS_H
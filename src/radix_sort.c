@@ -0,0 +1,38 @@
+#include "radix_sort.h"
+#include <assert.h>
+
+#define RADIX_SORT_BUCKET_COUNT 256
+
+uint64_t *radix_sort_u64(uint64_t *keys, uint64_t *scratch, size_t count,
+                         uint32_t key_shift) {
+  assert(key_shift < 64 && key_shift % 8 == 0);
+  uint64_t *source = keys;
+  uint64_t *destination = scratch;
+  for (uint32_t shift = key_shift; shift < 64; shift += 8) {
+    size_t offsets[RADIX_SORT_BUCKET_COUNT] = {0};
+    for (size_t key_index = 0; key_index < count; key_index++) {
+      offsets[(source[key_index] >> shift) & 0xff]++;
+    }
+
+    // Already in order when every key falls in the same bucket
+    if (count == 0 || offsets[(source[0] >> shift) & 0xff] == count) {
+      continue;
+    }
+
+    size_t offset = 0;
+    for (uint32_t bucket = 0; bucket < RADIX_SORT_BUCKET_COUNT; bucket++) {
+      size_t bucket_size = offsets[bucket];
+      offsets[bucket] = offset;
+      offset += bucket_size;
+    }
+    for (size_t key_index = 0; key_index < count; key_index++) {
+      uint64_t key = source[key_index];
+      destination[offsets[(key >> shift) & 0xff]++] = key;
+    }
+
+    uint64_t *swap = source;
+    source = destination;
+    destination = swap;
+  }
+  return source;
+}
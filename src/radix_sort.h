@@ -0,0 +1,15 @@
+#ifndef VKGUIDE_RADIX_SORT_H
+#define VKGUIDE_RADIX_SORT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Stable LSD radix sort of `count` keys on their bits [key_shift, 64), one
+// byte per pass. The bits below key_shift are carried along as payload (e.g.
+// an index into the sorted items) and don't cost a pass; passes over bytes
+// every key shares are skipped. `scratch` must hold `count` keys. Returns the
+// array holding the sorted keys, either `keys` or `scratch`.
+uint64_t *radix_sort_u64(uint64_t *keys, uint64_t *scratch, size_t count,
+                         uint32_t key_shift);
+
+#endif // VKGUIDE_RADIX_SORT_H
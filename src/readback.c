@@ -0,0 +1,334 @@
+#include "readback.h"
+#include "image_file.h"
+#include "log.h"
+#include <assert.h>
+#include <string.h>
+
+bool readback_format_channel_order(
+    VkFormat format, enum image_file_channel_order *out_channel_order) {
+  switch (format) {
+  case VK_FORMAT_B8G8R8A8_SRGB:
+  case VK_FORMAT_B8G8R8A8_UNORM:
+    *out_channel_order = IMAGE_FILE_CHANNEL_ORDER_BGRA;
+    return true;
+  case VK_FORMAT_R8G8B8A8_SRGB:
+  case VK_FORMAT_R8G8B8A8_UNORM:
+    *out_channel_order = IMAGE_FILE_CHANNEL_ORDER_RGBA;
+    return true;
+  default:
+    return false;
+  }
+}
+
+void readback_encode_slot(const struct readback_slot *slot) {
+  enum image_file_channel_order channel_order;
+  bool is_supported_format =
+      readback_format_channel_order(slot->format, &channel_order);
+  assert(is_supported_format);
+  (void)is_supported_format;
+
+  // sRGB formats already hold the encoded bytes image files expect
+  if (image_file_write(slot->path, slot->width, slot->height, slot->mapped,
+                       channel_order)) {
+    LOG("Captured frame to %s", slot->path);
+  }
+}
+
+int readback_worker_main(void *data) {
+  struct readback *readback = data;
+  SDL_LockMutex(readback->mutex);
+  while (true) {
+    struct readback_slot *slot = NULL;
+    for (uint32_t slot_index = 0; slot_index < MAX_FRAMES_IN_FLIGHT;
+         slot_index++) {
+      if (readback->slots[slot_index].state == READBACK_SLOT_STATE_ENCODING) {
+        slot = &readback->slots[slot_index];
+        break;
+      }
+    }
+
+    if (!slot) {
+      if (readback->stop_requested) {
+        break;
+      }
+      SDL_WaitCondition(readback->condition, readback->mutex);
+      continue;
+    }
+
+    // The render thread doesn't touch encoding slots
+    SDL_UnlockMutex(readback->mutex);
+    readback_encode_slot(slot);
+    SDL_LockMutex(readback->mutex);
+    slot->state = READBACK_SLOT_STATE_FREE;
+    SDL_BroadcastCondition(readback->condition);
+  }
+  SDL_UnlockMutex(readback->mutex);
+  return 0;
+}
+
+void readback_destroy_slot_buffer(struct readback *readback,
+                                  struct readback_slot *slot) {
+  VkDevice device = readback->renderer->device;
+  vkDestroyBuffer(device, slot->buffer, NULL);
+  vulkan_renderer_free_memory(readback->renderer, slot->memory);
+  slot->buffer = VK_NULL_HANDLE;
+  slot->memory = VK_NULL_HANDLE;
+  slot->mapped = NULL;
+  slot->size = 0;
+}
+
+bool readback_create_slot_buffer(struct readback *readback,
+                                 struct readback_slot *slot,
+                                 VkDeviceSize size) {
+  struct vulkan_renderer *renderer = readback->renderer;
+  // Cached memory makes the reads of the worker much faster where it exists
+  VkMemoryPropertyFlags memory_properties =
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+      VK_MEMORY_PROPERTY_HOST_COHERENT_BIT |
+      VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+  uint32_t memory_type_index;
+  if (!find_memory_type(renderer->physical_device, UINT32_MAX,
+                        memory_properties, &memory_type_index)) {
+    memory_properties &= ~VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+  }
+
+  if (!vulkan_renderer_create_buffer(renderer, size,
+                                     VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                     memory_properties, &slot->buffer,
+                                     &slot->memory)) {
+    LOG("Couldn't create readback buffer");
+    goto err;
+  }
+
+  void *mapped;
+  if (vkMapMemory(renderer->device, slot->memory, 0, VK_WHOLE_SIZE, 0,
+                  &mapped) != VK_SUCCESS) {
+    LOG("Couldn't map readback buffer");
+    goto destroy_buffer;
+  }
+  slot->mapped = mapped;
+  slot->size = size;
+
+  return true;
+destroy_buffer:
+  readback_destroy_slot_buffer(readback, slot);
+err:
+  return false;
+}
+
+bool readback_init(struct readback *readback,
+                   struct vulkan_renderer *renderer) {
+  assert(readback);
+  assert(renderer);
+  *readback = (struct readback){0};
+  readback->renderer = renderer;
+
+  readback->mutex = SDL_CreateMutex();
+  if (!readback->mutex) {
+    LOG("Couldn't create readback mutex: %s", SDL_GetError());
+    goto err;
+  }
+
+  readback->condition = SDL_CreateCondition();
+  if (!readback->condition) {
+    LOG("Couldn't create readback condition: %s", SDL_GetError());
+    goto destroy_mutex;
+  }
+
+  readback->worker =
+      SDL_CreateThread(readback_worker_main, "readback", readback);
+  if (!readback->worker) {
+    LOG("Couldn't create readback worker: %s", SDL_GetError());
+    goto destroy_condition;
+  }
+
+  return true;
+destroy_condition:
+  SDL_DestroyCondition(readback->condition);
+destroy_mutex:
+  SDL_DestroyMutex(readback->mutex);
+err:
+  return false;
+}
+
+void readback_deinit(struct readback *readback) {
+  readback_flush(readback);
+
+  SDL_LockMutex(readback->mutex);
+  readback->stop_requested = true;
+  SDL_BroadcastCondition(readback->condition);
+  SDL_UnlockMutex(readback->mutex);
+  SDL_WaitThread(readback->worker, NULL);
+
+  for (uint32_t slot_index = 0; slot_index < MAX_FRAMES_IN_FLIGHT;
+       slot_index++) {
+    readback_destroy_slot_buffer(readback, &readback->slots[slot_index]);
+  }
+  SDL_DestroyCondition(readback->condition);
+  SDL_DestroyMutex(readback->mutex);
+}
+
+bool readback_request(struct readback *readback, const char *path) {
+  assert(readback);
+  assert(path);
+  if (readback->request_count == MAX_READBACK_REQUEST_COUNT) {
+    LOG("Too many pending readback requests");
+    return false;
+  }
+
+  if (strlen(path) >= READBACK_MAX_PATH_LENGTH) {
+    LOG("Readback path is too long: %s", path);
+    return false;
+  }
+
+  strcpy(readback->request_paths[readback->request_count++], path);
+  return true;
+}
+
+// Recorded copies of the slot are complete once the fence of its frame has
+// been waited on
+void readback_submit_slot_to_worker(struct readback *readback,
+                                    struct readback_slot *slot) {
+  SDL_LockMutex(readback->mutex);
+  if (slot->state == READBACK_SLOT_STATE_RECORDED) {
+    slot->state = READBACK_SLOT_STATE_ENCODING;
+    SDL_BroadcastCondition(readback->condition);
+  }
+  SDL_UnlockMutex(readback->mutex);
+}
+
+void readback_record(struct readback *readback, VkImage image,
+                     VkImageLayout layout, VkFormat format,
+                     VkExtent2D extent) {
+  assert(readback);
+  struct vulkan_renderer *renderer = readback->renderer;
+  struct readback_slot *slot = &readback->slots[renderer->current_frame];
+  readback_submit_slot_to_worker(readback, slot);
+  if (readback->request_count == 0) {
+    return;
+  }
+
+  SDL_LockMutex(readback->mutex);
+  bool is_slot_free = slot->state == READBACK_SLOT_STATE_FREE;
+  SDL_UnlockMutex(readback->mutex);
+  // Still being encoded, the request waits for the next frames
+  if (!is_slot_free) {
+    return;
+  }
+
+  const char *path = readback->request_paths[0];
+  enum image_file_channel_order channel_order;
+  VkDeviceSize size = (VkDeviceSize)extent.width * extent.height * 4;
+  if (!readback_format_channel_order(format, &channel_order)) {
+    LOG("Can't capture %s, unsupported image format %d", path, format);
+    goto pop_request;
+  }
+
+  if (slot->size < size) {
+    readback_destroy_slot_buffer(readback, slot);
+    if (!readback_create_slot_buffer(readback, slot, size)) {
+      goto pop_request;
+    }
+  }
+
+  VkCommandBuffer command_buffer =
+      renderer->frames[renderer->current_frame].command_buffer;
+  VkImageSubresourceRange subresource_range = {
+      .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT, .levelCount = 1, .layerCount = 1};
+  vkCmdPipelineBarrier(
+      command_buffer,
+      VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+          VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+      VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL, 1,
+      &(const VkImageMemoryBarrier){
+          .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+          .srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+                           VK_ACCESS_SHADER_WRITE_BIT |
+                           VK_ACCESS_TRANSFER_WRITE_BIT,
+          .dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT,
+          .oldLayout = layout,
+          .newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+          .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+          .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+          .image = image,
+          .subresourceRange = subresource_range});
+
+  vkCmdCopyImageToBuffer(
+      command_buffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+      slot->buffer, 1,
+      &(const VkBufferImageCopy){
+          .imageSubresource = {.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                               .layerCount = 1},
+          .imageExtent = {extent.width, extent.height, 1}});
+
+  // Back to the caller's layout for whatever comes next (e.g. presentation),
+  // and the copy made visible to the host reads of the worker
+  vkCmdPipelineBarrier(
+      command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+      VK_PIPELINE_STAGE_ALL_COMMANDS_BIT | VK_PIPELINE_STAGE_HOST_BIT, 0, 1,
+      &(const VkMemoryBarrier){.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+                               .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+                               .dstAccessMask = VK_ACCESS_HOST_READ_BIT},
+      0, NULL, 1,
+      &(const VkImageMemoryBarrier){
+          .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+          .srcAccessMask = 0,
+          .dstAccessMask = 0,
+          .oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+          .newLayout = layout,
+          .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+          .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+          .image = image,
+          .subresourceRange = subresource_range});
+
+  slot->width = extent.width;
+  slot->height = extent.height;
+  slot->format = format;
+  strcpy(slot->path, path);
+  SDL_LockMutex(readback->mutex);
+  slot->state = READBACK_SLOT_STATE_RECORDED;
+  SDL_UnlockMutex(readback->mutex);
+
+pop_request:
+  readback->request_count--;
+  memmove(readback->request_paths[0], readback->request_paths[1],
+          readback->request_count * sizeof(readback->request_paths[0]));
+}
+
+void readback_record_swapchain(struct readback *readback) {
+  struct vulkan_renderer *renderer = readback->renderer;
+  if (readback->request_count > 0 &&
+      !renderer->swapchain_transfer_src_supported) {
+    LOG("Swapchain images can't be captured on this surface");
+    readback->request_count = 0;
+    return;
+  }
+
+  readback_record(
+      readback,
+      renderer->swapchain_images[renderer->current_swapchain_image_index],
+      VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, renderer->swapchain_image_format,
+      renderer->swapchain_extent);
+}
+
+void readback_flush(struct readback *readback) {
+  for (uint32_t slot_index = 0; slot_index < MAX_FRAMES_IN_FLIGHT;
+       slot_index++) {
+    readback_submit_slot_to_worker(readback, &readback->slots[slot_index]);
+  }
+
+  SDL_LockMutex(readback->mutex);
+  while (true) {
+    bool is_encoding = false;
+    for (uint32_t slot_index = 0; slot_index < MAX_FRAMES_IN_FLIGHT;
+         slot_index++) {
+      is_encoding |=
+          readback->slots[slot_index].state == READBACK_SLOT_STATE_ENCODING;
+    }
+    if (!is_encoding) {
+      break;
+    }
+    SDL_WaitCondition(readback->condition, readback->mutex);
+  }
+  SDL_UnlockMutex(readback->mutex);
+}
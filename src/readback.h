@@ -0,0 +1,73 @@
+#ifndef VKGUIDE_READBACK_H
+#define VKGUIDE_READBACK_H
+
+#include "vulkan_renderer.h"
+#include <SDL3/SDL.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <vulkan/vulkan.h>
+
+#define READBACK_MAX_PATH_LENGTH 256
+#define MAX_READBACK_REQUEST_COUNT 8
+
+enum readback_slot_state {
+  READBACK_SLOT_STATE_FREE,
+  // The copy has been recorded in the frame owning the slot
+  READBACK_SLOT_STATE_RECORDED,
+  // The frame's fence has signaled, the worker owns the slot
+  READBACK_SLOT_STATE_ENCODING,
+};
+
+struct readback_slot {
+  VkBuffer buffer;
+  VkDeviceMemory memory;
+  VkDeviceSize size;
+  const uint8_t *mapped;
+  uint32_t width;
+  uint32_t height;
+  VkFormat format;
+  char path[READBACK_MAX_PATH_LENGTH];
+  enum readback_slot_state state;
+};
+
+// Copies images into host-visible buffers without ever waiting on the GPU.
+// Each frame in flight owns a slot, its content is handed over to a worker
+// thread the next time the frame comes around, after its fence has been
+// waited on by vulkan_renderer_begin_frame. The worker encodes the image
+// straight from the mapped buffer.
+struct readback {
+  struct vulkan_renderer *renderer;
+  struct readback_slot slots[MAX_FRAMES_IN_FLIGHT];
+
+  char request_paths[MAX_READBACK_REQUEST_COUNT][READBACK_MAX_PATH_LENGTH];
+  uint32_t request_count;
+
+  // Guards the slot states and stop_requested
+  SDL_Mutex *mutex;
+  SDL_Condition *condition;
+  SDL_Thread *worker;
+  bool stop_requested;
+};
+
+bool readback_init(struct readback *readback,
+                   struct vulkan_renderer *renderer);
+// Waits for the pending captures to be written. The device must be idle.
+void readback_deinit(struct readback *readback);
+
+// Queues a capture of one of the next frames. The image is written as PPM
+// when the path ends in .ppm, as PNG otherwise.
+bool readback_request(struct readback *readback, const char *path);
+
+// Records the copy of `image` for the oldest pending request, if the slot of
+// the current frame is free. `image` must be in `layout` and is left in it.
+// Must be called outside of a render pass, before vulkan_renderer_end_frame.
+void readback_record(struct readback *readback, VkImage image,
+                     VkImageLayout layout, VkFormat format, VkExtent2D extent);
+// Captures the current swapchain image, once the render pass has ended
+void readback_record_swapchain(struct readback *readback);
+
+// Hands the recorded copies over to the worker and waits for every capture to
+// be written. The device must be idle.
+void readback_flush(struct readback *readback);
+
+#endif // VKGUIDE_READBACK_H
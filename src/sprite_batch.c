@@ -0,0 +1,597 @@
+#include "sprite_batch.h"
+#include "arena.h"
+#include "log.h"
+#include "radix_sort.h"
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+// Sort key layout, the sprite index below SPRITE_SORT_KEY_SHIFT is payload
+#define SPRITE_SORT_KEY_SHIFT 32
+#define SPRITE_SORT_KEY_TEXTURE_SHIFT 32
+#define SPRITE_SORT_KEY_PIPELINE_SHIFT 40
+#define SPRITE_SORT_KEY_LAYER_SHIFT 48
+#define SPRITE_SORT_KEY_STATE_MASK 0xffffu
+_Static_assert(MAX_TEXTURE_COUNT <= 256,
+               "texture indices must fit in a byte of the sort key");
+
+uint32_t sprite_pipeline_index(enum sprite_blend_mode blend_mode,
+                               bool textured) {
+  return (uint32_t)blend_mode * 2 + (textured ? 1 : 0);
+}
+
+VkShaderModule load_sprite_shader(struct vulkan_renderer *renderer,
+                                  const char *path) {
+  size_t arena_mark_before_shader = arena_mark(&renderer->init_arena);
+  size_t shader_code_size;
+  char *shader_code =
+      load_shader_from_file(&renderer->init_arena, path, &shader_code_size);
+  if (!shader_code) {
+    LOG("Couldn't load sprite shader %s", path);
+    return VK_NULL_HANDLE;
+  }
+  VkShaderModule shader_module =
+      create_shader_module(renderer->device, shader_code, shader_code_size);
+  arena_rewind(&renderer->init_arena, arena_mark_before_shader);
+  return shader_module;
+}
+
+// Drawn over the scene: no depth test, no culling so that mirrored sprites
+// (negative sizes) stay visible
+bool sprite_batch_create_pipeline(struct sprite_batch *batch,
+                                  VkShaderModule vertex_shader_module,
+                                  VkShaderModule fragment_shader_module,
+                                  enum sprite_blend_mode blend_mode,
+                                  VkPipeline *out_pipeline) {
+  struct vulkan_renderer *renderer = batch->renderer;
+  VkPipelineShaderStageCreateInfo shader_stages[] = {
+      {.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+       .stage = VK_SHADER_STAGE_VERTEX_BIT,
+       .module = vertex_shader_module,
+       .pName = "main"},
+      {.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+       .stage = VK_SHADER_STAGE_FRAGMENT_BIT,
+       .module = fragment_shader_module,
+       .pName = "main"}};
+
+  VkDynamicState dynamic_states[] = {VK_DYNAMIC_STATE_VIEWPORT,
+                                     VK_DYNAMIC_STATE_SCISSOR};
+
+  VkPipelineDynamicStateCreateInfo dynamic_state = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
+      .dynamicStateCount = (sizeof(dynamic_states) / sizeof(VkDynamicState)),
+      .pDynamicStates = dynamic_states};
+
+  VkVertexInputBindingDescription vertex_binding = {
+      .binding = 0,
+      .stride = sizeof(struct sprite_vertex),
+      .inputRate = VK_VERTEX_INPUT_RATE_VERTEX};
+
+  VkVertexInputAttributeDescription vertex_attributes[] = {
+      {.location = 0,
+       .binding = 0,
+       .format = VK_FORMAT_R32G32_SFLOAT,
+       .offset = offsetof(struct sprite_vertex, position)},
+      {.location = 1,
+       .binding = 0,
+       .format = VK_FORMAT_R32G32_SFLOAT,
+       .offset = offsetof(struct sprite_vertex, uv)},
+      {.location = 2,
+       .binding = 0,
+       .format = VK_FORMAT_R8G8B8A8_UNORM,
+       .offset = offsetof(struct sprite_vertex, color)}};
+
+  VkPipelineVertexInputStateCreateInfo vertex_input_info = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+      .vertexBindingDescriptionCount = 1,
+      .pVertexBindingDescriptions = &vertex_binding,
+      .vertexAttributeDescriptionCount =
+          sizeof(vertex_attributes) / sizeof(VkVertexInputAttributeDescription),
+      .pVertexAttributeDescriptions = vertex_attributes};
+
+  VkPipelineInputAssemblyStateCreateInfo input_assembly = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
+      .topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
+      .primitiveRestartEnable = VK_FALSE};
+
+  VkPipelineViewportStateCreateInfo viewport_state = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
+      .viewportCount = 1,
+      .scissorCount = 1};
+
+  VkPipelineRasterizationStateCreateInfo rasterizer = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
+      .depthClampEnable = VK_FALSE,
+      .rasterizerDiscardEnable = VK_FALSE,
+      .polygonMode = VK_POLYGON_MODE_FILL,
+      .lineWidth = 1.0f,
+      .cullMode = VK_CULL_MODE_NONE,
+      .frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE,
+      .depthBiasEnable = VK_FALSE};
+
+  VkPipelineMultisampleStateCreateInfo multisampling = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
+      .sampleShadingEnable = VK_FALSE,
+      .rasterizationSamples = renderer->msaa_sample_count,
+      .minSampleShading = 1.0f,
+  };
+
+  VkPipelineDepthStencilStateCreateInfo depth_stencil = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
+      .depthTestEnable = VK_FALSE,
+      .depthWriteEnable = VK_FALSE};
+
+  VkPipelineColorBlendAttachmentState color_blend_attachment = {
+      .colorWriteMask = MESH_PIPELINE_COLOR_WRITE_MASK_ALL,
+      .blendEnable = VK_TRUE,
+      .srcColorBlendFactor = VK_BLEND_FACTOR_ONE,
+      .dstColorBlendFactor = blend_mode == SPRITE_BLEND_MODE_ADDITIVE
+                                 ? VK_BLEND_FACTOR_ONE
+                                 : VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA,
+      .colorBlendOp = VK_BLEND_OP_ADD,
+      .srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE,
+      .dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA,
+      .alphaBlendOp = VK_BLEND_OP_ADD,
+  };
+
+  VkPipelineColorBlendStateCreateInfo color_blending = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
+      .logicOpEnable = VK_FALSE,
+      .attachmentCount = 1,
+      .pAttachments = &color_blend_attachment};
+
+  return vkCreateGraphicsPipelines(
+             renderer->device, VK_NULL_HANDLE, 1,
+             &(const VkGraphicsPipelineCreateInfo){
+                 .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+                 .stageCount = 2,
+                 .pStages = shader_stages,
+                 .pVertexInputState = &vertex_input_info,
+                 .pInputAssemblyState = &input_assembly,
+                 .pViewportState = &viewport_state,
+                 .pRasterizationState = &rasterizer,
+                 .pMultisampleState = &multisampling,
+                 .pDepthStencilState = &depth_stencil,
+                 .pColorBlendState = &color_blending,
+                 .pDynamicState = &dynamic_state,
+                 .layout = batch->pipeline_layout,
+                 .renderPass = renderer->render_pass,
+                 .subpass = 0},
+             NULL, out_pipeline) == VK_SUCCESS;
+}
+
+bool sprite_batch_create_pipelines(struct sprite_batch *batch) {
+  struct vulkan_renderer *renderer = batch->renderer;
+  bool created = false;
+  VkShaderModule vertex_shader_module =
+      load_sprite_shader(renderer, "shaders/sprite.vert.spv");
+  VkShaderModule fragment_shader_modules[2] = {
+      load_sprite_shader(renderer, "shaders/sprite_untextured.frag.spv"),
+      load_sprite_shader(renderer, "shaders/sprite.frag.spv")};
+  if (!vertex_shader_module || !fragment_shader_modules[0] ||
+      !fragment_shader_modules[1]) {
+    goto destroy_shader_modules;
+  }
+
+  for (uint32_t blend_mode = 0; blend_mode < SPRITE_BLEND_MODE_COUNT;
+       blend_mode++) {
+    for (uint32_t textured = 0; textured < 2; textured++) {
+      if (!sprite_batch_create_pipeline(
+              batch, vertex_shader_module, fragment_shader_modules[textured],
+              blend_mode,
+              &batch->pipelines[sprite_pipeline_index(blend_mode,
+                                                      textured)])) {
+        LOG("Couldn't create sprite pipeline");
+        goto destroy_shader_modules;
+      }
+    }
+  }
+  created = true;
+
+destroy_shader_modules:
+  vkDestroyShaderModule(renderer->device, vertex_shader_module, NULL);
+  vkDestroyShaderModule(renderer->device, fragment_shader_modules[0], NULL);
+  vkDestroyShaderModule(renderer->device, fragment_shader_modules[1], NULL);
+  return created;
+}
+
+// Two triangles per sprite, the vertices are written in the order
+// top-left, top-right, bottom-right, bottom-left
+bool sprite_batch_create_index_buffer(struct sprite_batch *batch) {
+  VkDeviceSize index_buffer_size =
+      sizeof(uint32_t) * 6 * (VkDeviceSize)SPRITE_BATCH_CAPACITY;
+  if (!vulkan_renderer_create_buffer(
+          batch->renderer, index_buffer_size,
+          VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+          VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &batch->index_buffer,
+          &batch->index_buffer_memory)) {
+    LOG("Couldn't create sprite index buffer");
+    goto err;
+  }
+
+  uint32_t *indices = malloc(index_buffer_size);
+  if (!indices) {
+    goto destroy_index_buffer;
+  }
+  for (uint32_t sprite_index = 0; sprite_index < SPRITE_BATCH_CAPACITY;
+       sprite_index++) {
+    uint32_t first_vertex = sprite_index * 4;
+    uint32_t *sprite_indices = &indices[sprite_index * 6];
+    sprite_indices[0] = first_vertex;
+    sprite_indices[1] = first_vertex + 1;
+    sprite_indices[2] = first_vertex + 2;
+    sprite_indices[3] = first_vertex + 2;
+    sprite_indices[4] = first_vertex + 3;
+    sprite_indices[5] = first_vertex;
+  }
+  bool uploaded = vulkan_renderer_upload_to_buffer(
+      batch->renderer, batch->index_buffer, 0, indices, index_buffer_size);
+  free(indices);
+  if (!uploaded) {
+    LOG("Couldn't upload sprite indices");
+    goto destroy_index_buffer;
+  }
+
+  return true;
+destroy_index_buffer:
+  vkDestroyBuffer(batch->renderer->device, batch->index_buffer, NULL);
+  vulkan_renderer_free_memory(batch->renderer, batch->index_buffer_memory);
+err:
+  return false;
+}
+
+bool sprite_batch_init(struct sprite_batch *batch,
+                       struct vulkan_renderer *renderer,
+                       struct texture_pool *texture_pool) {
+  assert(batch);
+  assert(renderer);
+  assert(texture_pool);
+  *batch = (struct sprite_batch){.renderer = renderer,
+                                 .texture_pool = texture_pool};
+  VkDevice device = renderer->device;
+
+  batch->sprites = malloc(sizeof(struct sprite) * SPRITE_BATCH_CAPACITY);
+  batch->sort_keys = malloc(sizeof(uint64_t) * SPRITE_BATCH_CAPACITY);
+  if (!batch->sprites || !batch->sort_keys) {
+    LOG("Couldn't allocate sprite arrays");
+    goto free_arrays;
+  }
+
+  if (vkCreateDescriptorSetLayout(
+          device,
+          &(const VkDescriptorSetLayoutCreateInfo){
+              .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+              .bindingCount = 1,
+              .pBindings =
+                  &(const VkDescriptorSetLayoutBinding){
+                      .binding = 0,
+                      .descriptorType =
+                          VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                      .descriptorCount = 1,
+                      .stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT}},
+          NULL, &batch->descriptor_set_layout) != VK_SUCCESS) {
+    LOG("Couldn't create sprite descriptor set layout");
+    goto free_arrays;
+  }
+
+  // Scale from swapchain pixels to normalized device coordinates
+  if (vkCreatePipelineLayout(
+          device,
+          &(const VkPipelineLayoutCreateInfo){
+              .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+              .setLayoutCount = 1,
+              .pSetLayouts = &batch->descriptor_set_layout,
+              .pushConstantRangeCount = 1,
+              .pPushConstantRanges =
+                  &(const VkPushConstantRange){
+                      .stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
+                      .size = sizeof(float) * 2}},
+          NULL, &batch->pipeline_layout) != VK_SUCCESS) {
+    LOG("Couldn't create sprite pipeline layout");
+    goto destroy_descriptor_set_layout;
+  }
+
+  if (!sprite_batch_create_pipelines(batch)) {
+    goto destroy_pipelines;
+  }
+
+  if (!sprite_batch_create_index_buffer(batch)) {
+    goto destroy_pipelines;
+  }
+
+  VkDeviceSize vertex_buffer_size = sizeof(struct sprite_vertex) * 4 *
+                                    (VkDeviceSize)SPRITE_BATCH_CAPACITY *
+                                    MAX_FRAMES_IN_FLIGHT;
+  if (!vulkan_renderer_create_buffer(renderer, vertex_buffer_size,
+                                     VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                                     VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                         VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                     &batch->vertex_buffer,
+                                     &batch->vertex_buffer_memory)) {
+    LOG("Couldn't create sprite vertex buffer");
+    goto destroy_index_buffer;
+  }
+
+  void *mapped;
+  if (vkMapMemory(device, batch->vertex_buffer_memory, 0, vertex_buffer_size,
+                  0, &mapped) != VK_SUCCESS) {
+    LOG("Couldn't map sprite vertex buffer");
+    goto destroy_vertex_buffer;
+  }
+  batch->vertices = mapped;
+
+  uint32_t frame_index = 0;
+  for (; frame_index < MAX_FRAMES_IN_FLIGHT; frame_index++) {
+    if (vkCreateDescriptorPool(
+            device,
+            &(const VkDescriptorPoolCreateInfo){
+                .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+                .maxSets = MAX_TEXTURE_COUNT,
+                .poolSizeCount = 1,
+                .pPoolSizes =
+                    &(const VkDescriptorPoolSize){
+                        .type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                        .descriptorCount = MAX_TEXTURE_COUNT}},
+            NULL, &batch->descriptor_pools[frame_index]) != VK_SUCCESS) {
+      LOG("Couldn't create sprite descriptor pool");
+      goto destroy_descriptor_pools;
+    }
+  }
+
+  return true;
+destroy_descriptor_pools:
+  for (uint32_t created_index = 0; created_index < frame_index;
+       created_index++) {
+    vkDestroyDescriptorPool(device, batch->descriptor_pools[created_index],
+                            NULL);
+  }
+destroy_vertex_buffer:
+  vkDestroyBuffer(device, batch->vertex_buffer, NULL);
+  vulkan_renderer_free_memory(batch->renderer, batch->vertex_buffer_memory);
+destroy_index_buffer:
+  vkDestroyBuffer(device, batch->index_buffer, NULL);
+  vulkan_renderer_free_memory(batch->renderer, batch->index_buffer_memory);
+destroy_pipelines:
+  for (uint32_t pipeline_index = 0; pipeline_index < SPRITE_PIPELINE_COUNT;
+       pipeline_index++) {
+    vkDestroyPipeline(device, batch->pipelines[pipeline_index], NULL);
+  }
+  vkDestroyPipelineLayout(device, batch->pipeline_layout, NULL);
+destroy_descriptor_set_layout:
+  vkDestroyDescriptorSetLayout(device, batch->descriptor_set_layout, NULL);
+free_arrays:
+  free(batch->sort_keys);
+  free(batch->sprites);
+  return false;
+}
+
+void sprite_batch_deinit(struct sprite_batch *batch) {
+  VkDevice device = batch->renderer->device;
+  for (uint32_t frame_index = 0; frame_index < MAX_FRAMES_IN_FLIGHT;
+       frame_index++) {
+    vkDestroyDescriptorPool(device, batch->descriptor_pools[frame_index],
+                            NULL);
+  }
+  vkDestroyBuffer(device, batch->vertex_buffer, NULL);
+  vulkan_renderer_free_memory(batch->renderer, batch->vertex_buffer_memory);
+  vkDestroyBuffer(device, batch->index_buffer, NULL);
+  vulkan_renderer_free_memory(batch->renderer, batch->index_buffer_memory);
+  for (uint32_t pipeline_index = 0; pipeline_index < SPRITE_PIPELINE_COUNT;
+       pipeline_index++) {
+    vkDestroyPipeline(device, batch->pipelines[pipeline_index], NULL);
+  }
+  vkDestroyPipelineLayout(device, batch->pipeline_layout, NULL);
+  vkDestroyDescriptorSetLayout(device, batch->descriptor_set_layout, NULL);
+  free(batch->sort_keys);
+  free(batch->sprites);
+}
+
+void sprite_batch_begin_frame(struct sprite_batch *batch) {
+  // The frame's fence has been waited on, its sets are no longer in use
+  vkResetDescriptorPool(
+      batch->renderer->device,
+      batch->descriptor_pools[batch->renderer->current_frame], 0);
+  for (uint32_t texture = 0; texture < MAX_TEXTURE_COUNT; texture++) {
+    batch->texture_descriptor_sets[texture] = VK_NULL_HANDLE;
+  }
+  batch->sprite_count = 0;
+  batch->frame_sprite_count = 0;
+  batch->draw_count = 0;
+  batch->dropped_sprite_count = 0;
+  batch->unsorted_sprite_count = 0;
+}
+
+bool sprite_batch_add(struct sprite_batch *batch, const struct sprite *sprite) {
+  assert(sprite->blend_mode < SPRITE_BLEND_MODE_COUNT);
+  if (batch->frame_sprite_count + batch->sprite_count >=
+      SPRITE_BATCH_CAPACITY) {
+    if (batch->dropped_sprite_count == 0) {
+      LOG("Sprite batch is full, dropping the remaining sprites of the frame");
+    }
+    batch->dropped_sprite_count++;
+    return false;
+  }
+
+  bool textured = sprite->texture != SPRITE_NO_TEXTURE;
+  if (textured) {
+    texture_pool_use(batch->texture_pool, sprite->texture);
+  }
+  uint32_t sprite_index = batch->sprite_count++;
+  batch->sprites[sprite_index] = *sprite;
+  batch->sort_keys[sprite_index] =
+      (uint64_t)sprite->layer << SPRITE_SORT_KEY_LAYER_SHIFT |
+      (uint64_t)sprite_pipeline_index(sprite->blend_mode, textured)
+          << SPRITE_SORT_KEY_PIPELINE_SHIFT |
+      (uint64_t)(textured ? sprite->texture : 0)
+          << SPRITE_SORT_KEY_TEXTURE_SHIFT |
+      sprite_index;
+  return true;
+}
+
+// Allocated once per frame and texture. VK_NULL_HANDLE while the texture has
+// no resident level.
+VkDescriptorSet sprite_batch_texture_descriptor_set(struct sprite_batch *batch,
+                                                    uint32_t texture) {
+  if (batch->texture_descriptor_sets[texture]) {
+    return batch->texture_descriptor_sets[texture];
+  }
+
+  VkImageView image_view =
+      texture_pool_image_view(batch->texture_pool, texture);
+  if (!image_view) {
+    return VK_NULL_HANDLE;
+  }
+
+  struct vulkan_renderer *renderer = batch->renderer;
+  VkDescriptorSet descriptor_set;
+  if (vkAllocateDescriptorSets(
+          renderer->device,
+          &(const VkDescriptorSetAllocateInfo){
+              .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+              .descriptorPool =
+                  batch->descriptor_pools[renderer->current_frame],
+              .descriptorSetCount = 1,
+              .pSetLayouts = &batch->descriptor_set_layout},
+          &descriptor_set) != VK_SUCCESS) {
+    LOG("Couldn't allocate sprite descriptor set");
+    return VK_NULL_HANDLE;
+  }
+
+  vkUpdateDescriptorSets(
+      renderer->device, 1,
+      &(const VkWriteDescriptorSet){
+          .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+          .dstSet = descriptor_set,
+          .dstBinding = 0,
+          .descriptorCount = 1,
+          .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+          .pImageInfo =
+              &(const VkDescriptorImageInfo){
+                  .sampler = batch->texture_pool->sampler,
+                  .imageView = image_view,
+                  .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL}},
+      0, NULL);
+  batch->texture_descriptor_sets[texture] = descriptor_set;
+  return descriptor_set;
+}
+
+void sprite_batch_write_vertices(struct sprite_vertex *vertices,
+                                 const struct sprite *sprite) {
+  float left = sprite->position[0];
+  float top = sprite->position[1];
+  float right = left + sprite->size[0];
+  float bottom = top + sprite->size[1];
+  vertices[0] = (struct sprite_vertex){
+      {left, top}, {sprite->uv_min[0], sprite->uv_min[1]}, sprite->color};
+  vertices[1] = (struct sprite_vertex){
+      {right, top}, {sprite->uv_max[0], sprite->uv_min[1]}, sprite->color};
+  vertices[2] = (struct sprite_vertex){
+      {right, bottom}, {sprite->uv_max[0], sprite->uv_max[1]}, sprite->color};
+  vertices[3] = (struct sprite_vertex){
+      {left, bottom}, {sprite->uv_min[0], sprite->uv_max[1]}, sprite->color};
+}
+
+void sprite_batch_flush(struct sprite_batch *batch) {
+  if (batch->sprite_count == 0) {
+    return;
+  }
+
+  struct vulkan_renderer *renderer = batch->renderer;
+  VkCommandBuffer command_buffer =
+      renderer->frames[renderer->current_frame].command_buffer;
+  // Only needed while recording, released at the end of the flush
+  size_t arena_mark_before_sort = arena_mark(&renderer->frame_arena);
+  uint64_t *sort_scratch =
+      ARENA_ALLOC_ARRAY(&renderer->frame_arena, uint64_t, batch->sprite_count);
+  // The keys hold the sprite indices, unsorted they are the order the sprites
+  // were added in
+  const uint64_t *sorted_keys = batch->sort_keys;
+  if (sort_scratch) {
+    sorted_keys = radix_sort_u64(batch->sort_keys, sort_scratch,
+                                 batch->sprite_count, SPRITE_SORT_KEY_SHIFT);
+  } else {
+    LOG("No room for the sort scratch, drawing %u sprites unsorted",
+        batch->sprite_count);
+    batch->unsorted_sprite_count += batch->sprite_count;
+  }
+
+  // The pipelines share the layout, the push constant survives their binds
+  float pixel_to_ndc[2] = {2.0f / (float)renderer->swapchain_extent.width,
+                           2.0f / (float)renderer->swapchain_extent.height};
+  vkCmdPushConstants(command_buffer, batch->pipeline_layout,
+                     VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(pixel_to_ndc),
+                     pixel_to_ndc);
+  VkDeviceSize frame_slice_offset = sizeof(struct sprite_vertex) * 4 *
+                                    (VkDeviceSize)SPRITE_BATCH_CAPACITY *
+                                    renderer->current_frame;
+  vkCmdBindVertexBuffers(command_buffer, 0, 1, &batch->vertex_buffer,
+                         &frame_slice_offset);
+  vkCmdBindIndexBuffer(command_buffer, batch->index_buffer, 0,
+                       VK_INDEX_TYPE_UINT32);
+
+  struct sprite_vertex *frame_vertices =
+      batch->vertices + (size_t)4 * SPRITE_BATCH_CAPACITY *
+                            renderer->current_frame;
+  uint32_t bound_pipeline = UINT32_MAX;
+  uint32_t bound_texture = UINT32_MAX;
+  uint32_t run_state = UINT32_MAX;
+  uint32_t run_first_sprite = batch->frame_sprite_count;
+  for (uint32_t key_index = 0; key_index < batch->sprite_count; key_index++) {
+    uint64_t key = sorted_keys[key_index];
+    const struct sprite *sprite = &batch->sprites[(uint32_t)key];
+    uint32_t state =
+        (uint32_t)(key >> SPRITE_SORT_KEY_SHIFT) & SPRITE_SORT_KEY_STATE_MASK;
+    if (state != run_state) {
+      uint32_t pipeline =
+          (uint32_t)(key >> SPRITE_SORT_KEY_PIPELINE_SHIFT) & 0xff;
+      bool textured = sprite->texture != SPRITE_NO_TEXTURE;
+      VkDescriptorSet descriptor_set = VK_NULL_HANDLE;
+      if (textured) {
+        descriptor_set =
+            sprite_batch_texture_descriptor_set(batch, sprite->texture);
+        if (!descriptor_set) {
+          continue;
+        }
+      }
+
+      if (batch->frame_sprite_count > run_first_sprite) {
+        vkCmdDrawIndexed(command_buffer,
+                         6 * (batch->frame_sprite_count - run_first_sprite), 1,
+                         6 * run_first_sprite, 0, 0);
+        batch->draw_count++;
+        batch->renderer->frame_counters.draw_call_count++;
+      }
+      run_state = state;
+      run_first_sprite = batch->frame_sprite_count;
+
+      if (pipeline != bound_pipeline) {
+        vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                          batch->pipelines[pipeline]);
+        batch->renderer->frame_counters.pipeline_bind_count++;
+        bound_pipeline = pipeline;
+      }
+      if (textured && sprite->texture != bound_texture) {
+        vkCmdBindDescriptorSets(command_buffer,
+                                VK_PIPELINE_BIND_POINT_GRAPHICS,
+                                batch->pipeline_layout, 0, 1, &descriptor_set,
+                                0, NULL);
+        bound_texture = sprite->texture;
+      }
+    }
+
+    sprite_batch_write_vertices(
+        &frame_vertices[(size_t)4 * batch->frame_sprite_count], sprite);
+    batch->frame_sprite_count++;
+  }
+
+  if (batch->frame_sprite_count > run_first_sprite) {
+    vkCmdDrawIndexed(command_buffer,
+                     6 * (batch->frame_sprite_count - run_first_sprite), 1,
+                     6 * run_first_sprite, 0, 0);
+    batch->draw_count++;
+    batch->renderer->frame_counters.draw_call_count++;
+  }
+  batch->sprite_count = 0;
+  arena_rewind(&renderer->frame_arena, arena_mark_before_sort);
+}
@@ -0,0 +1,104 @@
+#ifndef VKGUIDE_SPRITE_BATCH_H
+#define VKGUIDE_SPRITE_BATCH_H
+
+#include "texture.h"
+#include "vulkan_renderer.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <vulkan/vulkan.h>
+
+// Sprites per frame in flight, sprites added past it are dropped
+#define SPRITE_BATCH_CAPACITY 131072
+#define SPRITE_NO_TEXTURE UINT32_MAX
+
+enum sprite_blend_mode {
+  // Premultiplied alpha
+  SPRITE_BLEND_MODE_ALPHA,
+  SPRITE_BLEND_MODE_ADDITIVE,
+  SPRITE_BLEND_MODE_COUNT
+};
+
+// One pipeline per blend mode, with and without a texture
+#define SPRITE_PIPELINE_COUNT (SPRITE_BLEND_MODE_COUNT * 2)
+
+struct sprite {
+  // Top-left corner and size in swapchain pixels, whatever the render scale
+  float position[2];
+  float size[2];
+  float uv_min[2];
+  float uv_max[2];
+  // Premultiplied RGBA8 with R in the lowest byte, multiplies the texture
+  uint32_t color;
+  // Index in the texture pool or SPRITE_NO_TEXTURE
+  uint32_t texture;
+  enum sprite_blend_mode blend_mode;
+  // Higher layers are drawn over lower ones. Within a layer sprites are
+  // grouped by pipeline and texture, only sprites sharing both keep the order
+  // they were added in.
+  uint16_t layer;
+};
+
+// Vertex layout of shaders/sprite.vert
+struct sprite_vertex {
+  float position[2];
+  float uv[2];
+  uint32_t color;
+};
+
+// Draws textured quads (UI, overlays) in the scene render pass, over the
+// scene and without depth testing. Sprites are collected, sorted by layer,
+// pipeline and texture, written into a persistently mapped vertex ring and
+// drawn with one indexed draw per run of sprites sharing the same state.
+struct sprite_batch {
+  struct vulkan_renderer *renderer;
+  struct texture_pool *texture_pool;
+  VkDescriptorSetLayout descriptor_set_layout;
+  VkPipelineLayout pipeline_layout;
+  VkPipeline pipelines[SPRITE_PIPELINE_COUNT];
+
+  // Static, sprite i of a slice uses the vertices [4i, 4i + 4)
+  VkBuffer index_buffer;
+  VkDeviceMemory index_buffer_memory;
+  // Host-visible, one slice of SPRITE_BATCH_CAPACITY sprites per frame in
+  // flight
+  VkBuffer vertex_buffer;
+  VkDeviceMemory vertex_buffer_memory;
+  struct sprite_vertex *vertices;
+  // Sprites written into the current frame's slice by the previous flushes
+  uint32_t frame_sprite_count;
+
+  // Reset every frame, the texture pool's image views don't outlive it
+  VkDescriptorPool descriptor_pools[MAX_FRAMES_IN_FLIGHT];
+  VkDescriptorSet texture_descriptor_sets[MAX_TEXTURE_COUNT];
+
+  // Added since the last flush
+  struct sprite *sprites;
+  uint32_t sprite_count;
+  // The sort scratch is allocated from the renderer's frame arena
+  uint64_t *sort_keys;
+
+  // Of the current frame
+  uint32_t draw_count;
+  uint32_t dropped_sprite_count;
+  // Drawn in the order they were added because the sort scratch didn't fit
+  // in the frame arena
+  uint32_t unsorted_sprite_count;
+};
+
+bool sprite_batch_init(struct sprite_batch *batch,
+                       struct vulkan_renderer *renderer,
+                       struct texture_pool *texture_pool);
+// The device must be idle
+void sprite_batch_deinit(struct sprite_batch *batch);
+
+// Must be called after vulkan_renderer_begin_frame, before adding sprites
+void sprite_batch_begin_frame(struct sprite_batch *batch);
+// Marks the sprite's texture as used, sprites must therefore be added before
+// texture_pool_update. Returns false when the frame is full.
+bool sprite_batch_add(struct sprite_batch *batch, const struct sprite *sprite);
+// Records the sprites added since the last flush, inside the scene render
+// pass and after texture_pool_update. Sprites whose texture has no resident
+// level yet are skipped.
+void sprite_batch_flush(struct sprite_batch *batch);
+
+#endif // VKGUIDE_SPRITE_BATCH_H
@@ -0,0 +1,403 @@
+#define _POSIX_C_SOURCE 200809L
+#include "stats.h"
+#include "log.h"
+#include <SDL3/SDL.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define STATS_DEFAULT_INTERVAL_MS 1000
+#define STATS_SOCKET_PREFIX "unix:"
+#define STATS_MAX_HOSTNAME_LENGTH 256
+
+// Smallest value told apart from 0 by each histogram
+static const double stats_histogram_units[STATS_HISTOGRAM_COUNT] = {
+    [STATS_HISTOGRAM_CPU_FRAME_TIME_MS] = 0.01,
+    [STATS_HISTOGRAM_GPU_FRAME_TIME_MS] = 0.01,
+    [STATS_HISTOGRAM_DRAW_CALLS] = 1.0,
+    [STATS_HISTOGRAM_PIPELINE_BINDS] = 1.0,
+    [STATS_HISTOGRAM_UPLOADED_BYTES] = 1024.0,
+    [STATS_HISTOGRAM_MESHLETS_CULLED_PERCENT] = 0.1,
+    [STATS_HISTOGRAM_MESHLETS_OCCLUDED_PERCENT] = 0.1,
+    [STATS_HISTOGRAM_OCCLUSION_GPU_TIME_MS] = 0.01,
+    [STATS_HISTOGRAM_MESHLETS_CULLED] = 1.0,
+    [STATS_HISTOGRAM_CULL_GPU_TIME_MS] = 0.01};
+static const char *const stats_histogram_names[STATS_HISTOGRAM_COUNT] = {
+    [STATS_HISTOGRAM_CPU_FRAME_TIME_MS] = "cpu_frame_time_ms",
+    [STATS_HISTOGRAM_GPU_FRAME_TIME_MS] = "gpu_frame_time_ms",
+    [STATS_HISTOGRAM_DRAW_CALLS] = "draw_calls",
+    [STATS_HISTOGRAM_PIPELINE_BINDS] = "pipeline_binds",
+    [STATS_HISTOGRAM_UPLOADED_BYTES] = "uploaded_bytes",
+    [STATS_HISTOGRAM_MESHLETS_CULLED_PERCENT] = "meshlets_culled_percent",
+    [STATS_HISTOGRAM_MESHLETS_OCCLUDED_PERCENT] = "meshlets_occluded_percent",
+    [STATS_HISTOGRAM_OCCLUSION_GPU_TIME_MS] = "occlusion_gpu_time_ms",
+    [STATS_HISTOGRAM_MESHLETS_CULLED] = "meshlets_culled",
+    [STATS_HISTOGRAM_CULL_GPU_TIME_MS] = "cull_gpu_time_ms"};
+
+void stats_histogram_reset(struct stats_histogram *histogram) {
+  histogram->count = 0;
+  histogram->sum = 0.0;
+  histogram->min = 0.0;
+  histogram->max = 0.0;
+  memset(histogram->buckets, 0, sizeof(histogram->buckets));
+}
+
+uint32_t stats_histogram_bucket(const struct stats_histogram *histogram,
+                                double value) {
+  if (!(value >= histogram->unit)) {
+    return 0;
+  }
+  double bucket = 1.0 + floor(log2(value / histogram->unit) *
+                              STATS_HISTOGRAM_BUCKETS_PER_OCTAVE);
+  return bucket < STATS_HISTOGRAM_BUCKET_COUNT - 1
+             ? (uint32_t)bucket
+             : STATS_HISTOGRAM_BUCKET_COUNT - 1;
+}
+
+double stats_histogram_bucket_upper_bound(
+    const struct stats_histogram *histogram, uint32_t bucket) {
+  return histogram->unit *
+         exp2((double)bucket / STATS_HISTOGRAM_BUCKETS_PER_OCTAVE);
+}
+
+void stats_histogram_add(struct stats_histogram *histogram, double value) {
+  if (histogram->count == 0 || value < histogram->min) {
+    histogram->min = value;
+  }
+  if (histogram->count == 0 || value > histogram->max) {
+    histogram->max = value;
+  }
+  histogram->count++;
+  histogram->sum += value;
+  histogram->buckets[stats_histogram_bucket(histogram, value)]++;
+}
+
+// Upper bound of the bucket holding the percentile, never above the maximum
+double stats_histogram_percentile(const struct stats_histogram *histogram,
+                                  double percentile) {
+  uint64_t rank = (uint64_t)ceil(percentile * (double)histogram->count);
+  uint64_t cumulative_count = 0;
+  for (uint32_t bucket = 0; bucket < STATS_HISTOGRAM_BUCKET_COUNT; bucket++) {
+    cumulative_count += histogram->buckets[bucket];
+    if (cumulative_count >= rank) {
+      double upper_bound =
+          stats_histogram_bucket_upper_bound(histogram, bucket);
+      return upper_bound < histogram->max ? upper_bound : histogram->max;
+    }
+  }
+  return histogram->max;
+}
+
+void stats_close(struct stats *stats) {
+  if (stats->file_descriptor >= 0) {
+    close(stats->file_descriptor);
+  }
+  stats->file_descriptor = -1;
+  stats->pending_size = 0;
+}
+
+bool stats_open(struct stats *stats) {
+  if (!stats->destination_is_socket) {
+    stats->file_descriptor =
+        open(stats->destination, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (stats->file_descriptor < 0) {
+      LOG("Couldn't open stats file %s", stats->destination);
+      return false;
+    }
+    return true;
+  }
+
+  const char *socket_path = stats->destination + strlen(STATS_SOCKET_PREFIX);
+  struct sockaddr_un address = {.sun_family = AF_UNIX};
+  if (strlen(socket_path) >= sizeof(address.sun_path)) {
+    LOG("Stats socket path %s is too long", socket_path);
+    return false;
+  }
+  strcpy(address.sun_path, socket_path);
+
+  stats->file_descriptor = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (stats->file_descriptor < 0) {
+    LOG("Couldn't create stats socket");
+    return false;
+  }
+  // A slow collector must never stall a frame, nor kill the process. This
+  // includes the connection: a collector whose backlog is full
+  // (EAGAIN/EINPROGRESS) is retried at the next interval like a missing one.
+  int flags = fcntl(stats->file_descriptor, F_GETFL, 0);
+  fcntl(stats->file_descriptor, F_SETFL, flags | O_NONBLOCK);
+  if (connect(stats->file_descriptor, (const struct sockaddr *)&address,
+              sizeof(address)) < 0) {
+    stats_close(stats);
+    return false;
+  }
+#ifdef SO_NOSIGPIPE
+  int no_sigpipe = 1;
+  setsockopt(stats->file_descriptor, SOL_SOCKET, SO_NOSIGPIPE, &no_sigpipe,
+             sizeof(no_sigpipe));
+#endif
+  return true;
+}
+
+bool stats_init(struct stats *stats, const char *destination,
+                uint32_t interval_ms) {
+  *stats = (struct stats){.file_descriptor = -1};
+  if (!destination || destination[0] == '\0') {
+    return true;
+  }
+
+  if (strlen(destination) >= STATS_MAX_DESTINATION_LENGTH) {
+    LOG("Stats destination %s is too long", destination);
+    return false;
+  }
+  strcpy(stats->destination, destination);
+  stats->destination_is_socket =
+      strncmp(destination, STATS_SOCKET_PREFIX,
+              strlen(STATS_SOCKET_PREFIX)) == 0;
+  // A collector that isn't up yet is retried at every interval
+  if (!stats_open(stats) && !stats->destination_is_socket) {
+    return false;
+  }
+
+  for (int histogram_id = 0; histogram_id < STATS_HISTOGRAM_COUNT;
+       histogram_id++) {
+    struct stats_histogram *histogram = &stats->histograms[histogram_id];
+    histogram->name = stats_histogram_names[histogram_id];
+    histogram->unit = stats_histogram_units[histogram_id];
+  }
+  uint32_t effective_interval_ms =
+      interval_ms > 0 ? interval_ms : STATS_DEFAULT_INTERVAL_MS;
+  stats->interval_ns = (uint64_t)effective_interval_ms * 1000000;
+  stats->interval_start_ns = SDL_GetTicksNS();
+  stats->enabled = true;
+  LOG("Emitting stats to %s every %llu ms", destination,
+      (unsigned long long)(stats->interval_ns / 1000000));
+  return true;
+}
+
+void stats_deinit(struct stats *stats, const struct stats_gauges *gauges) {
+  if (!stats->enabled) {
+    return;
+  }
+  if (stats->frame_count > 0) {
+    stats_emit(stats, gauges);
+  }
+  stats_close(stats);
+  stats->enabled = false;
+}
+
+void stats_record_frame(struct stats *stats,
+                        const struct stats_frame_sample *sample) {
+  if (!stats->enabled) {
+    return;
+  }
+
+  stats->frame_count++;
+  stats_histogram_add(&stats->histograms[STATS_HISTOGRAM_CPU_FRAME_TIME_MS],
+                      (double)sample->cpu_frame_time_ns / 1e6);
+  if (sample->gpu_frame_time_available) {
+    stats_histogram_add(
+        &stats->histograms[STATS_HISTOGRAM_GPU_FRAME_TIME_MS],
+        (double)sample->gpu_frame_time_ns / 1e6);
+  }
+  stats_histogram_add(&stats->histograms[STATS_HISTOGRAM_DRAW_CALLS],
+                      (double)sample->counters.draw_call_count);
+  stats_histogram_add(&stats->histograms[STATS_HISTOGRAM_PIPELINE_BINDS],
+                      (double)sample->counters.pipeline_bind_count);
+  stats_histogram_add(&stats->histograms[STATS_HISTOGRAM_UPLOADED_BYTES],
+                      (double)sample->counters.uploaded_bytes);
+  if (sample->occlusion_stats_available) {
+    stats_histogram_add(&stats->histograms[STATS_HISTOGRAM_MESHLETS_CULLED],
+                        (double)sample->culled_meshlet_count);
+  }
+  if (sample->occlusion_stats_available && sample->meshlet_count > 0) {
+    stats_histogram_add(
+        &stats->histograms[STATS_HISTOGRAM_MESHLETS_CULLED_PERCENT],
+        100.0 * sample->culled_meshlet_count / sample->meshlet_count);
+    stats_histogram_add(
+        &stats->histograms[STATS_HISTOGRAM_MESHLETS_OCCLUDED_PERCENT],
+        100.0 * sample->occluded_meshlet_count / sample->meshlet_count);
+  }
+  if (sample->occlusion_stats_available &&
+      sample->occlusion_gpu_time_available) {
+    stats_histogram_add(
+        &stats->histograms[STATS_HISTOGRAM_OCCLUSION_GPU_TIME_MS],
+        (double)sample->occlusion_gpu_time_ns / 1e6);
+  }
+  if (sample->occlusion_stats_available &&
+      sample->occlusion_gpu_time_available &&
+      sample->early_cull_gpu_time_available) {
+    stats_histogram_add(
+        &stats->histograms[STATS_HISTOGRAM_CULL_GPU_TIME_MS],
+        (double)(sample->early_cull_gpu_time_ns +
+                 sample->occlusion_gpu_time_ns) /
+            1e6);
+  }
+}
+
+bool stats_emit_due(const struct stats *stats) {
+  return stats->enabled &&
+         SDL_GetTicksNS() - stats->interval_start_ns >= stats->interval_ns;
+}
+
+// Sets line_size past the capacity once the line is truncated
+void stats_append(struct stats *stats, const char *format, ...) {
+  if (stats->line_size >= STATS_LINE_CAPACITY) {
+    return;
+  }
+  va_list arguments;
+  va_start(arguments, format);
+  int length = vsnprintf(stats->line + stats->line_size,
+                         STATS_LINE_CAPACITY - stats->line_size, format,
+                         arguments);
+  va_end(arguments);
+  stats->line_size =
+      length < 0 ? STATS_LINE_CAPACITY : stats->line_size + (size_t)length;
+}
+
+void stats_append_histogram(struct stats *stats,
+                            const struct stats_histogram *histogram) {
+  stats_append(stats,
+               "\"%s\":{\"count\":%llu,\"sum\":%.6g,\"min\":%.6g,"
+               "\"max\":%.6g,\"p50\":%.6g,\"p95\":%.6g,\"p99\":%.6g,"
+               "\"unit\":%.6g,\"buckets_per_octave\":%d,\"buckets\":{",
+               histogram->name, (unsigned long long)histogram->count,
+               histogram->sum, histogram->min, histogram->max,
+               stats_histogram_percentile(histogram, 0.50),
+               stats_histogram_percentile(histogram, 0.95),
+               stats_histogram_percentile(histogram, 0.99), histogram->unit,
+               STATS_HISTOGRAM_BUCKETS_PER_OCTAVE);
+  // Sparse, most buckets of an interval are empty
+  bool first_bucket = true;
+  for (uint32_t bucket = 0; bucket < STATS_HISTOGRAM_BUCKET_COUNT; bucket++) {
+    if (histogram->buckets[bucket] == 0) {
+      continue;
+    }
+    stats_append(stats, "%s\"%u\":%u", first_bucket ? "" : ",", bucket,
+                 histogram->buckets[bucket]);
+    first_bucket = false;
+  }
+  stats_append(stats, "}}");
+}
+
+// Returns false when the destination is gone
+bool stats_send(struct stats *stats, const char *data, size_t size,
+                size_t *out_sent_size) {
+  *out_sent_size = 0;
+  while (*out_sent_size < size) {
+    ssize_t result;
+    if (stats->destination_is_socket) {
+#ifdef MSG_NOSIGNAL
+      result = send(stats->file_descriptor, data + *out_sent_size,
+                    size - *out_sent_size, MSG_NOSIGNAL);
+#else
+      result = send(stats->file_descriptor, data + *out_sent_size,
+                    size - *out_sent_size, 0);
+#endif
+    } else {
+      result = write(stats->file_descriptor, data + *out_sent_size,
+                     size - *out_sent_size);
+    }
+
+    if (result < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+    *out_sent_size += (size_t)result;
+  }
+  return true;
+}
+
+void stats_write_line(struct stats *stats) {
+  if (stats->file_descriptor < 0 && !stats_open(stats)) {
+    stats->dropped_line_count++;
+    return;
+  }
+
+  size_t sent_size;
+  if (stats->pending_size > 0) {
+    if (!stats_send(stats, stats->pending, stats->pending_size, &sent_size)) {
+      goto lost_destination;
+    }
+    stats->pending_size -= sent_size;
+    memmove(stats->pending, stats->pending + sent_size, stats->pending_size);
+    // The collector is still behind, the new line can't be queued
+    if (stats->pending_size > 0) {
+      stats->dropped_line_count++;
+      return;
+    }
+  }
+
+  if (!stats_send(stats, stats->line, stats->line_size, &sent_size)) {
+    goto lost_destination;
+  }
+  // Only a socket accepts part of a line
+  stats->pending_size = stats->line_size - sent_size;
+  memcpy(stats->pending, stats->line + sent_size, stats->pending_size);
+  return;
+lost_destination:
+  LOG("Lost stats destination %s", stats->destination);
+  stats_close(stats);
+  stats->dropped_line_count++;
+}
+
+void stats_emit(struct stats *stats, const struct stats_gauges *gauges) {
+  if (!stats->enabled) {
+    return;
+  }
+
+  uint64_t now_ns = SDL_GetTicksNS();
+  SDL_Time wall_time_ns = 0;
+  SDL_GetCurrentTime(&wall_time_ns);
+  char hostname[STATS_MAX_HOSTNAME_LENGTH] = "";
+  if (gethostname(hostname, sizeof(hostname) - 1) < 0) {
+    hostname[0] = '\0';
+  }
+
+  stats->line_size = 0;
+  stats_append(stats,
+               "{\"time_ms\":%lld,\"host\":\"%s\",\"pid\":%ld,"
+               "\"interval_ms\":%.3f,\"frames\":%u,\"dropped_lines\":%llu,"
+               "\"live_allocations\":%llu,\"performance_messages\":%llu,",
+               (long long)(wall_time_ns / 1000000), hostname, (long)getpid(),
+               (double)(now_ns - stats->interval_start_ns) / 1e6,
+               stats->frame_count,
+               (unsigned long long)stats->dropped_line_count,
+               (unsigned long long)gauges->live_device_memory_allocation_count,
+               (unsigned long long)gauges->performance_message_count);
+  if (gauges->vram_usage_available) {
+    stats_append(stats, "\"vram_usage_bytes\":%llu,",
+                 (unsigned long long)gauges->vram_usage_bytes);
+  } else {
+    stats_append(stats, "\"vram_usage_bytes\":null,");
+  }
+  stats_append(stats, "\"vram_budget_bytes\":%llu,\"histograms\":{",
+               (unsigned long long)gauges->vram_budget_bytes);
+  for (int histogram_id = 0; histogram_id < STATS_HISTOGRAM_COUNT;
+       histogram_id++) {
+    if (histogram_id > 0) {
+      stats_append(stats, ",");
+    }
+    stats_append_histogram(stats, &stats->histograms[histogram_id]);
+    stats_histogram_reset(&stats->histograms[histogram_id]);
+  }
+  stats_append(stats, "}}\n");
+
+  if (stats->line_size < STATS_LINE_CAPACITY) {
+    stats_write_line(stats);
+  } else {
+    LOG("Stats line doesn't fit in %d bytes, dropping it",
+        STATS_LINE_CAPACITY);
+    stats->dropped_line_count++;
+  }
+
+  stats->frame_count = 0;
+  stats->interval_start_ns = now_ns;
+}
@@ -0,0 +1,116 @@
+#ifndef VKGUIDE_STATS_H
+#define VKGUIDE_STATS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Bucket 0 holds the values below the histogram's unit, bucket i > 0 the
+// values in [unit * 2^((i - 1) / 4), unit * 2^(i / 4))
+#define STATS_HISTOGRAM_BUCKETS_PER_OCTAVE 4
+#define STATS_HISTOGRAM_BUCKET_COUNT                                           \
+  (24 * STATS_HISTOGRAM_BUCKETS_PER_OCTAVE + 1)
+// Longest JSON line, longer ones are dropped
+#define STATS_LINE_CAPACITY 16384
+#define STATS_MAX_DESTINATION_LENGTH 256
+
+// Incremented by the renderer modules as commands are recorded, reset once
+// the frame has been submitted
+struct stats_frame_counters {
+  uint32_t draw_call_count;
+  uint32_t pipeline_bind_count;
+  uint64_t uploaded_bytes;
+};
+
+struct stats_frame_sample {
+  uint64_t cpu_frame_time_ns;
+  bool gpu_frame_time_available;
+  uint64_t gpu_frame_time_ns;
+  struct stats_frame_counters counters;
+  // Of the occlusion culled frame that last used the frame slot, like the
+  // GPU time
+  bool occlusion_stats_available;
+  uint32_t meshlet_count;
+  // By the frustum, the normal cone or the depth pyramid
+  uint32_t culled_meshlet_count;
+  uint32_t occluded_meshlet_count;
+  bool occlusion_gpu_time_available;
+  uint64_t occlusion_gpu_time_ns;
+  bool early_cull_gpu_time_available;
+  uint64_t early_cull_gpu_time_ns;
+};
+
+// Sampled when a line is emitted rather than every frame
+struct stats_gauges {
+  uint64_t live_device_memory_allocation_count;
+  // Since the renderer was created, see VULKAN_RENDERER_VALIDATION_PERFORMANCE
+  uint64_t performance_message_count;
+  bool vram_usage_available;
+  uint64_t vram_usage_bytes;
+  uint64_t vram_budget_bytes;
+};
+
+struct stats_histogram {
+  const char *name;
+  double unit;
+  uint64_t count;
+  double sum;
+  double min;
+  double max;
+  uint32_t buckets[STATS_HISTOGRAM_BUCKET_COUNT];
+};
+
+enum stats_histogram_id {
+  STATS_HISTOGRAM_CPU_FRAME_TIME_MS,
+  STATS_HISTOGRAM_GPU_FRAME_TIME_MS,
+  STATS_HISTOGRAM_DRAW_CALLS,
+  STATS_HISTOGRAM_PIPELINE_BINDS,
+  STATS_HISTOGRAM_UPLOADED_BYTES,
+  STATS_HISTOGRAM_MESHLETS_CULLED_PERCENT,
+  STATS_HISTOGRAM_MESHLETS_OCCLUDED_PERCENT,
+  STATS_HISTOGRAM_OCCLUSION_GPU_TIME_MS,
+  STATS_HISTOGRAM_MESHLETS_CULLED,
+  // Both culling passes and the depth pyramid build
+  STATS_HISTOGRAM_CULL_GPU_TIME_MS,
+  STATS_HISTOGRAM_COUNT
+};
+
+// Aggregates per-frame samples into histograms and writes them as one JSON
+// line per interval, to a file (appended to) or a Unix stream socket
+// ("unix:<path>"). Cheap enough to stay enabled in release builds: recording
+// a frame only touches the histograms, lines are formatted into a fixed
+// buffer and written without blocking. Lines that can't be written are
+// dropped and counted, a lost socket is reconnected at the next interval.
+struct stats {
+  bool enabled;
+  char destination[STATS_MAX_DESTINATION_LENGTH];
+  bool destination_is_socket;
+  int file_descriptor;
+  uint64_t interval_ns;
+  uint64_t interval_start_ns;
+  uint32_t frame_count;
+  uint64_t dropped_line_count;
+  struct stats_histogram histograms[STATS_HISTOGRAM_COUNT];
+
+  char line[STATS_LINE_CAPACITY];
+  size_t line_size;
+  // Tail of a line a socket only partially accepted, sent before the next one
+  char pending[STATS_LINE_CAPACITY];
+  size_t pending_size;
+};
+
+// `destination` NULL or empty leaves stats disabled, every other call is
+// then a no-op. An interval of 0 means one second.
+bool stats_init(struct stats *stats, const char *destination,
+                uint32_t interval_ms);
+// Emits what was recorded since the last line
+void stats_deinit(struct stats *stats, const struct stats_gauges *gauges);
+
+void stats_record_frame(struct stats *stats,
+                        const struct stats_frame_sample *sample);
+// Whether the current interval is over and stats_emit should be called
+bool stats_emit_due(const struct stats *stats);
+// Writes the histograms and gauges, then starts a new interval
+void stats_emit(struct stats *stats, const struct stats_gauges *gauges);
+
+#endif // VKGUIDE_STATS_H
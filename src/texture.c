@@ -0,0 +1,779 @@
+#define _POSIX_C_SOURCE 200809L
+#include "texture.h"
+#include "log.h"
+#include <assert.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Per frame in flight, also the largest level that can ever be streamed in
+#define TEXTURE_STREAMING_STAGING_SIZE (16 * 1024 * 1024)
+// Copy offsets must be multiples of the texel block size
+#define TEXTURE_STAGING_ALIGNMENT 16
+// Share of the heap budget left to textures once the rest of the process's
+// usage is accounted for, eviction starts above it
+#define TEXTURE_BUDGET_PERCENT 80
+// Without VK_EXT_memory_budget only the heap size is known
+#define TEXTURE_FALLBACK_BUDGET_PERCENT 50
+// Textures used within that many frames keep streaming in
+#define TEXTURE_RECENT_USE_FRAME_COUNT 2
+
+#define TEXTURE_SAMPLED_STAGES                                                 \
+  (VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT)
+
+static const VkFormat texture_encoding_formats[TEXTURE_ENCODING_COUNT] = {
+    [TEXTURE_ENCODING_BC7_SRGB] = VK_FORMAT_BC7_SRGB_BLOCK,
+    [TEXTURE_ENCODING_ASTC_4X4_SRGB] = VK_FORMAT_ASTC_4x4_SRGB_BLOCK,
+    [TEXTURE_ENCODING_RGBA8_SRGB] = VK_FORMAT_R8G8B8A8_SRGB};
+
+uint32_t texture_mip_extent(uint32_t size, uint32_t mip) {
+  uint32_t extent = size >> mip;
+  return extent > 0 ? extent : 1;
+}
+
+uint64_t texture_level_data_size(enum texture_encoding encoding,
+                                 uint32_t width, uint32_t height) {
+  if (encoding == TEXTURE_ENCODING_RGBA8_SRGB) {
+    return (uint64_t)width * height * 4;
+  }
+  // 4x4 blocks of 16 bytes
+  return (uint64_t)((width + 3) / 4) * ((height + 3) / 4) * 16;
+}
+
+bool texture_file_header_is_valid(const struct texture_file_header *header,
+                                  size_t file_size) {
+  if (header->magic != TEXTURE_FILE_MAGIC) {
+    LOG("Invalid texture file magic");
+    return false;
+  }
+
+  if (header->version != TEXTURE_FILE_VERSION) {
+    LOG("Unsupported texture file version %u", header->version);
+    return false;
+  }
+
+  uint32_t expected_mip_count = 1;
+  while ((header->width >> expected_mip_count) > 0 ||
+         (header->height >> expected_mip_count) > 0) {
+    expected_mip_count++;
+  }
+  if (header->width == 0 || header->height == 0 ||
+      header->mip_count != expected_mip_count ||
+      header->mip_count > TEXTURE_MAX_MIP_COUNT) {
+    LOG("Invalid texture dimensions %ux%u with %u mips", header->width,
+        header->height, header->mip_count);
+    return false;
+  }
+
+  for (int encoding_index = 0; encoding_index < TEXTURE_ENCODING_COUNT;
+       encoding_index++) {
+    const struct texture_file_encoding *encoding =
+        &header->encodings[encoding_index];
+    if (encoding->stored_mip_count > header->mip_count) {
+      LOG("Texture encoding %d stores too many levels", encoding_index);
+      return false;
+    }
+
+    for (uint32_t mip = 0; mip < encoding->stored_mip_count; mip++) {
+      const struct texture_file_level *level = &encoding->levels[mip];
+      uint64_t expected_size = texture_level_data_size(
+          encoding_index, texture_mip_extent(header->width, mip),
+          texture_mip_extent(header->height, mip));
+      if (level->data_size != expected_size ||
+          level->data_offset % TEXTURE_FILE_SECTION_ALIGNMENT != 0 ||
+          level->data_offset > file_size ||
+          level->data_size > file_size - level->data_offset) {
+        LOG("Texture level %u of encoding %d is out of bounds", mip,
+            encoding_index);
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+bool texture_format_has_features(struct vulkan_renderer *renderer,
+                                 VkFormat format,
+                                 VkFormatFeatureFlags features) {
+  VkFormatProperties properties;
+  vkGetPhysicalDeviceFormatProperties(renderer->physical_device, format,
+                                      &properties);
+  return (properties.optimalTilingFeatures & features) == features;
+}
+
+// Compressed encodings are preferred whenever the device can sample them,
+// they can't be blitted so they must come with their full chain
+bool texture_encoding_is_usable(struct vulkan_renderer *renderer,
+                                const struct texture_file_header *header,
+                                enum texture_encoding encoding) {
+  uint32_t stored_mip_count = header->encodings[encoding].stored_mip_count;
+  if (stored_mip_count == 0) {
+    return false;
+  }
+
+  switch (encoding) {
+  case TEXTURE_ENCODING_BC7_SRGB:
+    if (!renderer->texture_compression_bc_supported ||
+        stored_mip_count != header->mip_count) {
+      return false;
+    }
+    break;
+  case TEXTURE_ENCODING_ASTC_4X4_SRGB:
+    if (!renderer->texture_compression_astc_ldr_supported ||
+        stored_mip_count != header->mip_count) {
+      return false;
+    }
+    break;
+  case TEXTURE_ENCODING_RGBA8_SRGB:
+  case TEXTURE_ENCODING_COUNT:
+    break;
+  }
+
+  return texture_format_has_features(renderer,
+                                     texture_encoding_formats[encoding],
+                                     VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT |
+                                         VK_FORMAT_FEATURE_TRANSFER_SRC_BIT |
+                                         VK_FORMAT_FEATURE_TRANSFER_DST_BIT);
+}
+
+uint32_t texture_upload_mip(const struct texture *texture, uint32_t mip) {
+  return mip < texture->stored_mip_count ? mip : texture->stored_mip_count - 1;
+}
+
+void texture_pool_refresh_budget(struct texture_pool *pool) {
+  struct vulkan_renderer *renderer = pool->renderer;
+  VkPhysicalDeviceMemoryBudgetPropertiesEXT memory_budget = {
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT};
+  VkPhysicalDeviceMemoryProperties2 memory_properties = {
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2,
+      .pNext = renderer->memory_budget_supported ? &memory_budget : NULL};
+  vkGetPhysicalDeviceMemoryProperties2(renderer->physical_device,
+                                       &memory_properties);
+
+  uint32_t heap = pool->memory_heap_index;
+  if (renderer->memory_budget_supported) {
+    VkDeviceSize other_usage =
+        memory_budget.heapUsage[heap] > pool->allocated_bytes
+            ? memory_budget.heapUsage[heap] - pool->allocated_bytes
+            : 0;
+    VkDeviceSize available = memory_budget.heapBudget[heap] > other_usage
+                                 ? memory_budget.heapBudget[heap] - other_usage
+                                 : 0;
+    pool->budget_bytes = available / 100 * TEXTURE_BUDGET_PERCENT;
+  } else {
+    pool->budget_bytes =
+        memory_properties.memoryProperties.memoryHeaps[heap].size / 100 *
+        TEXTURE_FALLBACK_BUDGET_PERCENT;
+  }
+}
+
+bool texture_pool_fits_budget(const struct texture_pool *pool,
+                              VkDeviceSize size) {
+  return pool->allocated_bytes - pool->garbage_bytes + size <=
+         pool->budget_bytes;
+}
+
+void texture_pool_destroy_image(struct texture_pool *pool,
+                                struct texture_image *image) {
+  VkDevice device = pool->renderer->device;
+  vkDestroyImageView(device, image->image_view, NULL);
+  vkDestroyImage(device, image->image, NULL);
+  vulkan_renderer_free_memory(pool->renderer, image->memory);
+  pool->allocated_bytes -= image->memory_size;
+  *image = (struct texture_image){0};
+}
+
+void texture_pool_collect_garbage(struct texture_pool *pool,
+                                  uint32_t frame_index) {
+  for (uint32_t garbage_index = 0;
+       garbage_index < pool->garbage_counts[frame_index]; garbage_index++) {
+    struct texture_image *image = &pool->garbage[frame_index][garbage_index];
+    pool->garbage_bytes -= image->memory_size;
+    texture_pool_destroy_image(pool, image);
+  }
+  pool->garbage_counts[frame_index] = 0;
+}
+
+// The image may still be read by frames in flight
+void texture_pool_retire_image(struct texture_pool *pool,
+                               struct texture_image *image) {
+  if (image->image == VK_NULL_HANDLE) {
+    return;
+  }
+
+  uint32_t frame_index = pool->renderer->current_frame;
+  assert(pool->garbage_counts[frame_index] < MAX_TEXTURE_GARBAGE_COUNT);
+  pool->garbage[frame_index][pool->garbage_counts[frame_index]++] = *image;
+  pool->garbage_bytes += image->memory_size;
+  *image = (struct texture_image){0};
+}
+
+bool texture_pool_reallocate(struct texture_pool *pool,
+                             struct texture *texture, uint32_t base_mip,
+                             bool is_growing);
+
+// Shrinks the least recently used textures until `size` more bytes fit the
+// budget. Textures used as recently as `requester` are never evicted for it.
+bool texture_pool_make_room(struct texture_pool *pool, VkDeviceSize size,
+                            const struct texture *requester) {
+  uint64_t eviction_frame_limit =
+      requester ? requester->last_used_frame : pool->frame_index;
+  while (!texture_pool_fits_budget(pool, size)) {
+    struct texture *victim = NULL;
+    for (uint32_t texture_index = 0; texture_index < MAX_TEXTURE_COUNT;
+         texture_index++) {
+      struct texture *texture = &pool->textures[texture_index];
+      // The smallest level always stays, it is cheap and keeps the texture
+      // usable
+      if (!texture->is_loaded || texture == requester ||
+          texture->mip_count - texture->resident_mip < 2 ||
+          texture->last_used_frame >= eviction_frame_limit) {
+        continue;
+      }
+
+      if (!victim || texture->last_used_frame < victim->last_used_frame ||
+          (texture->last_used_frame == victim->last_used_frame &&
+           texture->resident_mip < victim->resident_mip)) {
+        victim = texture;
+      }
+    }
+
+    if (!victim ||
+        !texture_pool_reallocate(pool, victim, victim->resident_mip + 1,
+                                 false)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+void texture_image_barrier(VkCommandBuffer command_buffer, VkImage image,
+                           uint32_t base_mip, uint32_t mip_count,
+                           VkImageLayout old_layout, VkImageLayout new_layout,
+                           VkPipelineStageFlags src_stages,
+                           VkAccessFlags src_access,
+                           VkPipelineStageFlags dst_stages,
+                           VkAccessFlags dst_access) {
+  vkCmdPipelineBarrier(
+      command_buffer, src_stages, dst_stages, 0, 0, NULL, 0, NULL, 1,
+      &(const VkImageMemoryBarrier){
+          .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+          .srcAccessMask = src_access,
+          .dstAccessMask = dst_access,
+          .oldLayout = old_layout,
+          .newLayout = new_layout,
+          .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+          .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+          .image = image,
+          .subresourceRange = {.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                               .baseMipLevel = base_mip,
+                               .levelCount = mip_count,
+                               .layerCount = 1}});
+}
+
+bool texture_pool_create_image(struct texture_pool *pool,
+                               const struct texture *texture,
+                               uint32_t base_mip, bool is_growing,
+                               struct texture_image *out_image) {
+  struct vulkan_renderer *renderer = pool->renderer;
+  *out_image = (struct texture_image){0};
+  if (vkCreateImage(
+          renderer->device,
+          &(const VkImageCreateInfo){
+              .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+              .imageType = VK_IMAGE_TYPE_2D,
+              .format = texture->format,
+              .extent = {texture_mip_extent(texture->width, base_mip),
+                         texture_mip_extent(texture->height, base_mip), 1},
+              .mipLevels = texture->mip_count - base_mip,
+              .arrayLayers = 1,
+              .samples = VK_SAMPLE_COUNT_1_BIT,
+              .tiling = VK_IMAGE_TILING_OPTIMAL,
+              // Transfer source for the copy into the next reallocation and
+              // for mip generation
+              .usage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT |
+                       VK_IMAGE_USAGE_TRANSFER_DST_BIT |
+                       VK_IMAGE_USAGE_SAMPLED_BIT,
+              .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+              .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED},
+          NULL, &out_image->image) != VK_SUCCESS) {
+    LOG("Couldn't create texture image");
+    goto err;
+  }
+
+  VkMemoryRequirements memory_requirements;
+  vkGetImageMemoryRequirements(renderer->device, out_image->image,
+                               &memory_requirements);
+  if (is_growing &&
+      !texture_pool_make_room(pool, memory_requirements.size, texture)) {
+    goto destroy_image;
+  }
+
+  uint32_t memory_type_index;
+  if (!find_memory_type(renderer->physical_device,
+                        memory_requirements.memoryTypeBits,
+                        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                        &memory_type_index)) {
+    LOG("Couldn't find a suitable memory type for texture");
+    goto destroy_image;
+  }
+
+  if (vkAllocateMemory(renderer->device,
+                       &(const VkMemoryAllocateInfo){
+                           .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+                           .allocationSize = memory_requirements.size,
+                           .memoryTypeIndex = memory_type_index},
+                       NULL, &out_image->memory) != VK_SUCCESS) {
+    LOG("Couldn't allocate texture memory");
+    goto destroy_image;
+  }
+  renderer->device_memory_allocation_count++;
+  out_image->memory_size = memory_requirements.size;
+  pool->allocated_bytes += memory_requirements.size;
+
+  if (vkBindImageMemory(renderer->device, out_image->image, out_image->memory,
+                        0) != VK_SUCCESS) {
+    LOG("Couldn't bind texture memory");
+    goto destroy_texture_image;
+  }
+
+  if (vkCreateImageView(
+          renderer->device,
+          &(const VkImageViewCreateInfo){
+              .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+              .image = out_image->image,
+              .viewType = VK_IMAGE_VIEW_TYPE_2D,
+              .format = texture->format,
+              .subresourceRange = {.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                                   .levelCount = texture->mip_count - base_mip,
+                                   .layerCount = 1}},
+          NULL, &out_image->image_view) != VK_SUCCESS) {
+    LOG("Couldn't create texture image view");
+    goto destroy_texture_image;
+  }
+
+  return true;
+destroy_texture_image:
+  texture_pool_destroy_image(pool, out_image);
+  return false;
+destroy_image:
+  vkDestroyImage(renderer->device, out_image->image, NULL);
+err:
+  return false;
+}
+
+// Replaces the texture's image with one holding the levels
+// [base_mip, mip_count). Levels resident in both are copied on the GPU. When
+// growing, base_mip is uploaded from the file and the levels between it and
+// the previously resident ones are generated with blits.
+bool texture_pool_reallocate(struct texture_pool *pool,
+                             struct texture *texture, uint32_t base_mip,
+                             bool is_growing) {
+  struct vulkan_renderer *renderer = pool->renderer;
+  if (pool->garbage_counts[renderer->current_frame] ==
+      MAX_TEXTURE_GARBAGE_COUNT) {
+    return false;
+  }
+
+  const struct texture_file_level *level =
+      is_growing ? &texture->encoding->levels[base_mip] : NULL;
+  VkDeviceSize staging_offset =
+      (pool->staging_offset + TEXTURE_STAGING_ALIGNMENT - 1) /
+      TEXTURE_STAGING_ALIGNMENT * TEXTURE_STAGING_ALIGNMENT;
+  if (is_growing &&
+      staging_offset + level->data_size > TEXTURE_STREAMING_STAGING_SIZE) {
+    return false;
+  }
+
+  struct texture_image new_image;
+  if (!texture_pool_create_image(pool, texture, base_mip, is_growing,
+                                 &new_image)) {
+    return false;
+  }
+
+  // Evictions made room for the image may have used the last garbage slots
+  if (pool->garbage_counts[renderer->current_frame] ==
+      MAX_TEXTURE_GARBAGE_COUNT) {
+    texture_pool_destroy_image(pool, &new_image);
+    return false;
+  }
+
+  VkCommandBuffer command_buffer =
+      renderer->frames[renderer->current_frame].command_buffer;
+  uint32_t new_mip_count = texture->mip_count - base_mip;
+  texture_image_barrier(command_buffer, new_image.image, 0, new_mip_count,
+                        VK_IMAGE_LAYOUT_UNDEFINED,
+                        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                        VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0,
+                        VK_PIPELINE_STAGE_TRANSFER_BIT,
+                        VK_ACCESS_TRANSFER_WRITE_BIT);
+
+  uint32_t generated_mip_count = 0;
+  if (is_growing) {
+    VkDeviceSize region_offset =
+        (VkDeviceSize)renderer->current_frame * TEXTURE_STREAMING_STAGING_SIZE;
+    memcpy(pool->staging_buffer_mapped + region_offset + staging_offset,
+           (const uint8_t *)texture->file_content + level->data_offset,
+           level->data_size);
+    pool->staging_offset = staging_offset + level->data_size;
+    renderer->frame_counters.uploaded_bytes += level->data_size;
+    capture_record_upload(&renderer->capture, level->data_size);
+
+    vkCmdCopyBufferToImage(
+        command_buffer, pool->staging_buffer, new_image.image,
+        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1,
+        &(const VkBufferImageCopy){
+            .bufferOffset = region_offset + staging_offset,
+            .imageSubresource = {.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                                 .mipLevel = 0,
+                                 .layerCount = 1},
+            .imageExtent = {texture_mip_extent(texture->width, base_mip),
+                            texture_mip_extent(texture->height, base_mip),
+                            1}});
+
+    // Levels missing from the file, each one is blitted from the previous
+    generated_mip_count = texture->resident_mip - base_mip - 1;
+    for (uint32_t mip = 1; mip <= generated_mip_count; mip++) {
+      texture_image_barrier(command_buffer, new_image.image, mip - 1, 1,
+                            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                            VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                            VK_PIPELINE_STAGE_TRANSFER_BIT,
+                            VK_ACCESS_TRANSFER_WRITE_BIT,
+                            VK_PIPELINE_STAGE_TRANSFER_BIT,
+                            VK_ACCESS_TRANSFER_READ_BIT);
+      uint32_t src_width = texture_mip_extent(texture->width, base_mip + mip - 1);
+      uint32_t src_height =
+          texture_mip_extent(texture->height, base_mip + mip - 1);
+      vkCmdBlitImage(
+          command_buffer, new_image.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+          new_image.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1,
+          &(const VkImageBlit){
+              .srcSubresource = {.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                                 .mipLevel = mip - 1,
+                                 .layerCount = 1},
+              .srcOffsets = {{0, 0, 0},
+                             {(int32_t)src_width, (int32_t)src_height, 1}},
+              .dstSubresource = {.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                                 .mipLevel = mip,
+                                 .layerCount = 1},
+              .dstOffsets = {{0, 0, 0},
+                             {(int32_t)texture_mip_extent(src_width, 1),
+                              (int32_t)texture_mip_extent(src_height, 1), 1}}},
+          VK_FILTER_LINEAR);
+    }
+  }
+
+  uint32_t first_copied_mip =
+      texture->resident_mip > base_mip ? texture->resident_mip : base_mip;
+  if (texture->image.image != VK_NULL_HANDLE &&
+      first_copied_mip < texture->mip_count) {
+    // Only a write-after-read hazard with earlier sampling
+    texture_image_barrier(command_buffer, texture->image.image, 0,
+                          texture->mip_count - texture->resident_mip,
+                          VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                          VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                          TEXTURE_SAMPLED_STAGES, 0,
+                          VK_PIPELINE_STAGE_TRANSFER_BIT,
+                          VK_ACCESS_TRANSFER_READ_BIT);
+
+    VkImageCopy regions[TEXTURE_MAX_MIP_COUNT];
+    uint32_t region_count = 0;
+    for (uint32_t mip = first_copied_mip; mip < texture->mip_count; mip++) {
+      regions[region_count++] = (VkImageCopy){
+          .srcSubresource = {.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                             .mipLevel = mip - texture->resident_mip,
+                             .layerCount = 1},
+          .dstSubresource = {.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                             .mipLevel = mip - base_mip,
+                             .layerCount = 1},
+          .extent = {texture_mip_extent(texture->width, mip),
+                     texture_mip_extent(texture->height, mip), 1}};
+    }
+    vkCmdCopyImage(command_buffer, texture->image.image,
+                   VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, new_image.image,
+                   VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, region_count,
+                   regions);
+  }
+
+  // Blit sources ended up in TRANSFER_SRC, everything else in TRANSFER_DST
+  if (generated_mip_count > 0) {
+    texture_image_barrier(command_buffer, new_image.image, 0,
+                          generated_mip_count,
+                          VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                          VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                          VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                          TEXTURE_SAMPLED_STAGES, VK_ACCESS_SHADER_READ_BIT);
+  }
+  texture_image_barrier(command_buffer, new_image.image, generated_mip_count,
+                        new_mip_count - generated_mip_count,
+                        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                        VK_PIPELINE_STAGE_TRANSFER_BIT,
+                        VK_ACCESS_TRANSFER_WRITE_BIT, TEXTURE_SAMPLED_STAGES,
+                        VK_ACCESS_SHADER_READ_BIT);
+
+  texture_pool_retire_image(pool, &texture->image);
+  texture->image = new_image;
+  texture->resident_mip = base_mip;
+  return true;
+}
+
+// Streams in the next larger level of the texture. Levels the file doesn't
+// store are produced from the smallest stored level, which is uploaded
+// instead.
+bool texture_pool_stream_in(struct texture_pool *pool,
+                            struct texture *texture) {
+  uint32_t base_mip = texture_upload_mip(texture, texture->resident_mip - 1);
+  return texture_pool_reallocate(pool, texture, base_mip, true);
+}
+
+bool texture_pool_init(struct texture_pool *pool,
+                       struct vulkan_renderer *renderer) {
+  assert(pool);
+  assert(renderer);
+  *pool = (struct texture_pool){0};
+  pool->renderer = renderer;
+
+  uint32_t memory_type_index;
+  if (!find_memory_type(renderer->physical_device, UINT32_MAX,
+                        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                        &memory_type_index)) {
+    LOG("Couldn't find device local memory for textures");
+    goto err;
+  }
+  VkPhysicalDeviceMemoryProperties memory_properties;
+  vkGetPhysicalDeviceMemoryProperties(renderer->physical_device,
+                                      &memory_properties);
+  pool->memory_heap_index =
+      memory_properties.memoryTypes[memory_type_index].heapIndex;
+  texture_pool_refresh_budget(pool);
+
+  if (!vulkan_renderer_create_buffer(
+          renderer, TEXTURE_STREAMING_STAGING_SIZE * MAX_FRAMES_IN_FLIGHT,
+          VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+          VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+              VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+          &pool->staging_buffer, &pool->staging_buffer_memory)) {
+    LOG("Couldn't create texture streaming staging buffer");
+    goto err;
+  }
+
+  if (vkMapMemory(renderer->device, pool->staging_buffer_memory, 0,
+                  VK_WHOLE_SIZE, 0,
+                  (void **)&pool->staging_buffer_mapped) != VK_SUCCESS) {
+    LOG("Couldn't map texture streaming staging buffer");
+    goto destroy_staging_buffer;
+  }
+
+  if (vkCreateSampler(renderer->device,
+                      &(const VkSamplerCreateInfo){
+                          .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+                          .magFilter = VK_FILTER_LINEAR,
+                          .minFilter = VK_FILTER_LINEAR,
+                          .mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR,
+                          .addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT,
+                          .addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT,
+                          .addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT,
+                          .maxLod = VK_LOD_CLAMP_NONE},
+                      NULL, &pool->sampler) != VK_SUCCESS) {
+    LOG("Couldn't create texture sampler");
+    goto destroy_staging_buffer;
+  }
+
+  LOG("Texture budget: %llu MiB",
+      (unsigned long long)(pool->budget_bytes / (1024 * 1024)));
+  return true;
+destroy_staging_buffer:
+  vkDestroyBuffer(renderer->device, pool->staging_buffer, NULL);
+  vulkan_renderer_free_memory(renderer, pool->staging_buffer_memory);
+err:
+  return false;
+}
+
+void texture_pool_deinit(struct texture_pool *pool) {
+  for (uint32_t texture_index = 0; texture_index < MAX_TEXTURE_COUNT;
+       texture_index++) {
+    if (pool->textures[texture_index].is_loaded) {
+      texture_pool_unload(pool, texture_index);
+    }
+  }
+  for (uint32_t frame_index = 0; frame_index < MAX_FRAMES_IN_FLIGHT;
+       frame_index++) {
+    texture_pool_collect_garbage(pool, frame_index);
+  }
+  assert(pool->allocated_bytes == 0);
+
+  VkDevice device = pool->renderer->device;
+  vkDestroySampler(device, pool->sampler, NULL);
+  vkDestroyBuffer(device, pool->staging_buffer, NULL);
+  vulkan_renderer_free_memory(pool->renderer, pool->staging_buffer_memory);
+}
+
+bool texture_pool_load(struct texture_pool *pool, const char *path,
+                       uint32_t *out_texture) {
+  assert(pool);
+  assert(path);
+  assert(out_texture);
+
+  uint32_t texture_index = 0;
+  while (texture_index < MAX_TEXTURE_COUNT &&
+         pool->textures[texture_index].is_loaded) {
+    texture_index++;
+  }
+  if (texture_index == MAX_TEXTURE_COUNT) {
+    LOG("Too many textures loaded");
+    goto err;
+  }
+  struct texture *texture = &pool->textures[texture_index];
+
+  int file_descriptor = open(path, O_RDONLY);
+  if (file_descriptor < 0) {
+    LOG("Couldn't open texture file %s", path);
+    goto err;
+  }
+
+  struct stat file_stat;
+  if (fstat(file_descriptor, &file_stat) < 0 ||
+      (size_t)file_stat.st_size < sizeof(struct texture_file_header)) {
+    LOG("Texture file %s is too small", path);
+    close(file_descriptor);
+    goto err;
+  }
+  size_t file_size = file_stat.st_size;
+
+  // The mapping outlives the descriptor
+  void *file_content =
+      mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, file_descriptor, 0);
+  close(file_descriptor);
+  if (file_content == MAP_FAILED) {
+    LOG("Couldn't map texture file %s", path);
+    goto err;
+  }
+
+  const struct texture_file_header *header = file_content;
+  if (!texture_file_header_is_valid(header, file_size)) {
+    goto unmap_file;
+  }
+
+  int encoding = 0;
+  while (encoding < TEXTURE_ENCODING_COUNT &&
+         !texture_encoding_is_usable(pool->renderer, header, encoding)) {
+    encoding++;
+  }
+  if (encoding == TEXTURE_ENCODING_COUNT) {
+    LOG("Texture %s has no encoding the device can sample", path);
+    goto unmap_file;
+  }
+
+  *texture = (struct texture){
+      .is_loaded = true,
+      .file_content = file_content,
+      .file_size = file_size,
+      .encoding = &header->encodings[encoding],
+      .format = texture_encoding_formats[encoding],
+      .width = header->width,
+      .height = header->height,
+      .mip_count = header->mip_count,
+      .stored_mip_count = header->encodings[encoding].stored_mip_count,
+      .last_used_frame = pool->frame_index};
+
+  if (texture->stored_mip_count < texture->mip_count &&
+      !texture_format_has_features(pool->renderer, texture->format,
+                                   VK_FORMAT_FEATURE_BLIT_SRC_BIT |
+                                       VK_FORMAT_FEATURE_BLIT_DST_BIT |
+                                       VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT)) {
+    LOG("Texture %s: mips can't be generated, only stored levels are used",
+        path);
+    texture->mip_count = texture->stored_mip_count;
+  }
+  texture->resident_mip = texture->mip_count;
+
+  texture->min_streamable_mip = 0;
+  while (texture->min_streamable_mip < texture->mip_count &&
+         texture->encoding
+                 ->levels[texture_upload_mip(texture,
+                                             texture->min_streamable_mip)]
+                 .data_size > TEXTURE_STREAMING_STAGING_SIZE) {
+    texture->min_streamable_mip++;
+  }
+  if (texture->min_streamable_mip == texture->mip_count) {
+    LOG("Texture %s has no level small enough to be streamed", path);
+    *texture = (struct texture){0};
+    goto unmap_file;
+  }
+
+  LOG("Loaded texture %s: %ux%u, %u mips, encoding %d", path, texture->width,
+      texture->height, texture->mip_count, encoding);
+  *out_texture = texture_index;
+  return true;
+unmap_file:
+  munmap(file_content, file_size);
+err:
+  return false;
+}
+
+void texture_pool_unload(struct texture_pool *pool, uint32_t texture_index) {
+  assert(texture_index < MAX_TEXTURE_COUNT);
+  struct texture *texture = &pool->textures[texture_index];
+  assert(texture->is_loaded);
+  texture_pool_retire_image(pool, &texture->image);
+  munmap(texture->file_content, texture->file_size);
+  *texture = (struct texture){0};
+}
+
+void texture_pool_use(struct texture_pool *pool, uint32_t texture_index) {
+  assert(texture_index < MAX_TEXTURE_COUNT);
+  assert(pool->textures[texture_index].is_loaded);
+  pool->textures[texture_index].last_used_frame = pool->frame_index;
+}
+
+VkImageView texture_pool_image_view(const struct texture_pool *pool,
+                                    uint32_t texture_index) {
+  assert(texture_index < MAX_TEXTURE_COUNT);
+  return pool->textures[texture_index].image.image_view;
+}
+
+void texture_pool_update(struct texture_pool *pool) {
+  // The frame's fence has been waited on, nothing uses its garbage anymore
+  texture_pool_collect_garbage(pool, pool->renderer->current_frame);
+  pool->staging_offset = 0;
+  pool->frame_index++;
+
+  texture_pool_refresh_budget(pool);
+  if (!texture_pool_make_room(pool, 0, NULL)) {
+    LOG("Texture memory is over budget and nothing can be evicted");
+  }
+
+  // Lowest resolution first across all textures, so none of them stays
+  // blank while another one gets its largest levels
+  while (true) {
+    struct texture *candidate = NULL;
+    for (uint32_t texture_index = 0; texture_index < MAX_TEXTURE_COUNT;
+         texture_index++) {
+      struct texture *texture = &pool->textures[texture_index];
+      if (!texture->is_loaded ||
+          texture->resident_mip <= texture->min_streamable_mip ||
+          texture->last_used_frame + TEXTURE_RECENT_USE_FRAME_COUNT <
+              pool->frame_index ||
+          texture->streamed_frame == pool->frame_index) {
+        continue;
+      }
+
+      if (!candidate || texture->resident_mip > candidate->resident_mip ||
+          (texture->resident_mip == candidate->resident_mip &&
+           texture->last_used_frame > candidate->last_used_frame)) {
+        candidate = texture;
+      }
+    }
+
+    // Out of staging space or budget, the rest waits for the next frames
+    if (!candidate || !texture_pool_stream_in(pool, candidate)) {
+      break;
+    }
+    candidate->streamed_frame = pool->frame_index;
+  }
+}
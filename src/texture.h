@@ -0,0 +1,98 @@
+#ifndef VKGUIDE_TEXTURE_H
+#define VKGUIDE_TEXTURE_H
+
+#include "texture_format.h"
+#include "vulkan_renderer.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <vulkan/vulkan.h>
+
+#define MAX_TEXTURE_COUNT 256
+// Images replaced during a frame, destroyed once that frame slot comes back
+#define MAX_TEXTURE_GARBAGE_COUNT 64
+
+struct texture_image {
+  VkImage image;
+  VkDeviceMemory memory;
+  VkDeviceSize memory_size;
+  VkImageView image_view;
+};
+
+struct texture {
+  bool is_loaded;
+  // The file stays mapped so that evicted levels can be streamed back in
+  void *file_content;
+  size_t file_size;
+  const struct texture_file_encoding *encoding;
+  VkFormat format;
+  uint32_t width;
+  uint32_t height;
+  // Can be shorter than the file's chain when the tail can't be generated
+  uint32_t mip_count;
+  uint32_t stored_mip_count;
+  // Levels whose upload doesn't fit the streaming staging area stay evicted
+  uint32_t min_streamable_mip;
+  // `image` holds the levels [resident_mip, mip_count), resident_mip is
+  // mip_count while nothing is resident
+  uint32_t resident_mip;
+  struct texture_image image;
+  uint64_t last_used_frame;
+  // Pool frame a level was last streamed in, one level per texture and frame
+  uint64_t streamed_frame;
+};
+
+// Streams texture levels in and out of device memory. Levels are streamed
+// smallest first so every texture becomes usable at a low resolution before
+// any texture gets its full resolution. Device memory used by textures is
+// kept under a budget derived from VK_EXT_memory_budget, the least recently
+// used textures lose their largest levels first when it is exceeded.
+//
+// Growing or shrinking a texture reallocates its image and copies the levels
+// that stay resident, so image views change whenever texture_pool_update
+// runs.
+struct texture_pool {
+  struct vulkan_renderer *renderer;
+  struct texture textures[MAX_TEXTURE_COUNT];
+  VkSampler sampler;
+
+  // One streaming region per frame in flight
+  VkBuffer staging_buffer;
+  VkDeviceMemory staging_buffer_memory;
+  uint8_t *staging_buffer_mapped;
+  VkDeviceSize staging_offset;
+
+  struct texture_image garbage[MAX_FRAMES_IN_FLIGHT]
+                              [MAX_TEXTURE_GARBAGE_COUNT];
+  uint32_t garbage_counts[MAX_FRAMES_IN_FLIGHT];
+  VkDeviceSize garbage_bytes;
+  // Including garbage
+  VkDeviceSize allocated_bytes;
+  VkDeviceSize budget_bytes;
+  uint32_t memory_heap_index;
+  uint64_t frame_index;
+};
+
+bool texture_pool_init(struct texture_pool *pool,
+                       struct vulkan_renderer *renderer);
+// The device must be idle
+void texture_pool_deinit(struct texture_pool *pool);
+
+// Nothing is resident until the texture has been used and the pool updated
+bool texture_pool_load(struct texture_pool *pool, const char *path,
+                       uint32_t *out_texture);
+void texture_pool_unload(struct texture_pool *pool, uint32_t texture);
+
+// Marks the texture as used this frame, used textures are streamed up to
+// their full resolution and are the last to be evicted
+void texture_pool_use(struct texture_pool *pool, uint32_t texture);
+// VK_NULL_HANDLE while no level is resident. Only valid until the next
+// texture_pool_update.
+VkImageView texture_pool_image_view(const struct texture_pool *pool,
+                                    uint32_t texture);
+
+// Records this frame's streaming work, must be called between
+// vulkan_renderer_begin_frame and vulkan_renderer_begin_render_pass
+void texture_pool_update(struct texture_pool *pool);
+
+#endif // VKGUIDE_TEXTURE_H
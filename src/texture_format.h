@@ -0,0 +1,54 @@
+#ifndef VKGUIDE_TEXTURE_FORMAT_H
+#define VKGUIDE_TEXTURE_FORMAT_H
+
+// On-disk layout of the .vkt texture container written by
+// tools/texture_converter.c. Like .vkm files, it is mmap'd and levels are
+// copied from the mapping straight into the staging buffer.
+//
+// A file can hold the same texture in several encodings, the loader picks
+// the best one the device can sample. Each encoding stores the levels
+// [0, stored_mip_count), the remaining levels of the chain are generated on
+// the GPU with blits, which is only possible for uncompressed encodings.
+// Levels are laid out smallest first, the order in which they are streamed.
+
+#include <stdint.h>
+
+#define TEXTURE_FILE_MAGIC 0x544b5656u // "VVKT"
+#define TEXTURE_FILE_VERSION 1u
+#define TEXTURE_FILE_SECTION_ALIGNMENT 16u
+#define TEXTURE_MAX_MIP_COUNT 16
+
+// In order of preference
+enum texture_encoding {
+  TEXTURE_ENCODING_BC7_SRGB,
+  TEXTURE_ENCODING_ASTC_4X4_SRGB,
+  TEXTURE_ENCODING_RGBA8_SRGB,
+  TEXTURE_ENCODING_COUNT
+};
+
+struct texture_file_level {
+  uint64_t data_offset;
+  uint64_t data_size;
+};
+
+struct texture_file_encoding {
+  // 0 when the encoding is absent from the file
+  uint32_t stored_mip_count;
+  uint32_t reserved;
+  struct texture_file_level levels[TEXTURE_MAX_MIP_COUNT];
+};
+
+struct texture_file_header {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t width;
+  uint32_t height;
+  // Length of the full chain, down to 1x1
+  uint32_t mip_count;
+  uint32_t reserved;
+  struct texture_file_encoding encodings[TEXTURE_ENCODING_COUNT];
+};
+_Static_assert(sizeof(struct texture_file_header) == 24 + 3 * 264,
+               "texture_file_header must have a stable layout");
+
+#endif // VKGUIDE_TEXTURE_FORMAT_H
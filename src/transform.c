@@ -0,0 +1,93 @@
+#include "transform.h"
+#include <math.h>
+
+struct vec3 vec3_add(struct vec3 a, struct vec3 b) {
+  return (struct vec3){a.x + b.x, a.y + b.y, a.z + b.z};
+}
+
+struct vec3 vec3_sub(struct vec3 a, struct vec3 b) {
+  return (struct vec3){a.x - b.x, a.y - b.y, a.z - b.z};
+}
+
+struct vec3 vec3_scale(struct vec3 v, float s) {
+  return (struct vec3){v.x * s, v.y * s, v.z * s};
+}
+
+struct vec3 vec3_cross(struct vec3 a, struct vec3 b) {
+  return (struct vec3){a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z,
+                       a.x * b.y - a.y * b.x};
+}
+
+float vec3_dot(struct vec3 a, struct vec3 b) {
+  return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+float vec3_length(struct vec3 v) { return sqrtf(vec3_dot(v, v)); }
+
+struct vec3 vec3_normalize(struct vec3 v) {
+  float length = vec3_length(v);
+  if (length == 0.0f) {
+    return v;
+  }
+  return vec3_scale(v, 1.0f / length);
+}
+
+struct mat4 mat4_identity(void) {
+  return (struct mat4){.m = {1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f,
+                             0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f}};
+}
+
+struct mat4 mat4_multiply(const struct mat4 *a, const struct mat4 *b) {
+  struct mat4 result;
+  for (int column = 0; column < 4; column++) {
+    for (int row = 0; row < 4; row++) {
+      float sum = 0.0f;
+      for (int k = 0; k < 4; k++) {
+        sum += a->m[k * 4 + row] * b->m[column * 4 + k];
+      }
+      result.m[column * 4 + row] = sum;
+    }
+  }
+  return result;
+}
+
+struct mat4 mat4_translation(struct vec3 translation) {
+  struct mat4 result = mat4_identity();
+  result.m[12] = translation.x;
+  result.m[13] = translation.y;
+  result.m[14] = translation.z;
+  return result;
+}
+
+struct mat4 mat4_perspective(float fov_y_radians, float aspect_ratio,
+                             float near_plane, float far_plane) {
+  float focal_length = 1.0f / tanf(fov_y_radians * 0.5f);
+  struct mat4 result = {0};
+  result.m[0] = focal_length / aspect_ratio;
+  result.m[5] = -focal_length;
+  result.m[10] = far_plane / (near_plane - far_plane);
+  result.m[11] = -1.0f;
+  result.m[14] = (near_plane * far_plane) / (near_plane - far_plane);
+  return result;
+}
+
+struct mat4 mat4_look_at(struct vec3 eye, struct vec3 center, struct vec3 up) {
+  struct vec3 forward = vec3_normalize(vec3_sub(center, eye));
+  struct vec3 side = vec3_normalize(vec3_cross(forward, up));
+  struct vec3 camera_up = vec3_cross(side, forward);
+
+  struct mat4 result = mat4_identity();
+  result.m[0] = side.x;
+  result.m[4] = side.y;
+  result.m[8] = side.z;
+  result.m[1] = camera_up.x;
+  result.m[5] = camera_up.y;
+  result.m[9] = camera_up.z;
+  result.m[2] = -forward.x;
+  result.m[6] = -forward.y;
+  result.m[10] = -forward.z;
+  result.m[12] = -vec3_dot(side, eye);
+  result.m[13] = -vec3_dot(camera_up, eye);
+  result.m[14] = vec3_dot(forward, eye);
+  return result;
+}
@@ -0,0 +1,32 @@
+#ifndef VKGUIDE_TRANSFORM_H
+#define VKGUIDE_TRANSFORM_H
+
+struct vec3 {
+  float x;
+  float y;
+  float z;
+};
+
+// Column-major, matching the GLSL mat4 memory layout
+struct mat4 {
+  float m[16];
+};
+
+struct vec3 vec3_add(struct vec3 a, struct vec3 b);
+struct vec3 vec3_sub(struct vec3 a, struct vec3 b);
+struct vec3 vec3_scale(struct vec3 v, float s);
+struct vec3 vec3_cross(struct vec3 a, struct vec3 b);
+float vec3_dot(struct vec3 a, struct vec3 b);
+float vec3_length(struct vec3 v);
+struct vec3 vec3_normalize(struct vec3 v);
+
+struct mat4 mat4_identity(void);
+struct mat4 mat4_multiply(const struct mat4 *a, const struct mat4 *b);
+struct mat4 mat4_translation(struct vec3 translation);
+// Right-handed, depth in [0, 1] and Y pointing down in clip space, as Vulkan
+// expects
+struct mat4 mat4_perspective(float fov_y_radians, float aspect_ratio,
+                             float near_plane, float far_plane);
+struct mat4 mat4_look_at(struct vec3 eye, struct vec3 center, struct vec3 up);
+
+#endif // VKGUIDE_TRANSFORM_H
@@ -0,0 +1,2863 @@
+#include "vulkan_renderer.h"
+#include "arena.h"
+#include "dynamic_resolution.h"
+#include "log.h"
+#include "mesh.h"
+#include "mesh_format.h"
+#include "meshlet.h"
+#include "occlusion.h"
+#include "post_process.h"
+#include <SDL3/SDL.h>
+#include <SDL3/SDL_vulkan.h>
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vulkan/vulkan.h>
+#include <vulkan/vulkan_core.h>
+
+// Startup scratch: layer/extension enumerations, shader code, create-info
+// arrays. Reset once initialization is done.
+#define INIT_ARENA_CAPACITY (4 * 1024 * 1024)
+// Transient CPU-side data for a single frame: the draw list and sprite batch
+// sort scratch, 8 bytes per draw or sprite. Fits a full sprite batch next to
+// a 131072 draw list. Reset at the start of every frame.
+#define FRAME_ARENA_CAPACITY (2 * 1024 * 1024)
+// Uploads larger than this are split into several transfers
+#define STAGING_BUFFER_SIZE (16 * 1024 * 1024)
+#define RENDER_SCALE_MIN 0.25f
+#define RENDER_SCALE_MAX 2.0f
+// Draws per frame when the draw data doesn't fit in push constants
+#define DRAW_DATA_RING_FRAME_CAPACITY 16384
+
+#define MAX_EXTENSION_COUNT 256
+#define MAX_ADDITIONAL_EXTENSION_COUNT 100
+#define MAX_DEVICE_COUNT 48
+
+#define VALIDATION_LAYER_NAME "VK_LAYER_KHRONOS_validation"
+
+VKAPI_ATTR VkBool32 VKAPI_CALL
+vulkan_debug_callback(VkDebugUtilsMessageSeverityFlagBitsEXT message_severity,
+                      VkDebugUtilsMessageTypeFlagsEXT message_type,
+                      const VkDebugUtilsMessengerCallbackDataEXT *callback_data,
+                      void *user_data) {
+  (void)message_severity;
+  (void)callback_data;
+  // Can be called from any thread making Vulkan calls
+  struct vulkan_renderer *renderer = user_data;
+  if (message_type & VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT) {
+    SDL_AddAtomicInt(&renderer->performance_message_count, 1);
+  }
+  LOG("Validation layer: %s", callback_data->pMessage);
+  return VK_FALSE;
+}
+
+static const struct {
+  const char *name;
+  enum vulkan_renderer_validation validation;
+} validation_names[] = {
+    {"off", VULKAN_RENDERER_VALIDATION_OFF},
+    {"standard", VULKAN_RENDERER_VALIDATION_STANDARD},
+    {"sync", VULKAN_RENDERER_VALIDATION_SYNCHRONIZATION},
+    {"gpu", VULKAN_RENDERER_VALIDATION_GPU_ASSISTED},
+    {"perf", VULKAN_RENDERER_VALIDATION_PERFORMANCE}};
+#define VALIDATION_NAME_COUNT                                                  \
+  (sizeof(validation_names) / sizeof(validation_names[0]))
+
+bool vulkan_renderer_validation_from_name(
+    const char *name, enum vulkan_renderer_validation *out_validation) {
+  for (size_t name_index = 0; name_index < VALIDATION_NAME_COUNT;
+       name_index++) {
+    if (strcmp(name, validation_names[name_index].name) == 0) {
+      *out_validation = validation_names[name_index].validation;
+      return true;
+    }
+  }
+  return false;
+}
+
+const char *
+vulkan_renderer_validation_name(enum vulkan_renderer_validation validation) {
+  for (size_t name_index = 0; name_index < VALIDATION_NAME_COUNT;
+       name_index++) {
+    if (validation_names[name_index].validation == validation) {
+      return validation_names[name_index].name;
+    }
+  }
+  return "default";
+}
+
+// Looks among the extensions of `layer_name`, or of the implementation and
+// the implicit layers when NULL
+bool instance_supports_extension(struct arena *scratch_arena,
+                                 const char *layer_name,
+                                 const char *extension_name) {
+  uint32_t extension_count = 0;
+  if (vkEnumerateInstanceExtensionProperties(layer_name, &extension_count,
+                                             NULL) != VK_SUCCESS) {
+    return false;
+  }
+
+  size_t scratch_arena_mark = arena_mark(scratch_arena);
+  VkExtensionProperties *extensions = ARENA_ALLOC_ARRAY(
+      scratch_arena, VkExtensionProperties, extension_count);
+  if (!extensions) {
+    return false;
+  }
+  vkEnumerateInstanceExtensionProperties(layer_name, &extension_count,
+                                         extensions);
+
+  bool supported = false;
+  for (uint32_t extension_index = 0; extension_index < extension_count;
+       extension_index++) {
+    if (strcmp(extensions[extension_index].extensionName, extension_name) ==
+        0) {
+      supported = true;
+      break;
+    }
+  }
+
+  arena_rewind(scratch_arena, scratch_arena_mark);
+  return supported;
+}
+
+bool instance_supports_layer(struct arena *scratch_arena,
+                             const char *layer_name) {
+  uint32_t layer_count = 0;
+  if (vkEnumerateInstanceLayerProperties(&layer_count, NULL) != VK_SUCCESS) {
+    return false;
+  }
+
+  size_t scratch_arena_mark = arena_mark(scratch_arena);
+  VkLayerProperties *layers =
+      ARENA_ALLOC_ARRAY(scratch_arena, VkLayerProperties, layer_count);
+  if (!layers) {
+    return false;
+  }
+  vkEnumerateInstanceLayerProperties(&layer_count, layers);
+
+  bool supported = false;
+  for (uint32_t layer_index = 0; layer_index < layer_count; layer_index++) {
+    if (strcmp(layers[layer_index].layerName, layer_name) == 0) {
+      supported = true;
+      break;
+    }
+  }
+
+  arena_rewind(scratch_arena, scratch_arena_mark);
+  return supported;
+}
+
+// Warnings and errors only, verbose messages cost a callback each for
+// little information. Performance validation only subscribes to performance
+// messages.
+VkDebugUtilsMessengerCreateInfoEXT
+vulkan_renderer_debug_messenger_create_info(struct vulkan_renderer *renderer) {
+  VkDebugUtilsMessageTypeFlagsEXT message_type =
+      VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
+  if (renderer->validation != VULKAN_RENDERER_VALIDATION_PERFORMANCE) {
+    message_type |= VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT |
+                    VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT;
+  }
+  return (VkDebugUtilsMessengerCreateInfoEXT){
+      .sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT,
+      .messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT |
+                         VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT,
+      .messageType = message_type,
+      .pfnUserCallback = vulkan_debug_callback,
+      .pUserData = renderer};
+}
+
+static const VkValidationFeatureEnableEXT
+    synchronization_validation_features[] = {
+        VK_VALIDATION_FEATURE_ENABLE_SYNCHRONIZATION_VALIDATION_EXT};
+static const VkValidationFeatureEnableEXT gpu_assisted_validation_features[] = {
+    VK_VALIDATION_FEATURE_ENABLE_GPU_ASSISTED_EXT,
+    VK_VALIDATION_FEATURE_ENABLE_GPU_ASSISTED_RESERVE_BINDING_SLOT_EXT};
+static const VkValidationFeatureEnableEXT performance_validation_features[] = {
+    VK_VALIDATION_FEATURE_ENABLE_BEST_PRACTICES_EXT};
+// Everything but the best practices checks
+static const VkValidationFeatureDisableEXT
+    performance_validation_disabled_features[] = {
+        VK_VALIDATION_FEATURE_DISABLE_SHADERS_EXT,
+        VK_VALIDATION_FEATURE_DISABLE_THREAD_SAFETY_EXT,
+        VK_VALIDATION_FEATURE_DISABLE_API_PARAMETERS_EXT,
+        VK_VALIDATION_FEATURE_DISABLE_OBJECT_LIFETIMES_EXT,
+        VK_VALIDATION_FEATURE_DISABLE_CORE_CHECKS_EXT,
+        VK_VALIDATION_FEATURE_DISABLE_UNIQUE_HANDLES_EXT};
+#define FEATURE_COUNT(features)                                                \
+  (uint32_t)(sizeof(features) / sizeof(features[0]))
+
+VkValidationFeaturesEXT
+vulkan_renderer_validation_features(const struct vulkan_renderer *renderer) {
+  VkValidationFeaturesEXT features = {
+      .sType = VK_STRUCTURE_TYPE_VALIDATION_FEATURES_EXT};
+  switch (renderer->validation) {
+  case VULKAN_RENDERER_VALIDATION_SYNCHRONIZATION:
+    features.enabledValidationFeatureCount =
+        FEATURE_COUNT(synchronization_validation_features);
+    features.pEnabledValidationFeatures = synchronization_validation_features;
+    break;
+  case VULKAN_RENDERER_VALIDATION_GPU_ASSISTED:
+    features.enabledValidationFeatureCount =
+        FEATURE_COUNT(gpu_assisted_validation_features);
+    features.pEnabledValidationFeatures = gpu_assisted_validation_features;
+    break;
+  case VULKAN_RENDERER_VALIDATION_PERFORMANCE:
+    features.enabledValidationFeatureCount =
+        FEATURE_COUNT(performance_validation_features);
+    features.pEnabledValidationFeatures = performance_validation_features;
+    features.disabledValidationFeatureCount =
+        FEATURE_COUNT(performance_validation_disabled_features);
+    features.pDisabledValidationFeatures =
+        performance_validation_disabled_features;
+    break;
+  default:
+    break;
+  }
+  return features;
+}
+
+// Downgrades renderer->validation to what the installed layer supports.
+// Performance validation is meant for production where the layer may be
+// missing, it is then turned off rather than failing.
+bool vulkan_renderer_select_validation(struct vulkan_renderer *renderer) {
+  if (renderer->validation == VULKAN_RENDERER_VALIDATION_OFF) {
+    return true;
+  }
+
+  bool performance_only =
+      renderer->validation == VULKAN_RENDERER_VALIDATION_PERFORMANCE;
+  if (!instance_supports_layer(&renderer->init_arena, VALIDATION_LAYER_NAME)) {
+    if (!performance_only) {
+      LOG("Validation layer " VALIDATION_LAYER_NAME " isn't available.");
+      return false;
+    }
+    LOG("Validation layer unavailable, performance validation disabled");
+    renderer->validation = VULKAN_RENDERER_VALIDATION_OFF;
+    return true;
+  }
+
+  if (renderer->validation != VULKAN_RENDERER_VALIDATION_STANDARD &&
+      !instance_supports_extension(&renderer->init_arena,
+                                   VALIDATION_LAYER_NAME,
+                                   VK_EXT_VALIDATION_FEATURES_EXTENSION_NAME)) {
+    LOG("Validation layer has no " VK_EXT_VALIDATION_FEATURES_EXTENSION_NAME
+        ", %s",
+        performance_only ? "performance validation disabled"
+                         : "falling back to standard validation");
+    renderer->validation = performance_only
+                               ? VULKAN_RENDERER_VALIDATION_OFF
+                               : VULKAN_RENDERER_VALIDATION_STANDARD;
+  }
+  return true;
+}
+
+bool vulkan_renderer_create_instance(struct vulkan_renderer *renderer) {
+  if (!vulkan_renderer_select_validation(renderer)) {
+    goto err;
+  }
+  renderer->enable_validation_layers =
+      renderer->validation != VULKAN_RENDERER_VALIDATION_OFF;
+
+  VkApplicationInfo application_info = {
+      .sType = VK_STRUCTURE_TYPE_APPLICATION_INFO,
+      .pApplicationName = "vkguide",
+      .applicationVersion = VK_MAKE_VERSION(1, 0, 0),
+      .pEngineName = "None",
+      .engineVersion = VK_MAKE_VERSION(1, 0, 0),
+      .apiVersion = VK_API_VERSION_1_2};
+
+  const char *requested_extensions[MAX_EXTENSION_COUNT] = {0};
+  uint32_t requested_extension_count = 0;
+  uint32_t required_instance_extension_count;
+  const char *const *required_instance_extensions =
+      SDL_Vulkan_GetInstanceExtensions(&required_instance_extension_count);
+
+  assert(requested_extension_count + required_instance_extension_count <
+         MAX_EXTENSION_COUNT);
+  memcpy(requested_extensions, required_instance_extensions,
+         required_instance_extension_count * sizeof(const char *));
+  requested_extension_count += required_instance_extension_count;
+
+  const char *additional_extensions[MAX_ADDITIONAL_EXTENSION_COUNT] = {0};
+  uint32_t additional_extension_count = 0;
+
+  // Portability implementations (e.g. MoltenVK) are only enumerated with
+  // the flag, which requires the extension
+  VkInstanceCreateFlags instance_create_flags = 0;
+  if (instance_supports_extension(
+          &renderer->init_arena, NULL,
+          VK_KHR_PORTABILITY_ENUMERATION_EXTENSION_NAME)) {
+    additional_extensions[additional_extension_count++] =
+        VK_KHR_PORTABILITY_ENUMERATION_EXTENSION_NAME;
+    instance_create_flags |= VK_INSTANCE_CREATE_ENUMERATE_PORTABILITY_BIT_KHR;
+  }
+
+  if (renderer->enable_validation_layers) {
+    additional_extensions[additional_extension_count++] =
+        VK_EXT_DEBUG_UTILS_EXTENSION_NAME;
+  }
+
+  VkValidationFeaturesEXT validation_features =
+      vulkan_renderer_validation_features(renderer);
+  bool validation_features_used =
+      validation_features.enabledValidationFeatureCount > 0;
+  if (validation_features_used) {
+    additional_extensions[additional_extension_count++] =
+        VK_EXT_VALIDATION_FEATURES_EXTENSION_NAME;
+  }
+
+  assert(requested_extension_count + additional_extension_count <
+         MAX_EXTENSION_COUNT);
+  memcpy(requested_extensions + requested_extension_count,
+         additional_extensions,
+         additional_extension_count * sizeof(const char *));
+  requested_extension_count += additional_extension_count;
+
+  static const char *validation_layers[] = {VALIDATION_LAYER_NAME};
+  VkDebugUtilsMessengerCreateInfoEXT debug_create_info =
+      vulkan_renderer_debug_messenger_create_info(renderer);
+  if (validation_features_used) {
+    debug_create_info.pNext = &validation_features;
+  }
+
+  VkInstanceCreateInfo instance_create_info = {
+      .sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
+      .pApplicationInfo = &application_info,
+      .enabledExtensionCount = requested_extension_count,
+      .ppEnabledExtensionNames = requested_extensions,
+      .flags = instance_create_flags};
+  if (renderer->enable_validation_layers) {
+    instance_create_info.enabledLayerCount = 1;
+    instance_create_info.ppEnabledLayerNames = validation_layers;
+    instance_create_info.pNext = &debug_create_info;
+  }
+
+  VkResult create_instance_result =
+      vkCreateInstance(&instance_create_info, NULL, &renderer->instance);
+  if (create_instance_result != VK_SUCCESS) {
+    LOG("Vulkan instance creation failed, VkResult=%d", create_instance_result);
+    goto err;
+  }
+  return true;
+err:
+  return false;
+}
+
+void vulkan_renderer_destroy_instance(struct vulkan_renderer *renderer) {
+  vkDestroyInstance(renderer->instance, NULL);
+}
+VkResult vkCreateDebugUtilsMessengerEXT(
+    VkInstance instance, const VkDebugUtilsMessengerCreateInfoEXT *create_info,
+    const VkAllocationCallbacks *allocation_callbacks,
+    VkDebugUtilsMessengerEXT *debug_messenger) {
+  PFN_vkCreateDebugUtilsMessengerEXT func =
+      (PFN_vkCreateDebugUtilsMessengerEXT)vkGetInstanceProcAddr(
+          instance, "vkCreateDebugUtilsMessengerEXT");
+  if (func != NULL) {
+    return func(instance, create_info, allocation_callbacks, debug_messenger);
+  } else {
+    return VK_ERROR_EXTENSION_NOT_PRESENT;
+  }
+}
+
+void vkDestroyDebugUtilsMessengerEXT(VkInstance instance,
+                                     VkDebugUtilsMessengerEXT debugMessenger,
+                                     const VkAllocationCallbacks *pAllocator) {
+  PFN_vkDestroyDebugUtilsMessengerEXT func =
+      (PFN_vkDestroyDebugUtilsMessengerEXT)vkGetInstanceProcAddr(
+          instance, "vkDestroyDebugUtilsMessengerEXT");
+  if (func != NULL) {
+    func(instance, debugMessenger, pAllocator);
+  }
+}
+
+bool vulkan_renderer_create_debug_messenger(struct vulkan_renderer *renderer) {
+  VkDebugUtilsMessengerCreateInfoEXT create_info =
+      vulkan_renderer_debug_messenger_create_info(renderer);
+  return vkCreateDebugUtilsMessengerEXT(renderer->instance, &create_info, NULL,
+                                        &renderer->debug_messenger) ==
+         VK_SUCCESS;
+}
+
+struct queue_family_indices {
+  uint32_t graphics_family;
+  uint32_t present_family;
+  bool has_graphics_family;
+  bool has_present_family;
+};
+
+bool queue_family_indices_is_complete(
+    const struct queue_family_indices *indices) {
+  return indices->has_graphics_family && indices->has_present_family;
+}
+
+#define MAX_QUEUE_FAMILY_COUNT 64
+struct queue_family_indices find_queue_families(VkPhysicalDevice device,
+                                                VkSurfaceKHR surface) {
+  struct queue_family_indices indices = {0};
+
+  uint32_t queue_family_count = 0;
+  vkGetPhysicalDeviceQueueFamilyProperties(device, &queue_family_count, NULL);
+
+  assert(queue_family_count < MAX_QUEUE_FAMILY_COUNT);
+  VkQueueFamilyProperties queue_families[MAX_QUEUE_FAMILY_COUNT];
+  vkGetPhysicalDeviceQueueFamilyProperties(device, &queue_family_count,
+                                           queue_families);
+
+  for (uint32_t queue_family_index = 0; queue_family_index < queue_family_count;
+       queue_family_index++) {
+    VkQueueFamilyProperties *queue_family = &queue_families[queue_family_index];
+
+    VkBool32 present_support;
+    vkGetPhysicalDeviceSurfaceSupportKHR(device, queue_family_index, surface,
+                                         &present_support);
+
+    if (queue_family->queueFlags & VK_QUEUE_GRAPHICS_BIT) {
+      indices.graphics_family = queue_family_index;
+      indices.has_graphics_family = true;
+    }
+
+    if (present_support) {
+      indices.present_family = queue_family_index;
+      indices.has_present_family = true;
+    }
+
+    if (queue_family_indices_is_complete(&indices)) {
+      break;
+    }
+  }
+
+  return indices;
+}
+
+bool extension_with_name_is_in_array(VkExtensionProperties *array,
+                                     uint32_t length,
+                                     const char *extension_name) {
+  for (uint32_t index = 0; index < length; index++) {
+    if (strcmp(array[index].extensionName, extension_name) == 0) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+bool device_supports_requested_extensions(struct arena *scratch_arena,
+                                          VkPhysicalDevice device,
+                                          const char **required_extensions,
+                                          uint32_t required_extension_count) {
+  uint32_t supported_extension_count;
+  vkEnumerateDeviceExtensionProperties(device, NULL, &supported_extension_count,
+                                       NULL);
+
+  size_t scratch_arena_mark = arena_mark(scratch_arena);
+  VkExtensionProperties *supported_extensions = ARENA_ALLOC_ARRAY(
+      scratch_arena, VkExtensionProperties, supported_extension_count);
+  if (!supported_extensions) {
+    return false;
+  }
+  vkEnumerateDeviceExtensionProperties(device, NULL, &supported_extension_count,
+                                       supported_extensions);
+
+  bool all_extensions_supported = true;
+  for (uint32_t required_extension_index = 0;
+       required_extension_index < required_extension_count;
+       required_extension_index++) {
+    if (!extension_with_name_is_in_array(
+            supported_extensions, supported_extension_count,
+            required_extensions[required_extension_index])) {
+      all_extensions_supported = false;
+      break;
+    }
+  }
+
+  arena_rewind(scratch_arena, scratch_arena_mark);
+  return all_extensions_supported;
+}
+
+#define MAX_SWAPCHAIN_SURFACE_FORMAT_COUNT 64
+#define MAX_SWAPCHAIN_SURFACE_PRESENT_MODE_COUNT 64
+
+struct swapchain_support_details {
+  VkSurfaceCapabilitiesKHR capabilities;
+  VkSurfaceFormatKHR formats[MAX_SWAPCHAIN_SURFACE_FORMAT_COUNT];
+  VkPresentModeKHR present_modes[MAX_SWAPCHAIN_SURFACE_PRESENT_MODE_COUNT];
+  uint32_t format_count;
+  uint32_t present_mode_count;
+};
+struct swapchain_support_details
+query_swapchain_support(VkPhysicalDevice device, VkSurfaceKHR surface) {
+  struct swapchain_support_details details;
+  vkGetPhysicalDeviceSurfaceCapabilitiesKHR(device, surface,
+                                            &details.capabilities);
+
+  vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface, &details.format_count,
+                                       NULL);
+  if (details.format_count != 0) {
+    assert(details.format_count < MAX_SWAPCHAIN_SURFACE_FORMAT_COUNT);
+    vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface, &details.format_count,
+                                         details.formats);
+  }
+
+  vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface,
+                                            &details.present_mode_count, NULL);
+  if (details.present_mode_count != 0) {
+    assert(details.present_mode_count <
+           MAX_SWAPCHAIN_SURFACE_PRESENT_MODE_COUNT);
+    vkGetPhysicalDeviceSurfacePresentModesKHR(
+        device, surface, &details.present_mode_count, details.present_modes);
+  }
+
+  return details;
+}
+
+bool is_device_suitable(struct arena *scratch_arena, VkPhysicalDevice device,
+                        VkSurfaceKHR surface, const char **required_extensions,
+                        uint32_t required_extension_count) {
+  struct queue_family_indices queue_family_indices =
+      find_queue_families(device, surface);
+
+  bool extensions_supported = device_supports_requested_extensions(
+      scratch_arena, device, required_extensions, required_extension_count);
+
+  bool swapchain_adequate = false;
+  if (extensions_supported) {
+    struct swapchain_support_details swapchain_support_details =
+        query_swapchain_support(device, surface);
+    swapchain_adequate = swapchain_support_details.format_count != 0 &&
+                         swapchain_support_details.present_mode_count != 0;
+  }
+
+  return queue_family_indices_is_complete(&queue_family_indices) &&
+         extensions_supported && swapchain_adequate;
+}
+
+static const char *required_extensions[] = {VK_KHR_SWAPCHAIN_EXTENSION_NAME};
+static uint32_t required_extension_count =
+    sizeof(required_extensions) / sizeof(const char *);
+#define PORTABILITY_SUBSET_EXTENSION_NAME "VK_KHR_portability_subset"
+#define MAX_ENABLED_DEVICE_EXTENSION_COUNT 8
+
+bool vulkan_renderer_pick_physical_device(struct vulkan_renderer *renderer) {
+
+  VkPhysicalDevice physical_device = VK_NULL_HANDLE;
+  uint32_t device_count = 0;
+  vkEnumeratePhysicalDevices(renderer->instance, &device_count, NULL);
+  if (device_count == 0) {
+    LOG("No GPU with Vulkan support found");
+    goto err;
+  }
+  assert(device_count < MAX_DEVICE_COUNT);
+
+  VkPhysicalDevice devices[MAX_DEVICE_COUNT];
+  vkEnumeratePhysicalDevices(renderer->instance, &device_count, devices);
+
+  for (uint32_t device_index = 0; device_index < device_count; device_index++) {
+    if (is_device_suitable(&renderer->init_arena, devices[device_index],
+                           renderer->surface, required_extensions,
+                           required_extension_count)) {
+      physical_device = devices[device_index];
+      break;
+    }
+  }
+
+  if (physical_device == VK_NULL_HANDLE) {
+    LOG("Failed to find a suitable GPU");
+    goto err;
+  }
+
+  renderer->physical_device = physical_device;
+
+  return true;
+err:
+  return false;
+}
+
+// Optional features only change which code paths are taken, their absence is
+// never an error
+void vulkan_renderer_query_optional_device_features(
+    struct vulkan_renderer *renderer) {
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(renderer->physical_device, &properties);
+
+  // Must be enabled whenever the implementation exposes it
+  renderer->portability_subset_supported =
+      device_supports_requested_extensions(
+          &renderer->init_arena, renderer->physical_device,
+          (const char *[]){PORTABILITY_SUBSET_EXTENSION_NAME}, 1);
+  bool mesh_shader_extension_supported = device_supports_requested_extensions(
+      &renderer->init_arena, renderer->physical_device,
+      (const char *[]){VK_EXT_MESH_SHADER_EXTENSION_NAME}, 1);
+  renderer->memory_budget_supported = device_supports_requested_extensions(
+      &renderer->init_arena, renderer->physical_device,
+      (const char *[]){VK_EXT_MEMORY_BUDGET_EXTENSION_NAME}, 1);
+
+  VkPhysicalDeviceMeshShaderFeaturesEXT mesh_shader_features = {
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT};
+  VkPhysicalDeviceVulkan12Features vulkan_12_features = {
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES};
+  VkPhysicalDeviceFeatures2 features = {
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2};
+  bool is_vulkan_12_device = properties.apiVersion >= VK_API_VERSION_1_2;
+  if (is_vulkan_12_device) {
+    vulkan_12_features.pNext = features.pNext;
+    features.pNext = &vulkan_12_features;
+  }
+  if (mesh_shader_extension_supported) {
+    mesh_shader_features.pNext = features.pNext;
+    features.pNext = &mesh_shader_features;
+  }
+  vkGetPhysicalDeviceFeatures2(renderer->physical_device, &features);
+
+  renderer->multi_draw_indirect_supported = features.features.multiDrawIndirect;
+  renderer->texture_compression_bc_supported =
+      features.features.textureCompressionBC;
+  renderer->texture_compression_astc_ldr_supported =
+      features.features.textureCompressionASTC_LDR;
+  renderer->storage_image_write_without_format_supported =
+      features.features.shaderStorageImageWriteWithoutFormat;
+  renderer->draw_indirect_count_supported =
+      is_vulkan_12_device && vulkan_12_features.drawIndirectCount;
+  // The meshlet pipeline needs SPIR-V 1.4, core since Vulkan 1.2
+  renderer->mesh_shader_supported =
+      is_vulkan_12_device && mesh_shader_extension_supported &&
+      mesh_shader_features.taskShader && mesh_shader_features.meshShader;
+
+  LOG("Mesh shaders: %s, multi draw indirect: %s, draw indirect count: %s",
+      renderer->mesh_shader_supported ? "yes" : "no",
+      renderer->multi_draw_indirect_supported ? "yes" : "no",
+      renderer->draw_indirect_count_supported ? "yes" : "no");
+  LOG("Memory budget: %s, BC compression: %s, ASTC LDR compression: %s",
+      renderer->memory_budget_supported ? "yes" : "no",
+      renderer->texture_compression_bc_supported ? "yes" : "no",
+      renderer->texture_compression_astc_ldr_supported ? "yes" : "no");
+}
+
+bool is_in_array(uint32_t *array, int length, uint32_t value) {
+  for (int i = 0; i < length; i++) {
+    if (array[i] == value) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+bool vulkan_renderer_create_logical_device(struct vulkan_renderer *renderer) {
+  struct queue_family_indices indices =
+      find_queue_families(renderer->physical_device, renderer->surface);
+  VkDeviceQueueCreateInfo queue_create_infos[MAX_QUEUE_FAMILY_COUNT] = {0};
+  int queue_create_info_count = 0;
+
+  uint32_t unique_queue_families[MAX_QUEUE_FAMILY_COUNT] = {0};
+  int unique_queue_family_count = 0;
+
+  if (!is_in_array(unique_queue_families, unique_queue_family_count,
+                   indices.graphics_family)) {
+    assert(unique_queue_family_count < MAX_QUEUE_FAMILY_COUNT);
+    unique_queue_families[unique_queue_family_count++] =
+        indices.graphics_family;
+  }
+  if (!is_in_array(unique_queue_families, unique_queue_family_count,
+                   indices.present_family)) {
+    assert(unique_queue_family_count < MAX_QUEUE_FAMILY_COUNT);
+    unique_queue_families[unique_queue_family_count++] = indices.present_family;
+  }
+
+  float queue_priority = 1.0f;
+  for (int unique_queue_family_index = 0;
+       unique_queue_family_index < unique_queue_family_count;
+       unique_queue_family_index++) {
+    queue_create_infos[queue_create_info_count++] = (VkDeviceQueueCreateInfo){
+        .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+        .queueFamilyIndex = unique_queue_families[unique_queue_family_index],
+        .queueCount = 1,
+        .pQueuePriorities = &queue_priority};
+  }
+
+  const char *enabled_extensions[MAX_ENABLED_DEVICE_EXTENSION_COUNT];
+  uint32_t enabled_extension_count = 0;
+  for (uint32_t required_extension_index = 0;
+       required_extension_index < required_extension_count;
+       required_extension_index++) {
+    enabled_extensions[enabled_extension_count++] =
+        required_extensions[required_extension_index];
+  }
+  if (renderer->portability_subset_supported) {
+    enabled_extensions[enabled_extension_count++] =
+        PORTABILITY_SUBSET_EXTENSION_NAME;
+  }
+  if (renderer->mesh_shader_supported) {
+    enabled_extensions[enabled_extension_count++] =
+        VK_EXT_MESH_SHADER_EXTENSION_NAME;
+  }
+  if (renderer->memory_budget_supported) {
+    enabled_extensions[enabled_extension_count++] =
+        VK_EXT_MEMORY_BUDGET_EXTENSION_NAME;
+  }
+  assert(enabled_extension_count <= MAX_ENABLED_DEVICE_EXTENSION_COUNT);
+
+  VkPhysicalDeviceFeatures device_features = {
+      .multiDrawIndirect = renderer->multi_draw_indirect_supported,
+      .textureCompressionBC = renderer->texture_compression_bc_supported,
+      .textureCompressionASTC_LDR =
+          renderer->texture_compression_astc_ldr_supported,
+      // The swapchain formats have no matching storage image format
+      .shaderStorageImageWriteWithoutFormat =
+          renderer->post_process_enabled &&
+          renderer->storage_image_write_without_format_supported};
+
+  const void *device_create_info_next = NULL;
+  VkPhysicalDeviceVulkan12Features vulkan_12_features = {
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES,
+      .drawIndirectCount = renderer->draw_indirect_count_supported};
+  if (renderer->draw_indirect_count_supported) {
+    device_create_info_next = &vulkan_12_features;
+  }
+  VkPhysicalDeviceMeshShaderFeaturesEXT mesh_shader_features = {
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT,
+      .pNext = (void *)device_create_info_next,
+      .taskShader = VK_TRUE,
+      .meshShader = VK_TRUE};
+  if (renderer->mesh_shader_supported) {
+    device_create_info_next = &mesh_shader_features;
+  }
+
+  if (vkCreateDevice(renderer->physical_device,
+                     &(const VkDeviceCreateInfo){
+                         .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
+                         .pNext = device_create_info_next,
+                         .pQueueCreateInfos = queue_create_infos,
+                         .queueCreateInfoCount = queue_create_info_count,
+                         .pEnabledFeatures = &device_features,
+                         .ppEnabledExtensionNames = enabled_extensions,
+                         .enabledExtensionCount = enabled_extension_count,
+                         // TODO maybe add the validation layers
+                         // Not required according to vulkan-tutorial, but might
+                         // be good for compatibility
+                     },
+                     NULL, &renderer->device) != VK_SUCCESS) {
+    LOG("Couldn't create logical vulkan device");
+    return false;
+  }
+
+  renderer->graphics_queue_family = indices.graphics_family;
+  vkGetDeviceQueue(renderer->device, indices.graphics_family, 0,
+                   &renderer->graphics_queue);
+  vkGetDeviceQueue(renderer->device, indices.present_family, 0,
+                   &renderer->present_queue);
+  LOG("graphics_queue: %p", (void *)renderer->graphics_queue);
+  LOG("present_queue: %p", (void *)renderer->present_queue);
+
+  return true;
+}
+
+// With `storage_format_preferred`, favors a UNORM format that can be written
+// by compute shaders (sRGB formats never can) and sets
+// `out_storage_supported` when one is found
+VkSurfaceFormatKHR
+choose_swapchain_surface_format(VkPhysicalDevice physical_device,
+                                VkSurfaceFormatKHR *available_formats,
+                                uint32_t available_format_count,
+                                bool storage_format_preferred,
+                                bool *out_storage_supported) {
+  *out_storage_supported = false;
+  for (uint32_t available_format_index = 0;
+       storage_format_preferred &&
+       available_format_index < available_format_count;
+       available_format_index++) {
+    VkSurfaceFormatKHR available_format =
+        available_formats[available_format_index];
+    if ((available_format.format != VK_FORMAT_B8G8R8A8_UNORM &&
+         available_format.format != VK_FORMAT_R8G8B8A8_UNORM) ||
+        available_format.colorSpace != VK_COLOR_SPACE_SRGB_NONLINEAR_KHR) {
+      continue;
+    }
+    VkFormatProperties format_properties;
+    vkGetPhysicalDeviceFormatProperties(
+        physical_device, available_format.format, &format_properties);
+    if (format_properties.optimalTilingFeatures &
+        VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT) {
+      *out_storage_supported = true;
+      return available_format;
+    }
+  }
+
+  for (uint32_t available_format_index = 0;
+       available_format_index < available_format_count;
+       available_format_index++) {
+    VkSurfaceFormatKHR available_format =
+        available_formats[available_format_index];
+    if (available_format.format == VK_FORMAT_B8G8R8A8_SRGB &&
+        available_format.colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR) {
+      return available_format;
+    }
+  }
+
+  return available_formats[0];
+}
+
+VkPresentModeKHR
+choose_swapchain_present_mode(VkPresentModeKHR *available_present_modes,
+                              uint32_t available_present_mode_count) {
+  for (uint32_t available_present_mode_index = 0;
+       available_present_mode_index < available_present_mode_count;
+       available_present_mode_index++) {
+    VkPresentModeKHR present_mode =
+        available_present_modes[available_present_mode_index];
+    if (present_mode == VK_PRESENT_MODE_MAILBOX_KHR) {
+      return present_mode;
+    }
+  }
+  return VK_PRESENT_MODE_FIFO_KHR;
+}
+
+uint32_t clamp_uint32(uint32_t min, uint32_t max, uint32_t value) {
+  return value < min ? min : value > max ? max : value;
+}
+
+VkExtent2D choose_swapchain_extent(const VkSurfaceCapabilitiesKHR *capabilities,
+                                   int width, int height) {
+  if (capabilities->currentExtent.width != UINT32_MAX) {
+    return capabilities->currentExtent;
+  } else {
+    VkExtent2D actual_extent = {width, height};
+    actual_extent.width =
+        clamp_uint32(capabilities->minImageExtent.width,
+                     capabilities->maxImageExtent.width, actual_extent.width);
+    actual_extent.height =
+        clamp_uint32(capabilities->minImageExtent.height,
+                     capabilities->maxImageExtent.height, actual_extent.height);
+    return actual_extent;
+  }
+}
+
+bool vulkan_renderer_create_swapchain(struct vulkan_renderer *renderer,
+                                      int window_width_px,
+                                      int window_height_px) {
+  struct swapchain_support_details swapchain_support =
+      query_swapchain_support(renderer->physical_device, renderer->surface);
+
+  // The compute post process writes the swapchain images directly
+  bool storage_format_preferred =
+      renderer->post_process_enabled &&
+      renderer->storage_image_write_without_format_supported &&
+      (swapchain_support.capabilities.supportedUsageFlags &
+       VK_IMAGE_USAGE_STORAGE_BIT);
+  VkSurfaceFormatKHR surface_format = choose_swapchain_surface_format(
+      renderer->physical_device, swapchain_support.formats,
+      swapchain_support.format_count, storage_format_preferred,
+      &renderer->swapchain_storage_supported);
+  VkPresentModeKHR present_mode = choose_swapchain_present_mode(
+      swapchain_support.present_modes, swapchain_support.present_mode_count);
+  VkExtent2D extent = choose_swapchain_extent(
+      &swapchain_support.capabilities, window_width_px, window_height_px);
+  uint32_t image_count = swapchain_support.capabilities.minImageCount + 1;
+  if (swapchain_support.capabilities.maxImageCount > 0 &&
+      image_count > swapchain_support.capabilities.maxImageCount) {
+    image_count = swapchain_support.capabilities.maxImageCount;
+  }
+
+  VkSwapchainCreateInfoKHR create_info = {0};
+  create_info.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
+  create_info.surface = renderer->surface;
+  create_info.minImageCount = image_count;
+  create_info.imageFormat = surface_format.format;
+  create_info.imageColorSpace = surface_format.colorSpace;
+  create_info.imageExtent = extent;
+  create_info.imageArrayLayers = 1;
+  create_info.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+  // Lets frames be read back, see readback.c
+  renderer->swapchain_transfer_src_supported =
+      swapchain_support.capabilities.supportedUsageFlags &
+      VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+  if (renderer->swapchain_transfer_src_supported) {
+    create_info.imageUsage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+  }
+  if (renderer->swapchain_storage_supported) {
+    create_info.imageUsage |= VK_IMAGE_USAGE_STORAGE_BIT;
+  }
+
+  struct queue_family_indices indices =
+      find_queue_families(renderer->physical_device, renderer->surface);
+  uint32_t queue_family_indices[] = {indices.graphics_family,
+                                     indices.present_family};
+
+  if (indices.graphics_family != indices.present_family) {
+    create_info.imageSharingMode = VK_SHARING_MODE_CONCURRENT;
+    create_info.queueFamilyIndexCount = 2;
+    create_info.pQueueFamilyIndices = queue_family_indices;
+  } else {
+    create_info.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  }
+
+  create_info.preTransform = swapchain_support.capabilities.currentTransform;
+  create_info.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
+  create_info.presentMode = present_mode;
+  create_info.clipped = VK_TRUE;
+  create_info.oldSwapchain = VK_NULL_HANDLE;
+
+  if (vkCreateSwapchainKHR(renderer->device, &create_info, NULL,
+                           &renderer->swapchain) != VK_SUCCESS) {
+    LOG("Couldn't create swapchain");
+    return false;
+  }
+
+  uint32_t actual_image_count;
+  vkGetSwapchainImagesKHR(renderer->device, renderer->swapchain,
+                          &actual_image_count, NULL);
+  assert(actual_image_count <= MAX_SWAPCHAIN_IMAGE_COUNT);
+  renderer->swapchain_image_count = actual_image_count;
+  vkGetSwapchainImagesKHR(renderer->device, renderer->swapchain,
+                          &actual_image_count, renderer->swapchain_images);
+  renderer->swapchain_image_format = surface_format.format;
+  renderer->swapchain_extent = extent;
+  vulkan_renderer_update_render_extents(renderer);
+  return true;
+}
+
+bool vulkan_renderer_create_swapchain_image_views(
+    struct vulkan_renderer *renderer) {
+  uint32_t swapchain_image_index = 0;
+  for (; swapchain_image_index < renderer->swapchain_image_count;
+       swapchain_image_index++) {
+    if (vkCreateImageView(
+            renderer->device,
+            &(const VkImageViewCreateInfo){
+                .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+                .image = renderer->swapchain_images[swapchain_image_index],
+                .viewType = VK_IMAGE_VIEW_TYPE_2D,
+                .format = renderer->swapchain_image_format,
+                .subresourceRange = {.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                                     .levelCount = 1,
+                                     .layerCount = 1}},
+            NULL, &renderer->swapchain_image_views[swapchain_image_index]) !=
+        VK_SUCCESS) {
+      goto err;
+    }
+  }
+
+  return true;
+err:
+  // Destroying the image views that got created
+  for (uint32_t image_view_index = 0; image_view_index < swapchain_image_index;
+       image_view_index++) {
+    vkDestroyImageView(renderer->device,
+                       renderer->swapchain_image_views[image_view_index], NULL);
+  }
+  return false;
+}
+
+char *load_shader_from_file(struct arena *arena, const char *path,
+                            size_t *out_size) {
+  FILE *file_handle = fopen(path, "rb");
+  if (!file_handle) {
+    goto err;
+  }
+
+  if (fseek(file_handle, 0, SEEK_END) < 0) {
+    goto close_file;
+  }
+
+  long file_size = ftell(file_handle);
+  if (file_size < 0) {
+    goto close_file;
+  }
+  rewind(file_handle);
+  size_t arena_mark_before_shader = arena_mark(arena);
+  // SPIR-V is consumed as a uint32_t array
+  char *shader_file_content = arena_alloc(arena, file_size, sizeof(uint32_t));
+  if (!shader_file_content) {
+    goto close_file;
+  }
+  if (fread(shader_file_content, file_size, 1, file_handle) != 1) {
+    goto release_shader_file_content;
+  }
+
+  if (fclose(file_handle) != 0) {
+    arena_rewind(arena, arena_mark_before_shader);
+    goto err;
+  }
+
+  *out_size = file_size;
+  return shader_file_content;
+release_shader_file_content:
+  arena_rewind(arena, arena_mark_before_shader);
+close_file:
+  fclose(file_handle);
+err:
+  return NULL;
+}
+
+VkShaderModule create_shader_module(VkDevice device, char *code,
+                                    size_t code_size) {
+  VkShaderModule shader_module;
+  if (vkCreateShaderModule(
+          device,
+          &(const VkShaderModuleCreateInfo){
+              .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+              .codeSize = code_size,
+              .pCode = (const uint32_t *)code,
+          },
+          NULL, &shader_module) != VK_SUCCESS) {
+    return NULL;
+  }
+
+  return shader_module;
+}
+
+bool vulkan_renderer_create_mesh_pipeline(
+    struct vulkan_renderer *renderer, const struct mesh_pipeline_state *state,
+    VkPipeline *out_pipeline) {
+  size_t arena_mark_before_shaders = arena_mark(&renderer->init_arena);
+  size_t vertex_shader_code_size;
+  char *vertex_shader_code = load_shader_from_file(
+      &renderer->init_arena,
+      renderer->draw_data_in_push_constants ? "shaders/mesh.vert.spv"
+                                            : "shaders/mesh_uniform.vert.spv",
+      &vertex_shader_code_size);
+  size_t fragment_shader_code_size;
+  char *fragment_shader_code =
+      load_shader_from_file(&renderer->init_arena, "shaders/mesh.frag.spv",
+                            &fragment_shader_code_size);
+  VkShaderModule vertex_shader_module = create_shader_module(
+      renderer->device, vertex_shader_code, vertex_shader_code_size);
+  VkShaderModule fragment_shader_module = create_shader_module(
+      renderer->device, fragment_shader_code, fragment_shader_code_size);
+  arena_rewind(&renderer->init_arena, arena_mark_before_shaders);
+
+  VkPipelineShaderStageCreateInfo vertex_shader_stage_info = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+      .stage = VK_SHADER_STAGE_VERTEX_BIT,
+      .module = vertex_shader_module,
+      .pName = "main"};
+  VkPipelineShaderStageCreateInfo fragment_shader_stage_info = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+      .stage = VK_SHADER_STAGE_FRAGMENT_BIT,
+      .module = fragment_shader_module,
+      .pName = "main"};
+
+  VkPipelineShaderStageCreateInfo shader_stages[] = {
+      vertex_shader_stage_info, fragment_shader_stage_info};
+
+  VkDynamicState dynamic_states[] = {VK_DYNAMIC_STATE_VIEWPORT,
+                                     VK_DYNAMIC_STATE_SCISSOR};
+
+  VkPipelineDynamicStateCreateInfo dynamic_state = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
+      .dynamicStateCount = (sizeof(dynamic_states) / sizeof(VkDynamicState)),
+      .pDynamicStates = dynamic_states};
+
+  VkVertexInputBindingDescription vertex_binding = {
+      .binding = 0,
+      .stride = sizeof(struct mesh_vertex),
+      .inputRate = VK_VERTEX_INPUT_RATE_VERTEX};
+
+  VkVertexInputAttributeDescription vertex_attributes[] = {
+      {.location = 0,
+       .binding = 0,
+       .format = VK_FORMAT_R16G16B16A16_UNORM,
+       .offset = offsetof(struct mesh_vertex, position)},
+      {.location = 1,
+       .binding = 0,
+       .format = VK_FORMAT_R16G16_SNORM,
+       .offset = offsetof(struct mesh_vertex, normal)},
+      {.location = 2,
+       .binding = 0,
+       .format = VK_FORMAT_R16G16_SFLOAT,
+       .offset = offsetof(struct mesh_vertex, uv)}};
+
+  VkPipelineVertexInputStateCreateInfo vertex_input_info = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+      .vertexBindingDescriptionCount = 1,
+      .pVertexBindingDescriptions = &vertex_binding,
+      .vertexAttributeDescriptionCount =
+          sizeof(vertex_attributes) / sizeof(VkVertexInputAttributeDescription),
+      .pVertexAttributeDescriptions = vertex_attributes};
+
+  VkPipelineInputAssemblyStateCreateInfo input_assembly = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
+      .topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
+      .primitiveRestartEnable = VK_FALSE};
+
+  VkViewport viewport = {.width = (float)renderer->swapchain_extent.width,
+                         .height = (float)renderer->swapchain_extent.height,
+                         .maxDepth = 1.0f};
+
+  VkRect2D scissor = {.offset = {0}, .extent = renderer->swapchain_extent};
+
+  VkPipelineViewportStateCreateInfo viewport_state = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
+      .viewportCount = 1,
+      .scissorCount = 1,
+      .pViewports = &viewport,
+      .pScissors = &scissor};
+
+  VkPipelineRasterizationStateCreateInfo rasterizer = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
+      .depthClampEnable = VK_FALSE,
+      .rasterizerDiscardEnable = VK_FALSE,
+      .polygonMode = VK_POLYGON_MODE_FILL,
+      .lineWidth = 1.0f,
+      .cullMode = state->cull_mode,
+      .frontFace = state->front_face,
+      .depthBiasEnable = VK_FALSE};
+
+  VkPipelineMultisampleStateCreateInfo multisampling = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
+      .sampleShadingEnable = VK_FALSE,
+      .rasterizationSamples = renderer->msaa_sample_count,
+      .minSampleShading = 1.0f,
+  };
+
+  VkPipelineDepthStencilStateCreateInfo depth_stencil = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
+      .depthTestEnable = VK_TRUE,
+      .depthWriteEnable = !state->blend_enable,
+      .depthCompareOp = VK_COMPARE_OP_LESS};
+
+  // Premultiplied alpha when blending
+  VkPipelineColorBlendAttachmentState color_blend_attachment = {
+      .colorWriteMask = state->color_write_mask,
+      .blendEnable = state->blend_enable,
+      .srcColorBlendFactor = VK_BLEND_FACTOR_ONE,
+      .dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA,
+      .colorBlendOp = VK_BLEND_OP_ADD,
+      .srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE,
+      .dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA,
+      .alphaBlendOp = VK_BLEND_OP_ADD,
+  };
+
+  VkPipelineColorBlendStateCreateInfo color_blending = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
+      .logicOpEnable = VK_FALSE,
+      .attachmentCount = 1,
+      .pAttachments = &color_blend_attachment};
+
+  if (vkCreateGraphicsPipelines(
+          renderer->device, VK_NULL_HANDLE, 1,
+          &(const VkGraphicsPipelineCreateInfo){
+              .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+              .stageCount = 2,
+              .pStages = shader_stages,
+              .pVertexInputState = &vertex_input_info,
+              .pInputAssemblyState = &input_assembly,
+              .pViewportState = &viewport_state,
+              .pRasterizationState = &rasterizer,
+              .pMultisampleState = &multisampling,
+              .pDepthStencilState = &depth_stencil,
+              .pColorBlendState = &color_blending,
+              .pDynamicState = &dynamic_state,
+              .layout = renderer->pipeline_layout,
+              .renderPass = renderer->render_pass,
+              .subpass = 0,
+
+          },
+          NULL, out_pipeline) != VK_SUCCESS) {
+    goto destroy_shader_modules;
+  }
+
+  vkDestroyShaderModule(renderer->device, vertex_shader_module, NULL);
+  vkDestroyShaderModule(renderer->device, fragment_shader_module, NULL);
+  return true;
+destroy_shader_modules:
+  vkDestroyShaderModule(renderer->device, vertex_shader_module, NULL);
+  vkDestroyShaderModule(renderer->device, fragment_shader_module, NULL);
+  return false;
+}
+
+// Creates the uniform ring the draw data goes through when it doesn't fit in
+// push constants, VKGUIDE_DRAW_DATA_UNIFORM_RING=1 forces it for testing
+bool vulkan_renderer_create_draw_data_ring(struct vulkan_renderer *renderer) {
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(renderer->physical_device, &properties);
+  const char *force_ring = getenv("VKGUIDE_DRAW_DATA_UNIFORM_RING");
+  renderer->draw_data_in_push_constants =
+      sizeof(struct mesh_draw_constants) <=
+          properties.limits.maxPushConstantsSize &&
+      !(force_ring && strcmp(force_ring, "1") == 0);
+  if (renderer->draw_data_in_push_constants) {
+    return true;
+  }
+
+  LOG("Draw data (%zu bytes) goes through a uniform ring, push constants are "
+      "limited to %u bytes",
+      sizeof(struct mesh_draw_constants),
+      properties.limits.maxPushConstantsSize);
+
+  VkDeviceSize alignment = properties.limits.minUniformBufferOffsetAlignment;
+  if (alignment == 0) {
+    alignment = 1;
+  }
+  renderer->draw_data_ring_stride =
+      (sizeof(struct mesh_draw_constants) + alignment - 1) / alignment *
+      alignment;
+  renderer->draw_data_ring_frame_capacity = DRAW_DATA_RING_FRAME_CAPACITY;
+  VkDeviceSize ring_size = renderer->draw_data_ring_stride *
+                           DRAW_DATA_RING_FRAME_CAPACITY *
+                           MAX_FRAMES_IN_FLIGHT;
+  if (!vulkan_renderer_create_buffer(renderer, ring_size,
+                                     VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+                                     VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                         VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                     &renderer->draw_data_ring_buffer,
+                                     &renderer->draw_data_ring_memory)) {
+    LOG("Couldn't create draw data ring");
+    goto err;
+  }
+
+  void *mapped;
+  if (vkMapMemory(renderer->device, renderer->draw_data_ring_memory, 0,
+                  ring_size, 0, &mapped) != VK_SUCCESS) {
+    LOG("Couldn't map draw data ring");
+    goto destroy_ring_buffer;
+  }
+  renderer->draw_data_ring_mapped = mapped;
+
+  if (vkCreateDescriptorSetLayout(
+          renderer->device,
+          &(const VkDescriptorSetLayoutCreateInfo){
+              .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+              .bindingCount = 1,
+              .pBindings =
+                  &(const VkDescriptorSetLayoutBinding){
+                      .binding = 0,
+                      .descriptorType =
+                          VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+                      .descriptorCount = 1,
+                      .stageFlags = VK_SHADER_STAGE_VERTEX_BIT}},
+          NULL, &renderer->draw_data_descriptor_set_layout) != VK_SUCCESS) {
+    LOG("Couldn't create draw data descriptor set layout");
+    goto destroy_ring_buffer;
+  }
+
+  if (vkCreateDescriptorPool(
+          renderer->device,
+          &(const VkDescriptorPoolCreateInfo){
+              .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+              .maxSets = 1,
+              .poolSizeCount = 1,
+              .pPoolSizes =
+                  &(const VkDescriptorPoolSize){
+                      .type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+                      .descriptorCount = 1}},
+          NULL, &renderer->draw_data_descriptor_pool) != VK_SUCCESS) {
+    LOG("Couldn't create draw data descriptor pool");
+    goto destroy_descriptor_set_layout;
+  }
+
+  if (vkAllocateDescriptorSets(
+          renderer->device,
+          &(const VkDescriptorSetAllocateInfo){
+              .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+              .descriptorPool = renderer->draw_data_descriptor_pool,
+              .descriptorSetCount = 1,
+              .pSetLayouts = &renderer->draw_data_descriptor_set_layout},
+          &renderer->draw_data_descriptor_set) != VK_SUCCESS) {
+    LOG("Couldn't allocate draw data descriptor set");
+    goto destroy_descriptor_pool;
+  }
+
+  // Written once, the draws only move the dynamic offset
+  vkUpdateDescriptorSets(
+      renderer->device, 1,
+      &(const VkWriteDescriptorSet){
+          .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+          .dstSet = renderer->draw_data_descriptor_set,
+          .dstBinding = 0,
+          .descriptorCount = 1,
+          .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+          .pBufferInfo =
+              &(const VkDescriptorBufferInfo){
+                  .buffer = renderer->draw_data_ring_buffer,
+                  .offset = 0,
+                  .range = sizeof(struct mesh_draw_constants)}},
+      0, NULL);
+
+  return true;
+destroy_descriptor_pool:
+  vkDestroyDescriptorPool(renderer->device,
+                          renderer->draw_data_descriptor_pool, NULL);
+destroy_descriptor_set_layout:
+  vkDestroyDescriptorSetLayout(renderer->device,
+                               renderer->draw_data_descriptor_set_layout, NULL);
+destroy_ring_buffer:
+  vkDestroyBuffer(renderer->device, renderer->draw_data_ring_buffer, NULL);
+  vulkan_renderer_free_memory(renderer, renderer->draw_data_ring_memory);
+err:
+  return false;
+}
+
+void vulkan_renderer_destroy_draw_data_ring(struct vulkan_renderer *renderer) {
+  vkDestroyDescriptorPool(renderer->device,
+                          renderer->draw_data_descriptor_pool, NULL);
+  vkDestroyDescriptorSetLayout(renderer->device,
+                               renderer->draw_data_descriptor_set_layout, NULL);
+  vkDestroyBuffer(renderer->device, renderer->draw_data_ring_buffer, NULL);
+  vulkan_renderer_free_memory(renderer, renderer->draw_data_ring_memory);
+}
+
+bool vulkan_renderer_create_graphics_pipeline(
+    struct vulkan_renderer *renderer) {
+  if (!vulkan_renderer_create_draw_data_ring(renderer)) {
+    goto err;
+  }
+
+  bool push_constants = renderer->draw_data_in_push_constants;
+  if (vkCreatePipelineLayout(
+          renderer->device,
+          &(const VkPipelineLayoutCreateInfo){
+              .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+              .setLayoutCount = push_constants ? 0 : 1,
+              .pSetLayouts = &renderer->draw_data_descriptor_set_layout,
+              .pushConstantRangeCount = push_constants ? 1 : 0,
+              .pPushConstantRanges =
+                  &(const VkPushConstantRange){
+                      .stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
+                      .offset = 0,
+                      .size = sizeof(struct mesh_draw_constants)}},
+          NULL, &renderer->pipeline_layout) != VK_SUCCESS) {
+    goto destroy_draw_data_ring;
+  }
+
+  if (!vulkan_renderer_create_mesh_pipeline(
+          renderer,
+          &(const struct mesh_pipeline_state){
+              .cull_mode = VK_CULL_MODE_BACK_BIT,
+              .front_face = VK_FRONT_FACE_COUNTER_CLOCKWISE,
+              .color_write_mask = MESH_PIPELINE_COLOR_WRITE_MASK_ALL},
+          &renderer->pipeline)) {
+    goto destroy_pipeline_layout;
+  }
+
+  return true;
+destroy_pipeline_layout:
+  vkDestroyPipelineLayout(renderer->device, renderer->pipeline_layout, NULL);
+destroy_draw_data_ring:
+  vulkan_renderer_destroy_draw_data_ring(renderer);
+err:
+  return false;
+}
+
+// Picks the largest sample count not above the requested one that both color
+// and depth attachments support, and the depth format
+bool vulkan_renderer_choose_attachment_formats(
+    struct vulkan_renderer *renderer,
+    const struct vulkan_renderer_options *options) {
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(renderer->physical_device, &properties);
+  VkSampleCountFlags supported_sample_counts =
+      properties.limits.framebufferColorSampleCounts &
+      properties.limits.framebufferDepthSampleCounts;
+  renderer->msaa_sample_count = VK_SAMPLE_COUNT_1_BIT;
+  for (uint32_t sample_count = VK_SAMPLE_COUNT_64_BIT;
+       sample_count > VK_SAMPLE_COUNT_1_BIT; sample_count >>= 1) {
+    if (sample_count <= options->msaa_sample_count &&
+        (supported_sample_counts & sample_count)) {
+      renderer->msaa_sample_count = (VkSampleCountFlagBits)sample_count;
+      break;
+    }
+  }
+  if (renderer->msaa_sample_count != options->msaa_sample_count &&
+      options->msaa_sample_count > 1) {
+    LOG("%ux MSAA isn't supported, using %ux", options->msaa_sample_count,
+        renderer->msaa_sample_count);
+  }
+
+  // HDR until tonemapped by the post process, mandatory as a blendable color
+  // attachment
+  renderer->scene_color_format = renderer->post_process_enabled
+                                     ? VK_FORMAT_R16G16B16A16_SFLOAT
+                                     : renderer->swapchain_image_format;
+
+  static const VkFormat depth_formats[] = {VK_FORMAT_D32_SFLOAT,
+                                           VK_FORMAT_D32_SFLOAT_S8_UINT,
+                                           VK_FORMAT_D24_UNORM_S8_UINT};
+  for (size_t format_index = 0;
+       format_index < sizeof(depth_formats) / sizeof(depth_formats[0]);
+       format_index++) {
+    VkFormatProperties format_properties;
+    vkGetPhysicalDeviceFormatProperties(renderer->physical_device,
+                                        depth_formats[format_index],
+                                        &format_properties);
+    if (format_properties.optimalTilingFeatures &
+        VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT) {
+      renderer->depth_format = depth_formats[format_index];
+      return true;
+    }
+  }
+
+  LOG("Couldn't find a supported depth format");
+  return false;
+}
+
+// Occlusion culled frames split the scene render pass in two around the depth
+// pyramid build, the early part stores what the late part loads. Both parts
+// are compatible with the whole pass and share its framebuffers and
+// pipelines.
+enum scene_render_pass_part {
+  SCENE_RENDER_PASS_WHOLE,
+  SCENE_RENDER_PASS_EARLY,
+  SCENE_RENDER_PASS_LATE
+};
+
+bool vulkan_renderer_create_scene_render_pass(
+    struct vulkan_renderer *renderer, enum scene_render_pass_part part,
+    VkRenderPass *out_render_pass) {
+  bool multisampled = renderer->msaa_sample_count > VK_SAMPLE_COUNT_1_BIT;
+  bool early = part == SCENE_RENDER_PASS_EARLY;
+  bool late = part == SCENE_RENDER_PASS_LATE;
+  // The post process samples the scene color once the pass is done
+  VkImageLayout scene_color_final_layout =
+      renderer->post_process_enabled ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+                                     : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+  // The multisampled color and the depth are never stored past the end of
+  // the scene, which lets tilers keep them in tile memory. The early part's
+  // resolve is discarded, the late part resolves again.
+  VkAttachmentDescription attachments[] = {
+      {.format = renderer->scene_color_format,
+       .samples = renderer->msaa_sample_count,
+       .loadOp =
+           late ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR,
+       .storeOp = multisampled && !early ? VK_ATTACHMENT_STORE_OP_DONT_CARE
+                                         : VK_ATTACHMENT_STORE_OP_STORE,
+       .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+       .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+       .initialLayout = late ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
+                             : VK_IMAGE_LAYOUT_UNDEFINED,
+       .finalLayout = multisampled || early
+                          ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
+                          : scene_color_final_layout},
+      // Sampled by the depth pyramid build between the two parts
+      {.format = renderer->depth_format,
+       .samples = renderer->msaa_sample_count,
+       .loadOp =
+           late ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR,
+       .storeOp = early ? VK_ATTACHMENT_STORE_OP_STORE
+                        : VK_ATTACHMENT_STORE_OP_DONT_CARE,
+       .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+       .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+       .initialLayout = late ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL
+                             : VK_IMAGE_LAYOUT_UNDEFINED,
+       .finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL},
+      // Scene color the multisampled color is resolved into
+      {.format = renderer->scene_color_format,
+       .samples = VK_SAMPLE_COUNT_1_BIT,
+       .loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+       .storeOp = early ? VK_ATTACHMENT_STORE_OP_DONT_CARE
+                        : VK_ATTACHMENT_STORE_OP_STORE,
+       .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+       .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+       .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+       .finalLayout = early ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
+                            : scene_color_final_layout}};
+
+  VkAttachmentReference color_attachment_ref = {
+      .attachment = 0,
+      .layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+  };
+  VkAttachmentReference depth_attachment_ref = {
+      .attachment = 1,
+      .layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+  };
+  VkAttachmentReference resolve_attachment_ref = {
+      .attachment = 2,
+      .layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+  };
+
+  VkSubpassDescription subpass = {
+      .pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS,
+      .colorAttachmentCount = 1,
+      .pColorAttachments = &color_attachment_ref,
+      .pResolveAttachments = multisampled ? &resolve_attachment_ref : NULL,
+      .pDepthStencilAttachment = &depth_attachment_ref};
+
+  // The layout transition of the swapchain image must wait for the image to
+  // be acquired, which is signaled at the color attachment output stage. The
+  // shared attachments must also wait for the previous frame to be done with
+  // them, including the post process reading the scene color. The late part
+  // also loads what the early part stored, once the depth pyramid build is
+  // done reading the depth.
+  VkAccessFlags load_access_mask =
+      late ? VK_ACCESS_COLOR_ATTACHMENT_READ_BIT |
+                 VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT
+           : 0;
+  VkSubpassDependency dependencies[] = {
+      {.srcSubpass = VK_SUBPASS_EXTERNAL,
+       .dstSubpass = 0,
+       .srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+                       VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT |
+                       VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT |
+                       VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+       .srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+                        VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+       .dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+                       VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT,
+       .dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+                        VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
+                        load_access_mask},
+      {.srcSubpass = 0,
+       .dstSubpass = VK_SUBPASS_EXTERNAL,
+       .srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+       .srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+       .dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT |
+                       VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+       .dstAccessMask = VK_ACCESS_SHADER_READ_BIT}};
+
+  return vkCreateRenderPass(
+             renderer->device,
+             &(const VkRenderPassCreateInfo){
+                 .sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
+                 .attachmentCount = multisampled ? 3 : 2,
+                 .pAttachments = attachments,
+                 .subpassCount = 1,
+                 .pSubpasses = &subpass,
+                 .dependencyCount =
+                     renderer->post_process_enabled && !early ? 2 : 1,
+                 .pDependencies = dependencies},
+             NULL, out_render_pass) == VK_SUCCESS;
+}
+
+void vulkan_renderer_destroy_render_pass(struct vulkan_renderer *renderer) {
+  vkDestroyRenderPass(renderer->device, renderer->occlusion_late_render_pass,
+                      NULL);
+  vkDestroyRenderPass(renderer->device, renderer->occlusion_early_render_pass,
+                      NULL);
+  vkDestroyRenderPass(renderer->device, renderer->render_pass, NULL);
+}
+
+// Also creates the two parts of the scene render pass when occlusion culling
+// is enabled
+bool vulkan_renderer_create_render_pass(struct vulkan_renderer *renderer) {
+  if (!vulkan_renderer_create_scene_render_pass(
+          renderer, SCENE_RENDER_PASS_WHOLE, &renderer->render_pass)) {
+    return false;
+  }
+  if (renderer->occlusion_culling_enabled &&
+      (!vulkan_renderer_create_scene_render_pass(
+           renderer, SCENE_RENDER_PASS_EARLY,
+           &renderer->occlusion_early_render_pass) ||
+       !vulkan_renderer_create_scene_render_pass(
+           renderer, SCENE_RENDER_PASS_LATE,
+           &renderer->occlusion_late_render_pass))) {
+    vulkan_renderer_destroy_render_pass(renderer);
+    return false;
+  }
+
+  return true;
+}
+
+void vulkan_renderer_destroy_attachment(
+    struct vulkan_renderer *renderer,
+    struct vulkan_renderer_attachment *attachment) {
+  vkDestroyImageView(renderer->device, attachment->view, NULL);
+  vkDestroyImage(renderer->device, attachment->image, NULL);
+  vulkan_renderer_free_memory(renderer, attachment->memory);
+  *attachment = (struct vulkan_renderer_attachment){0};
+}
+
+// Transient attachments are backed by lazily allocated memory when the device
+// has some, tilers then never allocate them outside of tile memory
+bool vulkan_renderer_create_attachment(
+    struct vulkan_renderer *renderer, VkFormat format,
+    VkSampleCountFlagBits samples, VkImageUsageFlags usage,
+    VkImageAspectFlags aspect, struct vulkan_renderer_attachment *out) {
+  *out = (struct vulkan_renderer_attachment){0};
+  if (vkCreateImage(
+          renderer->device,
+          &(const VkImageCreateInfo){
+              .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+              .imageType = VK_IMAGE_TYPE_2D,
+              .format = format,
+              .extent = {renderer->render_target_extent.width,
+                         renderer->render_target_extent.height, 1},
+              .mipLevels = 1,
+              .arrayLayers = 1,
+              .samples = samples,
+              .tiling = VK_IMAGE_TILING_OPTIMAL,
+              .usage = usage,
+              .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+              .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED},
+          NULL, &out->image) != VK_SUCCESS) {
+    LOG("Couldn't create attachment image");
+    goto err;
+  }
+
+  VkMemoryRequirements memory_requirements;
+  vkGetImageMemoryRequirements(renderer->device, out->image,
+                               &memory_requirements);
+  bool transient = usage & VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+  uint32_t memory_type_index;
+  if (!(transient &&
+        find_memory_type(renderer->physical_device,
+                         memory_requirements.memoryTypeBits,
+                         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT |
+                             VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT,
+                         &memory_type_index)) &&
+      !find_memory_type(renderer->physical_device,
+                        memory_requirements.memoryTypeBits,
+                        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                        &memory_type_index)) {
+    LOG("Couldn't find a suitable memory type for attachment");
+    goto destroy_attachment;
+  }
+
+  if (vkAllocateMemory(renderer->device,
+                       &(const VkMemoryAllocateInfo){
+                           .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+                           .allocationSize = memory_requirements.size,
+                           .memoryTypeIndex = memory_type_index},
+                       NULL, &out->memory) != VK_SUCCESS) {
+    LOG("Couldn't allocate attachment memory");
+    goto destroy_attachment;
+  }
+  renderer->device_memory_allocation_count++;
+
+  if (vkBindImageMemory(renderer->device, out->image, out->memory, 0) !=
+      VK_SUCCESS) {
+    LOG("Couldn't bind attachment memory");
+    goto destroy_attachment;
+  }
+
+  if (vkCreateImageView(
+          renderer->device,
+          &(const VkImageViewCreateInfo){
+              .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+              .image = out->image,
+              .viewType = VK_IMAGE_VIEW_TYPE_2D,
+              .format = format,
+              .subresourceRange = {.aspectMask = aspect,
+                                   .levelCount = 1,
+                                   .layerCount = 1}},
+          NULL, &out->view) != VK_SUCCESS) {
+    LOG("Couldn't create attachment image view");
+    goto destroy_attachment;
+  }
+
+  return true;
+destroy_attachment:
+  vulkan_renderer_destroy_attachment(renderer, out);
+err:
+  return false;
+}
+
+bool vulkan_renderer_create_attachments(struct vulkan_renderer *renderer) {
+  // Occlusion culled frames store the depth and multisampled color between
+  // the two parts of the scene render pass, and sample the depth
+  VkImageUsageFlags transient_usage =
+      renderer->occlusion_culling_enabled
+          ? 0
+          : VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+  VkImageUsageFlags sampled_depth_usage =
+      renderer->occlusion_culling_enabled ? VK_IMAGE_USAGE_SAMPLED_BIT : 0;
+  if (!vulkan_renderer_create_attachment(
+          renderer, renderer->depth_format, renderer->msaa_sample_count,
+          VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | transient_usage |
+              sampled_depth_usage,
+          VK_IMAGE_ASPECT_DEPTH_BIT, &renderer->depth_attachment)) {
+    goto err;
+  }
+
+  if (renderer->msaa_sample_count > VK_SAMPLE_COUNT_1_BIT &&
+      !vulkan_renderer_create_attachment(
+          renderer, renderer->scene_color_format, renderer->msaa_sample_count,
+          VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | transient_usage,
+          VK_IMAGE_ASPECT_COLOR_BIT, &renderer->msaa_color_attachment)) {
+    goto destroy_depth_attachment;
+  }
+
+  if (renderer->post_process_enabled &&
+      !vulkan_renderer_create_attachment(
+          renderer, renderer->scene_color_format, VK_SAMPLE_COUNT_1_BIT,
+          VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+          VK_IMAGE_ASPECT_COLOR_BIT, &renderer->scene_color_attachment)) {
+    goto destroy_msaa_color_attachment;
+  }
+
+  if (!vulkan_renderer_create_depth_pyramid(renderer)) {
+    goto destroy_scene_color_attachment;
+  }
+
+  return true;
+destroy_scene_color_attachment:
+  vulkan_renderer_destroy_attachment(renderer,
+                                     &renderer->scene_color_attachment);
+destroy_msaa_color_attachment:
+  vulkan_renderer_destroy_attachment(renderer,
+                                     &renderer->msaa_color_attachment);
+destroy_depth_attachment:
+  vulkan_renderer_destroy_attachment(renderer, &renderer->depth_attachment);
+err:
+  return false;
+}
+
+void vulkan_renderer_destroy_attachments(struct vulkan_renderer *renderer) {
+  vulkan_renderer_destroy_depth_pyramid(renderer);
+  vulkan_renderer_destroy_attachment(renderer,
+                                     &renderer->scene_color_attachment);
+  vulkan_renderer_destroy_attachment(renderer,
+                                     &renderer->msaa_color_attachment);
+  vulkan_renderer_destroy_attachment(renderer, &renderer->depth_attachment);
+}
+
+bool vulkan_renderer_create_framebuffers(struct vulkan_renderer *renderer) {
+  bool multisampled = renderer->msaa_sample_count > VK_SAMPLE_COUNT_1_BIT;
+  if (renderer->post_process_enabled) {
+    VkImageView attachments[] = {
+        multisampled ? renderer->msaa_color_attachment.view
+                     : renderer->scene_color_attachment.view,
+        renderer->depth_attachment.view, renderer->scene_color_attachment.view};
+    if (vkCreateFramebuffer(
+            renderer->device,
+            &(const VkFramebufferCreateInfo){
+                .sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
+                .renderPass = renderer->render_pass,
+                .attachmentCount = multisampled ? 3 : 2,
+                .pAttachments = attachments,
+                .width = renderer->render_target_extent.width,
+                .height = renderer->render_target_extent.height,
+                .layers = 1},
+            NULL, &renderer->scene_framebuffer) != VK_SUCCESS) {
+      return false;
+    }
+
+    // The compute post process doesn't render into the swapchain images
+    if (renderer->swapchain_storage_supported) {
+      return true;
+    }
+  }
+
+  for (uint32_t swapchain_image_view_index = 0;
+       swapchain_image_view_index < renderer->swapchain_image_count;
+       swapchain_image_view_index++) {
+    VkImageView swapchain_image_view =
+        renderer->swapchain_image_views[swapchain_image_view_index];
+    VkImageView attachments[] = {
+        multisampled ? renderer->msaa_color_attachment.view
+                     : swapchain_image_view,
+        renderer->depth_attachment.view, swapchain_image_view};
+    uint32_t attachment_count = multisampled ? 3 : 2;
+    VkRenderPass render_pass = renderer->render_pass;
+    if (renderer->post_process_enabled) {
+      attachments[0] = swapchain_image_view;
+      attachment_count = 1;
+      render_pass = renderer->post_process_render_pass;
+    }
+
+    if (vkCreateFramebuffer(
+            renderer->device,
+            &(const VkFramebufferCreateInfo){
+                .sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
+                .renderPass = render_pass,
+                .attachmentCount = attachment_count,
+                .pAttachments = attachments,
+                .width = renderer->swapchain_extent.width,
+                .height = renderer->swapchain_extent.height,
+                .layers = 1},
+            NULL,
+            &renderer->swapchain_framebuffers[swapchain_image_view_index]) !=
+        VK_SUCCESS) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void vulkan_renderer_destroy_framebuffers(struct vulkan_renderer *renderer) {
+  vkDestroyFramebuffer(renderer->device, renderer->scene_framebuffer, NULL);
+  renderer->scene_framebuffer = VK_NULL_HANDLE;
+  for (uint32_t framebuffer_index = 0;
+       framebuffer_index < renderer->swapchain_image_count;
+       framebuffer_index++) {
+    vkDestroyFramebuffer(renderer->device,
+                         renderer->swapchain_framebuffers[framebuffer_index],
+                         NULL);
+    renderer->swapchain_framebuffers[framebuffer_index] = VK_NULL_HANDLE;
+  }
+}
+
+bool find_memory_type(VkPhysicalDevice physical_device, uint32_t type_filter,
+                      VkMemoryPropertyFlags properties,
+                      uint32_t *out_memory_type_index) {
+  VkPhysicalDeviceMemoryProperties memory_properties;
+  vkGetPhysicalDeviceMemoryProperties(physical_device, &memory_properties);
+
+  for (uint32_t memory_type_index = 0;
+       memory_type_index < memory_properties.memoryTypeCount;
+       memory_type_index++) {
+    if ((type_filter & (1u << memory_type_index)) &&
+        (memory_properties.memoryTypes[memory_type_index].propertyFlags &
+         properties) == properties) {
+      *out_memory_type_index = memory_type_index;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+bool vulkan_renderer_create_buffer(struct vulkan_renderer *renderer,
+                                   VkDeviceSize size, VkBufferUsageFlags usage,
+                                   VkMemoryPropertyFlags memory_properties,
+                                   VkBuffer *out_buffer,
+                                   VkDeviceMemory *out_memory) {
+  if (vkCreateBuffer(renderer->device,
+                     &(const VkBufferCreateInfo){
+                         .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+                         .size = size,
+                         .usage = usage,
+                         .sharingMode = VK_SHARING_MODE_EXCLUSIVE},
+                     NULL, out_buffer) != VK_SUCCESS) {
+    LOG("Couldn't create buffer");
+    goto err;
+  }
+
+  VkMemoryRequirements memory_requirements;
+  vkGetBufferMemoryRequirements(renderer->device, *out_buffer,
+                                &memory_requirements);
+
+  uint32_t memory_type_index;
+  if (!find_memory_type(renderer->physical_device,
+                        memory_requirements.memoryTypeBits, memory_properties,
+                        &memory_type_index)) {
+    LOG("Couldn't find a suitable memory type for buffer");
+    goto destroy_buffer;
+  }
+
+  if (vkAllocateMemory(renderer->device,
+                       &(const VkMemoryAllocateInfo){
+                           .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+                           .allocationSize = memory_requirements.size,
+                           .memoryTypeIndex = memory_type_index},
+                       NULL, out_memory) != VK_SUCCESS) {
+    LOG("Couldn't allocate buffer memory");
+    goto destroy_buffer;
+  }
+  renderer->device_memory_allocation_count++;
+
+  if (vkBindBufferMemory(renderer->device, *out_buffer, *out_memory, 0) !=
+      VK_SUCCESS) {
+    LOG("Couldn't bind buffer memory");
+    goto free_memory;
+  }
+
+  return true;
+free_memory:
+  vulkan_renderer_free_memory(renderer, *out_memory);
+destroy_buffer:
+  vkDestroyBuffer(renderer->device, *out_buffer, NULL);
+err:
+  return false;
+}
+
+void vulkan_renderer_free_memory(struct vulkan_renderer *renderer,
+                                 VkDeviceMemory memory) {
+  if (memory == VK_NULL_HANDLE) {
+    return;
+  }
+  vkFreeMemory(renderer->device, memory, NULL);
+  renderer->device_memory_free_count++;
+}
+
+bool vulkan_renderer_create_command_pool(struct vulkan_renderer *renderer) {
+  return vkCreateCommandPool(
+             renderer->device,
+             &(const VkCommandPoolCreateInfo){
+                 .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+                 .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+                 .queueFamilyIndex = renderer->graphics_queue_family},
+             NULL, &renderer->command_pool) == VK_SUCCESS;
+}
+
+void vulkan_renderer_destroy_frames(struct vulkan_renderer *renderer,
+                                    uint32_t frame_count) {
+  for (uint32_t frame_index = 0; frame_index < frame_count; frame_index++) {
+    struct vulkan_renderer_frame *frame = &renderer->frames[frame_index];
+    vkDestroyFence(renderer->device, frame->in_flight_fence, NULL);
+    vkDestroySemaphore(renderer->device, frame->image_available_semaphore,
+                       NULL);
+    vkFreeCommandBuffers(renderer->device, renderer->command_pool, 1,
+                         &frame->command_buffer);
+  }
+}
+
+bool vulkan_renderer_create_frames(struct vulkan_renderer *renderer) {
+  uint32_t frame_index = 0;
+  for (; frame_index < MAX_FRAMES_IN_FLIGHT; frame_index++) {
+    struct vulkan_renderer_frame *frame = &renderer->frames[frame_index];
+    if (vkAllocateCommandBuffers(
+            renderer->device,
+            &(const VkCommandBufferAllocateInfo){
+                .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+                .commandPool = renderer->command_pool,
+                .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+                .commandBufferCount = 1},
+            &frame->command_buffer) != VK_SUCCESS) {
+      goto err;
+    }
+
+    if (vkCreateSemaphore(renderer->device,
+                          &(const VkSemaphoreCreateInfo){
+                              .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO},
+                          NULL,
+                          &frame->image_available_semaphore) != VK_SUCCESS) {
+      goto free_command_buffer;
+    }
+
+    // Created signaled so the first wait on it doesn't block forever
+    if (vkCreateFence(renderer->device,
+                      &(const VkFenceCreateInfo){
+                          .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+                          .flags = VK_FENCE_CREATE_SIGNALED_BIT},
+                      NULL, &frame->in_flight_fence) != VK_SUCCESS) {
+      goto destroy_semaphore;
+    }
+  }
+
+  renderer->current_frame = 0;
+  return true;
+
+destroy_semaphore:
+  vkDestroySemaphore(renderer->device,
+                     renderer->frames[frame_index].image_available_semaphore,
+                     NULL);
+free_command_buffer:
+  vkFreeCommandBuffers(renderer->device, renderer->command_pool, 1,
+                       &renderer->frames[frame_index].command_buffer);
+err:
+  vulkan_renderer_destroy_frames(renderer, frame_index);
+  return false;
+}
+
+// GPU frame times are measured with timestamps at the start and end of each
+// frame in flight, read back once the frame's fence has signaled. Occlusion
+// culled frames also time their culling passes and depth pyramid build.
+// Without timestamp support on the graphics queue, frames are simply not
+// timed.
+bool vulkan_renderer_create_timestamp_query_pool(
+    struct vulkan_renderer *renderer) {
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(renderer->physical_device, &properties);
+  uint32_t queue_family_count = 0;
+  vkGetPhysicalDeviceQueueFamilyProperties(renderer->physical_device,
+                                           &queue_family_count, NULL);
+  VkQueueFamilyProperties *queue_families = ARENA_ALLOC_ARRAY(
+      &renderer->init_arena, VkQueueFamilyProperties, queue_family_count);
+  if (!queue_families) {
+    return false;
+  }
+  vkGetPhysicalDeviceQueueFamilyProperties(
+      renderer->physical_device, &queue_family_count, queue_families);
+
+  uint32_t timestamp_valid_bits =
+      queue_families[renderer->graphics_queue_family].timestampValidBits;
+  if (timestamp_valid_bits == 0 || properties.limits.timestampPeriod <= 0.0f) {
+    LOG("GPU timestamps are unsupported, frames won't be timed");
+    return true;
+  }
+
+  renderer->timestamp_period_ns = properties.limits.timestampPeriod;
+  renderer->timestamp_mask = timestamp_valid_bits >= 64
+                                 ? UINT64_MAX
+                                 : (UINT64_C(1) << timestamp_valid_bits) - 1;
+  return vkCreateQueryPool(
+             renderer->device,
+             &(const VkQueryPoolCreateInfo){
+                 .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+                 .queryType = VK_QUERY_TYPE_TIMESTAMP,
+                 .queryCount =
+                     VULKAN_RENDERER_TIMESTAMP_COUNT * MAX_FRAMES_IN_FLIGHT},
+             NULL, &renderer->timestamp_query_pool) == VK_SUCCESS;
+}
+
+void vulkan_renderer_destroy_render_finished_semaphores(
+    struct vulkan_renderer *renderer, uint32_t semaphore_count) {
+  for (uint32_t semaphore_index = 0; semaphore_index < semaphore_count;
+       semaphore_index++) {
+    vkDestroySemaphore(renderer->device,
+                       renderer->render_finished_semaphores[semaphore_index],
+                       NULL);
+  }
+}
+
+// One per swapchain image: a semaphore waited on by the presentation engine
+// can only be reused once that image has been acquired again.
+bool vulkan_renderer_create_render_finished_semaphores(
+    struct vulkan_renderer *renderer) {
+  for (uint32_t semaphore_index = 0;
+       semaphore_index < renderer->swapchain_image_count; semaphore_index++) {
+    if (vkCreateSemaphore(
+            renderer->device,
+            &(const VkSemaphoreCreateInfo){
+                .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO},
+            NULL,
+            &renderer->render_finished_semaphores[semaphore_index]) !=
+        VK_SUCCESS) {
+      vulkan_renderer_destroy_render_finished_semaphores(renderer,
+                                                         semaphore_index);
+      return false;
+    }
+  }
+  return true;
+}
+
+bool vulkan_renderer_create_staging_buffer(struct vulkan_renderer *renderer) {
+  if (!vulkan_renderer_create_buffer(renderer, STAGING_BUFFER_SIZE,
+                                     VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                                     VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                         VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                     &renderer->staging_buffer,
+                                     &renderer->staging_buffer_memory)) {
+    goto err;
+  }
+
+  if (vkMapMemory(renderer->device, renderer->staging_buffer_memory, 0,
+                  STAGING_BUFFER_SIZE, 0,
+                  &renderer->staging_buffer_mapped) != VK_SUCCESS) {
+    LOG("Couldn't map staging buffer");
+    goto destroy_staging_buffer;
+  }
+
+  if (vkAllocateCommandBuffers(
+          renderer->device,
+          &(const VkCommandBufferAllocateInfo){
+              .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+              .commandPool = renderer->command_pool,
+              .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+              .commandBufferCount = 1},
+          &renderer->upload_command_buffer) != VK_SUCCESS) {
+    goto destroy_staging_buffer;
+  }
+
+  if (vkCreateFence(renderer->device,
+                    &(const VkFenceCreateInfo){
+                        .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO},
+                    NULL, &renderer->upload_fence) != VK_SUCCESS) {
+    goto free_upload_command_buffer;
+  }
+
+  return true;
+free_upload_command_buffer:
+  vkFreeCommandBuffers(renderer->device, renderer->command_pool, 1,
+                       &renderer->upload_command_buffer);
+destroy_staging_buffer:
+  vkDestroyBuffer(renderer->device, renderer->staging_buffer, NULL);
+  vulkan_renderer_free_memory(renderer, renderer->staging_buffer_memory);
+err:
+  return false;
+}
+
+void vulkan_renderer_destroy_staging_buffer(struct vulkan_renderer *renderer) {
+  vkDestroyFence(renderer->device, renderer->upload_fence, NULL);
+  vkFreeCommandBuffers(renderer->device, renderer->command_pool, 1,
+                       &renderer->upload_command_buffer);
+  vkDestroyBuffer(renderer->device, renderer->staging_buffer, NULL);
+  vulkan_renderer_free_memory(renderer, renderer->staging_buffer_memory);
+}
+
+bool vulkan_renderer_upload_to_buffer(struct vulkan_renderer *renderer,
+                                      VkBuffer dst_buffer,
+                                      VkDeviceSize dst_offset, const void *data,
+                                      VkDeviceSize size) {
+  renderer->frame_counters.uploaded_bytes += size;
+  capture_record_upload(&renderer->capture, size);
+  const uint8_t *bytes = data;
+  VkDeviceSize uploaded_size = 0;
+  while (uploaded_size < size) {
+    VkDeviceSize chunk_size = size - uploaded_size;
+    if (chunk_size > STAGING_BUFFER_SIZE) {
+      chunk_size = STAGING_BUFFER_SIZE;
+    }
+
+    // The staging memory is host coherent, no flush needed
+    memcpy(renderer->staging_buffer_mapped, bytes + uploaded_size, chunk_size);
+
+    vkResetCommandBuffer(renderer->upload_command_buffer, 0);
+    if (vkBeginCommandBuffer(
+            renderer->upload_command_buffer,
+            &(const VkCommandBufferBeginInfo){
+                .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+                .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT}) !=
+        VK_SUCCESS) {
+      return false;
+    }
+    vkCmdCopyBuffer(renderer->upload_command_buffer, renderer->staging_buffer,
+                    dst_buffer, 1,
+                    &(const VkBufferCopy){.srcOffset = 0,
+                                          .dstOffset =
+                                              dst_offset + uploaded_size,
+                                          .size = chunk_size});
+    if (vkEndCommandBuffer(renderer->upload_command_buffer) != VK_SUCCESS) {
+      return false;
+    }
+
+    vkResetFences(renderer->device, 1, &renderer->upload_fence);
+    if (vkQueueSubmit(renderer->graphics_queue, 1,
+                      &(const VkSubmitInfo){
+                          .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+                          .commandBufferCount = 1,
+                          .pCommandBuffers = &renderer->upload_command_buffer},
+                      renderer->upload_fence) != VK_SUCCESS) {
+      LOG("Couldn't submit upload");
+      return false;
+    }
+    // The staging buffer is reused by the next chunk
+    vkWaitForFences(renderer->device, 1, &renderer->upload_fence, VK_TRUE,
+                    UINT64_MAX);
+
+    uploaded_size += chunk_size;
+  }
+
+  return true;
+}
+
+void vulkan_renderer_destroy_swapchain_resources(
+    struct vulkan_renderer *renderer) {
+  vulkan_renderer_destroy_render_finished_semaphores(
+      renderer, renderer->swapchain_image_count);
+  vulkan_renderer_destroy_framebuffers(renderer);
+  vulkan_renderer_destroy_attachments(renderer);
+  for (uint32_t swapchain_image_view_index = 0;
+       swapchain_image_view_index < renderer->swapchain_image_count;
+       swapchain_image_view_index++) {
+    vkDestroyImageView(
+        renderer->device,
+        renderer->swapchain_image_views[swapchain_image_view_index], NULL);
+  }
+  vkDestroySwapchainKHR(renderer->device, renderer->swapchain, NULL);
+}
+
+bool vulkan_renderer_recreate_swapchain(struct vulkan_renderer *renderer) {
+  int window_width_px;
+  int window_height_px;
+  if (!SDL_GetWindowSizeInPixels(renderer->window, &window_width_px,
+                                 &window_height_px)) {
+    LOG("Couldn't get window size");
+    return false;
+  }
+
+  // Minimized, keep the old swapchain around until we get a usable size
+  if (window_width_px == 0 || window_height_px == 0) {
+    return false;
+  }
+
+  vkDeviceWaitIdle(renderer->device);
+  vulkan_renderer_destroy_swapchain_resources(renderer);
+
+  VkFormat previous_swapchain_image_format = renderer->swapchain_image_format;
+  if (!vulkan_renderer_create_swapchain(renderer, window_width_px,
+                                        window_height_px)) {
+    LOG("Couldn't recreate swapchain");
+    goto err;
+  }
+  // The render pass and pipeline were built for this format
+  assert(renderer->swapchain_image_format == previous_swapchain_image_format);
+  (void)previous_swapchain_image_format;
+
+  if (!vulkan_renderer_create_swapchain_image_views(renderer)) {
+    LOG("Couldn't recreate swapchain image views");
+    goto destroy_swapchain;
+  }
+
+  if (!vulkan_renderer_create_attachments(renderer)) {
+    LOG("Couldn't recreate attachments");
+    goto destroy_swapchain_image_views;
+  }
+
+  if (!vulkan_renderer_create_framebuffers(renderer)) {
+    LOG("Couldn't recreate framebuffers");
+    goto destroy_attachments;
+  }
+
+  if (!vulkan_renderer_create_render_finished_semaphores(renderer)) {
+    LOG("Couldn't recreate render finished semaphores");
+    goto destroy_framebuffers;
+  }
+  vulkan_renderer_update_post_process_descriptors(renderer);
+
+  renderer->swapchain_out_of_date = false;
+  return true;
+
+destroy_framebuffers:
+  vulkan_renderer_destroy_framebuffers(renderer);
+destroy_attachments:
+  vulkan_renderer_destroy_attachments(renderer);
+destroy_swapchain_image_views:
+  for (uint32_t swapchain_image_view_index = 0;
+       swapchain_image_view_index < renderer->swapchain_image_count;
+       swapchain_image_view_index++) {
+    vkDestroyImageView(
+        renderer->device,
+        renderer->swapchain_image_views[swapchain_image_view_index], NULL);
+  }
+destroy_swapchain:
+  vkDestroySwapchainKHR(renderer->device, renderer->swapchain, NULL);
+err:
+  renderer->swapchain = VK_NULL_HANDLE;
+  renderer->swapchain_image_count = 0;
+  return false;
+}
+
+void vulkan_renderer_notify_resize(struct vulkan_renderer *renderer) {
+  renderer->swapchain_out_of_date = true;
+}
+
+bool vulkan_renderer_begin_frame(struct vulkan_renderer *renderer) {
+  renderer->cpu_frame_start_ns = SDL_GetTicksNS();
+  if (renderer->swapchain_out_of_date &&
+      !vulkan_renderer_recreate_swapchain(renderer)) {
+    return false;
+  }
+
+  struct vulkan_renderer_frame *frame =
+      &renderer->frames[renderer->current_frame];
+  vkWaitForFences(renderer->device, 1, &frame->in_flight_fence, VK_TRUE,
+                  UINT64_MAX);
+  arena_reset(&renderer->frame_arena);
+  renderer->draw_data_ring_count = 0;
+
+  vulkan_renderer_harvest_occlusion_stats(renderer);
+  renderer->gpu_frame_time_available = false;
+  if (frame->timestamps_written) {
+    uint64_t timestamps[2];
+    if (vkGetQueryPoolResults(renderer->device,
+                              renderer->timestamp_query_pool,
+                              renderer->current_frame *
+                                  VULKAN_RENDERER_TIMESTAMP_COUNT,
+                              2,
+                              sizeof(timestamps), timestamps,
+                              sizeof(timestamps[0]),
+                              VK_QUERY_RESULT_64_BIT) == VK_SUCCESS) {
+      uint64_t elapsed_ticks =
+          (timestamps[1] - timestamps[0]) & renderer->timestamp_mask;
+      renderer->gpu_frame_time_ns =
+          (uint64_t)((double)elapsed_ticks * renderer->timestamp_period_ns);
+      renderer->gpu_frame_time_available = true;
+    }
+    frame->timestamps_written = false;
+  }
+  vulkan_renderer_update_dynamic_resolution(renderer);
+
+  VkResult acquire_result = vkAcquireNextImageKHR(
+      renderer->device, renderer->swapchain, UINT64_MAX,
+      frame->image_available_semaphore, VK_NULL_HANDLE,
+      &renderer->current_swapchain_image_index);
+  if (acquire_result == VK_ERROR_OUT_OF_DATE_KHR) {
+    renderer->swapchain_out_of_date = true;
+    return false;
+  }
+  if (acquire_result != VK_SUCCESS && acquire_result != VK_SUBOPTIMAL_KHR) {
+    LOG("Couldn't acquire swapchain image, VkResult=%d", acquire_result);
+    return false;
+  }
+
+  vkResetCommandBuffer(frame->command_buffer, 0);
+  if (vkBeginCommandBuffer(frame->command_buffer,
+                           &(const VkCommandBufferBeginInfo){
+                               .sType =
+                                   VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+                               .flags =
+                                   VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT}) !=
+      VK_SUCCESS) {
+    LOG("Couldn't begin frame command buffer");
+    return false;
+  }
+
+  if (renderer->timestamp_query_pool != VK_NULL_HANDLE) {
+    vkCmdResetQueryPool(
+        frame->command_buffer, renderer->timestamp_query_pool,
+        renderer->current_frame * VULKAN_RENDERER_TIMESTAMP_COUNT,
+        VULKAN_RENDERER_TIMESTAMP_COUNT);
+    vkCmdWriteTimestamp(
+        frame->command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+        renderer->timestamp_query_pool,
+        renderer->current_frame * VULKAN_RENDERER_TIMESTAMP_COUNT +
+            VULKAN_RENDERER_TIMESTAMP_FRAME_START);
+  }
+  renderer->occlusion_phase =
+      renderer->occlusion_culling_enabled &&
+              !renderer->occlusion_culling_paused
+          ? VULKAN_RENDERER_OCCLUSION_PHASE_EARLY
+          : VULKAN_RENDERER_OCCLUSION_PHASE_OFF;
+  renderer->early_cull_timing = false;
+  capture_record_begin_frame(&renderer->capture, renderer);
+
+  return true;
+}
+
+// `render_pass` is render_pass or one of its occlusion culling parts
+void vulkan_renderer_begin_scene_render_pass(struct vulkan_renderer *renderer,
+                                             VkRenderPass render_pass) {
+  struct vulkan_renderer_frame *frame =
+      &renderer->frames[renderer->current_frame];
+  VkClearValue clear_values[] = {
+      {.color = {.float32 = {0.0f, 0.0f, 0.0f, 1.0f}}},
+      {.depthStencil = {.depth = 1.0f}}};
+  vkCmdBeginRenderPass(
+      frame->command_buffer,
+      &(const VkRenderPassBeginInfo){
+          .sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
+          .renderPass = render_pass,
+          .framebuffer =
+              renderer->post_process_enabled
+                  ? renderer->scene_framebuffer
+                  : renderer->swapchain_framebuffers
+                        [renderer->current_swapchain_image_index],
+          .renderArea = {.offset = {0, 0}, .extent = renderer->render_extent},
+          .clearValueCount = sizeof(clear_values) / sizeof(VkClearValue),
+          .pClearValues = clear_values},
+      VK_SUBPASS_CONTENTS_INLINE);
+
+  vkCmdSetViewport(
+      frame->command_buffer, 0, 1,
+      &(const VkViewport){.width = (float)renderer->render_extent.width,
+                          .height = (float)renderer->render_extent.height,
+                          .maxDepth = 1.0f});
+  vkCmdSetScissor(
+      frame->command_buffer, 0, 1,
+      &(const VkRect2D){.offset = {0, 0}, .extent = renderer->render_extent});
+}
+
+void vulkan_renderer_begin_render_pass(struct vulkan_renderer *renderer) {
+  capture_record_command(&renderer->capture,
+                         CAPTURE_COMMAND_BEGIN_RENDER_PASS);
+  if (renderer->early_cull_timing) {
+    vkCmdWriteTimestamp(
+        renderer->frames[renderer->current_frame].command_buffer,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, renderer->timestamp_query_pool,
+        renderer->current_frame * VULKAN_RENDERER_TIMESTAMP_COUNT +
+            VULKAN_RENDERER_TIMESTAMP_EARLY_CULL_END);
+  }
+  vulkan_renderer_begin_scene_render_pass(
+      renderer,
+      renderer->occlusion_phase == VULKAN_RENDERER_OCCLUSION_PHASE_EARLY
+          ? renderer->occlusion_early_render_pass
+          : renderer->render_pass);
+}
+
+void vulkan_renderer_resume_render_pass(struct vulkan_renderer *renderer) {
+  if (renderer->occlusion_phase != VULKAN_RENDERER_OCCLUSION_PHASE_LATE_CULL) {
+    return;
+  }
+  capture_record_command(&renderer->capture,
+                         CAPTURE_COMMAND_RESUME_RENDER_PASS);
+
+  // The cull stats are read back once the frame's fence has signaled
+  VkCommandBuffer command_buffer =
+      renderer->frames[renderer->current_frame].command_buffer;
+  vkCmdPipelineBarrier(
+      command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+      VK_PIPELINE_STAGE_HOST_BIT, 0, 1,
+      &(const VkMemoryBarrier){.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+                               .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+                               .dstAccessMask = VK_ACCESS_HOST_READ_BIT},
+      0, NULL, 0, NULL);
+  if (renderer->timestamp_query_pool != VK_NULL_HANDLE) {
+    vkCmdWriteTimestamp(
+        command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        renderer->timestamp_query_pool,
+        renderer->current_frame * VULKAN_RENDERER_TIMESTAMP_COUNT +
+            VULKAN_RENDERER_TIMESTAMP_OCCLUSION_END);
+  }
+  vulkan_renderer_begin_scene_render_pass(
+      renderer, renderer->occlusion_late_render_pass);
+  renderer->occlusion_phase = VULKAN_RENDERER_OCCLUSION_PHASE_LATE_DRAW;
+}
+
+struct mesh_draw_data mesh_draw_data_from_model_view_projection(
+    const struct mat4 *model_view_projection) {
+  return (struct mesh_draw_data){.model_view_projection =
+                                     *model_view_projection,
+                                 .model = mat4_identity(),
+                                 .color = {1.0f, 1.0f, 1.0f, 1.0f}};
+}
+
+void vulkan_renderer_bind_mesh_buffers(struct vulkan_renderer *renderer,
+                                       const struct mesh *mesh) {
+  VkCommandBuffer command_buffer =
+      renderer->frames[renderer->current_frame].command_buffer;
+  VkDeviceSize vertex_buffer_offset = 0;
+  vkCmdBindVertexBuffers(command_buffer, 0, 1, &mesh->vertex_buffer,
+                         &vertex_buffer_offset);
+  vkCmdBindIndexBuffer(command_buffer, mesh->index_buffer, 0,
+                       mesh->index_type);
+}
+
+void vulkan_renderer_bind_mesh(struct vulkan_renderer *renderer,
+                               const struct mesh *mesh) {
+  vkCmdBindPipeline(renderer->frames[renderer->current_frame].command_buffer,
+                    VK_PIPELINE_BIND_POINT_GRAPHICS, renderer->pipeline);
+  renderer->frame_counters.pipeline_bind_count++;
+  vulkan_renderer_bind_mesh_buffers(renderer, mesh);
+}
+
+bool vulkan_renderer_set_mesh_draw_data(
+    struct vulkan_renderer *renderer, const struct mesh *mesh,
+    const struct mesh_draw_data *draw_data) {
+  VkCommandBuffer command_buffer =
+      renderer->frames[renderer->current_frame].command_buffer;
+
+  struct mesh_draw_constants draw_constants = {
+      .draw_data = *draw_data,
+      .position_offset = {mesh->position_offset[0], mesh->position_offset[1],
+                          mesh->position_offset[2], 0.0f},
+      .position_scale = {mesh->position_scale[0], mesh->position_scale[1],
+                         mesh->position_scale[2], 0.0f}};
+  if (renderer->draw_data_in_push_constants) {
+    vkCmdPushConstants(command_buffer, renderer->pipeline_layout,
+                       VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(draw_constants),
+                       &draw_constants);
+    return true;
+  }
+
+  if (renderer->draw_data_ring_count >=
+      renderer->draw_data_ring_frame_capacity) {
+    if (renderer->draw_data_ring_count ==
+        renderer->draw_data_ring_frame_capacity) {
+      LOG("Draw data ring is full, skipping the remaining draws of the frame");
+      renderer->draw_data_ring_count++;
+    }
+    return false;
+  }
+
+  uint32_t dynamic_offset =
+      (uint32_t)(((VkDeviceSize)renderer->current_frame *
+                      renderer->draw_data_ring_frame_capacity +
+                  renderer->draw_data_ring_count) *
+                 renderer->draw_data_ring_stride);
+  renderer->draw_data_ring_count++;
+  memcpy(renderer->draw_data_ring_mapped + dynamic_offset, &draw_constants,
+         sizeof(draw_constants));
+  vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                          renderer->pipeline_layout, 0, 1,
+                          &renderer->draw_data_descriptor_set, 1,
+                          &dynamic_offset);
+  return true;
+}
+
+void vulkan_renderer_draw_mesh(struct vulkan_renderer *renderer,
+                               const struct mesh *mesh,
+                               const struct mesh_draw_data *draw_data) {
+  capture_record_draw_mesh(&renderer->capture, mesh, draw_data);
+  vulkan_renderer_bind_mesh(renderer, mesh);
+  if (!vulkan_renderer_set_mesh_draw_data(renderer, mesh, draw_data)) {
+    return;
+  }
+  vkCmdDrawIndexed(renderer->frames[renderer->current_frame].command_buffer,
+                   mesh->index_count, 1, 0, 0, 0);
+  renderer->frame_counters.draw_call_count++;
+}
+
+void vulkan_renderer_end_render_pass(struct vulkan_renderer *renderer) {
+  // Ends the occlusion culling phases the frame skipped, captured before the
+  // end of the pass like explicit calls
+  vulkan_renderer_build_depth_pyramid(renderer);
+  vulkan_renderer_resume_render_pass(renderer);
+  capture_record_command(&renderer->capture, CAPTURE_COMMAND_END_RENDER_PASS);
+  vkCmdEndRenderPass(renderer->frames[renderer->current_frame].command_buffer);
+  if (renderer->post_process_enabled) {
+    vulkan_renderer_record_post_process(renderer);
+  }
+}
+
+struct stats_gauges
+vulkan_renderer_query_stats_gauges(struct vulkan_renderer *renderer) {
+  struct stats_gauges gauges = {
+      .live_device_memory_allocation_count =
+          renderer->device_memory_allocation_count -
+          renderer->device_memory_free_count,
+      .performance_message_count =
+          (uint64_t)SDL_GetAtomicInt(&renderer->performance_message_count),
+      .vram_usage_available = renderer->memory_budget_supported};
+
+  VkPhysicalDeviceMemoryBudgetPropertiesEXT memory_budget = {
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT};
+  VkPhysicalDeviceMemoryProperties2 memory_properties = {
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2,
+      .pNext = renderer->memory_budget_supported ? &memory_budget : NULL};
+  vkGetPhysicalDeviceMemoryProperties2(renderer->physical_device,
+                                       &memory_properties);
+
+  // Without VK_EXT_memory_budget the budget is the size of the heaps
+  const VkPhysicalDeviceMemoryProperties *properties =
+      &memory_properties.memoryProperties;
+  for (uint32_t heap = 0; heap < properties->memoryHeapCount; heap++) {
+    if (!(properties->memoryHeaps[heap].flags &
+          VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)) {
+      continue;
+    }
+    if (renderer->memory_budget_supported) {
+      gauges.vram_usage_bytes += memory_budget.heapUsage[heap];
+      gauges.vram_budget_bytes += memory_budget.heapBudget[heap];
+    } else {
+      gauges.vram_budget_bytes += properties->memoryHeaps[heap].size;
+    }
+  }
+  return gauges;
+}
+
+// Called once the frame is submitted. The GPU time is the one of the last
+// frame that used this frame slot, harvested by vulkan_renderer_begin_frame.
+void vulkan_renderer_record_frame_stats(struct vulkan_renderer *renderer) {
+  if (!renderer->stats.enabled) {
+    renderer->frame_counters = (struct stats_frame_counters){0};
+    return;
+  }
+
+  const struct vulkan_renderer_occlusion_stats *occlusion_stats =
+      &renderer->occlusion_stats;
+  stats_record_frame(
+      &renderer->stats,
+      &(const struct stats_frame_sample){
+          .cpu_frame_time_ns = SDL_GetTicksNS() - renderer->cpu_frame_start_ns,
+          .gpu_frame_time_available = renderer->gpu_frame_time_available,
+          .gpu_frame_time_ns = renderer->gpu_frame_time_ns,
+          .counters = renderer->frame_counters,
+          .occlusion_stats_available = renderer->occlusion_stats_available,
+          .meshlet_count = occlusion_stats->meshlet_count,
+          .culled_meshlet_count =
+              occlusion_stats->frustum_culled_meshlet_count +
+              occlusion_stats->occluded_meshlet_count,
+          .occluded_meshlet_count = occlusion_stats->occluded_meshlet_count,
+          .occlusion_gpu_time_available = occlusion_stats->gpu_time_available,
+          .occlusion_gpu_time_ns = occlusion_stats->gpu_time_ns,
+          .early_cull_gpu_time_available =
+              occlusion_stats->early_cull_gpu_time_available,
+          .early_cull_gpu_time_ns = occlusion_stats->early_cull_gpu_time_ns});
+  renderer->frame_counters = (struct stats_frame_counters){0};
+
+  if (stats_emit_due(&renderer->stats)) {
+    struct stats_gauges gauges = vulkan_renderer_query_stats_gauges(renderer);
+    stats_emit(&renderer->stats, &gauges);
+  }
+}
+
+bool vulkan_renderer_end_frame(struct vulkan_renderer *renderer) {
+  struct vulkan_renderer_frame *frame =
+      &renderer->frames[renderer->current_frame];
+
+  if (renderer->timestamp_query_pool != VK_NULL_HANDLE) {
+    vkCmdWriteTimestamp(
+        frame->command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+        renderer->timestamp_query_pool,
+        renderer->current_frame * VULKAN_RENDERER_TIMESTAMP_COUNT +
+            VULKAN_RENDERER_TIMESTAMP_FRAME_END);
+  }
+  if (vkEndCommandBuffer(frame->command_buffer) != VK_SUCCESS) {
+    LOG("Couldn't record frame command buffer");
+    return false;
+  }
+
+  // Only reset once the frame is submitted with this fence, a frame that
+  // fails earlier would leave it unsignaled and the next wait on it hanging
+  vkResetFences(renderer->device, 1, &frame->in_flight_fence);
+
+  VkSemaphore render_finished_semaphore =
+      renderer
+          ->render_finished_semaphores[renderer->current_swapchain_image_index];
+  VkPipelineStageFlags wait_stage =
+      VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+  if (vkQueueSubmit(renderer->graphics_queue, 1,
+                    &(const VkSubmitInfo){
+                        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+                        .waitSemaphoreCount = 1,
+                        .pWaitSemaphores = &frame->image_available_semaphore,
+                        .pWaitDstStageMask = &wait_stage,
+                        .commandBufferCount = 1,
+                        .pCommandBuffers = &frame->command_buffer,
+                        .signalSemaphoreCount = 1,
+                        .pSignalSemaphores = &render_finished_semaphore},
+                    frame->in_flight_fence) != VK_SUCCESS) {
+    LOG("Couldn't submit frame command buffer");
+    return false;
+  }
+  frame->timestamps_written =
+      renderer->timestamp_query_pool != VK_NULL_HANDLE;
+  frame->occlusion_culled =
+      renderer->occlusion_phase != VULKAN_RENDERER_OCCLUSION_PHASE_OFF;
+  frame->early_cull_timed = renderer->early_cull_timing;
+  capture_record_end_frame(&renderer->capture,
+                           SDL_GetTicksNS() - renderer->cpu_frame_start_ns);
+  vulkan_renderer_record_frame_stats(renderer);
+
+  VkResult present_result = vkQueuePresentKHR(
+      renderer->present_queue,
+      &(const VkPresentInfoKHR){
+          .sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
+          .waitSemaphoreCount = 1,
+          .pWaitSemaphores = &render_finished_semaphore,
+          .swapchainCount = 1,
+          .pSwapchains = &renderer->swapchain,
+          .pImageIndices = &renderer->current_swapchain_image_index});
+  renderer->current_frame = (renderer->current_frame + 1) % MAX_FRAMES_IN_FLIGHT;
+  if (present_result == VK_ERROR_OUT_OF_DATE_KHR ||
+      present_result == VK_SUBOPTIMAL_KHR) {
+    renderer->swapchain_out_of_date = true;
+  } else if (present_result != VK_SUCCESS) {
+    LOG("Couldn't present swapchain image, VkResult=%d", present_result);
+    return false;
+  }
+
+  return true;
+}
+
+bool vulkan_renderer_init(struct vulkan_renderer *renderer, SDL_Window *window,
+                          const struct vulkan_renderer_options *options) {
+  assert(renderer);
+  assert(window);
+  assert(options);
+  *renderer = (struct vulkan_renderer){0};
+  renderer->window = window;
+  // Adjusted to what the validation layer supports by
+  // vulkan_renderer_create_instance
+  renderer->validation = options->validation;
+  if (renderer->validation == VULKAN_RENDERER_VALIDATION_DEFAULT) {
+#ifdef NDEBUG
+    renderer->validation = VULKAN_RENDERER_VALIDATION_OFF;
+#else
+    renderer->validation = VULKAN_RENDERER_VALIDATION_STANDARD;
+#endif
+  }
+  // Dynamic resolution needs the scene in an offscreen target
+  renderer->post_process_enabled =
+      options->post_process || options->dynamic_resolution_budget_ms > 0.0f;
+  renderer->render_scale =
+      options->render_scale == 0.0f ? 1.0f
+      : options->render_scale < RENDER_SCALE_MIN ? RENDER_SCALE_MIN
+      : options->render_scale > RENDER_SCALE_MAX ? RENDER_SCALE_MAX
+                                                 : options->render_scale;
+  // Starts at the top of its range, the scene targets are allocated for it
+  renderer->dynamic_resolution_budget_ms =
+      options->dynamic_resolution_budget_ms;
+  renderer->dynamic_resolution_scale = renderer->render_scale;
+
+  if (!arena_init(&renderer->init_arena, "init", INIT_ARENA_CAPACITY)) {
+    goto err;
+  }
+
+  if (!arena_init(&renderer->frame_arena, "frame", FRAME_ARENA_CAPACITY)) {
+    goto deinit_init_arena;
+  }
+
+  if (!vulkan_renderer_create_instance(renderer)) {
+    goto deinit_frame_arena;
+  }
+
+  if (renderer->enable_validation_layers) {
+    if (!vulkan_renderer_create_debug_messenger(renderer)) {
+      LOG("Couldn't create Vulkan renderer debug messenger.");
+    }
+  }
+
+  if (!SDL_Vulkan_CreateSurface(window, renderer->instance, NULL,
+                                &renderer->surface)) {
+    LOG("Couldn't create Vulkan rendering surface: %s", SDL_GetError());
+    goto destroy_instance;
+  }
+
+  if (!vulkan_renderer_pick_physical_device(renderer)) {
+    LOG("Couldn't pick the appropriate physical device.");
+    goto destroy_surface;
+  }
+  vulkan_renderer_query_optional_device_features(renderer);
+  // The meshlets of occlusion culled frames are culled by the compute pass,
+  // the task shader has no late pass
+  renderer->occlusion_culling_enabled =
+      options->occlusion_culling && renderer->multi_draw_indirect_supported;
+  if (options->occlusion_culling && !renderer->occlusion_culling_enabled) {
+    LOG("Occlusion culling needs multi draw indirect, it is disabled");
+  }
+  if (renderer->occlusion_culling_enabled) {
+    renderer->mesh_shader_supported = false;
+  }
+
+  if (!vulkan_renderer_create_logical_device(renderer)) {
+    LOG("Couldn't create the logical device");
+    goto destroy_surface;
+  }
+
+  int window_width_px;
+  int window_height_px;
+  if (!SDL_GetWindowSizeInPixels(window, &window_width_px, &window_height_px)) {
+    LOG("Couldn't get window size");
+    goto destroy_logical_device;
+  }
+
+  if (!vulkan_renderer_create_swapchain(renderer, window_width_px,
+                                        window_height_px)) {
+    LOG("Couldn't create swapchain");
+    goto destroy_logical_device;
+  }
+
+  if (!vulkan_renderer_create_swapchain_image_views(renderer)) {
+    LOG("Couldn't create swapchain image views");
+    goto destroy_swapchain;
+  }
+
+  if (!vulkan_renderer_choose_attachment_formats(renderer, options)) {
+    goto destroy_swapchain_image_views;
+  }
+  vulkan_renderer_select_occlusion_culling(renderer);
+
+  if (!vulkan_renderer_create_render_pass(renderer)) {
+    LOG("Couldn't create render pass");
+    goto destroy_swapchain_image_views;
+  }
+
+  if (!vulkan_renderer_create_graphics_pipeline(renderer)) {
+    LOG("Couldn't create graphics pipeline");
+    goto destroy_render_pass;
+  }
+
+  if (!vulkan_renderer_create_occlusion(renderer)) {
+    LOG("Couldn't create occlusion culling resources");
+    goto destroy_graphics_pipeline;
+  }
+
+  if (!vulkan_renderer_create_meshlet_pipelines(renderer)) {
+    LOG("Couldn't create meshlet pipelines");
+    goto destroy_occlusion;
+  }
+
+  if (!vulkan_renderer_create_post_process(renderer)) {
+    LOG("Couldn't create post process");
+    goto destroy_meshlet_pipelines;
+  }
+
+  if (!vulkan_renderer_create_attachments(renderer)) {
+    LOG("Couldn't create attachments");
+    goto destroy_post_process;
+  }
+
+  if (!vulkan_renderer_create_framebuffers(renderer)) {
+    LOG("Couldn't create framebuffers");
+    goto destroy_attachments;
+  }
+  vulkan_renderer_update_post_process_descriptors(renderer);
+
+  if (!vulkan_renderer_create_command_pool(renderer)) {
+    LOG("Couldn't create command pool");
+    goto destroy_framebuffers;
+  }
+
+  if (!vulkan_renderer_create_frames(renderer)) {
+    LOG("Couldn't create frame resources");
+    goto destroy_command_pool;
+  }
+
+  if (!vulkan_renderer_create_timestamp_query_pool(renderer)) {
+    LOG("Couldn't create timestamp query pool");
+    goto destroy_frames;
+  }
+
+  if (!vulkan_renderer_create_render_finished_semaphores(renderer)) {
+    LOG("Couldn't create render finished semaphores");
+    goto destroy_timestamp_query_pool;
+  }
+
+  if (!vulkan_renderer_create_staging_buffer(renderer)) {
+    LOG("Couldn't create staging buffer");
+    goto destroy_render_finished_semaphores;
+  }
+
+  // Stats are diagnostics, the renderer works without them
+  if (!stats_init(&renderer->stats, options->stats_destination,
+                  options->stats_interval_ms)) {
+    LOG("Couldn't init stats, continuing without them");
+  }
+  if (!capture_init(&renderer->capture, options->capture_path,
+                    options->capture_frame_count,
+                    options->capture_threshold_ms)) {
+    LOG("Couldn't init capture, continuing without it");
+  }
+
+  arena_log_usage(&renderer->init_arena);
+  arena_reset(&renderer->init_arena);
+  return true;
+
+destroy_render_finished_semaphores:
+  vulkan_renderer_destroy_render_finished_semaphores(
+      renderer, renderer->swapchain_image_count);
+destroy_timestamp_query_pool:
+  vkDestroyQueryPool(renderer->device, renderer->timestamp_query_pool, NULL);
+destroy_frames:
+  vulkan_renderer_destroy_frames(renderer, MAX_FRAMES_IN_FLIGHT);
+destroy_command_pool:
+  vkDestroyCommandPool(renderer->device, renderer->command_pool, NULL);
+destroy_framebuffers:
+  vulkan_renderer_destroy_framebuffers(renderer);
+destroy_attachments:
+  vulkan_renderer_destroy_attachments(renderer);
+destroy_post_process:
+  vulkan_renderer_destroy_post_process(renderer);
+destroy_meshlet_pipelines:
+  vulkan_renderer_destroy_meshlet_pipelines(renderer);
+destroy_occlusion:
+  vulkan_renderer_destroy_occlusion(renderer);
+destroy_graphics_pipeline:
+  vkDestroyPipeline(renderer->device, renderer->pipeline, NULL);
+  vkDestroyPipelineLayout(renderer->device, renderer->pipeline_layout, NULL);
+  vulkan_renderer_destroy_draw_data_ring(renderer);
+destroy_render_pass:
+  vulkan_renderer_destroy_render_pass(renderer);
+destroy_swapchain_image_views:
+  for (uint32_t swapchain_image_view_index = 0;
+       swapchain_image_view_index < renderer->swapchain_image_count;
+       swapchain_image_view_index++) {
+    vkDestroyImageView(
+        renderer->device,
+        renderer->swapchain_image_views[swapchain_image_view_index], NULL);
+  }
+destroy_swapchain:
+  vkDestroySwapchainKHR(renderer->device, renderer->swapchain, NULL);
+destroy_logical_device:
+  vkDestroyDevice(renderer->device, NULL);
+destroy_surface:
+  vkDestroySurfaceKHR(renderer->instance, renderer->surface, NULL);
+destroy_instance:
+  if (renderer->enable_validation_layers) {
+    vkDestroyDebugUtilsMessengerEXT(renderer->instance,
+                                    renderer->debug_messenger, NULL);
+  }
+  vulkan_renderer_destroy_instance(renderer);
+deinit_frame_arena:
+  arena_deinit(&renderer->frame_arena);
+deinit_init_arena:
+  arena_deinit(&renderer->init_arena);
+err:
+  return false;
+}
+
+void vulkan_renderer_deinit(struct vulkan_renderer *renderer) {
+  vkDeviceWaitIdle(renderer->device);
+  struct stats_gauges gauges = vulkan_renderer_query_stats_gauges(renderer);
+  stats_deinit(&renderer->stats, &gauges);
+  capture_deinit(&renderer->capture);
+  vulkan_renderer_destroy_staging_buffer(renderer);
+  vkDestroyQueryPool(renderer->device, renderer->timestamp_query_pool, NULL);
+  vulkan_renderer_destroy_frames(renderer, MAX_FRAMES_IN_FLIGHT);
+  vkDestroyCommandPool(renderer->device, renderer->command_pool, NULL);
+  vulkan_renderer_destroy_swapchain_resources(renderer);
+  vulkan_renderer_destroy_post_process(renderer);
+  vulkan_renderer_destroy_meshlet_pipelines(renderer);
+  vulkan_renderer_destroy_occlusion(renderer);
+  vkDestroyPipeline(renderer->device, renderer->pipeline, NULL);
+  vkDestroyPipelineLayout(renderer->device, renderer->pipeline_layout, NULL);
+  vulkan_renderer_destroy_draw_data_ring(renderer);
+  vulkan_renderer_destroy_render_pass(renderer);
+  vkDestroyDevice(renderer->device, NULL);
+  vkDestroySurfaceKHR(renderer->instance, renderer->surface, NULL);
+  if (renderer->enable_validation_layers) {
+    vkDestroyDebugUtilsMessengerEXT(renderer->instance,
+                                    renderer->debug_messenger, NULL);
+  }
+  vulkan_renderer_destroy_instance(renderer);
+  arena_log_usage(&renderer->frame_arena);
+  arena_deinit(&renderer->frame_arena);
+  arena_deinit(&renderer->init_arena);
+}
@@ -0,0 +1,425 @@
+#ifndef VKGUIDE_VULKAN_RENDERER_H
+#define VKGUIDE_VULKAN_RENDERER_H
+
+#include "arena.h"
+#include "capture.h"
+#include "stats.h"
+#include "transform.h"
+#include <SDL3/SDL.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <vulkan/vulkan.h>
+
+#define MAX_SWAPCHAIN_IMAGE_COUNT 32
+#define MAX_FRAMES_IN_FLIGHT 2
+// Levels of a depth pyramid whose first level is at most 32768 texels wide
+#define DEPTH_PYRAMID_MAX_LEVEL_COUNT 16
+
+struct mesh;
+
+enum vulkan_renderer_validation {
+  // Standard without NDEBUG, off with it
+  VULKAN_RENDERER_VALIDATION_DEFAULT,
+  VULKAN_RENDERER_VALIDATION_OFF,
+  // The Khronos validation layer with its default checks
+  VULKAN_RENDERER_VALIDATION_STANDARD,
+  // Default checks plus synchronization validation (hazards between
+  // commands and missing barriers)
+  VULKAN_RENDERER_VALIDATION_SYNCHRONIZATION,
+  // Default checks plus GPU-assisted validation of the shaders' descriptor
+  // and buffer accesses, the layer reserves a descriptor set binding
+  VULKAN_RENDERER_VALIDATION_GPU_ASSISTED,
+  // Best practices checks only, reporting performance messages. Cheap enough
+  // to run in production, turned off when the layer isn't installed.
+  VULKAN_RENDERER_VALIDATION_PERFORMANCE
+};
+
+struct vulkan_renderer_options {
+  // Clamped to the sample counts supported for both color and depth, 0 or 1
+  // disables multisampling
+  uint32_t msaa_sample_count;
+  // Renders the scene into an HDR target that is tonemapped, anti-aliased and
+  // upscaled into the swapchain image, see post_process.c
+  bool post_process;
+  // Scene resolution relative to the swapchain's, only used with
+  // post_process. 0 means 1, clamped to [0.25, 2] otherwise.
+  float render_scale;
+  // GPU frame time the scene resolution is adjusted to meet, between
+  // min(0.5, render_scale) and render_scale. 0 disables dynamic resolution,
+  // anything else implies post_process.
+  float dynamic_resolution_budget_ms;
+  enum vulkan_renderer_validation validation;
+  // File or "unix:<socket path>" the stats lines are written to, see stats.h.
+  // NULL disables stats.
+  const char *stats_destination;
+  // 0 means one second
+  uint32_t stats_interval_ms;
+  // Two-phase occlusion culling of meshlets against a depth pyramid, see
+  // occlusion.h. Meshlets are then culled by the compute pass even when mesh
+  // shaders are supported, ignored without multi draw indirect.
+  bool occlusion_culling;
+  // Prefix of the capture files the last frames are dumped to, see
+  // capture.h. NULL disables capture.
+  const char *capture_path;
+  // Frames kept for the next dump, 0 means CAPTURE_DEFAULT_FRAME_COUNT
+  uint32_t capture_frame_count;
+  // CPU or GPU frame time above which the frames are dumped, 0 only dumps
+  // on request
+  float capture_threshold_ms;
+};
+
+// Image only ever used as an attachment of the render pass, its content
+// doesn't outlive it
+struct vulkan_renderer_attachment {
+  VkImage image;
+  VkDeviceMemory memory;
+  VkImageView view;
+};
+
+// Timestamp queries of each frame in flight
+enum vulkan_renderer_timestamp {
+  VULKAN_RENDERER_TIMESTAMP_FRAME_START,
+  VULKAN_RENDERER_TIMESTAMP_FRAME_END,
+  // Around the depth pyramid build and the late culling pass
+  VULKAN_RENDERER_TIMESTAMP_OCCLUSION_START,
+  VULKAN_RENDERER_TIMESTAMP_OCCLUSION_END,
+  // Around the early culling pass of occlusion culled frames
+  VULKAN_RENDERER_TIMESTAMP_EARLY_CULL_START,
+  VULKAN_RENDERER_TIMESTAMP_EARLY_CULL_END,
+  VULKAN_RENDERER_TIMESTAMP_COUNT
+};
+
+struct vulkan_renderer_frame {
+  VkCommandBuffer command_buffer;
+  VkSemaphore image_available_semaphore;
+  VkFence in_flight_fence;
+  bool timestamps_written;
+  // Whether the frame was occlusion culled, its cull stats and occlusion
+  // timestamps are then harvested with the frame timestamps
+  bool occlusion_culled;
+  // Whether its early culling pass was timed
+  bool early_cull_timed;
+};
+
+// Where the frame being recorded is in the two-phase occlusion culling
+enum vulkan_renderer_occlusion_phase {
+  // Occlusion culling is disabled or paused
+  VULKAN_RENDERER_OCCLUSION_PHASE_OFF,
+  // Until vulkan_renderer_build_depth_pyramid
+  VULKAN_RENDERER_OCCLUSION_PHASE_EARLY,
+  // Until vulkan_renderer_resume_render_pass
+  VULKAN_RENDERER_OCCLUSION_PHASE_LATE_CULL,
+  // Until vulkan_renderer_end_render_pass
+  VULKAN_RENDERER_OCCLUSION_PHASE_LATE_DRAW
+};
+
+// Of an occlusion culled frame, summed over the meshes it culled
+struct vulkan_renderer_occlusion_stats {
+  uint32_t meshlet_count;
+  // By the frustum or the normal cone
+  uint32_t frustum_culled_meshlet_count;
+  // Rejected by the previous frame's depth pyramid and retested
+  uint32_t retested_meshlet_count;
+  // Still rejected by the retest
+  uint32_t occluded_meshlet_count;
+  bool gpu_time_available;
+  // Depth pyramid build and late culling pass
+  uint64_t gpu_time_ns;
+  bool early_cull_gpu_time_available;
+  uint64_t early_cull_gpu_time_ns;
+};
+
+struct vulkan_renderer {
+  VkInstance instance;
+  VkPhysicalDevice physical_device;
+  VkDevice device;
+  VkQueue graphics_queue;
+  VkDebugUtilsMessengerEXT debug_messenger;
+  VkSurfaceKHR surface;
+  VkQueue present_queue;
+  VkSwapchainKHR swapchain;
+  VkImage swapchain_images[MAX_SWAPCHAIN_IMAGE_COUNT];
+  VkFormat swapchain_image_format;
+  VkExtent2D swapchain_extent;
+  VkImageView swapchain_image_views[MAX_SWAPCHAIN_IMAGE_COUNT];
+  VkRenderPass render_pass;
+  // Rendering happens in msaa_color_attachment, resolved into the scene color
+  // image, when msaa_sample_count > 1 and straight into the scene color image
+  // otherwise. The scene color image is the swapchain image unless post
+  // processing. The attachments are shared by the frames in flight and
+  // recreated with the swapchain.
+  VkSampleCountFlagBits msaa_sample_count;
+  VkFormat depth_format;
+  struct vulkan_renderer_attachment msaa_color_attachment;
+  struct vulkan_renderer_attachment depth_attachment;
+  // Resolution the scene is rendered at, the swapchain's unless post
+  // processing. The scene targets are allocated at render_target_extent once
+  // per swapchain, render_extent is the top-left part of them rendered into
+  // this frame so that dynamic resolution never reallocates them.
+  VkExtent2D render_target_extent;
+  VkExtent2D render_extent;
+  VkFormat scene_color_format;
+  VkPipelineLayout pipeline_layout;
+  VkPipeline pipeline;
+  VkFramebuffer swapchain_framebuffers[MAX_SWAPCHAIN_IMAGE_COUNT];
+  VkSemaphore render_finished_semaphores[MAX_SWAPCHAIN_IMAGE_COUNT];
+  uint32_t swapchain_image_count;
+  enum vulkan_renderer_validation validation;
+  // Whether the validation layer and VK_EXT_debug_utils are enabled
+  bool enable_validation_layers;
+  // VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT messages received so far
+  SDL_AtomicInt performance_message_count;
+  struct arena init_arena;
+  struct arena frame_arena;
+
+  SDL_Window *window;
+  uint32_t graphics_queue_family;
+  VkCommandPool command_pool;
+  struct vulkan_renderer_frame frames[MAX_FRAMES_IN_FLIGHT];
+  uint32_t current_frame;
+  uint32_t current_swapchain_image_index;
+  bool swapchain_out_of_date;
+  bool swapchain_transfer_src_supported;
+
+  // Persistently mapped host-visible buffer that every upload goes through
+  VkBuffer staging_buffer;
+  VkDeviceMemory staging_buffer_memory;
+  void *staging_buffer_mapped;
+  VkCommandBuffer upload_command_buffer;
+  VkFence upload_fence;
+
+  // VK_NULL_HANDLE when the graphics queue has no timestamps
+  VkQueryPool timestamp_query_pool;
+  float timestamp_period_ns;
+  uint64_t timestamp_mask;
+  // GPU time of the frame that last used the current frame slot, set by
+  // vulkan_renderer_begin_frame
+  bool gpu_frame_time_available;
+  uint64_t gpu_frame_time_ns;
+  // Every vkAllocateMemory made by the renderer modules, and every
+  // vulkan_renderer_free_memory
+  uint64_t device_memory_allocation_count;
+  uint64_t device_memory_free_count;
+
+  // Counters of the frame being recorded, handed to `stats` by
+  // vulkan_renderer_end_frame
+  struct stats_frame_counters frame_counters;
+  uint64_t cpu_frame_start_ns;
+  struct stats stats;
+  struct capture capture;
+
+  // Draw data is pushed when struct mesh_draw_constants fits in
+  // maxPushConstantsSize. Otherwise each frame in flight owns a slice of a
+  // persistently mapped uniform ring, bound with a dynamic offset per draw.
+  bool draw_data_in_push_constants;
+  VkDescriptorSetLayout draw_data_descriptor_set_layout;
+  VkDescriptorPool draw_data_descriptor_pool;
+  VkDescriptorSet draw_data_descriptor_set;
+  VkBuffer draw_data_ring_buffer;
+  VkDeviceMemory draw_data_ring_memory;
+  uint8_t *draw_data_ring_mapped;
+  VkDeviceSize draw_data_ring_stride;
+  uint32_t draw_data_ring_frame_capacity;
+  uint32_t draw_data_ring_count;
+
+  bool portability_subset_supported;
+  bool multi_draw_indirect_supported;
+  bool draw_indirect_count_supported;
+  bool mesh_shader_supported;
+  bool memory_budget_supported;
+  bool texture_compression_bc_supported;
+  bool texture_compression_astc_ldr_supported;
+
+  // Post processing, see post_process.c. The scene is rendered into
+  // scene_color_attachment through scene_framebuffer. A compute shader then
+  // writes the swapchain image through a storage view when
+  // swapchain_storage_supported, a fullscreen triangle drawn in
+  // post_process_render_pass through swapchain_framebuffers otherwise.
+  bool post_process_enabled;
+  float render_scale;
+  bool storage_image_write_without_format_supported;
+  bool swapchain_storage_supported;
+  struct vulkan_renderer_attachment scene_color_attachment;
+  VkFramebuffer scene_framebuffer;
+  VkRenderPass post_process_render_pass;
+  VkSampler post_process_sampler;
+  VkDescriptorSetLayout post_process_descriptor_set_layout;
+  VkDescriptorPool post_process_descriptor_pool;
+  // One per swapchain image, only the compute path writes the storage view
+  VkDescriptorSet post_process_descriptor_sets[MAX_SWAPCHAIN_IMAGE_COUNT];
+  VkPipelineLayout post_process_pipeline_layout;
+  VkPipeline post_process_pipeline;
+
+  // Dynamic resolution, see dynamic_resolution.c. dynamic_resolution_scale
+  // is relative to the swapchain extent, like render_scale.
+  float dynamic_resolution_budget_ms;
+  float dynamic_resolution_scale;
+  uint64_t dynamic_resolution_gpu_time_sum_ns;
+  uint32_t dynamic_resolution_sample_count;
+  uint32_t dynamic_resolution_settle_frame_count;
+
+  // Meshlet rendering, see meshlet.c. With mesh shaders the task shader culls
+  // and the mesh shader emits the surviving meshlets, otherwise a compute
+  // pass culls into an indirect draw buffer drawn with `pipeline`.
+  VkDescriptorSetLayout meshlet_descriptor_set_layout;
+  VkDescriptorPool meshlet_descriptor_pool;
+  VkPipelineLayout meshlet_pipeline_layout;
+  VkPipeline meshlet_cull_pipeline;
+  VkPipeline meshlet_mesh_pipeline;
+  PFN_vkCmdDrawMeshTasksEXT cmd_draw_mesh_tasks;
+
+  // Occlusion culling, see occlusion.c. The scene render pass is split in
+  // occlusion_early_render_pass and occlusion_late_render_pass, compatible
+  // with render_pass, around the depth pyramid build. The depth pyramid is
+  // shared by the frames in flight and recreated with the swapchain.
+  bool occlusion_culling_enabled;
+  // Renders the next frames as if occlusion culling was disabled, e.g. to
+  // measure what it saves. The resources stay allocated.
+  bool occlusion_culling_paused;
+  enum vulkan_renderer_occlusion_phase occlusion_phase;
+  // Whether the early culling pass of the frame being recorded wrote its
+  // start timestamp, the scene render pass then writes its end
+  bool early_cull_timing;
+  VkRenderPass occlusion_early_render_pass;
+  VkRenderPass occlusion_late_render_pass;
+  VkSampler depth_pyramid_sampler;
+  VkDescriptorSetLayout depth_pyramid_descriptor_set_layout;
+  VkDescriptorPool occlusion_descriptor_pool;
+  // One per level, reading the depth attachment or the level above
+  VkDescriptorSet depth_pyramid_descriptor_sets[DEPTH_PYRAMID_MAX_LEVEL_COUNT];
+  VkPipelineLayout depth_pyramid_pipeline_layout;
+  VkPipeline depth_pyramid_pipeline;
+  // Builds the first level from a multisampled depth attachment
+  VkPipeline depth_pyramid_multisampled_pipeline;
+  VkImage depth_pyramid_image;
+  VkDeviceMemory depth_pyramid_memory;
+  VkImageView depth_pyramid_view;
+  VkImageView depth_pyramid_level_views[DEPTH_PYRAMID_MAX_LEVEL_COUNT];
+  VkExtent2D depth_pyramid_extent;
+  uint32_t depth_pyramid_level_count;
+  // Whether the pyramid holds the depth of an earlier frame, false until the
+  // first build after each recreation
+  bool depth_pyramid_valid;
+  // Set 1 of meshlet_pipeline_layout: the depth pyramid and the cull stats
+  // of each frame in flight, in host-visible memory
+  VkDescriptorSetLayout occlusion_descriptor_set_layout;
+  VkDescriptorSet occlusion_descriptor_sets[MAX_FRAMES_IN_FLIGHT];
+  VkBuffer occlusion_stats_buffers[MAX_FRAMES_IN_FLIGHT];
+  VkDeviceMemory occlusion_stats_memories[MAX_FRAMES_IN_FLIGHT];
+  uint32_t *occlusion_stats_mapped[MAX_FRAMES_IN_FLIGHT];
+  // Of the frame that last used the current frame slot, set by
+  // vulkan_renderer_begin_frame like gpu_frame_time_ns
+  bool occlusion_stats_available;
+  struct vulkan_renderer_occlusion_stats occlusion_stats;
+};
+
+// Per-draw data of the mesh pipelines
+struct mesh_draw_data {
+  struct mat4 model_view_projection;
+  // Transforms the normals, must not scale
+  struct mat4 model;
+  // Multiplied with the shaded color
+  float color[4];
+};
+
+// Layout of the draw data block read by shaders/mesh.vert, the quantization
+// parameters come from the mesh
+struct mesh_draw_constants {
+  struct mesh_draw_data draw_data;
+  float position_offset[4];
+  float position_scale[4];
+};
+
+#define MESH_PIPELINE_COLOR_WRITE_MASK_ALL                                     \
+  (VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |                       \
+   VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT)
+
+// Fixed-function state of a pipeline drawing meshes with shaders/mesh.vert,
+// `pipeline` uses the default one (back face culling, no blending). Depth is
+// tested, and written unless blending.
+struct mesh_pipeline_state {
+  VkCullModeFlags cull_mode;
+  VkFrontFace front_face;
+  bool blend_enable;
+  VkColorComponentFlags color_write_mask;
+};
+
+// Names accepted by vulkan_renderer_validation_from_name: "off", "standard",
+// "sync", "gpu" and "perf"
+bool vulkan_renderer_validation_from_name(
+    const char *name, enum vulkan_renderer_validation *out_validation);
+const char *
+vulkan_renderer_validation_name(enum vulkan_renderer_validation validation);
+
+bool vulkan_renderer_init(struct vulkan_renderer *renderer, SDL_Window *window,
+                          const struct vulkan_renderer_options *options);
+void vulkan_renderer_deinit(struct vulkan_renderer *renderer);
+
+bool vulkan_renderer_create_buffer(struct vulkan_renderer *renderer,
+                                   VkDeviceSize size, VkBufferUsageFlags usage,
+                                   VkMemoryPropertyFlags memory_properties,
+                                   VkBuffer *out_buffer,
+                                   VkDeviceMemory *out_memory);
+// Frees memory allocated by any renderer module, VK_NULL_HANDLE is ignored
+void vulkan_renderer_free_memory(struct vulkan_renderer *renderer,
+                                 VkDeviceMemory memory);
+// Copies `size` bytes from `data` into `dst_buffer` through the staging
+// buffer. Blocks until the transfer has completed.
+bool vulkan_renderer_upload_to_buffer(struct vulkan_renderer *renderer,
+                                      VkBuffer dst_buffer,
+                                      VkDeviceSize dst_offset, const void *data,
+                                      VkDeviceSize size);
+
+// Shared with the other renderer modules
+bool find_memory_type(VkPhysicalDevice physical_device, uint32_t type_filter,
+                      VkMemoryPropertyFlags properties,
+                      uint32_t *out_memory_type_index);
+char *load_shader_from_file(struct arena *arena, const char *path,
+                            size_t *out_size);
+VkShaderModule create_shader_module(VkDevice device, char *code,
+                                    size_t code_size);
+
+// Creates a pipeline compatible with `pipeline_layout` and `render_pass`
+bool vulkan_renderer_create_mesh_pipeline(
+    struct vulkan_renderer *renderer, const struct mesh_pipeline_state *state,
+    VkPipeline *out_pipeline);
+
+void vulkan_renderer_notify_resize(struct vulkan_renderer *renderer);
+
+// Returns false when no swapchain image could be acquired this frame (e.g. the
+// swapchain is being recreated); the frame must then be skipped.
+// Compute work (e.g. meshlet culling) can be recorded between
+// vulkan_renderer_begin_frame and vulkan_renderer_begin_render_pass.
+bool vulkan_renderer_begin_frame(struct vulkan_renderer *renderer);
+void vulkan_renderer_begin_render_pass(struct vulkan_renderer *renderer);
+// Begins occlusion_late_render_pass once the depth pyramid is built and the
+// late culling pass recorded, see occlusion.h. Does nothing unless the frame
+// is occlusion culled.
+void vulkan_renderer_resume_render_pass(struct vulkan_renderer *renderer);
+// Untransformed and untinted
+struct mesh_draw_data mesh_draw_data_from_model_view_projection(
+    const struct mat4 *model_view_projection);
+// Binds the mesh pipeline, vertex and index buffers
+void vulkan_renderer_bind_mesh(struct vulkan_renderer *renderer,
+                               const struct mesh *mesh);
+// Binds the vertex and index buffers only, keeping the bound pipeline
+void vulkan_renderer_bind_mesh_buffers(struct vulkan_renderer *renderer,
+                                       const struct mesh *mesh);
+// Sets the draw data of the following draws of `mesh`, any pipeline created
+// with vulkan_renderer_create_mesh_pipeline can be bound. Returns false when
+// the uniform ring is full for this frame, the draws must then be skipped.
+bool vulkan_renderer_set_mesh_draw_data(struct vulkan_renderer *renderer,
+                                        const struct mesh *mesh,
+                                        const struct mesh_draw_data *draw_data);
+void vulkan_renderer_draw_mesh(struct vulkan_renderer *renderer,
+                               const struct mesh *mesh,
+                               const struct mesh_draw_data *draw_data);
+// Also records post processing when enabled, the swapchain image is then
+// ready to be presented. Occlusion culled frames whose render pass wasn't
+// resumed get their depth pyramid built and an empty late pass.
+void vulkan_renderer_end_render_pass(struct vulkan_renderer *renderer);
+// Transfers such as readbacks can be recorded between
+// vulkan_renderer_end_render_pass and vulkan_renderer_end_frame
+bool vulkan_renderer_end_frame(struct vulkan_renderer *renderer);
+
+#endif // VKGUIDE_VULKAN_RENDERER_H
@@ -0,0 +1,816 @@
+// Compares two images pixel by pixel, e.g. a frame captured with
+// VKGUIDE_CAPTURE against a golden image rendered with lavapipe.
+//
+// Reads 8-bit PNG (non-interlaced, gray/RGB with or without alpha) and binary
+// PPM (P6) / PAM (P7). Only the RGB channels are compared since captures
+// don't keep alpha. A pixel differs when one of its channels differs by more
+// than the threshold. Exits with 0 when at most --max-different-pixels
+// pixels differ, 1 when more do and 2 on errors.
+//
+// usage: vkguide-image-diff [--threshold <0-255>]
+//                           [--max-different-pixels <count>]
+//                           [--diff <output.png|ppm>] <a> <b>
+
+#include "image_file.h"
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define INFLATE_MAX_CODE_LENGTH 15
+#define INFLATE_MAX_LITERAL_LENGTH_CODE_COUNT 288
+#define INFLATE_MAX_DISTANCE_CODE_COUNT 30
+
+struct image {
+  uint32_t width;
+  uint32_t height;
+  // RGBA8
+  uint8_t *pixels;
+};
+
+char *read_file(const char *path, size_t *out_size) {
+  FILE *file_handle = fopen(path, "rb");
+  if (!file_handle) {
+    goto err;
+  }
+
+  if (fseek(file_handle, 0, SEEK_END) < 0) {
+    goto close_file;
+  }
+
+  long file_size = ftell(file_handle);
+  if (file_size < 0) {
+    goto close_file;
+  }
+  rewind(file_handle);
+
+  char *file_content = malloc(file_size + 1);
+  if (!file_content) {
+    goto close_file;
+  }
+
+  if (file_size > 0 && fread(file_content, file_size, 1, file_handle) != 1) {
+    goto free_file_content;
+  }
+  file_content[file_size] = '\0';
+
+  fclose(file_handle);
+  *out_size = file_size;
+  return file_content;
+free_file_content:
+  free(file_content);
+close_file:
+  fclose(file_handle);
+err:
+  return NULL;
+}
+
+uint32_t read_u32_be(const uint8_t *bytes) {
+  return (uint32_t)bytes[0] << 24 | (uint32_t)bytes[1] << 16 |
+         (uint32_t)bytes[2] << 8 | bytes[3];
+}
+
+struct inflate_state {
+  const uint8_t *input;
+  size_t input_size;
+  size_t input_offset;
+  uint32_t bit_buffer;
+  uint32_t bit_count;
+  uint8_t *output;
+  size_t output_size;
+  size_t output_offset;
+  bool failed;
+};
+
+// Canonical Huffman code, symbols sorted by code length
+struct inflate_huffman {
+  uint16_t counts[INFLATE_MAX_CODE_LENGTH + 1];
+  uint16_t symbols[INFLATE_MAX_LITERAL_LENGTH_CODE_COUNT];
+};
+
+uint32_t inflate_bits(struct inflate_state *state, uint32_t count) {
+  while (state->bit_count < count) {
+    if (state->input_offset == state->input_size) {
+      state->failed = true;
+      return 0;
+    }
+    state->bit_buffer |= (uint32_t)state->input[state->input_offset++]
+                         << state->bit_count;
+    state->bit_count += 8;
+  }
+
+  uint32_t value = state->bit_buffer & ((1u << count) - 1);
+  state->bit_buffer >>= count;
+  state->bit_count -= count;
+  return value;
+}
+
+bool inflate_huffman_build(struct inflate_huffman *huffman,
+                           const uint8_t *lengths, uint32_t symbol_count) {
+  memset(huffman->counts, 0, sizeof(huffman->counts));
+  for (uint32_t symbol = 0; symbol < symbol_count; symbol++) {
+    huffman->counts[lengths[symbol]]++;
+  }
+
+  // Over-subscribed codes are invalid, incomplete ones are allowed
+  int left = 1;
+  for (int length = 1; length <= INFLATE_MAX_CODE_LENGTH; length++) {
+    left = left * 2 - huffman->counts[length];
+    if (left < 0) {
+      return false;
+    }
+  }
+
+  uint16_t offsets[INFLATE_MAX_CODE_LENGTH + 1];
+  offsets[1] = 0;
+  for (int length = 1; length < INFLATE_MAX_CODE_LENGTH; length++) {
+    offsets[length + 1] = offsets[length] + huffman->counts[length];
+  }
+  for (uint32_t symbol = 0; symbol < symbol_count; symbol++) {
+    if (lengths[symbol] != 0) {
+      huffman->symbols[offsets[lengths[symbol]]++] = symbol;
+    }
+  }
+
+  return true;
+}
+
+int inflate_decode(struct inflate_state *state,
+                   const struct inflate_huffman *huffman) {
+  int code = 0;
+  int first = 0;
+  int index = 0;
+  for (int length = 1; length <= INFLATE_MAX_CODE_LENGTH; length++) {
+    code |= inflate_bits(state, 1);
+    int count = huffman->counts[length];
+    if (code - count < first) {
+      return huffman->symbols[index + (code - first)];
+    }
+    index += count;
+    first = (first + count) << 1;
+    code <<= 1;
+  }
+
+  state->failed = true;
+  return -1;
+}
+
+bool inflate_stored_block(struct inflate_state *state) {
+  state->bit_buffer = 0;
+  state->bit_count = 0;
+  if (state->input_size - state->input_offset < 4) {
+    return false;
+  }
+
+  const uint8_t *header = state->input + state->input_offset;
+  uint32_t length = header[0] | (uint32_t)header[1] << 8;
+  uint32_t length_complement = header[2] | (uint32_t)header[3] << 8;
+  state->input_offset += 4;
+  if (length != (~length_complement & 0xffffu) ||
+      state->input_size - state->input_offset < length ||
+      state->output_size - state->output_offset < length) {
+    return false;
+  }
+
+  memcpy(state->output + state->output_offset,
+         state->input + state->input_offset, length);
+  state->input_offset += length;
+  state->output_offset += length;
+  return true;
+}
+
+bool inflate_codes(struct inflate_state *state,
+                   const struct inflate_huffman *literal_lengths,
+                   const struct inflate_huffman *distances) {
+  static const uint16_t length_bases[29] = {
+      3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+      31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+  static const uint8_t length_extra_bits[29] = {
+      0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2,
+      2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+  static const uint16_t distance_bases[30] = {
+      1,    2,    3,    4,    5,    7,     9,     13,    17,  25,
+      33,   49,   65,   97,   129,  193,   257,   385,   513, 769,
+      1025, 1537, 2049, 3073, 4097, 6145,  8193,  12289, 16385, 24577};
+  static const uint8_t distance_extra_bits[30] = {
+      0, 0, 0, 0, 1, 1, 2, 2,  3,  3,  4,  4,  5,  5,  6,
+      6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+  while (true) {
+    int symbol = inflate_decode(state, literal_lengths);
+    if (state->failed) {
+      return false;
+    }
+
+    if (symbol < 256) {
+      if (state->output_offset == state->output_size) {
+        return false;
+      }
+      state->output[state->output_offset++] = symbol;
+    } else if (symbol == 256) {
+      return true;
+    } else {
+      symbol -= 257;
+      if (symbol >= 29) {
+        return false;
+      }
+      uint32_t length =
+          length_bases[symbol] + inflate_bits(state, length_extra_bits[symbol]);
+
+      int distance_symbol = inflate_decode(state, distances);
+      if (state->failed || distance_symbol >= 30) {
+        return false;
+      }
+      uint32_t distance =
+          distance_bases[distance_symbol] +
+          inflate_bits(state, distance_extra_bits[distance_symbol]);
+      if (state->failed || distance > state->output_offset ||
+          state->output_size - state->output_offset < length) {
+        return false;
+      }
+
+      // Byte by byte, the copy can overlap its own output
+      for (uint32_t byte_index = 0; byte_index < length; byte_index++) {
+        state->output[state->output_offset] =
+            state->output[state->output_offset - distance];
+        state->output_offset++;
+      }
+    }
+  }
+}
+
+bool inflate_fixed_block(struct inflate_state *state) {
+  static struct inflate_huffman literal_lengths;
+  static struct inflate_huffman distances;
+  static bool are_built = false;
+  if (!are_built) {
+    uint8_t lengths[INFLATE_MAX_LITERAL_LENGTH_CODE_COUNT];
+    int symbol = 0;
+    for (; symbol < 144; symbol++) {
+      lengths[symbol] = 8;
+    }
+    for (; symbol < 256; symbol++) {
+      lengths[symbol] = 9;
+    }
+    for (; symbol < 280; symbol++) {
+      lengths[symbol] = 7;
+    }
+    for (; symbol < INFLATE_MAX_LITERAL_LENGTH_CODE_COUNT; symbol++) {
+      lengths[symbol] = 8;
+    }
+    inflate_huffman_build(&literal_lengths, lengths,
+                          INFLATE_MAX_LITERAL_LENGTH_CODE_COUNT);
+
+    for (symbol = 0; symbol < INFLATE_MAX_DISTANCE_CODE_COUNT; symbol++) {
+      lengths[symbol] = 5;
+    }
+    inflate_huffman_build(&distances, lengths,
+                          INFLATE_MAX_DISTANCE_CODE_COUNT);
+    are_built = true;
+  }
+
+  return inflate_codes(state, &literal_lengths, &distances);
+}
+
+bool inflate_dynamic_block(struct inflate_state *state) {
+  static const uint8_t code_length_order[19] = {
+      16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+  uint32_t literal_length_count = inflate_bits(state, 5) + 257;
+  uint32_t distance_count = inflate_bits(state, 5) + 1;
+  uint32_t code_length_count = inflate_bits(state, 4) + 4;
+  if (state->failed ||
+      literal_length_count > INFLATE_MAX_LITERAL_LENGTH_CODE_COUNT ||
+      distance_count > INFLATE_MAX_DISTANCE_CODE_COUNT) {
+    return false;
+  }
+
+  uint8_t lengths[INFLATE_MAX_LITERAL_LENGTH_CODE_COUNT +
+                  INFLATE_MAX_DISTANCE_CODE_COUNT] = {0};
+  for (uint32_t index = 0; index < code_length_count; index++) {
+    lengths[code_length_order[index]] = inflate_bits(state, 3);
+  }
+
+  struct inflate_huffman code_lengths;
+  if (state->failed || !inflate_huffman_build(&code_lengths, lengths, 19)) {
+    return false;
+  }
+
+  uint32_t length_count = literal_length_count + distance_count;
+  uint32_t index = 0;
+  while (index < length_count) {
+    int symbol = inflate_decode(state, &code_lengths);
+    if (state->failed) {
+      return false;
+    }
+
+    if (symbol < 16) {
+      lengths[index++] = symbol;
+      continue;
+    }
+
+    uint8_t repeated_length = 0;
+    uint32_t repeat_count;
+    if (symbol == 16) {
+      if (index == 0) {
+        return false;
+      }
+      repeated_length = lengths[index - 1];
+      repeat_count = 3 + inflate_bits(state, 2);
+    } else if (symbol == 17) {
+      repeat_count = 3 + inflate_bits(state, 3);
+    } else {
+      repeat_count = 11 + inflate_bits(state, 7);
+    }
+    if (state->failed || index + repeat_count > length_count) {
+      return false;
+    }
+    while (repeat_count-- > 0) {
+      lengths[index++] = repeated_length;
+    }
+  }
+
+  // The end of block code must be reachable
+  if (lengths[256] == 0) {
+    return false;
+  }
+
+  struct inflate_huffman literal_lengths;
+  struct inflate_huffman distances;
+  if (!inflate_huffman_build(&literal_lengths, lengths,
+                             literal_length_count) ||
+      !inflate_huffman_build(&distances, lengths + literal_length_count,
+                             distance_count)) {
+    return false;
+  }
+
+  return inflate_codes(state, &literal_lengths, &distances);
+}
+
+// Decompresses a raw deflate stream into exactly `output_size` bytes
+bool inflate(const uint8_t *input, size_t input_size, uint8_t *output,
+             size_t output_size) {
+  struct inflate_state state = {.input = input,
+                                .input_size = input_size,
+                                .output = output,
+                                .output_size = output_size};
+  bool is_final_block = false;
+  while (!is_final_block) {
+    is_final_block = inflate_bits(&state, 1);
+    uint32_t block_type = inflate_bits(&state, 2);
+    if (state.failed) {
+      return false;
+    }
+
+    bool success;
+    switch (block_type) {
+    case 0:
+      success = inflate_stored_block(&state);
+      break;
+    case 1:
+      success = inflate_fixed_block(&state);
+      break;
+    case 2:
+      success = inflate_dynamic_block(&state);
+      break;
+    default:
+      success = false;
+      break;
+    }
+    if (!success) {
+      return false;
+    }
+  }
+
+  return state.output_offset == output_size;
+}
+
+uint8_t paeth_predictor(uint8_t left, uint8_t up, uint8_t up_left) {
+  int estimate = left + up - up_left;
+  int left_distance = abs(estimate - left);
+  int up_distance = abs(estimate - up);
+  int up_left_distance = abs(estimate - up_left);
+  if (left_distance <= up_distance && left_distance <= up_left_distance) {
+    return left;
+  }
+  return up_distance <= up_left_distance ? up : up_left;
+}
+
+bool unfilter_png_scanlines(uint8_t *data, uint32_t width, uint32_t height,
+                            uint32_t channel_count) {
+  size_t stride = (size_t)width * channel_count;
+  const uint8_t *previous_row = NULL;
+  for (uint32_t y = 0; y < height; y++) {
+    uint8_t filter_type = data[y * (stride + 1)];
+    uint8_t *row = data + y * (stride + 1) + 1;
+    for (size_t x = 0; x < stride; x++) {
+      uint8_t left = x >= channel_count ? row[x - channel_count] : 0;
+      uint8_t up = previous_row ? previous_row[x] : 0;
+      uint8_t up_left =
+          previous_row && x >= channel_count ? previous_row[x - channel_count]
+                                             : 0;
+      switch (filter_type) {
+      case 0:
+        break;
+      case 1:
+        row[x] += left;
+        break;
+      case 2:
+        row[x] += up;
+        break;
+      case 3:
+        row[x] += (left + up) / 2;
+        break;
+      case 4:
+        row[x] += paeth_predictor(left, up, up_left);
+        break;
+      default:
+        fprintf(stderr, "Invalid PNG filter type %u\n", filter_type);
+        return false;
+      }
+    }
+    previous_row = row;
+  }
+
+  return true;
+}
+
+bool parse_png(const uint8_t *data, size_t size, struct image *out_image) {
+  static const uint8_t png_signature[8] = {0x89, 'P',  'N',  'G',
+                                           '\r', '\n', 0x1a, '\n'};
+  if (size < sizeof(png_signature) ||
+      memcmp(data, png_signature, sizeof(png_signature)) != 0) {
+    return false;
+  }
+
+  uint32_t width = 0;
+  uint32_t height = 0;
+  uint32_t channel_count = 0;
+  uint8_t *compressed = NULL;
+  size_t compressed_size = 0;
+  size_t offset = sizeof(png_signature);
+  while (size - offset >= 12) {
+    uint32_t chunk_length = read_u32_be(data + offset);
+    const uint8_t *chunk_type = data + offset + 4;
+    const uint8_t *chunk_data = data + offset + 8;
+    if (chunk_length > size - offset - 12) {
+      fprintf(stderr, "Truncated PNG chunk\n");
+      goto free_compressed;
+    }
+
+    if (memcmp(chunk_type, "IHDR", 4) == 0 && chunk_length == 13) {
+      width = read_u32_be(chunk_data);
+      height = read_u32_be(chunk_data + 4);
+      uint8_t bit_depth = chunk_data[8];
+      uint8_t color_type = chunk_data[9];
+      uint8_t interlace_method = chunk_data[12];
+      static const uint32_t color_type_channel_counts[7] = {1, 0, 3, 0,
+                                                            2, 0, 4};
+      if (bit_depth != 8 || color_type > 6 ||
+          color_type_channel_counts[color_type] == 0 || interlace_method != 0) {
+        fprintf(stderr, "Only 8-bit non-interlaced gray/RGB PNGs are "
+                        "supported\n");
+        goto free_compressed;
+      }
+      channel_count = color_type_channel_counts[color_type];
+    } else if (memcmp(chunk_type, "IDAT", 4) == 0) {
+      uint8_t *grown_compressed =
+          realloc(compressed, compressed_size + chunk_length);
+      if (!grown_compressed) {
+        goto free_compressed;
+      }
+      compressed = grown_compressed;
+      memcpy(compressed + compressed_size, chunk_data, chunk_length);
+      compressed_size += chunk_length;
+    } else if (memcmp(chunk_type, "IEND", 4) == 0) {
+      break;
+    }
+    offset += (size_t)chunk_length + 12;
+  }
+
+  if (channel_count == 0 || width == 0 || height == 0 ||
+      compressed_size < 6) {
+    fprintf(stderr, "Invalid PNG\n");
+    goto free_compressed;
+  }
+
+  // zlib header: deflate, no preset dictionary. The Adler-32 isn't checked.
+  if ((compressed[0] & 0x0fu) != 8 || (compressed[1] & 0x20u) != 0 ||
+      (compressed[0] << 8 | compressed[1]) % 31 != 0) {
+    fprintf(stderr, "Unsupported PNG zlib stream\n");
+    goto free_compressed;
+  }
+
+  size_t raw_size = ((size_t)width * channel_count + 1) * height;
+  uint8_t *raw = malloc(raw_size);
+  if (!raw) {
+    goto free_compressed;
+  }
+
+  if (!inflate(compressed + 2, compressed_size - 2, raw, raw_size)) {
+    fprintf(stderr, "Couldn't decompress PNG data\n");
+    goto free_raw;
+  }
+
+  if (!unfilter_png_scanlines(raw, width, height, channel_count)) {
+    goto free_raw;
+  }
+
+  out_image->pixels = malloc((size_t)width * height * 4);
+  if (!out_image->pixels) {
+    goto free_raw;
+  }
+  out_image->width = width;
+  out_image->height = height;
+  for (uint32_t y = 0; y < height; y++) {
+    const uint8_t *row = raw + y * ((size_t)width * channel_count + 1) + 1;
+    for (uint32_t x = 0; x < width; x++) {
+      const uint8_t *source = row + (size_t)x * channel_count;
+      uint8_t *destination = out_image->pixels + ((size_t)y * width + x) * 4;
+      bool is_gray = channel_count <= 2;
+      destination[0] = source[0];
+      destination[1] = is_gray ? source[0] : source[1];
+      destination[2] = is_gray ? source[0] : source[2];
+      destination[3] = channel_count == 2   ? source[1]
+                       : channel_count == 4 ? source[3]
+                                            : 255;
+    }
+  }
+
+  free(raw);
+  free(compressed);
+  return true;
+free_raw:
+  free(raw);
+free_compressed:
+  free(compressed);
+  return false;
+}
+
+const char *skip_netpbm_whitespace(const char *cursor, const char *end) {
+  while (cursor < end) {
+    if (*cursor == '#') {
+      while (cursor < end && *cursor != '\n') {
+        cursor++;
+      }
+    } else if (*cursor == ' ' || *cursor == '\t' || *cursor == '\n' ||
+               *cursor == '\r') {
+      cursor++;
+    } else {
+      break;
+    }
+  }
+  return cursor;
+}
+
+const char *parse_netpbm_uint(const char *cursor, const char *end,
+                              uint32_t *out_value) {
+  cursor = skip_netpbm_whitespace(cursor, end);
+  if (cursor == end || *cursor < '0' || *cursor > '9') {
+    return NULL;
+  }
+
+  uint64_t value = 0;
+  while (cursor < end && *cursor >= '0' && *cursor <= '9') {
+    value = value * 10 + (uint64_t)(*cursor - '0');
+    if (value > UINT32_MAX) {
+      return NULL;
+    }
+    cursor++;
+  }
+  *out_value = (uint32_t)value;
+  return cursor;
+}
+
+const char *parse_pam_header(const char *cursor, const char *end,
+                             uint32_t *out_width, uint32_t *out_height,
+                             uint32_t *out_depth, uint32_t *out_max_value) {
+  while (true) {
+    cursor = skip_netpbm_whitespace(cursor, end);
+    const char *token = cursor;
+    while (cursor < end && *cursor != ' ' && *cursor != '\t' &&
+           *cursor != '\n' && *cursor != '\r') {
+      cursor++;
+    }
+    size_t token_length = (size_t)(cursor - token);
+
+    if (token_length == 6 && strncmp(token, "ENDHDR", 6) == 0) {
+      // Exactly one newline separates the header from the raster
+      while (cursor < end && *cursor != '\n') {
+        cursor++;
+      }
+      return cursor < end ? cursor + 1 : NULL;
+    } else if (token_length == 5 && strncmp(token, "WIDTH", 5) == 0) {
+      cursor = parse_netpbm_uint(cursor, end, out_width);
+    } else if (token_length == 6 && strncmp(token, "HEIGHT", 6) == 0) {
+      cursor = parse_netpbm_uint(cursor, end, out_height);
+    } else if (token_length == 5 && strncmp(token, "DEPTH", 5) == 0) {
+      cursor = parse_netpbm_uint(cursor, end, out_depth);
+    } else if (token_length == 6 && strncmp(token, "MAXVAL", 6) == 0) {
+      cursor = parse_netpbm_uint(cursor, end, out_max_value);
+    } else if (token_length == 8 && strncmp(token, "TUPLTYPE", 8) == 0) {
+      while (cursor < end && *cursor != '\n') {
+        cursor++;
+      }
+    } else {
+      return NULL;
+    }
+
+    if (!cursor) {
+      return NULL;
+    }
+  }
+}
+
+bool parse_netpbm(const char *data, size_t size, struct image *out_image) {
+  const char *end = data + size;
+  if (size < 2 || data[0] != 'P' || (data[1] != '6' && data[1] != '7')) {
+    return false;
+  }
+
+  uint32_t width = 0;
+  uint32_t height = 0;
+  uint32_t depth = 3;
+  uint32_t max_value = 0;
+  const char *cursor = data + 2;
+  if (data[1] == '6') {
+    cursor = parse_netpbm_uint(cursor, end, &width);
+    cursor = cursor ? parse_netpbm_uint(cursor, end, &height) : NULL;
+    cursor = cursor ? parse_netpbm_uint(cursor, end, &max_value) : NULL;
+    // Exactly one whitespace character before the raster
+    cursor = cursor && cursor < end ? cursor + 1 : NULL;
+  } else {
+    cursor =
+        parse_pam_header(cursor, end, &width, &height, &depth, &max_value);
+  }
+
+  if (!cursor || width == 0 || height == 0 || max_value != 255 ||
+      (depth != 3 && depth != 4)) {
+    fprintf(stderr, "Only 8-bit RGB/RGBA PPM and PAM images are supported\n");
+    return false;
+  }
+
+  size_t pixel_count = (size_t)width * height;
+  if ((size_t)(end - cursor) < pixel_count * depth) {
+    fprintf(stderr, "Truncated image raster\n");
+    return false;
+  }
+
+  out_image->pixels = malloc(pixel_count * 4);
+  if (!out_image->pixels) {
+    return false;
+  }
+  out_image->width = width;
+  out_image->height = height;
+  const uint8_t *raster = (const uint8_t *)cursor;
+  for (size_t pixel_index = 0; pixel_index < pixel_count; pixel_index++) {
+    out_image->pixels[pixel_index * 4 + 0] = raster[pixel_index * depth + 0];
+    out_image->pixels[pixel_index * 4 + 1] = raster[pixel_index * depth + 1];
+    out_image->pixels[pixel_index * 4 + 2] = raster[pixel_index * depth + 2];
+    out_image->pixels[pixel_index * 4 + 3] =
+        depth == 4 ? raster[pixel_index * depth + 3] : 255;
+  }
+  return true;
+}
+
+bool load_image(const char *path, struct image *out_image) {
+  size_t file_size;
+  char *file_content = read_file(path, &file_size);
+  if (!file_content) {
+    fprintf(stderr, "Couldn't read %s\n", path);
+    return false;
+  }
+
+  bool success =
+      parse_png((const uint8_t *)file_content, file_size, out_image) ||
+      parse_netpbm(file_content, file_size, out_image);
+  if (!success) {
+    fprintf(stderr, "Couldn't parse %s\n", path);
+  }
+  free(file_content);
+  return success;
+}
+
+void print_usage(void) {
+  fprintf(stderr, "usage: vkguide-image-diff [--threshold <0-255>] "
+                  "[--max-different-pixels <count>] "
+                  "[--diff <output.png|ppm>] <a> <b>\n");
+}
+
+int main(int argc, char **argv) {
+  uint32_t threshold = 0;
+  uint64_t max_different_pixel_count = 0;
+  const char *diff_path = NULL;
+  const char *paths[2];
+  int path_count = 0;
+  for (int arg_index = 1; arg_index < argc; arg_index++) {
+    bool has_value = arg_index + 1 < argc;
+    if (strcmp(argv[arg_index], "--threshold") == 0 && has_value) {
+      threshold = (uint32_t)strtoul(argv[++arg_index], NULL, 10);
+    } else if (strcmp(argv[arg_index], "--max-different-pixels") == 0 &&
+               has_value) {
+      max_different_pixel_count = strtoull(argv[++arg_index], NULL, 10);
+    } else if (strcmp(argv[arg_index], "--diff") == 0 && has_value) {
+      diff_path = argv[++arg_index];
+    } else if (path_count < 2 && argv[arg_index][0] != '-') {
+      paths[path_count++] = argv[arg_index];
+    } else {
+      print_usage();
+      return 2;
+    }
+  }
+
+  if (path_count != 2) {
+    print_usage();
+    return 2;
+  }
+
+  int exit_code = 2;
+  struct image images[2];
+  if (!load_image(paths[0], &images[0])) {
+    goto err;
+  }
+  if (!load_image(paths[1], &images[1])) {
+    goto free_first_image;
+  }
+
+  if (images[0].width != images[1].width ||
+      images[0].height != images[1].height) {
+    printf("size mismatch: %ux%u vs %ux%u\n", images[0].width,
+           images[0].height, images[1].width, images[1].height);
+    exit_code = 1;
+    goto free_second_image;
+  }
+
+  uint32_t width = images[0].width;
+  uint32_t height = images[0].height;
+  size_t pixel_count = (size_t)width * height;
+  uint8_t *diff_pixels = NULL;
+  if (diff_path) {
+    diff_pixels = malloc(pixel_count * 4);
+    if (!diff_pixels) {
+      goto free_second_image;
+    }
+  }
+
+  uint64_t different_pixel_count = 0;
+  uint32_t max_channel_difference = 0;
+  double squared_error_sum = 0.0;
+  for (size_t pixel_index = 0; pixel_index < pixel_count; pixel_index++) {
+    const uint8_t *a = images[0].pixels + pixel_index * 4;
+    const uint8_t *b = images[1].pixels + pixel_index * 4;
+    uint32_t pixel_max_difference = 0;
+    for (int channel = 0; channel < 3; channel++) {
+      uint32_t difference = (uint32_t)abs(a[channel] - b[channel]);
+      squared_error_sum += (double)difference * difference;
+      if (difference > pixel_max_difference) {
+        pixel_max_difference = difference;
+      }
+    }
+
+    bool is_different = pixel_max_difference > threshold;
+    different_pixel_count += is_different;
+    if (pixel_max_difference > max_channel_difference) {
+      max_channel_difference = pixel_max_difference;
+    }
+
+    // Differences in red over a dimmed grayscale version of the first image
+    if (diff_pixels) {
+      uint8_t gray = (uint8_t)((a[0] * 77 + a[1] * 150 + a[2] * 29) >> 10);
+      uint8_t *diff_pixel = diff_pixels + pixel_index * 4;
+      diff_pixel[0] = is_different ? 255 : gray;
+      diff_pixel[1] = is_different ? 0 : gray;
+      diff_pixel[2] = is_different ? 0 : gray;
+      diff_pixel[3] = 255;
+    }
+  }
+
+  double mean_squared_error = squared_error_sum / ((double)pixel_count * 3);
+  double psnr = mean_squared_error > 0.0
+                    ? 10.0 * log10(255.0 * 255.0 / mean_squared_error)
+                    : INFINITY;
+  printf("different pixels: %llu / %zu (threshold %u), max channel "
+         "difference: %u, PSNR: %.2f dB\n",
+         (unsigned long long)different_pixel_count, pixel_count, threshold,
+         max_channel_difference, psnr);
+
+  if (diff_pixels) {
+    if (!image_file_write(diff_path, width, height, diff_pixels,
+                          IMAGE_FILE_CHANNEL_ORDER_RGBA)) {
+      fprintf(stderr, "Couldn't write %s\n", diff_path);
+      goto free_diff_pixels;
+    }
+  }
+
+  exit_code = different_pixel_count > max_different_pixel_count ? 1 : 0;
+free_diff_pixels:
+  free(diff_pixels);
+free_second_image:
+  free(images[1].pixels);
+free_first_image:
+  free(images[0].pixels);
+err:
+  return exit_code;
+}
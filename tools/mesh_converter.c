@@ -0,0 +1,1299 @@
+// Offline converter from Wavefront OBJ to the .vkm container described in
+// src/mesh_format.h.
+//
+// The geometry goes through the same steps as meshoptimizer's recommended
+// pipeline:
+// - vertex cache optimization (Tom Forsyth's linear-speed algorithm)
+// - overdraw optimization (clusters sorted front-to-back around the mesh
+//   centroid, keeping the vertex cache efficiency within a threshold)
+// - vertex fetch optimization (vertices reordered by first use)
+// - attribute quantization (16-bit positions, octahedral normals, half UVs)
+// - meshlet generation over the final triangle order, with a bounding sphere
+//   and a normal cone per meshlet for GPU culling
+//
+// usage: vkguide-mesh-converter <input.obj> <output.vkm>
+
+#include "mesh_format.h"
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_FACE_CORNER_COUNT 64
+#define VERTEX_CACHE_SIZE 32
+#define SIMULATED_VERTEX_CACHE_SIZE 16
+#define OVERDRAW_CACHE_THRESHOLD 1.05f
+
+struct converter_vertex {
+  float position[3];
+  float normal[3];
+  float uv[2];
+};
+
+struct obj_corner {
+  int32_t position_index;
+  int32_t uv_index;
+  int32_t normal_index;
+};
+
+struct converter_mesh {
+  struct converter_vertex *vertices;
+  size_t vertex_count;
+  uint32_t *indices;
+  size_t index_count;
+};
+
+struct converter_meshlets {
+  struct mesh_meshlet *meshlets;
+  size_t meshlet_count;
+  uint32_t *vertices;
+  size_t vertex_count;
+  // One packed triangle per triangle of the index buffer
+  uint32_t *triangles;
+};
+
+bool grow_array(void **data, size_t *capacity, size_t required_count,
+                size_t element_size) {
+  if (required_count <= *capacity) {
+    return true;
+  }
+
+  size_t new_capacity = *capacity ? *capacity : 64;
+  while (new_capacity < required_count) {
+    new_capacity *= 2;
+  }
+
+  void *new_data = realloc(*data, new_capacity * element_size);
+  if (!new_data) {
+    return false;
+  }
+  *data = new_data;
+  *capacity = new_capacity;
+  return true;
+}
+
+char *read_file(const char *path, size_t *out_size) {
+  FILE *file_handle = fopen(path, "rb");
+  if (!file_handle) {
+    goto err;
+  }
+
+  if (fseek(file_handle, 0, SEEK_END) < 0) {
+    goto close_file;
+  }
+
+  long file_size = ftell(file_handle);
+  if (file_size < 0) {
+    goto close_file;
+  }
+  rewind(file_handle);
+
+  char *file_content = malloc(file_size + 1);
+  if (!file_content) {
+    goto close_file;
+  }
+  if (file_size > 0 && fread(file_content, file_size, 1, file_handle) != 1) {
+    goto free_file_content;
+  }
+  file_content[file_size] = '\0';
+
+  fclose(file_handle);
+  *out_size = file_size;
+  return file_content;
+free_file_content:
+  free(file_content);
+close_file:
+  fclose(file_handle);
+err:
+  return NULL;
+}
+
+uint64_t hash_obj_corner(const struct obj_corner *corner) {
+  uint64_t hash = 14695981039346656037ull;
+  const int32_t values[] = {corner->position_index, corner->uv_index,
+                            corner->normal_index};
+  for (size_t value_index = 0; value_index < 3; value_index++) {
+    hash ^= (uint32_t)values[value_index];
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+// Resolves a 1-based (or negative, relative) OBJ index into a 0-based one.
+// Returns -1 when the index is absent or out of range.
+int32_t resolve_obj_index(long index, size_t count) {
+  if (index > 0 && (size_t)index <= count) {
+    return (int32_t)(index - 1);
+  }
+  if (index < 0 && (size_t)(-index) <= count) {
+    return (int32_t)(count + index);
+  }
+  return -1;
+}
+
+// Parses "p", "p/t", "p//n" or "p/t/n"
+const char *parse_obj_corner(const char *cursor, size_t position_count,
+                             size_t uv_count, size_t normal_count,
+                             struct obj_corner *out_corner) {
+  char *end;
+  long position_index = strtol(cursor, &end, 10);
+  if (end == cursor) {
+    return NULL;
+  }
+  cursor = end;
+  out_corner->position_index = resolve_obj_index(position_index, position_count);
+  out_corner->uv_index = -1;
+  out_corner->normal_index = -1;
+  if (out_corner->position_index < 0) {
+    return NULL;
+  }
+
+  if (*cursor == '/') {
+    cursor++;
+    if (*cursor != '/') {
+      long uv_index = strtol(cursor, &end, 10);
+      if (end != cursor) {
+        out_corner->uv_index = resolve_obj_index(uv_index, uv_count);
+      }
+      cursor = end;
+    }
+    if (*cursor == '/') {
+      cursor++;
+      long normal_index = strtol(cursor, &end, 10);
+      if (end != cursor) {
+        out_corner->normal_index = resolve_obj_index(normal_index, normal_count);
+      }
+      cursor = end;
+    }
+  }
+
+  return cursor;
+}
+
+struct vertex_lookup {
+  struct obj_corner *keys;
+  uint32_t *values;
+  size_t capacity;
+};
+
+bool vertex_lookup_init(struct vertex_lookup *lookup, size_t capacity) {
+  lookup->capacity = capacity;
+  lookup->keys = malloc(capacity * sizeof(struct obj_corner));
+  lookup->values = malloc(capacity * sizeof(uint32_t));
+  if (!lookup->keys || !lookup->values) {
+    free(lookup->keys);
+    free(lookup->values);
+    return false;
+  }
+  for (size_t slot = 0; slot < capacity; slot++) {
+    lookup->keys[slot].position_index = -1;
+  }
+  return true;
+}
+
+void vertex_lookup_deinit(struct vertex_lookup *lookup) {
+  free(lookup->keys);
+  free(lookup->values);
+}
+
+bool vertex_lookup_rehash(struct vertex_lookup *lookup) {
+  struct vertex_lookup grown;
+  if (!vertex_lookup_init(&grown, lookup->capacity * 2)) {
+    return false;
+  }
+  for (size_t slot = 0; slot < lookup->capacity; slot++) {
+    if (lookup->keys[slot].position_index < 0) {
+      continue;
+    }
+    size_t grown_slot =
+        hash_obj_corner(&lookup->keys[slot]) & (grown.capacity - 1);
+    while (grown.keys[grown_slot].position_index >= 0) {
+      grown_slot = (grown_slot + 1) & (grown.capacity - 1);
+    }
+    grown.keys[grown_slot] = lookup->keys[slot];
+    grown.values[grown_slot] = lookup->values[slot];
+  }
+  vertex_lookup_deinit(lookup);
+  *lookup = grown;
+  return true;
+}
+
+// Parses the OBJ text into an indexed triangle list. Faces are fan
+// triangulated and corners sharing the same position/uv/normal triplet are
+// merged into a single vertex.
+bool parse_obj(const char *text, struct converter_mesh *out_mesh) {
+  float *positions = NULL;
+  size_t position_count = 0;
+  size_t position_capacity = 0;
+  float *uvs = NULL;
+  size_t uv_count = 0;
+  size_t uv_capacity = 0;
+  float *normals = NULL;
+  size_t normal_count = 0;
+  size_t normal_capacity = 0;
+
+  struct converter_vertex *vertices = NULL;
+  int32_t *vertex_position_indices = NULL;
+  bool *vertex_has_normal = NULL;
+  size_t vertex_count = 0;
+  size_t vertex_capacity = 0;
+  size_t vertex_position_index_capacity = 0;
+  size_t vertex_has_normal_capacity = 0;
+  uint32_t *indices = NULL;
+  size_t index_count = 0;
+  size_t index_capacity = 0;
+  bool success = false;
+
+  struct vertex_lookup lookup;
+  if (!vertex_lookup_init(&lookup, 1024)) {
+    return false;
+  }
+
+  const char *line = text;
+  while (*line) {
+    const char *line_end = strchr(line, '\n');
+    if (!line_end) {
+      line_end = line + strlen(line);
+    }
+
+    if (line[0] == 'v' && line[1] == ' ') {
+      if (!grow_array((void **)&positions, &position_capacity,
+                      (position_count + 1) * 3, sizeof(float))) {
+        goto out;
+      }
+      char *cursor = (char *)line + 2;
+      for (int component = 0; component < 3; component++) {
+        positions[position_count * 3 + component] = strtof(cursor, &cursor);
+      }
+      position_count++;
+    } else if (line[0] == 'v' && line[1] == 't' && line[2] == ' ') {
+      if (!grow_array((void **)&uvs, &uv_capacity, (uv_count + 1) * 2,
+                      sizeof(float))) {
+        goto out;
+      }
+      char *cursor = (char *)line + 3;
+      uvs[uv_count * 2 + 0] = strtof(cursor, &cursor);
+      // OBJ has its texture origin at the bottom left
+      uvs[uv_count * 2 + 1] = 1.0f - strtof(cursor, &cursor);
+      uv_count++;
+    } else if (line[0] == 'v' && line[1] == 'n' && line[2] == ' ') {
+      if (!grow_array((void **)&normals, &normal_capacity,
+                      (normal_count + 1) * 3, sizeof(float))) {
+        goto out;
+      }
+      char *cursor = (char *)line + 3;
+      for (int component = 0; component < 3; component++) {
+        normals[normal_count * 3 + component] = strtof(cursor, &cursor);
+      }
+      normal_count++;
+    } else if (line[0] == 'f' && line[1] == ' ') {
+      uint32_t face_vertices[MAX_FACE_CORNER_COUNT];
+      uint32_t face_corner_count = 0;
+      const char *cursor = line + 2;
+      while (cursor < line_end) {
+        while (cursor < line_end && (*cursor == ' ' || *cursor == '\t' ||
+                                     *cursor == '\r')) {
+          cursor++;
+        }
+        if (cursor >= line_end) {
+          break;
+        }
+
+        struct obj_corner corner;
+        cursor = parse_obj_corner(cursor, position_count, uv_count,
+                                  normal_count, &corner);
+        if (!cursor) {
+          fprintf(stderr, "Invalid face definition: %.*s\n",
+                  (int)(line_end - line), line);
+          goto out;
+        }
+        if (face_corner_count == MAX_FACE_CORNER_COUNT) {
+          fprintf(stderr, "Faces with more than %d corners aren't supported\n",
+                  MAX_FACE_CORNER_COUNT);
+          goto out;
+        }
+
+        // Keep the load factor under 1/2
+        if ((vertex_count + 1) * 2 > lookup.capacity &&
+            !vertex_lookup_rehash(&lookup)) {
+          goto out;
+        }
+        size_t slot = hash_obj_corner(&corner) & (lookup.capacity - 1);
+        while (lookup.keys[slot].position_index >= 0 &&
+               memcmp(&lookup.keys[slot], &corner, sizeof(corner)) != 0) {
+          slot = (slot + 1) & (lookup.capacity - 1);
+        }
+
+        if (lookup.keys[slot].position_index < 0) {
+          if (!grow_array((void **)&vertices, &vertex_capacity,
+                          vertex_count + 1, sizeof(struct converter_vertex)) ||
+              !grow_array((void **)&vertex_position_indices,
+                          &vertex_position_index_capacity, vertex_count + 1,
+                          sizeof(int32_t)) ||
+              !grow_array((void **)&vertex_has_normal,
+                          &vertex_has_normal_capacity, vertex_count + 1,
+                          sizeof(bool))) {
+            goto out;
+          }
+
+          struct converter_vertex *vertex = &vertices[vertex_count];
+          *vertex = (struct converter_vertex){0};
+          memcpy(vertex->position, &positions[corner.position_index * 3],
+                 sizeof(vertex->position));
+          if (corner.uv_index >= 0) {
+            memcpy(vertex->uv, &uvs[corner.uv_index * 2], sizeof(vertex->uv));
+          }
+          if (corner.normal_index >= 0) {
+            memcpy(vertex->normal, &normals[corner.normal_index * 3],
+                   sizeof(vertex->normal));
+          }
+          vertex_position_indices[vertex_count] = corner.position_index;
+          vertex_has_normal[vertex_count] = corner.normal_index >= 0;
+
+          lookup.keys[slot] = corner;
+          lookup.values[slot] = (uint32_t)vertex_count;
+          vertex_count++;
+        }
+
+        face_vertices[face_corner_count++] = lookup.values[slot];
+      }
+
+      for (uint32_t corner_index = 1; corner_index + 1 < face_corner_count;
+           corner_index++) {
+        uint32_t a = face_vertices[0];
+        uint32_t b = face_vertices[corner_index];
+        uint32_t c = face_vertices[corner_index + 1];
+        if (a == b || b == c || a == c) {
+          continue;
+        }
+        if (!grow_array((void **)&indices, &index_capacity, index_count + 3,
+                        sizeof(uint32_t))) {
+          goto out;
+        }
+        indices[index_count++] = a;
+        indices[index_count++] = b;
+        indices[index_count++] = c;
+      }
+    }
+
+    line = *line_end ? line_end + 1 : line_end;
+  }
+
+  if (index_count == 0) {
+    fprintf(stderr, "The OBJ file doesn't contain any triangle\n");
+    goto out;
+  }
+
+  // Generate smooth normals for the vertices the file didn't provide one for,
+  // accumulating area weighted face normals per OBJ position.
+  float *position_normals = calloc(position_count * 3, sizeof(float));
+  if (!position_normals) {
+    goto out;
+  }
+  for (size_t index = 0; index < index_count; index += 3) {
+    const float *p0 = vertices[indices[index + 0]].position;
+    const float *p1 = vertices[indices[index + 1]].position;
+    const float *p2 = vertices[indices[index + 2]].position;
+    float e1[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+    float e2[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+    float face_normal[3] = {e1[1] * e2[2] - e1[2] * e2[1],
+                            e1[2] * e2[0] - e1[0] * e2[2],
+                            e1[0] * e2[1] - e1[1] * e2[0]};
+    for (int corner = 0; corner < 3; corner++) {
+      int32_t position_index = vertex_position_indices[indices[index + corner]];
+      for (int component = 0; component < 3; component++) {
+        position_normals[position_index * 3 + component] +=
+            face_normal[component];
+      }
+    }
+  }
+  for (size_t vertex_index = 0; vertex_index < vertex_count; vertex_index++) {
+    if (!vertex_has_normal[vertex_index]) {
+      memcpy(vertices[vertex_index].normal,
+             &position_normals[vertex_position_indices[vertex_index] * 3],
+             sizeof(vertices[vertex_index].normal));
+    }
+  }
+  free(position_normals);
+
+  out_mesh->vertices = vertices;
+  out_mesh->vertex_count = vertex_count;
+  out_mesh->indices = indices;
+  out_mesh->index_count = index_count;
+  vertices = NULL;
+  indices = NULL;
+  success = true;
+
+out:
+  vertex_lookup_deinit(&lookup);
+  free(vertex_has_normal);
+  free(vertex_position_indices);
+  free(indices);
+  free(vertices);
+  free(normals);
+  free(uvs);
+  free(positions);
+  return success;
+}
+
+// Simulated FIFO post-transform cache, returns the number of misses the
+// triangle caused
+uint32_t simulate_vertex_cache(const uint32_t *triangle,
+                               uint32_t *cache_timestamps, uint32_t *timestamp) {
+  uint32_t miss_count = 0;
+  for (int corner = 0; corner < 3; corner++) {
+    uint32_t vertex = triangle[corner];
+    if (*timestamp - cache_timestamps[vertex] > SIMULATED_VERTEX_CACHE_SIZE) {
+      cache_timestamps[vertex] = (*timestamp)++;
+      miss_count++;
+    }
+  }
+  return miss_count;
+}
+
+void reset_simulated_vertex_cache(uint32_t *timestamp) {
+  *timestamp += SIMULATED_VERTEX_CACHE_SIZE + 1;
+}
+
+// Average cache miss ratio: transformed vertices per triangle
+float compute_acmr(const uint32_t *indices, size_t index_count,
+                   size_t vertex_count) {
+  uint32_t *cache_timestamps = calloc(vertex_count, sizeof(uint32_t));
+  if (!cache_timestamps) {
+    return 0.0f;
+  }
+  uint32_t timestamp = SIMULATED_VERTEX_CACHE_SIZE + 1;
+  size_t miss_count = 0;
+  for (size_t index = 0; index < index_count; index += 3) {
+    miss_count +=
+        simulate_vertex_cache(&indices[index], cache_timestamps, &timestamp);
+  }
+  free(cache_timestamps);
+  return (float)miss_count / (float)(index_count / 3);
+}
+
+float forsyth_vertex_score(int32_t cache_position, uint32_t remaining_valence) {
+  if (remaining_valence == 0) {
+    return -1.0f;
+  }
+
+  float score = 0.0f;
+  if (cache_position >= 0) {
+    if (cache_position < 3) {
+      // The most recent triangle should not get a bonus, it's already as cheap
+      // as it gets
+      score = 0.75f;
+    } else {
+      float scaler = 1.0f / (VERTEX_CACHE_SIZE - 3);
+      score = powf(1.0f - (float)(cache_position - 3) * scaler, 1.5f);
+    }
+  }
+
+  // Bonus for vertices with few remaining triangles, so that lone triangles
+  // get cleared out instead of being left behind
+  score += 2.0f * powf((float)remaining_valence, -0.5f);
+  return score;
+}
+
+bool optimize_vertex_cache(uint32_t *indices, size_t index_count,
+                           size_t vertex_count) {
+  size_t triangle_count = index_count / 3;
+  bool success = false;
+
+  uint32_t *triangle_offsets = calloc(vertex_count + 1, sizeof(uint32_t));
+  uint32_t *remaining_valences = calloc(vertex_count, sizeof(uint32_t));
+  uint32_t *vertex_triangles = malloc(index_count * sizeof(uint32_t));
+  int32_t *cache_positions = malloc(vertex_count * sizeof(int32_t));
+  float *vertex_scores = malloc(vertex_count * sizeof(float));
+  float *triangle_scores = malloc(triangle_count * sizeof(float));
+  bool *triangle_emitted = calloc(triangle_count, sizeof(bool));
+  uint32_t *output = malloc(index_count * sizeof(uint32_t));
+  if (!triangle_offsets || !remaining_valences || !vertex_triangles ||
+      !cache_positions || !vertex_scores || !triangle_scores ||
+      !triangle_emitted || !output) {
+    goto out;
+  }
+
+  for (size_t index = 0; index < index_count; index++) {
+    remaining_valences[indices[index]]++;
+  }
+  for (size_t vertex = 0; vertex < vertex_count; vertex++) {
+    triangle_offsets[vertex + 1] =
+        triangle_offsets[vertex] + remaining_valences[vertex];
+    remaining_valences[vertex] = 0;
+  }
+  for (size_t triangle = 0; triangle < triangle_count; triangle++) {
+    for (int corner = 0; corner < 3; corner++) {
+      uint32_t vertex = indices[triangle * 3 + corner];
+      vertex_triangles[triangle_offsets[vertex] +
+                       remaining_valences[vertex]++] = (uint32_t)triangle;
+    }
+  }
+
+  for (size_t vertex = 0; vertex < vertex_count; vertex++) {
+    cache_positions[vertex] = -1;
+    vertex_scores[vertex] = forsyth_vertex_score(-1, remaining_valences[vertex]);
+  }
+
+  uint32_t best_triangle = UINT32_MAX;
+  float best_score = -1.0f;
+  for (size_t triangle = 0; triangle < triangle_count; triangle++) {
+    triangle_scores[triangle] = vertex_scores[indices[triangle * 3 + 0]] +
+                                vertex_scores[indices[triangle * 3 + 1]] +
+                                vertex_scores[indices[triangle * 3 + 2]];
+    if (triangle_scores[triangle] > best_score) {
+      best_score = triangle_scores[triangle];
+      best_triangle = (uint32_t)triangle;
+    }
+  }
+
+  uint32_t cache[VERTEX_CACHE_SIZE + 3];
+  uint32_t cache_count = 0;
+  size_t scan_cursor = 0;
+  for (size_t output_triangle = 0; output_triangle < triangle_count;
+       output_triangle++) {
+    if (best_triangle == UINT32_MAX) {
+      // Nothing in the cache is connected to remaining triangles, restart from
+      // the best remaining one
+      best_score = -1.0f;
+      while (scan_cursor < triangle_count && triangle_emitted[scan_cursor]) {
+        scan_cursor++;
+      }
+      for (size_t triangle = scan_cursor; triangle < triangle_count;
+           triangle++) {
+        if (!triangle_emitted[triangle] &&
+            triangle_scores[triangle] > best_score) {
+          best_score = triangle_scores[triangle];
+          best_triangle = (uint32_t)triangle;
+        }
+      }
+    }
+
+    const uint32_t *triangle_vertices = &indices[best_triangle * 3];
+    memcpy(&output[output_triangle * 3], triangle_vertices,
+           3 * sizeof(uint32_t));
+    triangle_emitted[best_triangle] = true;
+
+    for (int corner = 0; corner < 3; corner++) {
+      uint32_t vertex = triangle_vertices[corner];
+      uint32_t *triangles = &vertex_triangles[triangle_offsets[vertex]];
+      for (uint32_t triangle_index = 0;
+           triangle_index < remaining_valences[vertex]; triangle_index++) {
+        if (triangles[triangle_index] == best_triangle) {
+          triangles[triangle_index] =
+              triangles[remaining_valences[vertex] - 1];
+          remaining_valences[vertex]--;
+          break;
+        }
+      }
+    }
+
+    uint32_t new_cache[VERTEX_CACHE_SIZE + 3];
+    uint32_t new_cache_count = 0;
+    for (int corner = 0; corner < 3; corner++) {
+      new_cache[new_cache_count++] = triangle_vertices[corner];
+    }
+    for (uint32_t cache_index = 0; cache_index < cache_count; cache_index++) {
+      uint32_t vertex = cache[cache_index];
+      if (vertex != triangle_vertices[0] && vertex != triangle_vertices[1] &&
+          vertex != triangle_vertices[2]) {
+        new_cache[new_cache_count++] = vertex;
+      }
+    }
+
+    for (uint32_t cache_index = 0; cache_index < new_cache_count;
+         cache_index++) {
+      uint32_t vertex = new_cache[cache_index];
+      cache_positions[vertex] =
+          cache_index < VERTEX_CACHE_SIZE ? (int32_t)cache_index : -1;
+      vertex_scores[vertex] = forsyth_vertex_score(cache_positions[vertex],
+                                                   remaining_valences[vertex]);
+    }
+
+    best_triangle = UINT32_MAX;
+    best_score = -1.0f;
+    for (uint32_t cache_index = 0; cache_index < new_cache_count;
+         cache_index++) {
+      uint32_t vertex = new_cache[cache_index];
+      const uint32_t *triangles = &vertex_triangles[triangle_offsets[vertex]];
+      for (uint32_t triangle_index = 0;
+           triangle_index < remaining_valences[vertex]; triangle_index++) {
+        uint32_t triangle = triangles[triangle_index];
+        triangle_scores[triangle] = vertex_scores[indices[triangle * 3 + 0]] +
+                                    vertex_scores[indices[triangle * 3 + 1]] +
+                                    vertex_scores[indices[triangle * 3 + 2]];
+        if (triangle_scores[triangle] > best_score) {
+          best_score = triangle_scores[triangle];
+          best_triangle = triangle;
+        }
+      }
+    }
+
+    cache_count = new_cache_count < VERTEX_CACHE_SIZE ? new_cache_count
+                                                      : VERTEX_CACHE_SIZE;
+    memcpy(cache, new_cache, cache_count * sizeof(uint32_t));
+  }
+
+  memcpy(indices, output, index_count * sizeof(uint32_t));
+  success = true;
+out:
+  free(output);
+  free(triangle_emitted);
+  free(triangle_scores);
+  free(vertex_scores);
+  free(cache_positions);
+  free(vertex_triangles);
+  free(remaining_valences);
+  free(triangle_offsets);
+  return success;
+}
+
+struct overdraw_cluster {
+  size_t first_triangle;
+  size_t triangle_count;
+  float sort_key;
+};
+
+int compare_overdraw_clusters(const void *lhs, const void *rhs) {
+  const struct overdraw_cluster *a = lhs;
+  const struct overdraw_cluster *b = rhs;
+  // Descending: clusters facing away from the mesh center, i.e. the most
+  // likely occluders, are drawn first
+  return (a->sort_key < b->sort_key) - (a->sort_key > b->sort_key);
+}
+
+// Splits the cache optimized triangle order into clusters and reorders them so
+// that outward facing clusters come first. Clusters start where the cache got
+// flushed (hard boundaries) and are further split where doing so keeps the
+// cache miss ratio within OVERDRAW_CACHE_THRESHOLD of the original order.
+bool optimize_overdraw(uint32_t *indices, size_t index_count,
+                       const struct converter_vertex *vertices,
+                       size_t vertex_count) {
+  size_t triangle_count = index_count / 3;
+  bool success = false;
+
+  uint32_t *cache_timestamps = calloc(vertex_count, sizeof(uint32_t));
+  size_t *hard_boundaries = malloc((triangle_count + 1) * sizeof(size_t));
+  struct overdraw_cluster *clusters =
+      malloc(triangle_count * sizeof(struct overdraw_cluster));
+  uint32_t *output = malloc(index_count * sizeof(uint32_t));
+  if (!cache_timestamps || !hard_boundaries || !clusters || !output) {
+    goto out;
+  }
+
+  uint32_t timestamp = SIMULATED_VERTEX_CACHE_SIZE + 1;
+  size_t hard_boundary_count = 0;
+  for (size_t triangle = 0; triangle < triangle_count; triangle++) {
+    uint32_t miss_count = simulate_vertex_cache(
+        &indices[triangle * 3], cache_timestamps, &timestamp);
+    if (triangle == 0 || miss_count == 3) {
+      hard_boundaries[hard_boundary_count++] = triangle;
+    }
+  }
+  hard_boundaries[hard_boundary_count] = triangle_count;
+
+  size_t cluster_count = 0;
+  for (size_t hard_cluster = 0; hard_cluster < hard_boundary_count;
+       hard_cluster++) {
+    size_t begin = hard_boundaries[hard_cluster];
+    size_t end = hard_boundaries[hard_cluster + 1];
+
+    reset_simulated_vertex_cache(&timestamp);
+    size_t cluster_miss_count = 0;
+    for (size_t triangle = begin; triangle < end; triangle++) {
+      cluster_miss_count += simulate_vertex_cache(
+          &indices[triangle * 3], cache_timestamps, &timestamp);
+    }
+    float threshold = (float)cluster_miss_count / (float)(end - begin) *
+                      OVERDRAW_CACHE_THRESHOLD;
+
+    reset_simulated_vertex_cache(&timestamp);
+    size_t cluster_begin = begin;
+    size_t miss_count = 0;
+    for (size_t triangle = begin; triangle < end; triangle++) {
+      miss_count += simulate_vertex_cache(&indices[triangle * 3],
+                                          cache_timestamps, &timestamp);
+      size_t cluster_triangle_count = triangle + 1 - cluster_begin;
+      if (triangle + 1 == end ||
+          (float)miss_count / (float)cluster_triangle_count <= threshold) {
+        clusters[cluster_count++] = (struct overdraw_cluster){
+            .first_triangle = cluster_begin,
+            .triangle_count = cluster_triangle_count};
+        cluster_begin = triangle + 1;
+        miss_count = 0;
+        reset_simulated_vertex_cache(&timestamp);
+      }
+    }
+  }
+
+  // Area weighted centroid of the whole mesh
+  double mesh_centroid[3] = {0.0, 0.0, 0.0};
+  double mesh_area = 0.0;
+  for (size_t triangle = 0; triangle < triangle_count; triangle++) {
+    const float *p0 = vertices[indices[triangle * 3 + 0]].position;
+    const float *p1 = vertices[indices[triangle * 3 + 1]].position;
+    const float *p2 = vertices[indices[triangle * 3 + 2]].position;
+    float e1[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+    float e2[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+    float n[3] = {e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2],
+                  e1[0] * e2[1] - e1[1] * e2[0]};
+    double area = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+    for (int component = 0; component < 3; component++) {
+      mesh_centroid[component] +=
+          area * (p0[component] + p1[component] + p2[component]) / 3.0;
+    }
+    mesh_area += area;
+  }
+  for (int component = 0; component < 3; component++) {
+    mesh_centroid[component] /= mesh_area > 0.0 ? mesh_area : 1.0;
+  }
+
+  for (size_t cluster_index = 0; cluster_index < cluster_count;
+       cluster_index++) {
+    struct overdraw_cluster *cluster = &clusters[cluster_index];
+    double centroid[3] = {0.0, 0.0, 0.0};
+    double normal[3] = {0.0, 0.0, 0.0};
+    double area_sum = 0.0;
+    for (size_t triangle = cluster->first_triangle;
+         triangle < cluster->first_triangle + cluster->triangle_count;
+         triangle++) {
+      const float *p0 = vertices[indices[triangle * 3 + 0]].position;
+      const float *p1 = vertices[indices[triangle * 3 + 1]].position;
+      const float *p2 = vertices[indices[triangle * 3 + 2]].position;
+      float e1[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+      float e2[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+      float n[3] = {e1[1] * e2[2] - e1[2] * e2[1],
+                    e1[2] * e2[0] - e1[0] * e2[2],
+                    e1[0] * e2[1] - e1[1] * e2[0]};
+      double area = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+      for (int component = 0; component < 3; component++) {
+        centroid[component] +=
+            area * (p0[component] + p1[component] + p2[component]) / 3.0;
+        normal[component] += n[component];
+      }
+      area_sum += area;
+    }
+
+    double normal_length = sqrt(normal[0] * normal[0] + normal[1] * normal[1] +
+                                normal[2] * normal[2]);
+    double inverse_area = area_sum > 0.0 ? 1.0 / area_sum : 0.0;
+    double inverse_normal_length =
+        normal_length > 0.0 ? 1.0 / normal_length : 0.0;
+    double sort_key = 0.0;
+    for (int component = 0; component < 3; component++) {
+      sort_key +=
+          (centroid[component] * inverse_area - mesh_centroid[component]) *
+          normal[component] * inverse_normal_length;
+    }
+    cluster->sort_key = (float)sort_key;
+  }
+
+  qsort(clusters, cluster_count, sizeof(struct overdraw_cluster),
+        compare_overdraw_clusters);
+
+  size_t output_index_count = 0;
+  for (size_t cluster_index = 0; cluster_index < cluster_count;
+       cluster_index++) {
+    const struct overdraw_cluster *cluster = &clusters[cluster_index];
+    memcpy(&output[output_index_count], &indices[cluster->first_triangle * 3],
+           cluster->triangle_count * 3 * sizeof(uint32_t));
+    output_index_count += cluster->triangle_count * 3;
+  }
+  memcpy(indices, output, index_count * sizeof(uint32_t));
+  success = true;
+
+out:
+  free(output);
+  free(clusters);
+  free(hard_boundaries);
+  free(cache_timestamps);
+  return success;
+}
+
+// Reorders vertices by first use in the index buffer so vertex fetches are as
+// linear as possible. Unreferenced vertices are dropped.
+bool optimize_vertex_fetch(struct converter_mesh *mesh) {
+  uint32_t *remap = malloc(mesh->vertex_count * sizeof(uint32_t));
+  struct converter_vertex *vertices =
+      malloc(mesh->vertex_count * sizeof(struct converter_vertex));
+  if (!remap || !vertices) {
+    free(remap);
+    free(vertices);
+    return false;
+  }
+  memset(remap, 0xff, mesh->vertex_count * sizeof(uint32_t));
+
+  uint32_t next_vertex = 0;
+  for (size_t index = 0; index < mesh->index_count; index++) {
+    uint32_t vertex = mesh->indices[index];
+    if (remap[vertex] == UINT32_MAX) {
+      remap[vertex] = next_vertex;
+      vertices[next_vertex] = mesh->vertices[vertex];
+      next_vertex++;
+    }
+    mesh->indices[index] = remap[vertex];
+  }
+
+  free(mesh->vertices);
+  free(remap);
+  mesh->vertices = vertices;
+  mesh->vertex_count = next_vertex;
+  return true;
+}
+
+void compute_meshlet_bounds(const struct converter_mesh *mesh,
+                            const uint32_t *meshlet_vertices,
+                            const uint32_t *meshlet_triangles,
+                            struct mesh_meshlet *meshlet) {
+  float bounds_min[3] = {INFINITY, INFINITY, INFINITY};
+  float bounds_max[3] = {-INFINITY, -INFINITY, -INFINITY};
+  for (uint32_t vertex = 0; vertex < meshlet->vertex_count; vertex++) {
+    const float *position = mesh->vertices[meshlet_vertices[vertex]].position;
+    for (int component = 0; component < 3; component++) {
+      bounds_min[component] = fminf(bounds_min[component], position[component]);
+      bounds_max[component] = fmaxf(bounds_max[component], position[component]);
+    }
+  }
+
+  float radius_squared = 0.0f;
+  for (int component = 0; component < 3; component++) {
+    meshlet->center[component] =
+        (bounds_min[component] + bounds_max[component]) * 0.5f;
+  }
+  for (uint32_t vertex = 0; vertex < meshlet->vertex_count; vertex++) {
+    const float *position = mesh->vertices[meshlet_vertices[vertex]].position;
+    float distance_squared = 0.0f;
+    for (int component = 0; component < 3; component++) {
+      float delta = position[component] - meshlet->center[component];
+      distance_squared += delta * delta;
+    }
+    radius_squared = fmaxf(radius_squared, distance_squared);
+  }
+  // Pad for the position quantization error
+  meshlet->radius = sqrtf(radius_squared) * 1.001f;
+
+  float triangle_normals[MESHLET_MAX_TRIANGLE_COUNT][3];
+  uint32_t normal_count = 0;
+  float cone_axis[3] = {0.0f, 0.0f, 0.0f};
+  for (uint32_t triangle = 0; triangle < meshlet->triangle_count; triangle++) {
+    uint32_t packed_triangle = meshlet_triangles[triangle];
+    const float *a =
+        mesh->vertices[meshlet_vertices[packed_triangle & 0xffu]].position;
+    const float *b =
+        mesh->vertices[meshlet_vertices[(packed_triangle >> 8) & 0xffu]]
+            .position;
+    const float *c =
+        mesh->vertices[meshlet_vertices[(packed_triangle >> 16) & 0xffu]]
+            .position;
+    float edge0[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+    float edge1[3] = {c[0] - a[0], c[1] - a[1], c[2] - a[2]};
+    float normal[3] = {edge0[1] * edge1[2] - edge0[2] * edge1[1],
+                       edge0[2] * edge1[0] - edge0[0] * edge1[2],
+                       edge0[0] * edge1[1] - edge0[1] * edge1[0]};
+    float length = sqrtf(normal[0] * normal[0] + normal[1] * normal[1] +
+                         normal[2] * normal[2]);
+    if (length == 0.0f) {
+      continue;
+    }
+
+    for (int component = 0; component < 3; component++) {
+      triangle_normals[normal_count][component] = normal[component] / length;
+      cone_axis[component] += triangle_normals[normal_count][component];
+    }
+    normal_count++;
+  }
+
+  float axis_length = sqrtf(cone_axis[0] * cone_axis[0] +
+                            cone_axis[1] * cone_axis[1] +
+                            cone_axis[2] * cone_axis[2]);
+  float min_dot = 1.0f;
+  for (uint32_t normal = 0; normal < normal_count && axis_length > 0.0f;
+       normal++) {
+    float dot = 0.0f;
+    for (int component = 0; component < 3; component++) {
+      dot += triangle_normals[normal][component] * cone_axis[component] /
+             axis_length;
+    }
+    min_dot = fminf(min_dot, dot);
+  }
+
+  // Cones wider than ~84 degrees would almost never cull anything, a zero
+  // axis with a cutoff of 1 makes the culling test always fail
+  if (axis_length == 0.0f || min_dot <= 0.1f) {
+    meshlet->cone_axis[0] = 0.0f;
+    meshlet->cone_axis[1] = 0.0f;
+    meshlet->cone_axis[2] = 0.0f;
+    meshlet->cone_cutoff = 1.0f;
+    return;
+  }
+
+  for (int component = 0; component < 3; component++) {
+    meshlet->cone_axis[component] = cone_axis[component] / axis_length;
+  }
+  meshlet->cone_cutoff = sqrtf(1.0f - min_dot * min_dot);
+}
+
+// Splits the index buffer into meshlets of consecutive triangles, a meshlet is
+// closed as soon as the next triangle would exceed the vertex or triangle
+// limit. Since the triangles are already ordered for the vertex cache, the
+// meshlets come out spatially coherent.
+bool build_meshlets(const struct converter_mesh *mesh,
+                    struct converter_meshlets *out_meshlets) {
+  size_t triangle_count = mesh->index_count / 3;
+  // Worst case, every meshlet but the last is closed by the vertex limit
+  // after MESHLET_MAX_VERTEX_COUNT / 3 triangles
+  size_t max_meshlet_count =
+      triangle_count / (MESHLET_MAX_VERTEX_COUNT / 3) + 1;
+  uint8_t *local_vertex = malloc(mesh->vertex_count * sizeof(uint8_t));
+  out_meshlets->meshlets =
+      malloc(max_meshlet_count * sizeof(struct mesh_meshlet));
+  out_meshlets->vertices = malloc(mesh->index_count * sizeof(uint32_t));
+  out_meshlets->triangles = malloc(triangle_count * sizeof(uint32_t));
+  if (!local_vertex || !out_meshlets->meshlets || !out_meshlets->vertices ||
+      !out_meshlets->triangles) {
+    free(local_vertex);
+    free(out_meshlets->meshlets);
+    free(out_meshlets->vertices);
+    free(out_meshlets->triangles);
+    return false;
+  }
+  memset(local_vertex, 0xff, mesh->vertex_count * sizeof(uint8_t));
+
+  size_t meshlet_count = 0;
+  size_t meshlet_vertex_count = 0;
+  struct mesh_meshlet meshlet = {0};
+  for (size_t triangle = 0; triangle <= triangle_count; triangle++) {
+    const uint32_t *corners = &mesh->indices[triangle * 3];
+    uint32_t new_vertex_count = 0;
+    if (triangle < triangle_count) {
+      for (int corner = 0; corner < 3; corner++) {
+        bool duplicate = (corner > 0 && corners[corner] == corners[0]) ||
+                         (corner > 1 && corners[corner] == corners[1]);
+        if (local_vertex[corners[corner]] == UINT8_MAX && !duplicate) {
+          new_vertex_count++;
+        }
+      }
+    }
+
+    bool is_full =
+        meshlet.vertex_count + new_vertex_count > MESHLET_MAX_VERTEX_COUNT ||
+        meshlet.triangle_count == MESHLET_MAX_TRIANGLE_COUNT;
+    if ((triangle == triangle_count || is_full) && meshlet.triangle_count > 0) {
+      compute_meshlet_bounds(
+          mesh, &out_meshlets->vertices[meshlet.vertex_offset],
+          &out_meshlets->triangles[meshlet.triangle_offset], &meshlet);
+      out_meshlets->meshlets[meshlet_count++] = meshlet;
+      for (uint32_t vertex = 0; vertex < meshlet.vertex_count; vertex++) {
+        local_vertex[out_meshlets->vertices[meshlet.vertex_offset + vertex]] =
+            UINT8_MAX;
+      }
+      meshlet = (struct mesh_meshlet){
+          .vertex_offset = (uint32_t)meshlet_vertex_count,
+          .triangle_offset = (uint32_t)triangle};
+    }
+
+    if (triangle == triangle_count) {
+      break;
+    }
+
+    uint8_t local_corners[3];
+    for (int corner = 0; corner < 3; corner++) {
+      uint32_t vertex = corners[corner];
+      if (local_vertex[vertex] == UINT8_MAX) {
+        local_vertex[vertex] = (uint8_t)meshlet.vertex_count++;
+        out_meshlets->vertices[meshlet_vertex_count++] = vertex;
+      }
+      local_corners[corner] = local_vertex[vertex];
+    }
+    out_meshlets->triangles[triangle] = MESHLET_PACK_TRIANGLE(
+        local_corners[0], local_corners[1], local_corners[2]);
+    meshlet.triangle_count++;
+  }
+
+  free(local_vertex);
+  out_meshlets->meshlet_count = meshlet_count;
+  out_meshlets->vertex_count = meshlet_vertex_count;
+  return true;
+}
+
+uint16_t quantize_unorm16(float value) {
+  value = value < 0.0f ? 0.0f : value > 1.0f ? 1.0f : value;
+  return (uint16_t)(value * 65535.0f + 0.5f);
+}
+
+int16_t quantize_snorm16(float value) {
+  value = value < -1.0f ? -1.0f : value > 1.0f ? 1.0f : value;
+  return (int16_t)lroundf(value * 32767.0f);
+}
+
+// Round to nearest even, handles subnormals, infinities and NaNs
+uint16_t quantize_half(float value) {
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  uint32_t sign = (bits >> 16) & 0x8000u;
+  uint32_t float_exponent = (bits >> 23) & 0xffu;
+  uint32_t mantissa = bits & 0x7fffffu;
+
+  if (float_exponent == 0xffu) {
+    return (uint16_t)(sign | 0x7c00u | (mantissa ? 0x200u : 0u));
+  }
+
+  int32_t exponent = (int32_t)float_exponent - 127 + 15;
+  if (exponent >= 31) {
+    return (uint16_t)(sign | 0x7c00u);
+  }
+
+  if (exponent <= 0) {
+    if (exponent < -10) {
+      return (uint16_t)sign;
+    }
+    mantissa |= 0x800000u;
+    uint32_t shift = (uint32_t)(14 - exponent);
+    uint32_t half_mantissa = mantissa >> shift;
+    uint32_t round_bit = 1u << (shift - 1);
+    if ((mantissa & round_bit) && (mantissa & (3u * round_bit - 1u))) {
+      half_mantissa++;
+    }
+    return (uint16_t)(sign | half_mantissa);
+  }
+
+  uint32_t half = sign | ((uint32_t)exponent << 10) | (mantissa >> 13);
+  uint32_t round_bits = mantissa & 0x1fffu;
+  // A carry into the exponent is the correctly rounded result
+  if (round_bits > 0x1000u || (round_bits == 0x1000u && (half & 1u))) {
+    half++;
+  }
+  return (uint16_t)half;
+}
+
+void octahedral_encode(const float normal[3], int16_t out_encoded[2]) {
+  float length = fabsf(normal[0]) + fabsf(normal[1]) + fabsf(normal[2]);
+  if (length == 0.0f) {
+    out_encoded[0] = 0;
+    out_encoded[1] = 0;
+    return;
+  }
+
+  float x = normal[0] / length;
+  float y = normal[1] / length;
+  if (normal[2] < 0.0f) {
+    float folded_x = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+    float folded_y = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+    x = folded_x;
+    y = folded_y;
+  }
+
+  out_encoded[0] = quantize_snorm16(x);
+  out_encoded[1] = quantize_snorm16(y);
+}
+
+uint64_t align_mesh_file_offset(uint64_t offset) {
+  return (offset + MESH_FILE_SECTION_ALIGNMENT - 1) /
+         MESH_FILE_SECTION_ALIGNMENT * MESH_FILE_SECTION_ALIGNMENT;
+}
+
+bool write_padding(FILE *file_handle, uint64_t *offset) {
+  static const uint8_t zeros[MESH_FILE_SECTION_ALIGNMENT] = {0};
+  uint64_t padding = align_mesh_file_offset(*offset) - *offset;
+  if (padding > 0 && fwrite(zeros, padding, 1, file_handle) != 1) {
+    return false;
+  }
+  *offset += padding;
+  return true;
+}
+
+bool write_mesh_file(const char *path, const struct converter_mesh *mesh,
+                     const struct converter_meshlets *meshlets) {
+  float bounds_min[3] = {INFINITY, INFINITY, INFINITY};
+  float bounds_max[3] = {-INFINITY, -INFINITY, -INFINITY};
+  for (size_t vertex = 0; vertex < mesh->vertex_count; vertex++) {
+    for (int component = 0; component < 3; component++) {
+      float value = mesh->vertices[vertex].position[component];
+      bounds_min[component] = fminf(bounds_min[component], value);
+      bounds_max[component] = fmaxf(bounds_max[component], value);
+    }
+  }
+
+  struct mesh_file_header header = {
+      .magic = MESH_FILE_MAGIC,
+      .version = MESH_FILE_VERSION,
+      .vertex_count = (uint32_t)mesh->vertex_count,
+      .index_count = (uint32_t)mesh->index_count,
+      .meshlet_count = (uint32_t)meshlets->meshlet_count,
+      .meshlet_vertex_count = (uint32_t)meshlets->vertex_count,
+      .index_size = mesh->vertex_count <= UINT16_MAX + 1u ? sizeof(uint16_t)
+                                                          : sizeof(uint32_t)};
+  for (int component = 0; component < 3; component++) {
+    header.position_offset[component] = bounds_min[component];
+    header.position_scale[component] =
+        bounds_max[component] - bounds_min[component];
+  }
+
+  struct mesh_vertex *quantized_vertices =
+      malloc(mesh->vertex_count * sizeof(struct mesh_vertex));
+  if (!quantized_vertices) {
+    return false;
+  }
+  for (size_t vertex_index = 0; vertex_index < mesh->vertex_count;
+       vertex_index++) {
+    const struct converter_vertex *vertex = &mesh->vertices[vertex_index];
+    struct mesh_vertex *quantized_vertex = &quantized_vertices[vertex_index];
+    for (int component = 0; component < 3; component++) {
+      float scale = header.position_scale[component];
+      quantized_vertex->position[component] = quantize_unorm16(
+          scale > 0.0f ? (vertex->position[component] - bounds_min[component]) /
+                             scale
+                       : 0.0f);
+    }
+    quantized_vertex->position[3] = 0;
+    octahedral_encode(vertex->normal, quantized_vertex->normal);
+    quantized_vertex->uv[0] = quantize_half(vertex->uv[0]);
+    quantized_vertex->uv[1] = quantize_half(vertex->uv[1]);
+  }
+
+  FILE *file_handle = fopen(path, "wb");
+  if (!file_handle) {
+    fprintf(stderr, "Couldn't open %s for writing\n", path);
+    free(quantized_vertices);
+    return false;
+  }
+
+  bool success = false;
+  // Section offsets are known upfront, so the header can go first
+  uint64_t vertex_data_size = mesh->vertex_count * sizeof(struct mesh_vertex);
+  header.vertex_data_offset = align_mesh_file_offset(sizeof(header));
+  header.index_data_offset =
+      align_mesh_file_offset(header.vertex_data_offset + vertex_data_size);
+  uint64_t index_data_size = mesh->index_count * header.index_size;
+  uint64_t meshlet_data_size =
+      meshlets->meshlet_count * sizeof(struct mesh_meshlet);
+  uint64_t meshlet_vertex_data_size = meshlets->vertex_count * sizeof(uint32_t);
+  header.meshlet_data_offset =
+      align_mesh_file_offset(header.index_data_offset + index_data_size);
+  header.meshlet_vertex_data_offset =
+      align_mesh_file_offset(header.meshlet_data_offset + meshlet_data_size);
+  header.meshlet_triangle_data_offset = align_mesh_file_offset(
+      header.meshlet_vertex_data_offset + meshlet_vertex_data_size);
+
+  uint64_t offset = sizeof(header);
+  if (fwrite(&header, sizeof(header), 1, file_handle) != 1 ||
+      !write_padding(file_handle, &offset) ||
+      fwrite(quantized_vertices, vertex_data_size, 1, file_handle) != 1) {
+    goto out;
+  }
+  offset += vertex_data_size;
+  if (!write_padding(file_handle, &offset)) {
+    goto out;
+  }
+
+  for (size_t index = 0; index < mesh->index_count; index++) {
+    size_t written;
+    if (header.index_size == sizeof(uint16_t)) {
+      uint16_t index_value = (uint16_t)mesh->indices[index];
+      written = fwrite(&index_value, sizeof(index_value), 1, file_handle);
+    } else {
+      written = fwrite(&mesh->indices[index], sizeof(uint32_t), 1, file_handle);
+    }
+    if (written != 1) {
+      goto out;
+    }
+  }
+  offset += index_data_size;
+
+  if (!write_padding(file_handle, &offset) ||
+      fwrite(meshlets->meshlets, meshlet_data_size, 1, file_handle) != 1) {
+    goto out;
+  }
+  offset += meshlet_data_size;
+  if (!write_padding(file_handle, &offset) ||
+      fwrite(meshlets->vertices, meshlet_vertex_data_size, 1, file_handle) !=
+          1) {
+    goto out;
+  }
+  offset += meshlet_vertex_data_size;
+  if (!write_padding(file_handle, &offset) ||
+      fwrite(meshlets->triangles, sizeof(uint32_t), mesh->index_count / 3,
+             file_handle) != mesh->index_count / 3) {
+    goto out;
+  }
+
+  success = true;
+out:
+  if (fclose(file_handle) != 0) {
+    success = false;
+  }
+  free(quantized_vertices);
+  if (!success) {
+    fprintf(stderr, "Couldn't write %s\n", path);
+  }
+  return success;
+}
+
+int main(int argc, char **argv) {
+  if (argc != 3) {
+    fprintf(stderr, "usage: %s <input.obj> <output.vkm>\n", argv[0]);
+    return 1;
+  }
+
+  size_t obj_size;
+  char *obj_text = read_file(argv[1], &obj_size);
+  if (!obj_text) {
+    fprintf(stderr, "Couldn't read %s\n", argv[1]);
+    goto err;
+  }
+
+  struct converter_mesh mesh;
+  if (!parse_obj(obj_text, &mesh)) {
+    fprintf(stderr, "Couldn't parse %s\n", argv[1]);
+    goto free_obj_text;
+  }
+
+  float initial_acmr =
+      compute_acmr(mesh.indices, mesh.index_count, mesh.vertex_count);
+  if (!optimize_vertex_cache(mesh.indices, mesh.index_count,
+                             mesh.vertex_count) ||
+      !optimize_overdraw(mesh.indices, mesh.index_count, mesh.vertices,
+                         mesh.vertex_count) ||
+      !optimize_vertex_fetch(&mesh)) {
+    fprintf(stderr, "Out of memory while optimizing %s\n", argv[1]);
+    goto free_mesh;
+  }
+  float optimized_acmr =
+      compute_acmr(mesh.indices, mesh.index_count, mesh.vertex_count);
+
+  struct converter_meshlets meshlets;
+  if (!build_meshlets(&mesh, &meshlets)) {
+    fprintf(stderr, "Out of memory while building meshlets of %s\n", argv[1]);
+    goto free_mesh;
+  }
+
+  if (!write_mesh_file(argv[2], &mesh, &meshlets)) {
+    goto free_meshlets;
+  }
+
+  printf("%s: %zu vertices, %zu triangles, %zu meshlets, ACMR %.3f -> %.3f\n",
+         argv[2], mesh.vertex_count, mesh.index_count / 3,
+         meshlets.meshlet_count, initial_acmr, optimized_acmr);
+
+  free(meshlets.triangles);
+  free(meshlets.vertices);
+  free(meshlets.meshlets);
+  free(mesh.indices);
+  free(mesh.vertices);
+  free(obj_text);
+  return 0;
+
+free_meshlets:
+  free(meshlets.triangles);
+  free(meshlets.vertices);
+  free(meshlets.meshlets);
+free_mesh:
+  free(mesh.indices);
+  free(mesh.vertices);
+free_obj_text:
+  free(obj_text);
+err:
+  return 1;
+}
@@ -0,0 +1,575 @@
+// Offline converter from binary PPM (P6) / PAM (P7) images to the .vkt
+// container described in src/texture_format.h.
+//
+// Two encodings are written:
+// - RGBA8 sRGB, base level only: the rest of the chain is generated on the
+//   GPU with blits when the texture is streamed in
+// - BC7 sRGB, full chain: levels are box filtered in linear space on the CPU
+//   and encoded with BC7 mode 6 (one subset, RGBA endpoints, 4-bit indices)
+//
+// usage: vkguide-texture-converter [--no-bc7] <input.ppm|pam> <output.vkt>
+
+#include "texture_format.h"
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BC7_BLOCK_SIZE 16
+
+struct image {
+  uint32_t width;
+  uint32_t height;
+  // RGBA8, sRGB encoded
+  uint8_t *pixels;
+};
+
+char *read_file(const char *path, size_t *out_size) {
+  FILE *file_handle = fopen(path, "rb");
+  if (!file_handle) {
+    goto err;
+  }
+
+  if (fseek(file_handle, 0, SEEK_END) < 0) {
+    goto close_file;
+  }
+
+  long file_size = ftell(file_handle);
+  if (file_size < 0) {
+    goto close_file;
+  }
+  rewind(file_handle);
+
+  char *file_content = malloc(file_size + 1);
+  if (!file_content) {
+    goto close_file;
+  }
+  if (file_size > 0 && fread(file_content, file_size, 1, file_handle) != 1) {
+    goto free_file_content;
+  }
+  file_content[file_size] = '\0';
+
+  fclose(file_handle);
+  *out_size = file_size;
+  return file_content;
+free_file_content:
+  free(file_content);
+close_file:
+  fclose(file_handle);
+err:
+  return NULL;
+}
+
+// Skips whitespace and # comments between netpbm header tokens
+const char *skip_netpbm_whitespace(const char *cursor, const char *end) {
+  while (cursor < end) {
+    if (*cursor == '#') {
+      while (cursor < end && *cursor != '\n') {
+        cursor++;
+      }
+    } else if (*cursor == ' ' || *cursor == '\t' || *cursor == '\r' ||
+               *cursor == '\n') {
+      cursor++;
+    } else {
+      break;
+    }
+  }
+  return cursor;
+}
+
+const char *parse_netpbm_uint(const char *cursor, const char *end,
+                              uint32_t *out_value) {
+  cursor = skip_netpbm_whitespace(cursor, end);
+  uint64_t value = 0;
+  const char *start = cursor;
+  while (cursor < end && *cursor >= '0' && *cursor <= '9' &&
+         value <= UINT32_MAX) {
+    value = value * 10 + (uint64_t)(*cursor - '0');
+    cursor++;
+  }
+  if (cursor == start || value > UINT32_MAX) {
+    return NULL;
+  }
+  *out_value = (uint32_t)value;
+  return cursor;
+}
+
+// PAM header: "P7\nWIDTH w\nHEIGHT h\nDEPTH d\nMAXVAL m\nTUPLTYPE t\nENDHDR\n"
+const char *parse_pam_header(const char *cursor, const char *end,
+                             uint32_t *out_width, uint32_t *out_height,
+                             uint32_t *out_depth, uint32_t *out_max_value) {
+  *out_width = 0;
+  *out_height = 0;
+  *out_depth = 0;
+  *out_max_value = 0;
+  while (cursor < end) {
+    cursor = skip_netpbm_whitespace(cursor, end);
+    const char *token = cursor;
+    while (cursor < end && *cursor != ' ' && *cursor != '\n' &&
+           *cursor != '\t' && *cursor != '\r') {
+      cursor++;
+    }
+    size_t token_length = cursor - token;
+
+    if (token_length == 6 && memcmp(token, "ENDHDR", 6) == 0) {
+      while (cursor < end && *cursor != '\n') {
+        cursor++;
+      }
+      return cursor < end ? cursor + 1 : NULL;
+    }
+
+    uint32_t *field = NULL;
+    if (token_length == 5 && memcmp(token, "WIDTH", 5) == 0) {
+      field = out_width;
+    } else if (token_length == 6 && memcmp(token, "HEIGHT", 6) == 0) {
+      field = out_height;
+    } else if (token_length == 5 && memcmp(token, "DEPTH", 5) == 0) {
+      field = out_depth;
+    } else if (token_length == 6 && memcmp(token, "MAXVAL", 6) == 0) {
+      field = out_max_value;
+    }
+
+    if (field) {
+      cursor = parse_netpbm_uint(cursor, end, field);
+      if (!cursor) {
+        return NULL;
+      }
+    } else {
+      // TUPLTYPE and unknown lines, DEPTH already says what we need
+      while (cursor < end && *cursor != '\n') {
+        cursor++;
+      }
+    }
+  }
+  return NULL;
+}
+
+bool parse_netpbm(const char *data, size_t size, struct image *out_image) {
+  const char *cursor = data;
+  const char *end = data + size;
+  if (size < 2 || cursor[0] != 'P' || (cursor[1] != '6' && cursor[1] != '7')) {
+    fprintf(stderr, "Only binary PPM (P6) and PAM (P7) images are supported\n");
+    return false;
+  }
+  bool is_pam = cursor[1] == '7';
+  cursor += 2;
+
+  uint32_t width;
+  uint32_t height;
+  uint32_t depth = 3;
+  uint32_t max_value;
+  if (is_pam) {
+    cursor =
+        parse_pam_header(cursor, end, &width, &height, &depth, &max_value);
+  } else {
+    cursor = parse_netpbm_uint(cursor, end, &width);
+    cursor = cursor ? parse_netpbm_uint(cursor, end, &height) : NULL;
+    cursor = cursor ? parse_netpbm_uint(cursor, end, &max_value) : NULL;
+    // A single whitespace character separates the header from the raster
+    cursor = cursor && cursor < end ? cursor + 1 : NULL;
+  }
+  if (!cursor) {
+    fprintf(stderr, "Invalid image header\n");
+    return false;
+  }
+
+  if (width == 0 || height == 0 || max_value != 255 ||
+      (depth != 3 && depth != 4)) {
+    fprintf(stderr, "Only 8-bit RGB and RGBA images are supported\n");
+    return false;
+  }
+  if (width > (1u << (TEXTURE_MAX_MIP_COUNT - 1)) ||
+      height > (1u << (TEXTURE_MAX_MIP_COUNT - 1))) {
+    fprintf(stderr, "Image is too large\n");
+    return false;
+  }
+
+  size_t pixel_count = (size_t)width * height;
+  if ((size_t)(end - cursor) < pixel_count * depth) {
+    fprintf(stderr, "Image raster is truncated\n");
+    return false;
+  }
+
+  uint8_t *pixels = malloc(pixel_count * 4);
+  if (!pixels) {
+    return false;
+  }
+  const uint8_t *raster = (const uint8_t *)cursor;
+  for (size_t pixel = 0; pixel < pixel_count; pixel++) {
+    pixels[pixel * 4 + 0] = raster[pixel * depth + 0];
+    pixels[pixel * 4 + 1] = raster[pixel * depth + 1];
+    pixels[pixel * 4 + 2] = raster[pixel * depth + 2];
+    pixels[pixel * 4 + 3] = depth == 4 ? raster[pixel * depth + 3] : 255;
+  }
+
+  *out_image = (struct image){.width = width, .height = height,
+                              .pixels = pixels};
+  return true;
+}
+
+float srgb_to_linear(uint8_t value) {
+  float normalized = value / 255.0f;
+  return normalized <= 0.04045f ? normalized / 12.92f
+                                : powf((normalized + 0.055f) / 1.055f, 2.4f);
+}
+
+uint8_t linear_to_srgb(float value) {
+  value = value < 0.0f ? 0.0f : value > 1.0f ? 1.0f : value;
+  float encoded = value <= 0.0031308f
+                      ? value * 12.92f
+                      : 1.055f * powf(value, 1.0f / 2.4f) - 0.055f;
+  return (uint8_t)(encoded * 255.0f + 0.5f);
+}
+
+// 2x2 box filter in linear space, odd edges reuse the last row/column
+bool downsample_image(const struct image *source,
+                      const float *srgb_to_linear_table,
+                      struct image *out_image) {
+  uint32_t width = source->width > 1 ? source->width / 2 : 1;
+  uint32_t height = source->height > 1 ? source->height / 2 : 1;
+  uint8_t *pixels = malloc((size_t)width * height * 4);
+  if (!pixels) {
+    return false;
+  }
+
+  for (uint32_t y = 0; y < height; y++) {
+    for (uint32_t x = 0; x < width; x++) {
+      uint32_t x0 = x * 2 < source->width ? x * 2 : source->width - 1;
+      uint32_t x1 = x * 2 + 1 < source->width ? x * 2 + 1 : x0;
+      uint32_t y0 = y * 2 < source->height ? y * 2 : source->height - 1;
+      uint32_t y1 = y * 2 + 1 < source->height ? y * 2 + 1 : y0;
+      const uint8_t *samples[4] = {
+          &source->pixels[((size_t)y0 * source->width + x0) * 4],
+          &source->pixels[((size_t)y0 * source->width + x1) * 4],
+          &source->pixels[((size_t)y1 * source->width + x0) * 4],
+          &source->pixels[((size_t)y1 * source->width + x1) * 4]};
+
+      uint8_t *pixel = &pixels[((size_t)y * width + x) * 4];
+      for (int channel = 0; channel < 3; channel++) {
+        float sum = 0.0f;
+        for (int sample = 0; sample < 4; sample++) {
+          sum += srgb_to_linear_table[samples[sample][channel]];
+        }
+        pixel[channel] = linear_to_srgb(sum * 0.25f);
+      }
+      // Alpha is linear
+      uint32_t alpha_sum = samples[0][3] + samples[1][3] + samples[2][3] +
+                           samples[3][3];
+      pixel[3] = (uint8_t)((alpha_sum + 2) / 4);
+    }
+  }
+
+  *out_image = (struct image){.width = width, .height = height,
+                              .pixels = pixels};
+  return true;
+}
+
+void put_bits(uint8_t *block, uint32_t *bit_offset, uint32_t value,
+              uint32_t bit_count) {
+  for (uint32_t bit = 0; bit < bit_count; bit++) {
+    uint32_t position = *bit_offset + bit;
+    if (value & (1u << bit)) {
+      block[position / 8] |= (uint8_t)(1u << (position % 8));
+    }
+  }
+  *bit_offset += bit_count;
+}
+
+// Picks the 7-bit endpoint and its p-bit so that (endpoint << 1 | p) is the
+// closest to the 8-bit target on all four channels
+void quantize_bc7_mode6_endpoint(const uint8_t target[4], uint8_t out_color[4],
+                                 uint32_t *out_p_bit) {
+  uint32_t best_error = UINT32_MAX;
+  for (uint32_t p_bit = 0; p_bit < 2; p_bit++) {
+    uint8_t color[4];
+    uint32_t error = 0;
+    for (int channel = 0; channel < 4; channel++) {
+      int quantized = ((int)target[channel] - (int)p_bit + 1) / 2;
+      quantized = quantized < 0 ? 0 : quantized > 127 ? 127 : quantized;
+      color[channel] = (uint8_t)quantized;
+      int reconstructed = (quantized << 1) | (int)p_bit;
+      int delta = reconstructed - target[channel];
+      error += (uint32_t)(delta * delta);
+    }
+    if (error < best_error) {
+      best_error = error;
+      memcpy(out_color, color, 4);
+      *out_p_bit = p_bit;
+    }
+  }
+}
+
+// BC7 mode 6 with the endpoints at the corners of the block's bounding box.
+// Not as good as a PCA fit, but every block decodes to a valid result and
+// smooth textures come out close.
+void encode_bc7_mode6_block(uint8_t texels[16][4],
+                            uint8_t out_block[BC7_BLOCK_SIZE]) {
+  static const uint32_t weights[16] = {0,  4,  9,  13, 17, 21, 26, 30,
+                                       34, 38, 43, 47, 51, 55, 60, 64};
+
+  uint8_t minimum[4] = {255, 255, 255, 255};
+  uint8_t maximum[4] = {0, 0, 0, 0};
+  for (int texel = 0; texel < 16; texel++) {
+    for (int channel = 0; channel < 4; channel++) {
+      uint8_t value = texels[texel][channel];
+      minimum[channel] = value < minimum[channel] ? value : minimum[channel];
+      maximum[channel] = value > maximum[channel] ? value : maximum[channel];
+    }
+  }
+
+  uint8_t endpoints[2][4];
+  uint32_t p_bits[2];
+  quantize_bc7_mode6_endpoint(minimum, endpoints[0], &p_bits[0]);
+  quantize_bc7_mode6_endpoint(maximum, endpoints[1], &p_bits[1]);
+
+  int palette[16][4];
+  for (int index = 0; index < 16; index++) {
+    for (int channel = 0; channel < 4; channel++) {
+      int e0 = (endpoints[0][channel] << 1) | (int)p_bits[0];
+      int e1 = (endpoints[1][channel] << 1) | (int)p_bits[1];
+      palette[index][channel] =
+          ((64 - (int)weights[index]) * e0 + (int)weights[index] * e1 + 32) >>
+          6;
+    }
+  }
+
+  uint32_t indices[16];
+  for (int texel = 0; texel < 16; texel++) {
+    uint32_t best_error = UINT32_MAX;
+    for (uint32_t index = 0; index < 16; index++) {
+      uint32_t error = 0;
+      for (int channel = 0; channel < 4; channel++) {
+        int delta = palette[index][channel] - texels[texel][channel];
+        error += (uint32_t)(delta * delta);
+      }
+      if (error < best_error) {
+        best_error = error;
+        indices[texel] = index;
+      }
+    }
+  }
+
+  // The anchor index is stored without its top bit, so it must be < 8
+  if (indices[0] >= 8) {
+    uint8_t swapped_color[4];
+    memcpy(swapped_color, endpoints[0], 4);
+    memcpy(endpoints[0], endpoints[1], 4);
+    memcpy(endpoints[1], swapped_color, 4);
+    uint32_t swapped_p_bit = p_bits[0];
+    p_bits[0] = p_bits[1];
+    p_bits[1] = swapped_p_bit;
+    for (int texel = 0; texel < 16; texel++) {
+      indices[texel] = 15 - indices[texel];
+    }
+  }
+
+  memset(out_block, 0, BC7_BLOCK_SIZE);
+  uint32_t bit_offset = 0;
+  put_bits(out_block, &bit_offset, 1u << 6, 7);
+  for (int channel = 0; channel < 4; channel++) {
+    put_bits(out_block, &bit_offset, endpoints[0][channel], 7);
+    put_bits(out_block, &bit_offset, endpoints[1][channel], 7);
+  }
+  put_bits(out_block, &bit_offset, p_bits[0], 1);
+  put_bits(out_block, &bit_offset, p_bits[1], 1);
+  put_bits(out_block, &bit_offset, indices[0], 3);
+  for (int texel = 1; texel < 16; texel++) {
+    put_bits(out_block, &bit_offset, indices[texel], 4);
+  }
+}
+
+uint8_t *encode_bc7(const struct image *image, size_t *out_size) {
+  uint32_t block_count_x = (image->width + 3) / 4;
+  uint32_t block_count_y = (image->height + 3) / 4;
+  size_t size = (size_t)block_count_x * block_count_y * BC7_BLOCK_SIZE;
+  uint8_t *blocks = malloc(size);
+  if (!blocks) {
+    return NULL;
+  }
+
+  for (uint32_t block_y = 0; block_y < block_count_y; block_y++) {
+    for (uint32_t block_x = 0; block_x < block_count_x; block_x++) {
+      // Blocks hanging over the edge replicate the last row/column
+      uint8_t texels[16][4];
+      for (uint32_t texel = 0; texel < 16; texel++) {
+        uint32_t x = block_x * 4 + texel % 4;
+        uint32_t y = block_y * 4 + texel / 4;
+        x = x < image->width ? x : image->width - 1;
+        y = y < image->height ? y : image->height - 1;
+        memcpy(texels[texel], &image->pixels[((size_t)y * image->width + x) * 4],
+               4);
+      }
+      encode_bc7_mode6_block(
+          texels,
+          &blocks[((size_t)block_y * block_count_x + block_x) * BC7_BLOCK_SIZE]);
+    }
+  }
+
+  *out_size = size;
+  return blocks;
+}
+
+uint64_t align_texture_file_offset(uint64_t offset) {
+  return (offset + TEXTURE_FILE_SECTION_ALIGNMENT - 1) /
+         TEXTURE_FILE_SECTION_ALIGNMENT * TEXTURE_FILE_SECTION_ALIGNMENT;
+}
+
+uint32_t compute_mip_count(uint32_t width, uint32_t height) {
+  uint32_t mip_count = 1;
+  while (width > 1 || height > 1) {
+    width = width > 1 ? width / 2 : 1;
+    height = height > 1 ? height / 2 : 1;
+    mip_count++;
+  }
+  return mip_count;
+}
+
+bool write_texture_file(const char *path, const struct image *base_level,
+                        uint8_t **bc7_levels, const size_t *bc7_level_sizes,
+                        uint32_t mip_count) {
+  struct texture_file_header header = {.magic = TEXTURE_FILE_MAGIC,
+                                       .version = TEXTURE_FILE_VERSION,
+                                       .width = base_level->width,
+                                       .height = base_level->height,
+                                       .mip_count = mip_count};
+
+  // Smallest levels first, in streaming order
+  uint64_t offset = align_texture_file_offset(sizeof(header));
+  if (bc7_levels) {
+    struct texture_file_encoding *encoding =
+        &header.encodings[TEXTURE_ENCODING_BC7_SRGB];
+    encoding->stored_mip_count = mip_count;
+    for (uint32_t level = mip_count; level-- > 0;) {
+      encoding->levels[level].data_offset = offset;
+      encoding->levels[level].data_size = bc7_level_sizes[level];
+      offset = align_texture_file_offset(offset + bc7_level_sizes[level]);
+    }
+  }
+  struct texture_file_encoding *rgba8_encoding =
+      &header.encodings[TEXTURE_ENCODING_RGBA8_SRGB];
+  rgba8_encoding->stored_mip_count = 1;
+  rgba8_encoding->levels[0].data_offset = offset;
+  rgba8_encoding->levels[0].data_size =
+      (uint64_t)base_level->width * base_level->height * 4;
+
+  FILE *file_handle = fopen(path, "wb");
+  if (!file_handle) {
+    fprintf(stderr, "Couldn't open %s for writing\n", path);
+    return false;
+  }
+
+  bool success = false;
+  static const uint8_t zeros[TEXTURE_FILE_SECTION_ALIGNMENT] = {0};
+  uint64_t written = 0;
+  if (fwrite(&header, sizeof(header), 1, file_handle) != 1) {
+    goto out;
+  }
+  written += sizeof(header);
+
+  for (int encoding_index = 0; encoding_index < TEXTURE_ENCODING_COUNT;
+       encoding_index++) {
+    const struct texture_file_encoding *encoding =
+        &header.encodings[encoding_index];
+    for (uint32_t level = encoding->stored_mip_count; level-- > 0;) {
+      const void *data = encoding_index == TEXTURE_ENCODING_BC7_SRGB
+                             ? (const void *)bc7_levels[level]
+                             : (const void *)base_level->pixels;
+      uint64_t padding = encoding->levels[level].data_offset - written;
+      if ((padding > 0 && fwrite(zeros, padding, 1, file_handle) != 1) ||
+          fwrite(data, encoding->levels[level].data_size, 1, file_handle) !=
+              1) {
+        goto out;
+      }
+      written += padding + encoding->levels[level].data_size;
+    }
+  }
+
+  success = true;
+out:
+  if (fclose(file_handle) != 0) {
+    success = false;
+  }
+  if (!success) {
+    fprintf(stderr, "Couldn't write %s\n", path);
+  }
+  return success;
+}
+
+int main(int argc, char **argv) {
+  bool success = false;
+  bool encode_bc7_levels = true;
+  int argument_index = 1;
+  if (argc == 4 && strcmp(argv[1], "--no-bc7") == 0) {
+    encode_bc7_levels = false;
+    argument_index++;
+  }
+  if (argc - argument_index != 2) {
+    fprintf(stderr, "usage: %s [--no-bc7] <input.ppm|pam> <output.vkt>\n",
+            argv[0]);
+    return 1;
+  }
+  const char *input_path = argv[argument_index];
+  const char *output_path = argv[argument_index + 1];
+
+  size_t input_size;
+  char *input = read_file(input_path, &input_size);
+  if (!input) {
+    fprintf(stderr, "Couldn't read %s\n", input_path);
+    goto err;
+  }
+
+  struct image levels[TEXTURE_MAX_MIP_COUNT] = {0};
+  if (!parse_netpbm(input, input_size, &levels[0])) {
+    fprintf(stderr, "Couldn't parse %s\n", input_path);
+    goto free_input;
+  }
+  uint32_t mip_count = compute_mip_count(levels[0].width, levels[0].height);
+
+  uint8_t *bc7_levels[TEXTURE_MAX_MIP_COUNT] = {0};
+  size_t bc7_level_sizes[TEXTURE_MAX_MIP_COUNT] = {0};
+  if (encode_bc7_levels) {
+    float srgb_to_linear_table[256];
+    for (int value = 0; value < 256; value++) {
+      srgb_to_linear_table[value] = srgb_to_linear((uint8_t)value);
+    }
+
+    for (uint32_t level = 0; level < mip_count; level++) {
+      if (level > 0 && !downsample_image(&levels[level - 1],
+                                         srgb_to_linear_table,
+                                         &levels[level])) {
+        fprintf(stderr, "Out of memory while generating mips\n");
+        goto free_levels;
+      }
+      bc7_levels[level] = encode_bc7(&levels[level], &bc7_level_sizes[level]);
+      if (!bc7_levels[level]) {
+        fprintf(stderr, "Out of memory while encoding BC7\n");
+        goto free_levels;
+      }
+    }
+  }
+
+  if (!write_texture_file(output_path, &levels[0],
+                          encode_bc7_levels ? bc7_levels : NULL,
+                          bc7_level_sizes, mip_count)) {
+    goto free_levels;
+  }
+
+  printf("%s: %ux%u, %u mips%s\n", output_path, levels[0].width,
+         levels[0].height, mip_count, encode_bc7_levels ? ", BC7" : "");
+  success = true;
+
+free_levels:
+  for (uint32_t level = 0; level < TEXTURE_MAX_MIP_COUNT; level++) {
+    free(bc7_levels[level]);
+    free(levels[level].pixels);
+  }
+free_input:
+  free(input);
+  if (success) {
+    return 0;
+  }
+err:
+  return 1;
+}